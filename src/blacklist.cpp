@@ -21,6 +21,9 @@ THE SOFTWARE.
 */
 #include <boost/variant.hpp>
 #include <regex>
+#include <algorithm>
+
+#include <arpa/inet.h>
 
 #include  "hiredis.h"
 
@@ -251,8 +254,10 @@ namespace drachtio {
       bool initialized = false;
       DR_LOG(log_debug) << "Blacklist thread id: " << std::this_thread::get_id()  ;
 
+      /* keep reloading the set, so that addresses added to or removed from it in redis take effect */
       while (true) {
-        unsigned int interval = m_refreshSecs;
+        unsigned int interval = m_refreshSecs ? m_refreshSecs : 3600;
+        initialized = false;
 
        /**
         * @brief If we are using redis sentinels, query the sentinels for the read replicas
@@ -330,7 +335,7 @@ namespace drachtio {
               if (QueryRedis(m_redisPassword, m_redisKey, endpoint, m_ips)) initialized = true;
             }
           }
-          if (initialized) break;
+          if (initialized) updateAddresses() ;
         }
         else {
           DR_LOG(log_error) << "Blacklist::threadFunc - Error: no redis address or sentinels configured" ;
@@ -345,4 +350,64 @@ namespace drachtio {
       //m_thread.join() ;
     }
 
+    bool Blacklist::makeAddress(int family, const void* addr, Address& address) {
+      static const unsigned char v4mapped[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff} ;
+
+      memset(&address, 0, sizeof(address)) ;
+      if (AF_INET == family) {
+        address.family = 4 ;
+        memcpy(address.bytes, addr, 4) ;
+        return true ;
+      }
+      if (AF_INET6 == family) {
+        if (0 == memcmp(addr, v4mapped, sizeof(v4mapped))) {
+          address.family = 4 ;
+          memcpy(address.bytes, static_cast<const unsigned char*>(addr) + sizeof(v4mapped), 4) ;
+        }
+        else {
+          address.family = 6 ;
+          memcpy(address.bytes, addr, 16) ;
+        }
+        return true ;
+      }
+      return false ;
+    }
+
+    void Blacklist::updateAddresses() {
+      auto addresses = std::make_shared<vector_of_addresses>() ;
+      addresses->reserve(m_ips.size()) ;
+      for (const auto& ip : m_ips) {
+        unsigned char buf[16] ;
+        Address address ;
+        if (1 == inet_pton(AF_INET, ip.c_str(), buf)) makeAddress(AF_INET, buf, address) ;
+        else if (1 == inet_pton(AF_INET6, ip.c_str(), buf)) makeAddress(AF_INET6, buf, address) ;
+        else {
+          DR_LOG(log_info) << "Blacklist::updateAddresses - ignoring invalid address " << ip ;
+          continue ;
+        }
+        addresses->push_back(address) ;
+      }
+      std::sort(addresses->begin(), addresses->end()) ;
+
+      std::shared_ptr<const vector_of_addresses> p = addresses ;
+      std::atomic_store(&m_addresses, p) ;
+      DR_LOG(log_info) << "Blacklist::updateAddresses - " << addresses->size() << " addresses now blacklisted" ;
+    }
+
+    bool Blacklist::isBlackListed(int family, const void* addr) const {
+      std::shared_ptr<const vector_of_addresses> addresses = std::atomic_load(&m_addresses) ;
+      if (!addresses || addresses->empty()) return false ;
+
+      Address address ;
+      if (!makeAddress(family, addr, address)) return false ;
+      return std::binary_search(addresses->begin(), addresses->end(), address) ;
+    }
+
+    bool Blacklist::isBlackListed(const char* srcAddress) {
+      unsigned char buf[16] ;
+      if (1 == inet_pton(AF_INET, srcAddress, buf)) return isBlackListed(AF_INET, buf) ;
+      if (1 == inet_pton(AF_INET6, srcAddress, buf)) return isBlackListed(AF_INET6, buf) ;
+      return false ;
+    }
+
  }
@@ -28,6 +28,11 @@ THE SOFTWARE.
 #include <unordered_set>
 #include <thread>
 #include <list>
+#include <vector>
+#include <memory>
+#include <cstring>
+
+#include <sys/socket.h>
 
 #include "drachtio.h"
 
@@ -45,12 +50,28 @@ namespace drachtio {
     void stop() ;
   	void threadFunc(void) ;
 
-    bool isBlackListed(const char* srcAddress) {
-      return m_ips.end() != m_ips.find(srcAddress);
-    }
+    bool isBlackListed(const char* srcAddress) ;
+
+    // family is AF_INET or AF_INET6, addr the network order address; no formatting or allocation involved
+    bool isBlackListed(int family, const void* addr) const ;
 
   private:
 
+    // a blocked source address: ipv4 uses the first 4 bytes, and ipv4-mapped ipv6 addresses are stored as ipv4
+    struct Address {
+      uint8_t family ;
+      unsigned char bytes[16] ;
+
+      bool operator<(const Address& rhs) const {
+        if (family != rhs.family) return family < rhs.family ;
+        return memcmp(bytes, rhs.bytes, sizeof(bytes)) < 0 ;
+      }
+    } ;
+    typedef std::vector<Address> vector_of_addresses ;
+
+    static bool makeAddress(int family, const void* addr, Address& address) ;
+    void updateAddresses(void) ;
+
     std::thread                     m_thread ;
     boost::asio::io_context         m_ioservice;
     std::string                     m_masterName;
@@ -62,6 +83,9 @@ namespace drachtio {
     unsigned int                    m_refreshSecs;
     std::unordered_set<std::string> m_ips ;      
     std::unordered_set<std::string> m_replicas ;      
+
+    // sorted, for a binary search per message; replaced whole (std::atomic_store) each time the list is refreshed
+    std::shared_ptr<const vector_of_addresses> m_addresses ;
   } ;
 }
 
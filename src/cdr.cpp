@@ -5,20 +5,17 @@
 
 namespace drachtio {
   
-  std::shared_ptr<Cdr> Cdr::postCdr( std::shared_ptr<Cdr> pCdr, const string& encodedMessage ) {
+  std::shared_ptr<Cdr> Cdr::postCdr( std::shared_ptr<Cdr> pCdr, const encoded_msg_ptr& encodedMessage ) {
     if( theOneAndOnlyController->getConfig()->generateCdrs() ) {
       pCdr->stamp() ;
       pCdr->setEncodedMessage( encodedMessage ) ;
       shared_ptr<ClientController> pClientController = theOneAndOnlyController->getClientController() ;
       client_ptr client = pClientController->selectClientForRequestOutsideDialog(pCdr->getRecordType()) ;
       if( client ) {
-        string encodedMessage ;
         string meta ;
-
-        pCdr->encodeMessage( encodedMessage ) ;
         pCdr->encodeMetaData( meta ) ;
 
-        pClientController->getIOService().post( std:: bind(&BaseClient::sendCdrToClient, client, encodedMessage, meta ) ) ;
+        client->post( { AppMessage::cdr, "", meta, "", pCdr->encodeMessage() } ) ;
       }
     }
     return pCdr ;
@@ -34,9 +31,9 @@ namespace drachtio {
     msg_destroy( m_msg ) ;
   }
 
-  void Cdr::encodeMessage( string& encodedMessage ) {
-    if( m_encodedMessage.length() > 0 ) encodedMessage = m_encodedMessage ;
-    else EncodeStackMessage( sip_object(m_msg), encodedMessage ) ;
+  encoded_msg_ptr Cdr::encodeMessage( void ) {
+    if( m_encodedMessage ) return m_encodedMessage ;
+    return EncodeStackMessage( m_msg ) ;
   }
   void Cdr::encodeMetaData( string& metaData ) {
     unsigned short second, minute, hour;
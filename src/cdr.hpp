@@ -36,7 +36,7 @@ namespace drachtio {
     class Cdr {
     public:
 
-        static std::shared_ptr<Cdr> postCdr( std::shared_ptr<Cdr> cdr, const string& encodedMsg = "" ) ;
+        static std::shared_ptr<Cdr> postCdr( std::shared_ptr<Cdr> cdr, const encoded_msg_ptr& encodedMsg = encoded_msg_ptr() ) ;
 
         Cdr( const Cdr& ) = delete;
 
@@ -99,10 +99,10 @@ namespace drachtio {
             return szReasons[ static_cast<int>(m_terminationReason) ] ;
         }
 
-        void encodeMessage( string& encodedMessage ) ;
+        encoded_msg_ptr encodeMessage( void ) ;
         void encodeMetaData( string& metaData ) ;
         void stamp(void) { m_eventTime = su_now() ; }
-        void setEncodedMessage(const string& s) { m_encodedMessage = s ;}
+        void setEncodedMessage(const encoded_msg_ptr& s) { m_encodedMessage = s ;}
         
     protected:
         msg_t*      m_msg ;
@@ -113,7 +113,7 @@ namespace drachtio {
 
         TerminationReason_t m_terminationReason ;
 
-        string      m_encodedMessage ;
+        encoded_msg_ptr m_encodedMessage ;
         string      m_source ;
     } ;
 
@@ -24,6 +24,12 @@ THE SOFTWARE.
 #include <functional>
 #include <algorithm>
 
+#include <strings.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include <boost/tokenizer.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/asio.hpp>
@@ -33,6 +39,9 @@ THE SOFTWARE.
 
 static string emptyString;
 
+// how long we reuse the addresses resolved for an outbound connection target
+#define OUTBOUND_DNS_CACHE_SECS (30)
+
 namespace drachtio {
     
     // simple tcp server
@@ -59,7 +68,8 @@ namespace drachtio {
         m_endpoint_tls(boost::asio::ip::make_address(address.c_str()), tlsPort),
         m_acceptor_tls(m_ioservice, m_endpoint_tls), 
         m_context(boost::asio::ssl::context::sslv23),
-        m_tcpPort(tcpPort), m_tlsPort(tlsPort) {
+        m_tcpPort(tcpPort), m_tlsPort(tlsPort),
+        m_acceptor_unix(m_ioservice) {
 
         if (0 != tlsPort) {
             m_context.set_options(
@@ -91,12 +101,54 @@ namespace drachtio {
     }
 
     void ClientController::start() {
-        DR_LOG(log_debug) << "Client controller thread id: " << std::this_thread::get_id()  ;
-        std::thread t(&ClientController::threadFunc, this) ;
-        m_thread.swap( t ) ;
+        DrachtioConfig::mapVerb2Policy policies ;
+        m_pController->getConfig()->getAppSelectionPolicies( policies ) ;
+        for (const auto& kv : policies) {
+            if (0 == kv.second.compare("least-outstanding")) m_selectionPolicies[kv.first] = RoutingIndex::policy_least_outstanding ;
+            else if (0 == kv.second.compare("latency")) m_selectionPolicies[kv.first] = RoutingIndex::policy_latency ;
+            else if (0 != kv.second.compare("round-robin")) {
+                DR_LOG(log_error) << "ClientController::start - ignoring unknown app selection policy '" << kv.second << "' for " << kv.first ;
+                continue ;
+            }
+            DR_LOG(log_notice) << "ClientController::start - using " << kv.second << " policy to select applications for " << kv.first << " requests" ;
+        }
+
+        unsigned int nThreads = std::max( m_pController->getClientIoThreads(), 1U ) ;
+        DR_LOG(log_debug) << "Client controller starting " << nThreads << " io thread(s) from thread id: " << std::this_thread::get_id()  ;
+        for( unsigned int i = 0; i < nThreads; i++ ) {
+            m_threads.emplace_back( &ClientController::threadFunc, this ) ;
+        }
             
         if (m_tcpPort) start_accept_tcp() ;
         if (m_tlsPort) start_accept_tls() ;
+        if (m_acceptor_unix.is_open()) start_accept_unix() ;
+    }
+
+    void ClientController::listenOnUnixSocket( const string& path, unsigned int mode ) {
+        boost::asio::local::stream_protocol::endpoint endpoint( path ) ;
+
+        /* a socket file left behind by a previous run would make the bind fail */
+        ::unlink( path.c_str() ) ;
+        m_acceptor_unix.open( endpoint.protocol() ) ;
+
+        /* unix socket clients are not asked for the secret, so the socket file must never
+           exist with looser permissions than configured, not even between bind and chmod */
+        mode_t oldMask = ::umask( 0777 & ~mode ) ;
+        boost::system::error_code ec ;
+        m_acceptor_unix.bind( endpoint, ec ) ;
+        ::umask( oldMask ) ;
+        if (ec) {
+            DR_LOG(log_error) << "ClientController::listenOnUnixSocket - unable to bind " << path << ": " << ec.message() ;
+            throw std::runtime_error( "unable to bind admin unix socket" ) ;
+        }
+        if (0 != ::chmod( path.c_str(), mode )) {
+            DR_LOG(log_error) << "ClientController::listenOnUnixSocket - unable to set permissions on " << path << ": " << strerror(errno) ;
+            m_acceptor_unix.close() ;
+            ::unlink( path.c_str() ) ;
+            throw std::runtime_error( "unable to set permissions on admin unix socket" ) ;
+        }
+        m_acceptor_unix.listen() ;
+        m_unixSocketPath = path ;
     }
 
     ClientController::~ClientController() {
@@ -123,33 +175,87 @@ namespace drachtio {
         }
     }
     void ClientController::join( client_ptr client ) {
+        std::lock_guard<std::mutex> l( m_lock ) ;
         m_clients.insert( client ) ;
-        client_weak_ptr p( client ) ;
         DR_LOG(log_info) << "ClientController::join - Added client, count of connected clients is now: " << m_clients.size()  ;       
     }
     void ClientController::leave( client_ptr client ) {
+        std::vector<string> transactionIds ;
+        std::unique_lock<std::mutex> l( m_lock ) ;
         m_clients.erase( client ) ;
+        if( client->isOutbound() ) {
+            pair<map_of_outbound_connections::iterator,map_of_outbound_connections::iterator> pair = m_outboundPool.equal_range( client->getOutboundKey() ) ;
+            for( map_of_outbound_connections::iterator it = pair.first; it != pair.second; ) {
+                client_ptr p = it->second.lock() ;
+                if( !p || p == client ) it = m_outboundPool.erase( it ) ;
+                else ++it ;
+            }
+
+            /* if it went away before authenticating, the requests waiting on it can not be delivered */
+            map_of_pending_outbound::iterator itPending = m_pendingOutbound.find( client->getOutboundKey() ) ;
+            if( m_pendingOutbound.end() != itPending && itPending->second.m_client.lock() == client ) {
+                transactionIds.swap( itPending->second.m_transactionIds ) ;
+                m_pendingOutbound.erase( itPending ) ;
+            }
+        }
+        for (map_of_request_types::iterator it = m_request_types.begin(); it != m_request_types.end(); ) {
+            if (it->second.client() == client) it = m_request_types.erase(it);
+            else ++it;
+        }
+        rebuildRoutingIndex_nolock() ;
         time_t duration = client->getConnectionDuration();
         DR_LOG(log_info) << "ClientController::leave - Removed client, connection duration " << std::dec << 
             duration << " seconds, count of connected clients is now: " << m_clients.size()  ;
+        l.unlock() ;
+
+        for( const string& transactionId : transactionIds ) outboundFailed( transactionId ) ;
+
+        client_ptr shm = client->detachSharedMemoryClient() ;
+        if( shm ) shm->close() ;
     }
     void ClientController::outboundFailed( const string& transactionId ) {
-      string headers, body;
+      string body;
       if((!m_pController->getDialogController()->respondToSipRequest( "", transactionId, "SIP/2.0 480 Temporarily Unavailable", 
-        headers, body) )) {
+        HeaderIndex(), body) )) {
         DR_LOG(log_error) << "ClientController::outboundFailed - error sending 480 for transactionId: " << transactionId ;
       }
     }
-    void ClientController::outboundReady( client_ptr client, const string& transactionId ) {
-      int rc = m_pController->getPendingRequestController()->routeNewRequestToClient(client, transactionId) ;
-      if( rc ) {
-        DR_LOG(log_error) << "ClientController::outboundReady - error routing over outbound connection transactionId: " << transactionId ;
-        return outboundFailed( transactionId);
+    void ClientController::outboundFailed( client_ptr client ) {
+      std::vector<string> transactionIds ;
+      {
+        std::lock_guard<std::mutex> l( m_lock ) ;
+        map_of_pending_outbound::iterator it = m_pendingOutbound.find( client->getOutboundKey() ) ;
+        if( m_pendingOutbound.end() != it && it->second.m_client.lock() == client ) {
+          transactionIds.swap( it->second.m_transactionIds ) ;
+          m_pendingOutbound.erase( it ) ;
+        }
+      }
+      for( const string& transactionId : transactionIds ) outboundFailed( transactionId ) ;
+    }
+    void ClientController::outboundReady( client_ptr client ) {
+      std::vector<string> transactionIds ;
+      {
+        std::lock_guard<std::mutex> l( m_lock ) ;
+        map_of_pending_outbound::iterator it = m_pendingOutbound.find( client->getOutboundKey() ) ;
+        if( m_pendingOutbound.end() == it || it->second.m_client.lock() != client ) return ;
+
+        transactionIds.swap( it->second.m_transactionIds ) ;
+        m_pendingOutbound.erase( it ) ;
+        m_outboundPool.insert( map_of_outbound_connections::value_type( client->getOutboundKey(), client ) ) ;
+        DR_LOG(log_info) << "ClientController::outboundReady - added connection to " << client->getOutboundKey() << 
+          " to the pool, there are now " << m_outboundPool.count( client->getOutboundKey() ) ;
+      }
+      for( const string& transactionId : transactionIds ) {
+        int rc = m_pController->getPendingRequestController()->routeNewRequestToClient(client, transactionId) ;
+        if( rc ) {
+          DR_LOG(log_error) << "ClientController::outboundReady - error routing over outbound connection transactionId: " << transactionId ;
+          outboundFailed( transactionId);
+        }
       }
     }
 
     void ClientController::addNamedService( client_ptr client, string& strAppName ) {
-        //TODO: should we be locking here?  need to review entire locking strategy for this class
+        std::lock_guard<std::mutex> l( m_lock ) ;
         client_weak_ptr p( client ) ;
         m_services.insert( map_of_services::value_type(strAppName,p)) ;       
     }
@@ -162,7 +268,7 @@ namespace drachtio {
     }
 	void ClientController::accept_handler_tcp( client_ptr session, const boost::system::error_code& ec) {
         DR_LOG(log_debug) << "ClientController::accept_handler_tcp - got connection" ;       
-        if(!ec) session->start() ;
+        if(!ec) boost::asio::post( session->strand(), std::bind(&BaseClient::start, session) ) ;
         start_accept_tcp(); 
     }
 
@@ -174,21 +280,88 @@ namespace drachtio {
     }
 	void ClientController::accept_handler_tls( client_ptr session, const boost::system::error_code& ec) {
         DR_LOG(log_debug) << "ClientController::accept_handler_tls - got connection" ;       
-        if(!ec) session->start() ;
+        if(!ec) boost::asio::post( session->strand(), std::bind(&BaseClient::start, session) ) ;
         start_accept_tls(); 
     }
 
+	void ClientController::start_accept_unix() {
+        DR_LOG(log_debug) << "ClientController::start_accept_unix"   ;
+        Client<unix_socket_t>* p = new Client<unix_socket_t>(m_ioservice, *this);
+		client_ptr new_session(p) ;
+		m_acceptor_unix.async_accept( p->socket(), std::bind(&ClientController::accept_handler_unix, shared_from_this(), new_session, std::placeholders::_1));
+    }
+	void ClientController::accept_handler_unix( client_ptr session, const boost::system::error_code& ec) {
+        DR_LOG(log_debug) << "ClientController::accept_handler_unix - got connection" ;       
+        if(!ec) boost::asio::post( session->strand(), std::bind(&BaseClient::start, session) ) ;
+        start_accept_unix(); 
+    }
+
     void ClientController::makeOutboundConnection( const string& transactionId, const string& host, const string& port, const string& transport ) {
-        if (0 == transport.compare("tls")) {
-            Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>* p =  new Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>( m_ioservice, m_context, *this, transactionId, host, port ) ;
-            client_ptr new_session(p) ;
-            p->async_connect() ;
+        string key = host + ":" + port + ";transport=" + transport ;
+        client_ptr client ;
+        {
+            std::lock_guard<std::mutex> l( m_lock ) ;
+
+            /* reuse the least busy authenticated connection to this target, if we have one */
+            pair<map_of_outbound_connections::iterator,map_of_outbound_connections::iterator> pair = m_outboundPool.equal_range( key ) ;
+            for( map_of_outbound_connections::iterator it = pair.first; it != pair.second; ) {
+                client_ptr p = it->second.lock() ;
+                if( !p ) {
+                    it = m_outboundPool.erase( it ) ;
+                    continue ;
+                }
+                if( !client || p->getOutstandingTransactions() < client->getOutstandingTransactions() ) client = p ;
+                ++it ;
+            }
+
+            if( !client ) {
+                /* a connection is already on its way; wait for it rather than opening another */
+                map_of_pending_outbound::iterator itPending = m_pendingOutbound.find( key ) ;
+                if( m_pendingOutbound.end() != itPending && itPending->second.m_client.lock() ) {
+                    DR_LOG(log_debug) << "ClientController::makeOutboundConnection - waiting on connection in progress to " << key ;
+                    itPending->second.m_transactionIds.push_back( transactionId ) ;
+                    return ;
+                }
+
+                if (0 == transport.compare("tls")) {
+                    client.reset( new Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>( m_ioservice, m_context, *this, key, host, port ) ) ;
+                }
+                else {
+                    client.reset( new Client<socket_t>( m_ioservice, *this, key, host, port ) ) ;
+                }
+                PendingOutbound& pending = m_pendingOutbound[key] ;
+                pending.m_client = client ;
+                pending.m_transactionIds.push_back( transactionId ) ;
+                boost::asio::post( client->strand(), std::bind(&BaseClient::async_connect, client) ) ;
+                return ;
+            }
         }
-        else {
-            Client<socket_t>* p =  new Client<socket_t>( m_ioservice, *this, transactionId, host, port ) ;
-            client_ptr new_session(p) ;
-            p->async_connect() ;
+
+        DR_LOG(log_debug) << "ClientController::makeOutboundConnection - reusing pooled connection to " << key ;
+        int rc = m_pController->getPendingRequestController()->routeNewRequestToClient(client, transactionId) ;
+        if( rc ) {
+            DR_LOG(log_error) << "ClientController::makeOutboundConnection - error routing over pooled connection transactionId: " << transactionId ;
+            outboundFailed( transactionId ) ;
+        }
+    }
+
+    bool ClientController::findCachedEndpoints( const string& host, const string& port, boost::asio::ip::tcp::resolver::results_type& results ) {
+        std::lock_guard<std::mutex> l( m_dnsLock ) ;
+        std::unordered_map<string,CachedEndpoints>::iterator it = m_dnsCache.find( host + ":" + port ) ;
+        if( m_dnsCache.end() == it ) return false ;
+        if( it->second.m_expires <= std::chrono::steady_clock::now() ) {
+            m_dnsCache.erase( it ) ;
+            return false ;
         }
+        results = it->second.m_results ;
+        return true ;
+    }
+
+    void ClientController::cacheEndpoints( const string& host, const string& port, const boost::asio::ip::tcp::resolver::results_type& results ) {
+        std::lock_guard<std::mutex> l( m_dnsLock ) ;
+        CachedEndpoints& entry = m_dnsCache[ host + ":" + port ] ;
+        entry.m_results = results ;
+        entry.m_expires = std::chrono::steady_clock::now() + std::chrono::seconds( OUTBOUND_DNS_CACHE_SECS ) ;
     }
 
     void ClientController::selectClientForTag(const string& transactionId, const string& tag) {
@@ -218,9 +391,7 @@ namespace drachtio {
         m_request_types.insert( map_of_request_types::value_type(verb, spec)) ;  
         DR_LOG(log_debug) << "Added client for " << verb << " requests"  ;
 
-        //initialize the offset if this is the first client registering for that verb
-        map_of_request_type_offsets::iterator it = m_map_of_request_type_offsets.find( verb ) ;
-        if( m_map_of_request_type_offsets.end() == it ) m_map_of_request_type_offsets.insert(map_of_request_type_offsets::value_type(verb,0)) ;
+        rebuildRoutingIndex_nolock() ;
 
         //TODO: validate the verb is supported
         return true ;  
@@ -241,77 +412,160 @@ namespace drachtio {
         }
         DR_LOG(log_debug) << "Removed client for " << verb << " requests"  ;
 
+        rebuildRoutingIndex_nolock() ;
+
         //TODO: validate the verb is supported
         return true ;  
     }
 
-    client_ptr ClientController::selectClientForRequestOutsideDialog(const char* keyword, const char* tag) {
-        string method_name = keyword ;
-        transform(method_name.begin(), method_name.end(), method_name.begin(), ::tolower);
+    ClientController::RoutingIndex::Route ClientController::makeRoute_nolock( const string& verb, const string& key ) {
+        RoutingIndex::Route route ;
+        string lcVerb = verb ;
+        transform(lcVerb.begin(), lcVerb.end(), lcVerb.begin(), ::tolower);
+        map_of_selection_policies::const_iterator itPolicy = m_selectionPolicies.find( lcVerb ) ;
+        route.m_policy = m_selectionPolicies.end() == itPolicy ? RoutingIndex::policy_round_robin : itPolicy->second ;
 
-        /* round robin select a client that has registered for this request type (and, optionally, tag)*/
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        client_ptr client ;
-        string matchId ;
-        pair<map_of_request_types::iterator,map_of_request_types::iterator> pair = m_request_types.equal_range(method_name) ;
-        unsigned int nPossibles = std::distance(pair.first, pair.second) ;
-        if( 0 == nPossibles ) {
-            if( 0 == method_name.find("cdr") ) {
-                DR_LOG(log_debug) << "No connected clients found to handle incoming " << method_name << " request"  ;
+        std::shared_ptr< std::atomic<unsigned int> >& cursor = m_routeCursors[key] ;
+        if (!cursor) cursor = std::make_shared< std::atomic<unsigned int> >(0) ;
+        route.m_cursor = cursor ;
+        return route ;
+    }
+
+    void ClientController::rebuildRoutingIndex_nolock() {
+        std::shared_ptr<RoutingIndex> index = std::make_shared<RoutingIndex>() ;
+
+        for (map_of_request_types::iterator it = m_request_types.begin(); it != m_request_types.end(); ) {
+            client_ptr client = it->second.client() ;
+            if (!client) {
+                it = m_request_types.erase(it) ;
+                continue ;
             }
-            else {
-                DR_LOG(log_info) << "No connected clients found to handle incoming " << method_name << " request"  ;
+
+            const string& verb = it->first ;
+            std::vector<RoutingIndex::VerbRoutes>::iterator itVerb = std::find_if(index->m_verbs.begin(), index->m_verbs.end(), 
+                [&verb](const RoutingIndex::VerbRoutes& v) { return 0 == strcasecmp(v.m_verb.c_str(), verb.c_str()); }) ;
+            if (index->m_verbs.end() == itVerb) {
+                RoutingIndex::VerbRoutes v ;
+                v.m_verb = verb ;
+                v.m_all = makeRoute_nolock( verb, verb ) ;
+                itVerb = index->m_verbs.insert(index->m_verbs.end(), v) ;
             }
-           return client ;           
+            itVerb->m_all.m_clients.push_back( client ) ;
+
+            for (const string& tag : client->getTags()) {
+                std::vector< std::pair<string, RoutingIndex::Route> >::iterator itTag = std::find_if(itVerb->m_tagged.begin(), itVerb->m_tagged.end(), 
+                    [&tag](const std::pair<string, RoutingIndex::Route>& t) { return t.first == tag; }) ;
+                if (itVerb->m_tagged.end() == itTag) {
+                    itTag = itVerb->m_tagged.insert(itVerb->m_tagged.end(), std::make_pair(tag, makeRoute_nolock( verb, itVerb->m_verb + "|" + tag ))) ;
+                }
+                itTag->second.m_clients.push_back( client ) ;
+            }
+            ++it ;
         }
 
-        unsigned int nOffset = 0 ;
-        map_of_request_type_offsets::const_iterator itOffset = m_map_of_request_type_offsets.find(method_name) ;
-        if( m_map_of_request_type_offsets.end() != itOffset ) {
-            unsigned int i = itOffset->second;
-            if( i < nPossibles ) nOffset = i ;
-            else nOffset = 0;
+        /* keep only the cursors the new index uses, so tags that come and go do not pile up here */
+        map_of_route_cursors cursors ;
+        for (const RoutingIndex::VerbRoutes& v : index->m_verbs) {
+            cursors.emplace( v.m_verb, v.m_all.m_cursor ) ;
+            for (const std::pair<string, RoutingIndex::Route>& t : v.m_tagged) cursors.emplace( v.m_verb + "|" + t.first, t.second.m_cursor ) ;
         }
-        DR_LOG(log_debug) << "ClientController::selectClientForRequestOutsideDialog - there are " << nPossibles << 
-            " possible clients, we are starting with offset " << nOffset  ;
+        m_routeCursors.swap( cursors ) ;
 
-        m_map_of_request_type_offsets.erase(itOffset) ;
-        m_map_of_request_type_offsets.insert(map_of_request_type_offsets::value_type(method_name, nOffset + 1)) ;
+        std::atomic_store( &m_routingIndex, std::shared_ptr<const RoutingIndex>( index ) ) ;
+        DR_LOG(log_debug) << "ClientController::rebuildRoutingIndex_nolock - clients are now routed for " << index->m_verbs.size() << " request types" ;
+    }
 
-        unsigned int nTries = 0 ;
-        map_of_request_types::iterator it = pair.first ;
-        std::advance(it, nOffset) ;
-        do {
-            if (it == pair.second) it = pair.first;
-    
-            RequestSpecifier& spec = it->second ;
-            client = spec.client() ;
-            if (!client) {
-                DR_LOG(log_debug) << "ClientController::route_request_outside_dialog - Removing disconnected client while iterating"  ;
-                it = m_request_types.erase( it ) ;
-                //pair = m_request_types.equal_range(method_name) ;
-                //nOffset = 0 ;
-                //nPossibles = std::distance( pair.first, pair.second ) ;
+    const ClientController::RoutingIndex::Route* ClientController::RoutingIndex::find( const char* verb, const char* tag ) const {
+        for (const VerbRoutes& v : m_verbs) {
+            if (0 != strcasecmp(v.m_verb.c_str(), verb)) continue ;
+            if (!tag) return &v.m_all ;
+            for (const std::pair<string, Route>& t : v.m_tagged) {
+                if (0 == t.first.compare(tag)) return &t.second ;
             }
-            else if (tag && !client->hasTag(tag)) {
-                DR_LOG(log_debug) << "ClientController::route_request_outside_dialog - client at offset " << nOffset << " does not support tag " << tag;
-                client = NULL;
-                it++;
+            return NULL ;
+        }
+        return NULL ;
+    }
+
+    client_ptr ClientController::selectClient( const RoutingIndex::Route& route ) {
+        client_ptr client ;
+        size_t nPossibles = route.m_clients.size() ;
+        unsigned int nOffset = route.m_cursor->fetch_add( 1, std::memory_order_relaxed ) ;
+        DR_LOG(log_debug) << "ClientController::selectClient - there are " << nPossibles << 
+            " possible clients, we are starting with offset " << nOffset % nPossibles  ;
+
+        /* a client that has disconnected stays in the index until leave() rebuilds it, so skip past any we find */
+        if (RoutingIndex::policy_round_robin == route.m_policy) {
+            for( size_t i = 0; i < nPossibles && !client; i++ ) {
+                client = route.m_clients[ (nOffset + i) % nPossibles ].lock() ;
+            }
+            return client ;
+        }
+
+        /* 
+          otherwise take the least loaded client, starting from the round robin position so ties are shared out.
+          A client that is stalled stops producing latency samples, so latency is scaled by the work it has pending.
+          A client with no samples yet is taken to be as quick as the average of its peers; when none has any, every 
+          client counts the same and they are ordered by pending work alone.
+        */
+        uint64_t seedLatency = 1 ;
+        if (RoutingIndex::policy_latency == route.m_policy) {
+            uint64_t sum = 0, count = 0 ;
+            for( size_t i = 0; i < nPossibles; i++ ) {
+                client_ptr candidate = route.m_clients[i].lock() ;
+                uint64_t latency = candidate ? candidate->getResponseLatency() : 0 ;
+                if (latency) {
+                    sum += latency ;
+                    count++ ;
+                }
+            }
+            if (count) seedLatency = std::max( sum / count, (uint64_t) 1 ) ;
+        }
+
+        uint64_t best = 0 ;
+        for( size_t i = 0; i < nPossibles; i++ ) {
+            client_ptr candidate = route.m_clients[ (nOffset + i) % nPossibles ].lock() ;
+            if (!candidate) continue ;
+
+            uint64_t outstanding = std::max( candidate->getOutstandingTransactions(), 0 ) ;
+            uint64_t latency = candidate->getResponseLatency() ;
+            uint64_t load = RoutingIndex::policy_least_outstanding == route.m_policy ? outstanding :
+                (latency ? latency : seedLatency) * (outstanding + 1) ;
+            if (!client || load < best) {
+                client = candidate ;
+                best = load ;
+            }
+        }
+        if (client) {
+            DR_LOG(log_debug) << "ClientController::selectClient - selected client with load " << best  ;
+        }
+        return client ;
+    }
+
+    client_ptr ClientController::selectClientForRequestOutsideDialog(const char* keyword, const char* tag) {
+        client_ptr client ;
+
+        /* select a client that has registered for this request type (and, optionally, tag), using the policy configured for it */
+        std::shared_ptr<const RoutingIndex> index = std::atomic_load( &m_routingIndex ) ;
+        const RoutingIndex::Route* route = index ? index->find( keyword, tag ) : NULL ;
+        if( !route ) {
+            if( 0 == strncasecmp(keyword, "cdr", 3) ) {
+                DR_LOG(log_debug) << "No connected clients found to handle incoming " << keyword << " request"  ;
             }
             else {
-                DR_LOG(log_debug) << "ClientController::route_request_outside_dialog - Selected client at offset " << nOffset  ;                
+                DR_LOG(log_info) << "No connected clients found to handle incoming " << keyword << " request"  ;
             }
-            nPossibles--;
-        } while( !client && nPossibles > 0 ) ;
+           return client ;           
+        }
+
+        client = selectClient( *route ) ;
 
         if( !client ) {
-            DR_LOG(log_info) << "ClientController::route_request_outside_dialog - No clients found to handle incoming " << method_name << " request"  ;
-            return client ;
+            DR_LOG(log_info) << "ClientController::route_request_outside_dialog - No clients found to handle incoming " << keyword << " request"  ;
         }
- 
         return client ;
     }
-    bool ClientController::route_ack_request_inside_dialog( const string& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, 
+    bool ClientController::route_ack_request_inside_dialog( const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, 
         sip_t const *sip, const string& transactionId, const string& inviteTransactionId, const string& dialogId ) {
 
         client_ptr client = this->findClientForDialog( dialogId );
@@ -323,8 +577,7 @@ namespace drachtio {
             }
         }
 
-        void (BaseClient::*fn)(const string&, const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-        m_ioservice.post( std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta) ) ;
+        client->post( { AppMessage::sip_message, transactionId, dialogId, "", rawSipMsg, meta } ) ;
 
         this->removeNetTransaction( inviteTransactionId ) ;
         DR_LOG(log_debug) << "ClientController::route_ack_request_inside_dialog - removed incoming invite transaction, map size is now: " << m_mapNetTransactions.size() << " request"  ;
@@ -332,7 +585,7 @@ namespace drachtio {
         return true ;
 
     }
-    bool ClientController::route_request_inside_invite( const string& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, sip_t const *sip, 
+    bool ClientController::route_request_inside_invite( const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, sip_t const *sip, 
         const string& transactionId, const string& dialogId  ) {
         client_ptr client = this->findClientForDialog( dialogId );
         if( !client ) {
@@ -345,13 +598,12 @@ namespace drachtio {
         }
  
         DR_LOG(log_debug) << "ClientController::route_request_inside_invite - sending cancel prack or update to client"  ;
-        void (BaseClient::*fn)(const string&, const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-        m_ioservice.post( std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta) ) ;
+        client->post( { AppMessage::sip_message, transactionId, dialogId, "", rawSipMsg, meta } ) ;
 
         return true ;
     }
 
-    bool ClientController::route_request_inside_dialog( const string& rawSipMsg, const SipMsgData_t& meta, sip_t const *sip, 
+    bool ClientController::route_request_inside_dialog( const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, sip_t const *sip, 
         const string& transactionId, const string& dialogId ) {
         client_ptr client = this->findClientForDialog( dialogId );
         string method_name = sip->sip_request->rq_method_name ;
@@ -380,8 +632,7 @@ namespace drachtio {
         }
         if (string::npos == transactionId.find("unsolicited")) this->addNetTransaction( client, transactionId ) ;
  
-        void (BaseClient::*fn)(const string&, const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-        m_ioservice.post( std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta) ) ;
+        client->post( { AppMessage::sip_message, transactionId, dialogId, "", rawSipMsg, meta } ) ;
 
         // if this is a BYE from the network, it ends the dialog 
         if( isBye || isFinalNotifyForSubscribe) {
@@ -391,7 +642,7 @@ namespace drachtio {
         return true ;
     }
 
-    bool ClientController::route_response_inside_transaction( const string& rawSipMsg, const SipMsgData_t& meta, nta_outgoing_t* orq, sip_t const *sip, 
+    bool ClientController::route_response_inside_transaction( const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, nta_outgoing_t* orq, sip_t const *sip, 
         const string& transactionId, const string& dialogId ) {
         
         client_ptr client = this->findClientForAppTransaction( transactionId );
@@ -403,8 +654,7 @@ namespace drachtio {
             return false ;
         }
 
-        void (BaseClient::*fn)(const string&, const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-        m_ioservice.post( std::bind(fn, client, transactionId, dialogId, rawSipMsg, meta) ) ;
+        client->post( { AppMessage::sip_message, transactionId, dialogId, "", rawSipMsg, meta } ) ;
 
         string method_name = sip->sip_cseq->cs_method_name ;
         if( sip->sip_status->st_status >= 200 ) {
@@ -419,20 +669,17 @@ namespace drachtio {
     }
     
     void ClientController::addDialogForTransaction( const string& transactionId, const string& dialogId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        mapId2Client::iterator it = m_mapNetTransactions.find( transactionId ) ;
-        if( m_mapNetTransactions.end() != it ) {
-            m_mapDialogs.insert( mapId2Client::value_type(dialogId, it->second ) ) ;
+        client_weak_ptr wp ;
+        if( m_mapNetTransactions.find( transactionId, wp ) ) {
+            m_mapDialogs.insert( dialogId, wp ) ;
             DR_LOG(log_info) << "ClientController::addDialogForTransaction - added dialog (uas), now tracking: " << 
                 m_mapDialogs.size() << " dialogs and " << m_mapNetTransactions.size() << " net transactions"  ;
          }
         else {
             /* dialog will already exist if we received a reliable provisional response */
-            mapId2Client::iterator itDialog = m_mapDialogs.find( dialogId ) ;
-            if( m_mapDialogs.end() == itDialog ) {
-                mapId2Client::iterator itApp = m_mapAppTransactions.find( transactionId ) ;
-                if( m_mapAppTransactions.end() != itApp ) {
-                    m_mapDialogs.insert( mapId2Client::value_type(dialogId, itApp->second ) ) ;
+            if( !m_mapDialogs.contains( dialogId ) ) {
+                if( m_mapAppTransactions.find( transactionId, wp ) ) {
+                    m_mapDialogs.insert( dialogId, wp ) ;
                     DR_LOG(log_info) << "ClientController::addDialogForTransaction - added dialog (uac), now tracking: " << 
                         m_mapDialogs.size() << " dialogs and " << m_mapAppTransactions.size() << " app transactions"  ;
                 }
@@ -446,7 +693,7 @@ namespace drachtio {
         DR_LOG(log_debug) << "ClientController::addDialogForTransaction - transaction id " << transactionId << 
             " has associated dialog " << dialogId  ;
 
-        client_ptr client = this->findClientForDialog_nolock( dialogId );
+        client_ptr client = this->findClientForDialog( dialogId );
         if( !client ) {
             m_mapDialogs.erase( dialogId ) ;
             DR_LOG(log_warning) << "ClientController::addDialogForTransaction - client managing dialog has disconnected: " << dialogId  ;
@@ -455,15 +702,15 @@ namespace drachtio {
         else {
             string strAppName ;
             if( client->getAppName( strAppName ) ) {
-                m_mapDialogId2Appname.insert( mapDialogId2Appname::value_type( dialogId, strAppName ) ) ;
+                m_mapDialogId2Appname.insert( dialogId, strAppName ) ;
                 
                 DR_LOG(log_debug) << "ClientController::addDialogForTransaction - dialog id " << dialogId << 
                     " has been established for client app " << strAppName << "; count of tracked dialogs is " << m_mapDialogId2Appname.size()  ;
             }
         }
     } 
-    bool ClientController::sendRequestInsideDialog( client_ptr client, const string& clientMsgId, const string& dialogId, const string& startLine, 
-        const string& headers, const string& body, string& transactionId ) {
+    bool ClientController::sendRequestInsideDialog( client_ptr client, const string& clientMsgId, const string& dialogId, std::string_view startLine, 
+        const HeaderIndex& headers, std::string_view body, string& transactionId ) {
 
         generateUuid( transactionId ) ;
         if( 0 != startLine.find("ACK") ) {
@@ -474,8 +721,8 @@ namespace drachtio {
         bool rc = m_pController->getDialogController()->sendRequestInsideDialog( clientMsgId, dialogId, startLine, headers, body, transactionId) ;
         return rc ;
     }
-    bool ClientController::sendRequestOutsideDialog( client_ptr client, const string& clientMsgId, const string& startLine, const string& headers, 
-            const string& body, string& transactionId, string& dialogId, string& routeUrl ) {
+    bool ClientController::sendRequestOutsideDialog( client_ptr client, const string& clientMsgId, std::string_view startLine, const HeaderIndex& headers, 
+            std::string_view body, string& transactionId, string& dialogId, string& routeUrl ) {
 
         generateUuid( transactionId ) ;
         if( 0 != startLine.find("ACK") ) {
@@ -486,15 +733,21 @@ namespace drachtio {
         bool rc = m_pController->getDialogController()->sendRequestOutsideDialog( clientMsgId, startLine, headers, body, transactionId, dialogId, routeUrl) ;
         return rc ;        
     }
-    bool ClientController::respondToSipRequest( client_ptr client, const string& clientMsgId, const string& transactionId, const string& startLine, const string& headers, 
-        const string& body ) {
+    bool ClientController::respondToSipRequest( client_ptr client, const string& clientMsgId, const string& transactionId, std::string_view startLine, const HeaderIndex& headers, 
+        std::string_view body ) {
+
+        /* the first response from the app to a request we sent it gives us a sample of how responsive it is */
+        std::chrono::steady_clock::time_point tRouted ;
+        if( m_mapNetTransactionStart.take( transactionId, tRouted ) ) {
+            client->observeResponseLatency( std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - tRouted ).count() ) ;
+        }
 
         addApiRequest( client, clientMsgId )  ;
         bool rc = m_pController->getDialogController()->respondToSipRequest( clientMsgId, transactionId, startLine, headers, body ) ;
         return rc ;               
     }   
-    bool ClientController::sendCancelRequest( client_ptr client, const string& clientMsgId, const string& transactionId, const string& startLine, const string& headers, 
-        const string& body ) {
+    bool ClientController::sendCancelRequest( client_ptr client, const string& clientMsgId, const string& transactionId, std::string_view startLine, const HeaderIndex& headers, 
+        std::string_view body ) {
 
         addApiRequest( client, clientMsgId )  ;
         bool rc = m_pController->getDialogController()->sendCancelRequest( clientMsgId, transactionId, startLine, headers, body ) ;
@@ -502,7 +755,7 @@ namespace drachtio {
     }
     bool ClientController::proxyRequest( client_ptr client, const string& clientMsgId, const string& transactionId, 
         bool recordRoute, bool fullResponse, bool followRedirects, bool simultaneous, const string& provisionalTimeout, 
-        const string& finalTimeout, const vector<string>& vecDestination, const string& headers ) {
+        const string& finalTimeout, const vector<string>& vecDestination, const HeaderIndex& headers ) {
         addApiRequest( client, clientMsgId )  ;
         m_pController->getProxyController()->proxyRequest( clientMsgId, transactionId, recordRoute, fullResponse, followRedirects, 
             simultaneous, provisionalTimeout, finalTimeout, vecDestination, headers ) ;
@@ -522,38 +775,30 @@ namespace drachtio {
         if( string::npos == additionalResponseData.find("|continue") ) {
             removeApiRequest( clientMsgId ) ;
         }
-        m_ioservice.post( std::bind(&BaseClient::sendApiResponseToClient, client, clientMsgId, responseText, additionalResponseData) ) ;
+        client->post( { AppMessage::api_response, clientMsgId, responseText, additionalResponseData } ) ;
         return true ;                
     }
     
     void ClientController::removeDialog( const string& dialogId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        mapId2Client::iterator it = m_mapDialogs.find( dialogId ) ;
-        if( m_mapDialogs.end() == it ) {
+        if( 0 == m_mapDialogs.erase( dialogId ) ) {
             DR_LOG(log_warning) << "ClientController::removeDialog - dialog not found: " << dialogId  ;
             return ;
         }
-        m_mapDialogs.erase( it ) ;
         DR_LOG(log_info) << "ClientController::removeDialog - after removing dialogs count is now: " << m_mapDialogs.size()  ;
     }
     client_ptr ClientController::findClientForDialog( const string& dialogId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        return findClientForDialog_nolock( dialogId ) ;
-    }
-
-    client_ptr ClientController::findClientForDialog_nolock( const string& dialogId ) {
         client_ptr client ;
+        client_weak_ptr wp ;
 
-        mapId2Client::iterator it = m_mapDialogs.find( dialogId ) ;
-        if( m_mapDialogs.end() != it ) client = it->second.lock() ;
+        if( m_mapDialogs.find( dialogId, wp ) ) client = wp.lock() ;
 
         // if that client is no longer connected, randomly select another client that is running that app 
         if( !client ) {
-            mapDialogId2Appname::iterator it = m_mapDialogId2Appname.find( dialogId ) ;
-            if( m_mapDialogId2Appname.end() != it ) {
-                string appName = it->second ;
+            string appName ;
+            if( m_mapDialogId2Appname.find( dialogId, appName ) ) {
                 DR_LOG(log_info) << "Attempting to find another client for app " << appName  ;
 
+                std::lock_guard<std::mutex> l( m_lock ) ;
                 pair<map_of_services::iterator,map_of_services::iterator> pair = m_services.equal_range( appName ) ;
                 unsigned int nPossibles = std::distance( pair.first, pair.second ) ;
                 if( 0 == nPossibles ) {
@@ -579,99 +824,109 @@ namespace drachtio {
     }
 
     client_ptr ClientController::findClientForAppTransaction( const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
         client_ptr client ;
-        mapId2Client::iterator it = m_mapAppTransactions.find( transactionId ) ;
-        if( m_mapAppTransactions.end() != it ) client = it->second.lock() ;
+        client_weak_ptr wp ;
+        if( m_mapAppTransactions.find( transactionId, wp ) ) client = wp.lock() ;
         return client ;
     }
     client_ptr ClientController::findClientForNetTransaction( const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
         client_ptr client ;
-        mapId2Client::iterator it = m_mapNetTransactions.find( transactionId ) ;
-        if( m_mapNetTransactions.end() != it ) client = it->second.lock() ;
+        client_weak_ptr wp ;
+        if( m_mapNetTransactions.find( transactionId, wp ) ) client = wp.lock() ;
         return client ;
     }
     client_ptr ClientController::findClientForApiRequest( const string& clientMsgId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
         client_ptr client ;
-        mapId2Client::iterator it = m_mapApiRequests.find( clientMsgId ) ;
-        if( m_mapApiRequests.end() != it ) client = it->second.lock() ;
+        client_weak_ptr wp ;
+        if( m_mapApiRequests.find( clientMsgId, wp ) ) client = wp.lock() ;
         return client ;
     }
     void ClientController::removeAppTransaction( const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapAppTransactions.erase( transactionId ) ;        
+        client_weak_ptr wp ;
+        if( m_mapAppTransactions.take( transactionId, wp ) ) {
+            client_ptr client = wp.lock() ;
+            if( client ) client->transactionEnded() ;
+        }
         DR_LOG(log_debug) << "ClientController::removeAppTransaction: transactionId " << transactionId << "; size: " << m_mapAppTransactions.size()  ;
     }
     void ClientController::removeNetTransaction( const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapNetTransactions.erase( transactionId ) ;        
+        client_weak_ptr wp ;
+        if( m_mapNetTransactions.take( transactionId, wp ) ) {
+            client_ptr client = wp.lock() ;
+            if( client ) client->transactionEnded() ;
+        }
+        m_mapNetTransactionStart.erase( transactionId ) ;
         DR_LOG(log_debug) << "ClientController::removeNetTransaction: transactionId " << transactionId << "; size: " << m_mapNetTransactions.size()  ;
     }
     void ClientController::removeApiRequest( const string& clientMsgId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
         m_mapApiRequests.erase( clientMsgId ) ;   
         DR_LOG(log_debug) << "ClientController::removeApiRequest: clientMsgId " << clientMsgId << "; size: " << m_mapApiRequests.size()  ;
     }
     void ClientController::addAppTransaction( client_ptr client, const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapAppTransactions.insert( make_pair( transactionId, client ) ) ;        
+        if( m_mapAppTransactions.insert( transactionId, client ) ) client->transactionStarted() ;
         DR_LOG(log_debug) << "ClientController::addAppTransaction: transactionId " << transactionId << "; size: " << m_mapAppTransactions.size()  ;
     }
     void ClientController::addNetTransaction( client_ptr client, const string& transactionId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapNetTransactions.insert( make_pair( transactionId, client ) ) ;        
+        if( m_mapNetTransactions.insert( transactionId, client ) ) {
+            client->transactionStarted() ;
+            m_mapNetTransactionStart.insert( transactionId, std::chrono::steady_clock::now() ) ;
+        }
         DR_LOG(log_debug) << "ClientController::addNetTransaction: transactionId " << transactionId << "; size: " << m_mapNetTransactions.size()  ;
     }
     void ClientController::addApiRequest( client_ptr client, const string& clientMsgId ) {
-        std::lock_guard<std::mutex> l( m_lock ) ;
-        m_mapApiRequests.insert( make_pair( clientMsgId, client ) ) ;        
+        m_mapApiRequests.insert( clientMsgId, client ) ;        
         DR_LOG(log_debug) << "ClientController::addApiRequest: clientMsgId " << clientMsgId << "; size: " << m_mapApiRequests.size()  ;
     }
 
     void ClientController::logStorageCount(bool bDetail) {
-        std::lock_guard<std::mutex> lock(m_lock) ;
-
-        DR_LOG(bDetail ? log_info : log_debug) << "ClientController storage counts"  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "----------------------------------"  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_clients size:                                                  " << m_clients.size()  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_services size:                                                 " << m_services.size()  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_request_types size:                                            " << m_request_types.size()  ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_map_of_request_type_offsets size:                              " << m_map_of_request_type_offsets.size()  ;
+        size_t nClients ;
+        {
+            std::lock_guard<std::mutex> lock(m_lock) ;
+            nClients = m_clients.size() ;
+
+            DR_LOG(bDetail ? log_info : log_debug) << "ClientController storage counts"  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "----------------------------------"  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_clients size:                                                  " << m_clients.size()  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_services size:                                                 " << m_services.size()  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_request_types size:                                            " << m_request_types.size()  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_outboundPool size:                                             " << m_outboundPool.size()  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_pendingOutbound size:                                          " << m_pendingOutbound.size()  ;
+            DR_LOG(bDetail ? log_info : log_debug) << "m_routeCursors size:                                             " << m_routeCursors.size()  ;
+        }
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapDialogs size:                                               " << m_mapDialogs.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapDialogs) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    dialog id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapDialogs.forEach([](const string& id, const client_weak_ptr&) {
+                DR_LOG(log_info) << "    dialog id: " << std::hex << id.c_str();
+            });
         }
 
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapNetTransactions size:                                       " << m_mapNetTransactions.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapNetTransactions) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    transaction id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapNetTransactions.forEach([](const string& id, const client_weak_ptr&) {
+                DR_LOG(log_info) << "    transaction id: " << std::hex << id.c_str();
+            });
         }
+        DR_LOG(bDetail ? log_info : log_debug) << "m_mapNetTransactionStart size:                                   " << m_mapNetTransactionStart.size()  ;
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapAppTransactions size:                                       " << m_mapAppTransactions.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapAppTransactions) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    transaction id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapAppTransactions.forEach([](const string& id, const client_weak_ptr&) {
+                DR_LOG(log_info) << "    transaction id: " << std::hex << id.c_str();
+            });
         }
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapApiRequests size:                                           " << m_mapApiRequests.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapApiRequests) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    client msg id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapApiRequests.forEach([](const string& id, const client_weak_ptr&) {
+                DR_LOG(log_info) << "    client msg id: " << std::hex << id.c_str();
+            });
         }
         DR_LOG(bDetail ? log_info : log_debug) << "m_mapDialogId2Appname size:                                      " << m_mapDialogId2Appname.size()  ;
         if (bDetail) {
-            for (const auto& kv : m_mapDialogId2Appname) {
-                DR_LOG(bDetail ? log_info : log_debug) << "    dialog id: " << std::hex << (kv.first).c_str();
-            }
+            m_mapDialogId2Appname.forEach([](const string& id, const string&) {
+                DR_LOG(log_info) << "    dialog id: " << std::hex << id.c_str();
+            });
         }
 
-        STATS_GAUGE_SET(STATS_GAUGE_CLIENT_APP_CONNECTIONS, m_clients.size())
+        STATS_GAUGE_SET(STATS_GAUGE_CLIENT_APP_CONNECTIONS, nClients)
 
     }
     std::shared_ptr<SipDialogController> ClientController::getDialogController(void) {
@@ -681,8 +936,14 @@ namespace drachtio {
     void ClientController::stop() {
         m_acceptor_tcp.cancel() ;
         m_acceptor_tls.cancel() ;
+        if (m_acceptor_unix.is_open()) {
+            m_acceptor_unix.close() ;
+            ::unlink( m_unixSocketPath.c_str() ) ;
+        }
         m_ioservice.stop() ;
-        m_thread.join() ;
+        for( std::thread& t : m_threads ) {
+            if( t.joinable() ) t.join() ;
+        }
     }
 
  }
@@ -28,7 +28,11 @@ THE SOFTWARE.
 
 #include <unordered_set>
 #include <unordered_map>
+#include <array>
+#include <vector>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <thread>
 
 #include <sofia-sip/nta.h>
@@ -60,14 +64,17 @@ namespace drachtio {
     ~ClientController() ;
     
     void start();
+    void listenOnUnixSocket( const string& path, unsigned int mode ) ;
   	void start_accept_tcp() ;
   	void start_accept_tls() ;
+  	void start_accept_unix() ;
   	void threadFunc(void) ;
 
     void join( client_ptr client ) ;
     void leave( client_ptr client ) ;
     void outboundFailed( const string& transactionId ) ;
-    void outboundReady( client_ptr client, const string& transactionId ) ;
+    void outboundFailed( client_ptr client ) ;
+    void outboundReady( client_ptr client ) ;
 
     void addNamedService( client_ptr client, string& strAppName ) ;
 
@@ -90,30 +97,32 @@ namespace drachtio {
     client_ptr findClientForApiRequest( const string& clientMsgId ) ;
 
     void makeOutboundConnection( const string& transactionId, const string& host, const string& port, const string& transport ) ;
+    bool findCachedEndpoints( const string& host, const string& port, boost::asio::ip::tcp::resolver::results_type& results ) ;
+    void cacheEndpoints( const string& host, const string& port, const boost::asio::ip::tcp::resolver::results_type& results ) ;
     void selectClientForTag(const string& transactionId, const string& tag);
 
-    bool sendRequestInsideDialog( client_ptr client, const string& clientMsgId, const string& dialogId, const string& startLine, const string& headers, const string& body, string& transactionId ) ;
-    bool sendRequestOutsideDialog( client_ptr client, const string& clientMsgId, const string& startLine, const string& headers, const string& body, string& transactionId, string& dialogId, string& routeUrl ) ;
-    bool respondToSipRequest( client_ptr client, const string& msgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) ;      
-    bool sendCancelRequest( client_ptr client, const string& msgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) ;
+    bool sendRequestInsideDialog( client_ptr client, const string& clientMsgId, const string& dialogId, std::string_view startLine, const HeaderIndex& headers, std::string_view body, string& transactionId ) ;
+    bool sendRequestOutsideDialog( client_ptr client, const string& clientMsgId, std::string_view startLine, const HeaderIndex& headers, std::string_view body, string& transactionId, string& dialogId, string& routeUrl ) ;
+    bool respondToSipRequest( client_ptr client, const string& msgId, const string& transactionId, std::string_view startLine, const HeaderIndex& headers, std::string_view body ) ;      
+    bool sendCancelRequest( client_ptr client, const string& msgId, const string& transactionId, std::string_view startLine, const HeaderIndex& headers, std::string_view body ) ;
     bool proxyRequest( client_ptr client, const string& clientMsgId, const string& transactionId, bool recordRoute, bool fullResponse,
       bool followRedirects, bool simultaneous, const string& provisionalTimeout, const string& finalTimeout, 
-      const vector<string>& vecDestination, const string& headers ) ;
+      const vector<string>& vecDestination, const HeaderIndex& headers ) ;
 
     //this sends the client a response to the request it made to send a sip message
     bool route_api_response( const string& clientMsgId, const string& responseText, const string& additionalResponseData ) ;
 
     //route an incoming ACK request to the client that handled the INVITE
-    bool route_ack_request_inside_dialog( const string& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, sip_t const *sip, 
+    bool route_ack_request_inside_dialog( const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, sip_t const *sip, 
       const string& transactionId, const string& inviteTransactionId, const string& dialogId ) ;
 
     //route an incoming response to a request generated by a client
-    bool route_response_inside_transaction( const string& rawSipMsg, const SipMsgData_t& meta, nta_outgoing_t* orq, sip_t const *sip, 
+    bool route_response_inside_transaction( const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, nta_outgoing_t* orq, sip_t const *sip, 
       const string& transactionId, const string& dialogId = "" ) ; 
 
-    bool route_request_inside_dialog( const string& rawSipMsg, const SipMsgData_t& meta, sip_t const *sip, const string& transactionId, const string& dialogId ) ;
+    bool route_request_inside_dialog( const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, sip_t const *sip, const string& transactionId, const string& dialogId ) ;
 
-    bool route_request_inside_invite( const string& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, sip_t const *sip, const string& transactionId, const string& dialogId  = "" ) ;
+    bool route_request_inside_invite( const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, nta_incoming_t* prack, sip_t const *sip, const string& transactionId, const string& dialogId  = "" ) ;
 
     void onTimer( const boost::system::error_code& e, boost::asio::deadline_timer* t ) ;
 
@@ -127,6 +136,99 @@ namespace drachtio {
 
   protected:
 
+    /* a string-keyed map split into independently locked shards, so that lookups from different io threads rarely contend */
+    template<typename V, size_t N = 16>
+    class ShardedMap {
+    public:
+      bool insert( const string& key, const V& value ) {
+        Shard& s = shard( key ) ;
+        std::lock_guard<std::mutex> l( s.m_lock ) ;
+        return s.m_map.insert( typename map_t::value_type( key, value ) ).second ;
+      }
+      bool find( const string& key, V& value ) {
+        Shard& s = shard( key ) ;
+        std::lock_guard<std::mutex> l( s.m_lock ) ;
+        typename map_t::const_iterator it = s.m_map.find( key ) ;
+        if( s.m_map.end() == it ) return false ;
+        value = it->second ;
+        return true ;
+      }
+      bool contains( const string& key ) {
+        Shard& s = shard( key ) ;
+        std::lock_guard<std::mutex> l( s.m_lock ) ;
+        return s.m_map.end() != s.m_map.find( key ) ;
+      }
+      bool take( const string& key, V& value ) {
+        Shard& s = shard( key ) ;
+        std::lock_guard<std::mutex> l( s.m_lock ) ;
+        typename map_t::iterator it = s.m_map.find( key ) ;
+        if( s.m_map.end() == it ) return false ;
+        value = std::move( it->second ) ;
+        s.m_map.erase( it ) ;
+        return true ;
+      }
+      size_t erase( const string& key ) {
+        Shard& s = shard( key ) ;
+        std::lock_guard<std::mutex> l( s.m_lock ) ;
+        return s.m_map.erase( key ) ;
+      }
+      size_t size() {
+        size_t count = 0 ;
+        for( Shard& s : m_shards ) {
+          std::lock_guard<std::mutex> l( s.m_lock ) ;
+          count += s.m_map.size() ;
+        }
+        return count ;
+      }
+      template<typename F> void forEach( F f ) {
+        for( Shard& s : m_shards ) {
+          std::lock_guard<std::mutex> l( s.m_lock ) ;
+          for( const auto& kv : s.m_map ) f( kv.first, kv.second ) ;
+        }
+      }
+
+    private:
+      typedef std::unordered_map<string,V> map_t ;
+      struct Shard {
+        std::mutex  m_lock ;
+        map_t       m_map ;
+      } ;
+      Shard& shard( const string& key ) { return m_shards[ std::hash<string>()( key ) % N ] ; }
+
+      std::array<Shard, N> m_shards ;
+    } ;
+
+    /* 
+      immutable snapshot of which clients want which requests, rebuilt under m_lock whenever routes or clients change 
+      and swapped in atomically, so that selecting a client for a new request never takes a lock 
+    */
+    class RoutingIndex {
+    public:
+      enum SelectionPolicy {
+        policy_round_robin = 0,
+        policy_least_outstanding,
+        policy_latency
+      } ;
+
+      struct Route {
+        SelectionPolicy m_policy ;
+        std::vector<client_weak_ptr> m_clients ;
+
+        // round robin position; shared with the routes that replace this one on a rebuild
+        std::shared_ptr< std::atomic<unsigned int> > m_cursor ;
+      } ;
+
+      // returns NULL if no client has asked for this verb (and tag, if provided)
+      const Route* find( const char* verb, const char* tag = NULL ) const ;
+
+      struct VerbRoutes {
+        string m_verb ;
+        Route m_all ;
+        std::vector< std::pair<string, Route> > m_tagged ;
+      } ;
+      std::vector<VerbRoutes> m_verbs ;
+    } ;
+
     class RequestSpecifier {
     public:
       RequestSpecifier( client_ptr client ) : m_client(client) {}
@@ -145,12 +247,16 @@ namespace drachtio {
   private:
     void accept_handler_tcp( client_ptr session, const boost::system::error_code& ec) ;
     void accept_handler_tls( client_ptr session, const boost::system::error_code& ec) ;
+    void accept_handler_unix( client_ptr session, const boost::system::error_code& ec) ;
     void stop() ;
-
-    client_ptr findClientForDialog_nolock( const string& dialogId ) ;
+    void rebuildRoutingIndex_nolock() ;
+    RoutingIndex::Route makeRoute_nolock( const string& verb, const string& key ) ;
+    client_ptr selectClient( const RoutingIndex::Route& route ) ;
 
     DrachtioController*         m_pController ;
-    std::thread                 m_thread ;
+    std::vector<std::thread>    m_threads ;
+
+    // guards the set of connected clients, the request routing tables and the outbound connection pool below
     std::mutex                m_lock ;
 
     boost::asio::io_context m_ioservice;
@@ -160,6 +266,8 @@ namespace drachtio {
     boost::asio::ip::tcp::acceptor  m_acceptor_tls ;
     boost::asio::ssl::context m_context;
     unsigned int m_tcpPort, m_tlsPort;
+    boost::asio::local::stream_protocol::acceptor  m_acceptor_unix ;
+    string m_unixSocketPath ;
 
     typedef std::unordered_set<client_ptr> set_of_clients ;
     set_of_clients m_clients ;
@@ -167,20 +275,52 @@ namespace drachtio {
     typedef std::unordered_multimap<string,client_weak_ptr> map_of_services ;
     map_of_services m_services ;
 
+    // authenticated outbound connections, by host:port;transport, that new requests for that target can reuse
+    typedef std::unordered_multimap<string,client_weak_ptr> map_of_outbound_connections ;
+    map_of_outbound_connections m_outboundPool ;
+
+    // an outbound connection being set up, and the requests waiting on it
+    struct PendingOutbound {
+      client_weak_ptr m_client ;
+      std::vector<string> m_transactionIds ;
+    } ;
+    typedef std::unordered_map<string,PendingOutbound> map_of_pending_outbound ;
+    map_of_pending_outbound m_pendingOutbound ;
+
+    // resolved addresses for outbound targets; getaddrinfo does not give us the record ttl, so entries are kept for a fixed time
+    struct CachedEndpoints {
+      boost::asio::ip::tcp::resolver::results_type m_results ;
+      std::chrono::steady_clock::time_point m_expires ;
+    } ;
+    std::mutex m_dnsLock ;
+    std::unordered_map<string,CachedEndpoints> m_dnsCache ;
+
     typedef std::unordered_multimap<string,RequestSpecifier> map_of_request_types ;
     map_of_request_types m_request_types ;
 
-    typedef std::unordered_map<string,unsigned int> map_of_request_type_offsets ;
-    map_of_request_type_offsets m_map_of_request_type_offsets ;
+    typedef std::unordered_map< string, std::shared_ptr< std::atomic<unsigned int> > > map_of_route_cursors ;
+    map_of_route_cursors m_routeCursors ;
 
-    typedef std::unordered_map<string,client_weak_ptr> mapId2Client ;
+    // selection policy for each verb (lower case) that is not round robin
+    typedef std::unordered_map<string, RoutingIndex::SelectionPolicy> map_of_selection_policies ;
+    map_of_selection_policies m_selectionPolicies ;
+
+    // built from m_request_types; only ever read through std::atomic_load
+    std::shared_ptr<const RoutingIndex> m_routingIndex ;
+
+    // these are consulted for nearly every message, so each carries its own locking
+    typedef ShardedMap<client_weak_ptr> mapId2Client ;
     mapId2Client m_mapDialogs ;
     mapId2Client m_mapAppTransactions ;
     mapId2Client m_mapNetTransactions ;
     mapId2Client m_mapApiRequests ;
 
-    typedef std::unordered_map<string,string> mapDialogId2Appname ;
+    typedef ShardedMap<string> mapDialogId2Appname ;
     mapDialogId2Appname m_mapDialogId2Appname ;
+
+    // when each new request was handed to a client, until the client first responds to it
+    typedef ShardedMap<std::chrono::steady_clock::time_point> mapId2Time ;
+    mapId2Time m_mapNetTransactionStart ;
       
   } ;
 
@@ -24,6 +24,10 @@ THE SOFTWARE.
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <string.h>
+#include <errno.h>
 
 #include <iostream>
 #include <memory>
@@ -38,6 +42,7 @@ THE SOFTWARE.
 #include "drachtio.h"
 #include "client.hpp"
 #include "controller.hpp"
+#include "shm-client.hpp"
 
 #if !defined(SOL_TCP) && defined(IPPROTO_TCP)
 #define SOL_TCP IPPROTO_TCP
@@ -46,6 +51,9 @@ THE SOFTWARE.
 #define TCP_KEEPIDLE TCP_KEEPALIVE
 #endif
 
+// minimum free space we offer to each socket read
+#define READ_CHUNK_SIZE (8192)
+
 namespace drachtio {
     std::size_t hash_value( BaseClient const &c ) {
         std::size_t seed = 0 ;
@@ -89,18 +97,44 @@ namespace drachtio {
         }
     }
 
+    // binary framing helpers; all integers go out in network byte order
+    static void appendUint16( string& s, uint16_t v ) {
+        s.push_back( (char) (v >> 8) ) ;
+        s.push_back( (char) v ) ;
+    }
+    static void appendUint32( string& s, uint32_t v ) {
+        appendUint16( s, (uint16_t) (v >> 16) ) ;
+        appendUint16( s, (uint16_t) v ) ;
+    }
+    static void appendUint64( string& s, uint64_t v ) {
+        appendUint32( s, (uint32_t) (v >> 32) ) ;
+        appendUint32( s, (uint32_t) v ) ;
+    }
+    static void appendAddress( string& s, const string& address ) {
+        unsigned char addr[16] = {0} ;
+        char family = 0 ;
+        if (!address.empty()) {
+            if (1 == inet_pton( AF_INET, address.c_str(), addr ) ) family = 4 ;
+            else if (1 == inet_pton( AF_INET6, address.c_str(), addr ) ) family = 6 ;
+        }
+        s.push_back( family ) ;
+        s.append( (const char *) addr, sizeof(addr) ) ;
+    }
+
     // BaseClient
     BaseClient::BaseClient(ClientController& controller) :
-        m_controller( controller ),  
-        m_state(initial), m_buffer(12228), m_nMessageLength(0) {
+        m_controller( controller ), m_strand( boost::asio::make_strand( controller.getIOService() ) ),
+        m_state(initial), m_buffer(16384), m_nReadPos(0), m_nWritePos(0), m_bWriteInProgress(false), m_bHoldWrites(false),
+        m_bLocal(false), m_bBinaryFraming(false), m_nMsgSeq(0), m_nOutstanding(0), m_nLatencyEwma(0) {
             time(&m_tConnect);
     }
     BaseClient::BaseClient(ClientController& controller, 
-        const string& transactionId, 
+        const string& outboundKey, 
         const string& host, const string& port) :
-        m_controller( controller ), 
-        m_transactionId(transactionId), m_host(host), m_port(port),
-        m_state(initial), m_buffer(12228), m_nMessageLength(0) {
+        m_controller( controller ), m_strand( boost::asio::make_strand( controller.getIOService() ) ),
+        m_outboundKey(outboundKey), m_host(host), m_port(port),
+        m_state(initial), m_buffer(16384), m_nReadPos(0), m_nWritePos(0), m_bWriteInProgress(false), m_bHoldWrites(false),
+        m_bLocal(false), m_bBinaryFraming(false), m_nMsgSeq(0), m_nOutstanding(0), m_nLatencyEwma(0) {
             time(&m_tConnect);
     }
 
@@ -108,15 +142,24 @@ namespace drachtio {
       DR_LOG(log_debug) << "BaseClient::~BaseClient";
     }
 
+    void BaseClient::observeResponseLatency( uint64_t usecs ) {
+        /* only ever called from our strand, so a plain read-modify-write is safe; weight of 1/8 for the new sample */
+        uint64_t ewma = m_nLatencyEwma ;
+        if (0 == ewma) ewma = usecs ;
+        else ewma = ewma - (ewma >> 3) + (usecs >> 3) ;
+        m_nLatencyEwma = std::max( ewma, (uint64_t) 1 ) ;
+    }
+
     std::shared_ptr<SipDialogController> BaseClient::getDialogController() {
         return m_controller.getDialogController(); 
     }
 
-    bool BaseClient::processClientMessage( const string& msg, string& msgResponse ) {
-        string meta, startLine, headers, body ;
+    bool BaseClient::processClientMessage( std::string_view msg, string& msgResponse ) {
+        std::string_view meta, startLine, headers, body ;
        
+        /* everything here is a view into the receive buffer; nothing is copied until handed off to the stack thread */
         splitMsg( msg, meta, startLine, headers, body ) ;
-        vector<string>tokens ;
+        vector<std::string_view> tokens ;
         splitTokens( meta, tokens) ;
 
         if( tokens.size() < 2 ) {
@@ -130,7 +173,7 @@ namespace drachtio {
             return true;
         }
         else if( 0 == tokens[1].compare("route") ) {
-            if( !m_controller.wants_requests( shared_from_this(), tokens[2] ) ) {
+            if( !m_controller.wants_requests( shared_from_this(), string(tokens[2]) ) ) {
                 DR_LOG(log_error) << "Route request includes unsupported verb: " << tokens[2]  ;   
                 createResponseMsg( tokens[0], msgResponse, false, "Route request includes unsupported verb" ) ;
                 return false ;        
@@ -138,7 +181,7 @@ namespace drachtio {
             createResponseMsg( tokens[0], msgResponse ) ;
         }
         else if( 0 == tokens[1].compare("remove_route") ) {
-            if( !m_controller.no_longer_wants_requests( shared_from_this(), tokens[2] ) ) {
+            if( !m_controller.no_longer_wants_requests( shared_from_this(), string(tokens[2]) ) ) {
                 DR_LOG(log_error) << "Remove route request includes unsupported verb: " << tokens[2]  ;   
                 createResponseMsg( tokens[0], msgResponse, false, "Remove route request includes unsupported verb" ) ;
                 return false ;        
@@ -146,9 +189,9 @@ namespace drachtio {
             createResponseMsg( tokens[0], msgResponse ) ;
         }
         else if( 0 == tokens[1].compare("authenticate")) {
-            string secret = tokens[2] ;
-            if (tokens.size() > 3) {
-                string tags = tokens[3];
+            string secret( tokens[2] ) ;
+            if (tokens.size() > 3 && !tokens[3].empty()) {
+                string tags( tokens[3] );
                 vector<string> strs;
                 boost::split(strs, tags, boost::is_any_of(","));
                 for (vector<string>::iterator it = strs.begin(); it != strs.end(); ++it) {
@@ -157,7 +200,7 @@ namespace drachtio {
                 DR_LOG(log_debug) << "Client::processAuthentication - added tags " << tags ;
             }
             DR_LOG(log_debug) << "Client::processAuthentication - validating secret " << secret  ;
-            if( !theOneAndOnlyController->isSecret( secret ) ) {
+            if( !m_bLocal && !theOneAndOnlyController->isSecret( secret ) ) {
                 DR_LOG(log_info) << "Client::processAuthentication - secret validation failed: " << secret  ;
                 createResponseMsg( tokens[0], msgResponse, false, "incorrect secret" ) ;
                 return false ;       
@@ -169,14 +212,57 @@ namespace drachtio {
                 string hostports = boost::algorithm::join(hps, ",") ;
                 string localHostports = boost::algorithm::join(local_hps, ",") ;
                 string response = hostports + "|" + DRACHTIO_VERSION + "|" + localHostports ;
-                createResponseMsg( tokens[0], msgResponse, true, response.c_str()) ;
+                if (tokens.size() > 4 && 0 == tokens[4].compare("binary")) {
+
+                    /* the response itself must go out text framed, since that is what the application is expecting */
+                    response += "|binary" ;
+                    createResponseMsg( tokens[0], msgResponse, true, response.c_str()) ;
+                    queueFrame( msgResponse ) ;
+                    msgResponse.clear() ;
+                    m_bBinaryFraming = true ;
+                    DR_LOG(log_debug) << "Client::processAuthentication - using binary framing for this connection" ;
+                }
+                else {
+                    createResponseMsg( tokens[0], msgResponse, true, response.c_str()) ;
+                }
                 DR_LOG(log_debug) << "Client::processAuthentication - secret validated successfully: " << secret ;
                 return true ;
             }            
         }
+        else if( 0 == tokens[1].compare("shm") ) {
+            if( !m_bLocal || m_sharedMemoryClient ) {
+                DR_LOG(log_error) << "Client::processClientMessage - shared memory transport requested on a connection that can not have one" ;
+                createResponseMsg( tokens[0], msgResponse, false, "shared memory transport is only available to a local connection, once" ) ;
+                return true ;
+            }
+            uint64_t ringSize = tokens.size() > 2 ? ::strtoull( string( tokens[2] ).c_str(), NULL, 10 ) : 0 ;
+            std::shared_ptr<ShmClient> shm = std::make_shared<ShmClient>( m_controller.getIOService(), m_controller ) ;
+            if( !shm->create( ringSize ) ) {
+                createResponseMsg( tokens[0], msgResponse, false, "unable to create shared memory transport" ) ;
+                return true ;
+            }
+
+            /* the new link acts for the same application as this connection */
+            BaseClient& link = *shm ;
+            link.m_tags = m_tags ;
+            link.m_strAppName = m_strAppName ;
+            link.m_bBinaryFraming = m_bBinaryFraming ;
+            link.m_state = m_state ;
+
+            m_sharedMemoryClient = shm ;
+            boost::asio::post( shm->strand(), std::bind( &BaseClient::start, shm ) ) ;
+
+            /* the descriptors for the ring travel with the response that announces it, so it is queued here rather than by the caller */
+            DR_LOG(log_info) << "Client::processClientMessage - created shared memory transport with ring size " << shm->getRingSize() ;
+            createResponseMsg( tokens[0], msgResponse, true, std::to_string( shm->getRingSize() ).c_str() ) ;
+            if( queueFrame( msgResponse ) ) shm->getFileDescriptors( m_outQueue.back().m_fds ) ;
+            msgResponse.clear() ;
+            return true ;
+        }
         else if( 0 == tokens[1].compare("sip") ) {
             bool bOK = false ;
-            string transactionId, dialogId, routeUrl ;
+            string clientMsgId( tokens[0] ), transactionId, dialogId, routeUrl ;
+            HeaderIndex headerIndex( headers ) ;
 
             DR_LOG(log_debug) << "Client::processMessage - got request with " << tokens.size() << " tokens"  ;
             assert(tokens.size() >= 4) ;
@@ -195,57 +281,57 @@ namespace drachtio {
                     createResponseMsg( tokens[0], msgResponse, false, "transaction id missing" ) ;
                     return false; 
                 }
-                m_controller.respondToSipRequest( shared_from_this(), tokens[0], transactionId, startLine, headers, body ) ;
+                m_controller.respondToSipRequest( shared_from_this(), clientMsgId, transactionId, startLine, headerIndex, body ) ;
             }
             else if( dialogId.length() > 0 ) { 
                 //has dialog id - request within a dialog
                 DR_LOG(log_debug) << "Client::processMessage - sending a request inside a dialog (dialogId provided)"  ;
-                bOK = m_controller.sendRequestInsideDialog( shared_from_this(), tokens[0], dialogId, startLine, headers, body, transactionId ) ;
+                bOK = m_controller.sendRequestInsideDialog( shared_from_this(), clientMsgId, dialogId, startLine, headerIndex, body, transactionId ) ;
             }
             else if( transactionId.length() > 0 ) {
                 if( 0 == startLine.find("CANCEL") ) {
                     DR_LOG(log_debug) << "Client::processMessage - sending a CANCEL request inside a transaction" ;
-                    bOK = m_controller.sendCancelRequest( shared_from_this(), tokens[0], transactionId, startLine, headers, body) ;
+                    bOK = m_controller.sendCancelRequest( shared_from_this(), clientMsgId, transactionId, startLine, headerIndex, body) ;
                 }
                 else {
                     assert(false) ;// are there other requests within a transaction, besides CANCEL??
                 }
             }
             else {
-                string strCallId ;
+                std::string_view callId ;
 
                 //if provided, check if Call-ID is for an existing dialog 
-                if( GetValueForHeader( headers, "Call-ID", strCallId ) ) {
+                if( headerIndex.find( sip_hdr_call_id, callId ) ) {
                     std::shared_ptr<SipDialog> dlg ;
-                    if( getDialogController()->findDialogByCallId( strCallId, dlg ) ) {
+                    if( getDialogController()->findDialogByCallId( string( callId ), dlg ) ) {
                         DR_LOG(log_debug) << "Client::processMessage - sending a request inside a dialog (call-id provided)"  ;
-                        m_controller.sendRequestInsideDialog( shared_from_this(), tokens[0], dlg->getDialogId(), startLine, headers, body, transactionId ) ;
+                        m_controller.sendRequestInsideDialog( shared_from_this(), clientMsgId, dlg->getDialogId(), startLine, headerIndex, body, transactionId ) ;
                         return true ;
                     }
                 }
                 DR_LOG(log_debug) << "Client::processMessage - sending a request outside of a dialog"  ;
-                bOK = m_controller.sendRequestOutsideDialog( shared_from_this(), tokens[0], startLine, headers, body, transactionId, dialogId, routeUrl ) ;
+                bOK = m_controller.sendRequestOutsideDialog( shared_from_this(), clientMsgId, startLine, headerIndex, body, transactionId, dialogId, routeUrl ) ;
              }
 
              return true ;
         }
         else if( 0 == tokens[1].compare("proxy") ) {
-            DR_LOG(log_debug) << "Client::processMessage - received proxy request " << boost::algorithm::join(tokens, ",");
+            DR_LOG(log_debug) << "Client::processMessage - received proxy request " << meta;
             if( tokens.size() < 4 ) {
-                DR_LOG(log_error) << "Invalid proxy request: insufficient tokens: '" <<  boost::algorithm::join(tokens, ",") ;
+                DR_LOG(log_error) << "Invalid proxy request: insufficient tokens: '" <<  meta ;
                 createResponseMsg( tokens[0], msgResponse, false, "Invalid proxy request: not enough information provided" ) ;
                 return false ;             
             }
-            string transactionId = tokens[2] ;
+            string clientMsgId( tokens[0] ), transactionId( tokens[2] ) ;
             bool recordRoute = 0 == tokens[3].compare("remainInDialog") ;
             bool fullResponse = 0 == tokens[4].compare("fullResponse") ;
             bool followRedirects = 0 == tokens[5].compare("followRedirects") ;
             bool simultaneous = 0 == tokens[6].compare("simultaneous") ;
-            string provisionalTimeout = tokens[7] ;
-            string finalTimeout = tokens[8]; 
+            string provisionalTimeout( tokens[7] ) ;
+            string finalTimeout( tokens[8] ); 
             vector<string> vecDestinations( tokens.begin() + 9, tokens.end() ) ;
-            m_controller.proxyRequest( shared_from_this(), tokens[0], transactionId, recordRoute, fullResponse, followRedirects, 
-                simultaneous, provisionalTimeout, finalTimeout, vecDestinations, headers ) ;
+            m_controller.proxyRequest( shared_from_this(), clientMsgId, transactionId, recordRoute, fullResponse, followRedirects, 
+                simultaneous, provisionalTimeout, finalTimeout, vecDestinations, HeaderIndex( headers ) ) ;
             return true ;
         }
         else {
@@ -257,50 +343,85 @@ namespace drachtio {
         return true ;
     }
 
-    bool BaseClient::readMessageLength(unsigned int& len) {
-        bool continueOn = true ;
-        std::array<char, 6> ch ;
-        memset( ch.data(), 0, sizeof(ch)) ;
-        unsigned int i = 0 ;
-        char c ;
-        do {
-            c = m_buffer.front() ;
-            m_buffer.pop_front() ;
+    bool BaseClient::nextFrame( std::string_view& frame ) {
+        const char* p = m_buffer.data() + m_nReadPos ;
+        size_t avail = m_nWritePos - m_nReadPos ;
+        size_t len = 0 ;
+        size_t i = 0 ;
+
+        for( ; i < avail; i++ ) {
+            char c = p[i] ;
             if ('#' == c) break ;
-            if (!isdigit(c)) throw std::runtime_error("Client::readMessageLength - invalid message length specifier") ;
-            ch[i++] = c ;
-        } while(m_buffer.size() && i < 6) ;
-
-        if (6 == i) throw std::runtime_error("Client::readMessageLength - invalid message length specifier") ;
-
-        if (0 == m_buffer.size()) {
-            if('#' != c) {
-                /* the message was split in the middle of the length specifier - put them back for next time to be read in full once remainder come in */
-                for( unsigned int n = 0; n < i; n++ ) m_buffer.push_back( ch[n] ) ;
-                len = 0 ;
-                return false ;
-            }
-            continueOn = false ;
+            if (!isdigit(c) || 5 == i) throw std::runtime_error("Client::nextFrame - invalid message length specifier") ;
+            len = len * 10 + (c - '0') ;
         }
 
-        len = boost::lexical_cast<unsigned int>(ch.data()); 
-        return continueOn ;
+        /* the message was split in the middle of the length specifier - it will be parsed again once the remainder comes in */
+        if (i == avail) return false ;
+
+        if (0 == i || 0 == len) throw std::runtime_error("Client::nextFrame - invalid message length specifier") ;
+
+        if (avail - i - 1 < len) return false ;
+
+        frame = std::string_view( p + i + 1, len ) ;
+        m_nReadPos += i + 1 + len ;
+        return true ;
     }
 
+    boost::asio::mutable_buffer BaseClient::prepareReadBuffer(void) {
+        if (m_nReadPos == m_nWritePos) {
+            m_nReadPos = m_nWritePos = 0 ;
+        }
+        else if (m_nReadPos > 0 && m_buffer.size() - m_nWritePos < READ_CHUNK_SIZE) {
+            /* slide the partial message to the front of the buffer */
+            memmove( m_buffer.data(), m_buffer.data() + m_nReadPos, m_nWritePos - m_nReadPos ) ;
+            m_nWritePos -= m_nReadPos ;
+            m_nReadPos = 0 ;
+        }
+        if (m_buffer.size() - m_nWritePos < READ_CHUNK_SIZE) {
+            m_buffer.resize( std::max( m_buffer.size() * 2, m_nWritePos + READ_CHUNK_SIZE ) ) ;
+        }
+        return boost::asio::buffer( m_buffer.data() + m_nWritePos, m_buffer.size() - m_nWritePos ) ;
+    }
 
-    void BaseClient::sendSipMessageToClient( const string& transactionId, const string& dialogId, const string& rawSipMsg, const SipMsgData_t& meta ) {
-        string strUuid, s ;
-        generateUuid( strUuid ) ;
-        meta.toMessageFormat(s) ;
 
-        send(strUuid + "|sip|" + s + "|" + transactionId + "|" + dialogId + "|" + DR_CRLF + rawSipMsg) ;
+    void BaseClient::sendSipMessageToClient( const string& transactionId, const string& dialogId, const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta ) {
+        if (m_bBinaryFraming) {
+            queueSipFrame( transactionId, dialogId, rawSipMsg, meta, false ) ;
+            flushIfIdle() ;
+            return ;
+        }
+
+        string strMsg ;
+        generateUuid( strMsg ) ;
+        strMsg.reserve( strMsg.length() + 128 + transactionId.length() + dialogId.length() ) ;
+        strMsg += "|sip|" ;
+        meta.appendMessageFormat( strMsg ) ;
+        strMsg += "|" ;
+        strMsg += transactionId ;
+        strMsg += "|" ;
+        strMsg += dialogId ;
+        strMsg += "|" ;
+        strMsg += DR_CRLF ;
+
+        if( queueFrame( strMsg, rawSipMsg ) ) flushIfIdle() ;
     }
 
-    void BaseClient::sendSipMessageToClient( const string& transactionId, const string& rawSipMsg, const SipMsgData_t& meta ) {
-        string strUuid, s ;
-        generateUuid( strUuid ) ;
-        meta.toMessageFormat(s) ;
-        string strMsg = strUuid + "|sip|" + s + "|" + transactionId + "||" ;
+    void BaseClient::sendSipMessageToClient( const string& transactionId, const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta ) {
+        if (m_bBinaryFraming) {
+            queueSipFrame( transactionId, "", rawSipMsg, meta, true ) ;
+            flushIfIdle() ;
+            return ;
+        }
+
+        string strMsg ;
+        generateUuid( strMsg ) ;
+        strMsg.reserve( strMsg.length() + 128 + transactionId.length() + meta.getDestAddress().length() ) ;
+        strMsg += "|sip|" ;
+        meta.appendMessageFormat( strMsg ) ;
+        strMsg += "|" ;
+        strMsg += transactionId ;
+        strMsg += "||" ;
         if (meta.getDestAddress().length() > 0) {
             strMsg += meta.getDestAddress();
             strMsg += "|";
@@ -308,17 +429,18 @@ namespace drachtio {
             strMsg += "|";
         }
         strMsg += DR_CRLF;
-        strMsg += rawSipMsg;
 
-        //send(strUuid + "|sip|" + s + "|" + transactionId + "||" + DR_CRLF + rawSipMsg) ;
-        send(strMsg) ;
+        if( queueFrame( strMsg, rawSipMsg ) ) flushIfIdle() ;
     }
 
-    void BaseClient::sendCdrToClient( const string& rawSipMsg, const string& meta ) {
-        string strUuid, s ;
-        generateUuid( strUuid ) ;
+    void BaseClient::sendCdrToClient( const encoded_msg_ptr& rawSipMsg, const string& meta ) {
+        string strMsg ;
+        generateUuid( strMsg ) ;
+        strMsg += "|" ;
+        strMsg += meta ;
+        strMsg += DR_CRLF ;
 
-        send(strUuid + "|" + meta + DR_CRLF + rawSipMsg) ;
+        if( queueFrame( strMsg, rawSipMsg ) ) flushIfIdle() ;
     }
 
     void BaseClient::sendApiResponseToClient( const string& clientMsgId, const string& responseText, const string& additionalResponseText ) {
@@ -333,10 +455,124 @@ namespace drachtio {
         send(msg) ;
     }
 
-    void BaseClient::createResponseMsg(const string& msgId, string& msg, bool ok, const char* szReason ) {
-        string strUuid ;
-        generateUuid( strUuid ) ;
-        msg = strUuid + "|response|" + msgId + "|" ;
+    void BaseClient::post( AppMessage&& msg ) {
+        if( m_inbox.push( std::move( msg ) ) ) {
+            boost::asio::post( m_strand, std::bind( &BaseClient::drainInbox, shared_from_this() ) ) ;
+        }
+    }
+
+    void BaseClient::drainInbox(void) {
+        std::chrono::steady_clock::time_point oldest = std::chrono::steady_clock::time_point::max() ;
+
+        /* queue the whole batch before writing any of it */
+        m_bHoldWrites = true ;
+        size_t count = m_inbox.drain( [this, &oldest](AppMessage&& msg, std::chrono::steady_clock::time_point enqueued) {
+            oldest = std::min( oldest, enqueued ) ;
+            switch( msg.m_kind ) {
+                case AppMessage::sip_message:
+                    sendSipMessageToClient( msg.m_id, msg.m_text, msg.m_msg, msg.m_meta ) ;
+                    break ;
+                case AppMessage::sip_message_with_destination:
+                    sendSipMessageToClient( msg.m_id, msg.m_msg, msg.m_meta ) ;
+                    break ;
+                case AppMessage::cdr:
+                    sendCdrToClient( msg.m_msg, msg.m_text ) ;
+                    break ;
+                case AppMessage::api_response:
+                    sendApiResponseToClient( msg.m_id, msg.m_text, msg.m_extra ) ;
+                    break ;
+            }
+        }) ;
+        m_bHoldWrites = false ;
+        flushIfIdle() ;
+
+        if( 0 == count ) return ;
+        STATS_HISTOGRAM_OBSERVE(STATS_HISTOGRAM_HANDOFF_BATCH_SIZE, count, {{"direction", "to_app"}})
+        STATS_HISTOGRAM_OBSERVE(STATS_HISTOGRAM_HANDOFF_LATENCY, 
+            std::chrono::duration<double>( std::chrono::steady_clock::now() - oldest ).count(), {{"direction", "to_app"}})
+    }
+
+    void BaseClient::flushIfIdle(void) {
+        if( !m_bHoldWrites && !m_bWriteInProgress && !m_outQueue.empty() ) flush() ;
+    }
+
+    bool BaseClient::queueFrame( const string& str, const encoded_msg_ptr& body ) {
+        size_t len = str.length() + (body ? body->length() : 0) ;
+
+        if (0 == len) {
+            DR_LOG(log_info) << "Client::send - we are unable to send this message back to client" << str; 
+            return false;
+        }
+
+        auto frame = std::make_shared<string>() ;
+        if (m_bBinaryFraming) {
+            frame->reserve( BINARY_FRAME_PREFIX_SIZE + str.length() ) ;
+            appendUint32( *frame, len + 1 ) ;
+            frame->push_back( (char) binary_frame_text ) ;
+        }
+        else {
+            string strLen = std::to_string(len) ;
+            frame->reserve( strLen.length() + 1 + str.length() ) ;
+            frame->append( strLen ) ;
+            frame->append( "#" ) ;
+        }
+        frame->append( str ) ;
+        DR_LOG(log_debug) << "Sending: " << str << (body ? std::string_view( *body ) : std::string_view()) << endl ;
+
+        m_outQueue.push_back( Frame{ frame, body } ) ;
+        return true ;
+    }
+
+    void BaseClient::queueSipFrame( const string& transactionId, const string& dialogId, const encoded_msg_ptr& rawSipMsg, 
+        const SipMsgData_t& meta, bool bIncludeDest ) {
+        const string* pDestAddress = bIncludeDest ? &meta.getDestAddress() : NULL ;
+        size_t len = 1 + BINARY_SIP_HEADER_SIZE + transactionId.length() + dialogId.length() + rawSipMsg->length() ;
+        auto frame = std::make_shared<string>() ;
+        frame->reserve( 4 + len - rawSipMsg->length() ) ;
+
+        appendUint32( *frame, len ) ;
+        frame->push_back( (char) binary_frame_sip ) ;
+        appendUint64( *frame, ++m_nMsgSeq ) ;
+        frame->push_back( (char) (meta.isFromApplication() ? 1 : 0) ) ;
+        frame->push_back( (char) meta.getProtocolType() ) ;
+        frame->push_back( (char) meta.getAddressFamily() ) ;
+        frame->append( (const char *) meta.getAddressBytes(), 16 ) ;
+        appendUint16( *frame, meta.getPortNumber() ) ;
+        appendUint64( *frame, meta.getTimestamp() ) ;
+        appendUint32( *frame, meta.getSize() ) ;
+        appendAddress( *frame, pDestAddress ? *pDestAddress : string() ) ;
+        appendUint16( *frame, pDestAddress ? ::atoi( meta.getDestPort().c_str() ) : 0 ) ;
+        appendUint16( *frame, transactionId.length() ) ;
+        appendUint16( *frame, dialogId.length() ) ;
+        assert( frame->length() == BINARY_FRAME_PREFIX_SIZE + BINARY_SIP_HEADER_SIZE ) ;
+
+        frame->append( transactionId ) ;
+        frame->append( dialogId ) ;
+
+        DR_LOG(log_debug) << "Sending sip frame, transaction id " << transactionId << ", dialog id " << dialogId << ": " << *rawSipMsg << endl ;
+        m_outQueue.push_back( Frame{ frame, rawSipMsg } ) ;
+    }
+
+    void BaseClient::takeQueuedFrames( std::vector<boost::asio::const_buffer>& buffers, size_t maxFrames ) {
+        size_t count = std::min( maxFrames, m_outQueue.size() ) ;
+        buffers.reserve( 2 * count ) ;
+        m_framesInFlight.reserve( count ) ;
+        while( count-- > 0 ) {
+            const Frame& frame = m_outQueue.front() ;
+            buffers.push_back( boost::asio::buffer( *frame.m_header ) ) ;
+            if( frame.m_body && !frame.m_body->empty() ) buffers.push_back( boost::asio::buffer( *frame.m_body ) ) ;
+            m_framesInFlight.push_back( std::move( m_outQueue.front() ) ) ;
+            m_outQueue.pop_front() ;
+        }
+
+        STATS_HISTOGRAM_OBSERVE(STATS_HISTOGRAM_APP_WRITE_QUEUE_DEPTH, m_framesInFlight.size())
+    }
+
+    void BaseClient::createResponseMsg(std::string_view msgId, string& msg, bool ok, const char* szReason ) {
+        generateUuid( msg ) ;
+        msg.append( "|response|" ) ;
+        msg.append( msgId ) ;
+        msg.append( "|" ) ;
         msg.append( ok ? "OK" : "NO") ;
         if( szReason ) {
             msg.append("|") ;
@@ -355,119 +591,117 @@ namespace drachtio {
             return ;
         }
 
-        //DR_LOG(log_debug) << "Client::read_handler read raw message of " << bytes_transferred << " bytes: " << std::string(m_readBuf.begin(), m_readBuf.begin() + bytes_transferred) << endl ;
 
-        /* append the data to our in-process buffer */
-        m_buffer.insert( m_buffer.end(), m_readBuf.begin(),  m_readBuf.begin() + bytes_transferred ) ;
+        m_nWritePos += bytes_transferred ;
 
-        /* if we're starting a new message, parse the message length */
-        if( 0 == m_nMessageLength ) {
+        /* while we have at least one full message, process it */
+        while( true ) {
+            std::string_view in ;
+            string msgResponse ;
+            bool bContinue = true ;
 
             try {
-                if( !readMessageLength( m_nMessageLength ) ) {
-                    DR_LOG(log_debug) << "Client::read_handler - message was split after message length of " << m_nMessageLength  ;                     
-                    goto read_again ;
-                }
+                if( !nextFrame( in ) ) break ;
             }
             catch( std::runtime_error& err ) {
-                DR_LOG(log_error) << "Client::read_handler client sent invalid message -- JSON message length not specified properly"  ;                     
+                DR_LOG(log_error) << "Client::read_handler client sent invalid message -- message length not specified properly"  ;                     
                 m_controller.leave( shared_from_this() ) ;               
                 return ;
             }
-        }
 
-        /* while we have at least one full message, process it */
-        while( m_buffer.size() >= m_nMessageLength && m_nMessageLength > 0 ) {
-            string msgResponse ;
-            string in ;
-            bool bContinue = true ;
             try {
-                in.assign(m_buffer.begin(), m_buffer.begin() + m_nMessageLength);
                 DR_LOG(log_debug) << "Client::read_handler read: " << in << endl ;
                 bContinue = processClientMessage( in, msgResponse ) ;
             } catch( std::runtime_error& err ) {
-                DR_LOG(log_error) << "Client::read_handler - Error processing client message: " << std::string( m_buffer.begin(), m_buffer.begin() + m_nMessageLength ) << " : " << err.what()  ;
+                DR_LOG(log_error) << "Client::read_handler - Error processing client message: " << in << " : " << err.what()  ;
                 m_controller.leave( shared_from_this() ) ;
                 return ;
             }
 
-            /* send response if indicated */
+            /* queue response if indicated; everything queued from this read goes out in one write below */
             if( !msgResponse.empty() ) {
-                int len = std::size(msgResponse);
-                auto forthelifeofsend = std::make_shared<std::string>(
-                    std::to_string(len) + std::string("#") + msgResponse
-                );
-
-                auto self(shared_from_this());
-                DR_LOG(log_debug) << "Sending response: " << *forthelifeofsend << endl ;
-                boost::asio::async_write( m_sock, boost::asio::buffer( *forthelifeofsend ), 
-                    [self, forthelifeofsend](const boost::system::error_code& ec, std::size_t bytes_transferred) {
-                        DR_LOG(log_debug) << "Client::read_handler - wrote " << bytes_transferred << " bytes: " << ec  ;
-                    } );
+                queueFrame( msgResponse ) ;
             }
             if( !bContinue ) {
                  DR_LOG(log_error) << "Client::read_handler - disconnecting client due to error processing client message" ;
+                if( !m_outQueue.empty() && !m_bWriteInProgress ) flush() ;
                 m_controller.leave( shared_from_this() ) ;
                 return ;
             }
 
-            if( this->isOutbound() && string::npos != in.find("|authenticate|")) {
-              m_controller.outboundReady( shared_from_this(), m_transactionId ) ;
-            }
-
-
-            /* reload for next message */
-            m_buffer.erase_begin( m_nMessageLength ) ;
-            if( m_buffer.size() ) {
-                DR_LOG(log_debug) << "Client::read_handler processing follow-on message in read buffer, remaining bytes to process: " << m_buffer.size()  ;
-                try {
-                    if( !readMessageLength( m_nMessageLength ) ) {
-                        DR_LOG(log_debug) << "Client::read_handler - message was split after message length of " << m_nMessageLength  ;                     
-                        break ;
-                    }
-                }
-                catch( std::runtime_error& err ) {
-                    DR_LOG(log_error) << "Client::read_handler client sent invalid message -- message length not specified properly"  ;                     
-                    m_controller.leave( shared_from_this() ) ;               
-                    return ;
-                }
-                DR_LOG(log_debug) << "Client::read_handler follow-on message length of " << m_nMessageLength << " bytes "  ; 
-            }
-            else {
-                m_nMessageLength = 0 ;
+            if( this->isOutbound() && std::string_view::npos != in.find("|authenticate|")) {
+              m_controller.outboundReady( shared_from_this() ) ;
             }
         }
 
-read_again:
-        m_sock.async_read_some(boost::asio::buffer(m_readBuf),
-            std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ;
+        if( !m_outQueue.empty() && !m_bWriteInProgress ) flush() ;
+
+        m_sock.async_read_some(prepareReadBuffer(),
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
        
     }
 
     template<typename T, typename S>
     void Client<T,S>::write_handler( const boost::system::error_code& ec, std::size_t bytes_transferred ) {
-        DR_LOG(log_debug) << "Client::write_handler - wrote " << bytes_transferred << " bytes: " << ec  ;
+        DR_LOG(log_debug) << "Client::write_handler - wrote " << bytes_transferred << " bytes in " << m_framesInFlight.size() << " frames: " << ec  ;
+
+        m_framesInFlight.clear() ;
+        m_bWriteInProgress = false ;
+
+        if( ec ) {
+            /* the read side will notice the connection is gone and remove us; anything still queued is lost */
+            DR_LOG(log_info) << "Client::write_handler - error writing to client, discarding " << m_outQueue.size() << " queued messages: " << ec.message() ;
+            m_outQueue.clear() ;
+            return ;
+        }
+
+        STATS_HISTOGRAM_OBSERVE(STATS_HISTOGRAM_APP_WRITE_FLUSH_BYTES, bytes_transferred)
+
+        if( !m_outQueue.empty() ) flush() ;
     }
 
     template<typename T, typename S>
-    void Client<T,S>::send( const string& str ) {
-        int len = std::size(str);
+    void Client<T,S>::flush() {
+        assert( !m_bWriteInProgress ) ;
 
-        if (0 == len) {
-            DR_LOG(log_info) << "Client::send - we are unable to send this message back to client" << str; 
-            return;
+        std::vector<boost::asio::const_buffer> buffers ;
+        takeQueuedFrames( buffers ) ;
+
+        m_bWriteInProgress = true ;
+        boost::asio::async_write( m_sock, buffers, 
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::write_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
+    }
+
+    template<typename T, typename S>
+    void Client<T,S>::async_connect() {
+        tcp::resolver::results_type results ;
+        if( m_controller.findCachedEndpoints( m_host, m_port, results ) ) {
+            DR_LOG(log_debug) << "Client::async_connect - using cached addresses for " << m_host << ":" << m_port ;
+            resolve_handler( boost::system::error_code(), results ) ;
+            return ;
         }
 
-        auto forthelifeofsend = std::make_shared<std::string>(
-            std::to_string(len) + std::string("#") + str
-        );
+        /* resolution runs in the background so a slow dns server does not hold up the io threads */
+        m_resolver.async_resolve( m_host, m_port,
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::resolve_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
+    }
+
+    template<typename T, typename S>
+    void Client<T,S>::resolve_handler( const boost::system::error_code& ec, tcp::resolver::results_type results ) {
+        if( ec || results.empty() ) {
+            DR_LOG(log_warning) << "Client::resolve_handler - unable to resolve " << m_host << ":" << m_port << ": " << ec.message() ;
+            m_controller.outboundFailed( shared_from_this() ) ;
+            return ;
+        }
+        m_controller.cacheEndpoints( m_host, m_port, results ) ;
 
-        auto self(shared_from_this());
-        DR_LOG(log_debug) << "Sending: " << *forthelifeofsend << endl ;
-        boost::asio::async_write( m_sock, boost::asio::buffer( *forthelifeofsend ), 
-            [self, forthelifeofsend](const boost::system::error_code& ec, std::size_t bytes_transferred) {
-                DR_LOG(log_debug) << "Client::send - wrote " << bytes_transferred << " bytes: " << ec  ;
-            } );
+        boost::asio::async_connect( m_sock.lowest_layer(), results, 
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
+    }
+
+    template<typename T, typename S>
+    void Client<T,S>::send( const string& str ) {
+        if( queueFrame( str ) ) flushIfIdle() ;
     }
 
     // Client (member function specializations for plain tcp connections)
@@ -475,15 +709,15 @@ read_again:
     template<>
     Client<socket_t>::Client(boost::asio::io_context& io_context, ClientController& controller) :
         BaseClient(controller),
-        m_sock(io_context) {
+        m_sock(io_context), m_resolver(io_context) {
     }
 
     template<>
     Client<socket_t>::Client( boost::asio::io_context& io_context, ClientController& controller,
-        const string& transactionId, const string& host, 
+        const string& outboundKey, const string& host, 
         const string& port ) :
-        BaseClient(controller, transactionId, host, port),
-        m_sock(io_context) {
+        BaseClient(controller, outboundKey, host, port),
+        m_sock(io_context), m_resolver(io_context) {
 
     }
 
@@ -498,23 +732,15 @@ read_again:
         setTcpKeepAlive(m_sock.native_handle());
 
         m_controller.join( shared_from_this() ) ;
-        m_sock.async_read_some(boost::asio::buffer(m_readBuf),
-            std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ;
-    }
-
-    template<>
-    void Client<socket_t>::async_connect() {
-        boost::asio::ip::tcp::resolver::query query(m_host, m_port) ;
-        boost::asio::ip::tcp::resolver resolver(m_controller.getIOService());
-        tcp::resolver::iterator endpointIterator = resolver.resolve(query);
-        tcp::endpoint endpoint = *endpointIterator;
-
-        m_sock.async_connect(endpoint, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator));
+        m_sock.async_read_some(prepareReadBuffer(),
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
     }
 
     template<>
-    void Client<socket_t>::connect_handler(const boost::system::error_code& ec, tcp::resolver::iterator endpointIterator) {
+    void Client<socket_t>::connect_handler(const boost::system::error_code& ec, const tcp::endpoint& endpoint) {
         if( !ec ) {
+            m_strRemoteAddress = endpoint.address().to_string() ;
+            m_nRemotePort = endpoint.port() ;
             DR_LOG(log_debug) << "Client::connect_handler tcp - successfully connected to " <<
             endpoint_address() << ":" << endpoint_port() ;
 
@@ -522,24 +748,17 @@ read_again:
 
         setTcpKeepAlive(m_sock.native_handle());
 
-        m_sock.async_read_some(boost::asio::buffer(m_readBuf),
-            std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, 
-            std::placeholders::_2 ) ) ;
+        m_sock.async_read_some(prepareReadBuffer(),
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, 
+            std::placeholders::_2 ) ) ) ;
 
         //TODO: set a timeout of 2 secs or so for remote side to authenticate
 
-        }
-        else if( endpointIterator != tcp::resolver::iterator() ) {
-            DR_LOG(log_debug) << "Client::connect_handler tcp - failed to connecte to " <<
-            endpoint_address() << ":" << endpoint_port() ;
-            m_sock.close() ;
-            tcp::endpoint endpoint = *endpointIterator;
-            m_sock.async_connect(endpoint, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator));
         }
         else {
-            // final failure
-            DR_LOG(log_warning) << "Client::connect_handler tcp - unable to connect to " << m_host << ":" << m_port ;
-            m_controller.outboundFailed(m_transactionId);
+            // final failure: every resolved address has been tried
+            DR_LOG(log_warning) << "Client::connect_handler tcp - unable to connect to " << m_host << ":" << m_port << ": " << ec.message() ;
+            m_controller.outboundFailed( shared_from_this() );
         }
     }
 
@@ -548,14 +767,14 @@ read_again:
     template<>
     Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>::Client(boost::asio::io_context& io_context, boost::asio::ssl::context& context, ClientController& controller) :
         BaseClient(controller),
-        m_sock(io_context, context) {
+        m_sock(io_context, context), m_resolver(io_context) {
     }
 
     template<>
     Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>::Client( boost::asio::io_context& io_context, boost::asio::ssl::context& context, ClientController& controller,
-        const string& transactionId, const string& host, const string& port ) :
-        BaseClient(controller, transactionId, host, port),
-        m_sock(io_context, context) {
+        const string& outboundKey, const string& host, const string& port ) :
+        BaseClient(controller, outboundKey, host, port),
+        m_sock(io_context, context), m_resolver(io_context) {
 
         m_sock.set_verify_mode(boost::asio::ssl::verify_none);
     }
@@ -569,40 +788,24 @@ read_again:
         setTcpKeepAlive(m_sock.lowest_layer().native_handle());
 
         m_sock.async_handshake(boost::asio::ssl::stream_base::server,
-            std::bind(&BaseClient::handle_handshake, shared_from_this(),
-            std::placeholders::_1));
+            boost::asio::bind_executor(m_strand, std::bind(&BaseClient::handle_handshake, shared_from_this(),
+            std::placeholders::_1)));
     }
 
     template<>
-    void Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>::async_connect() {
-        boost::asio::ip::tcp::resolver::query query(m_host, m_port) ;
-        boost::asio::ip::tcp::resolver resolver(m_controller.getIOService());
-        tcp::resolver::iterator endpointIterator = resolver.resolve(query);
-        tcp::endpoint endpoint = *endpointIterator;
-
-        m_sock.lowest_layer().async_connect(endpoint, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator));
-    }
-
-    template<>
-    void Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>::connect_handler(const boost::system::error_code& ec, tcp::resolver::iterator endpointIterator) {
+    void Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>::connect_handler(const boost::system::error_code& ec, const tcp::endpoint& endpoint) {
         if( !ec ) {
-            DR_LOG(log_debug) << "Client::connect_handler tls - successfully connected to " << m_sock.lowest_layer().remote_endpoint().address().to_string() << 
-                ":" << m_sock.lowest_layer().remote_endpoint().port() ;
+            m_strRemoteAddress = endpoint.address().to_string() ;
+            m_nRemotePort = endpoint.port() ;
+            DR_LOG(log_debug) << "Client::connect_handler tls - successfully connected to " << endpoint_address() << ":" << endpoint_port() ;
 
             m_controller.join( shared_from_this() ) ;
-            m_sock.async_handshake(boost::asio::ssl::stream_base::client, std::bind(&BaseClient::handle_handshake, shared_from_this(), std::placeholders::_1));
-        }
-        else if( endpointIterator != tcp::resolver::iterator() ) {
-            DR_LOG(log_debug) << "Client::connect_handler tls - failed to connect to "  << m_sock.lowest_layer().remote_endpoint().address().to_string() << 
-                ":" << m_sock.lowest_layer().remote_endpoint().port() ;
-            m_sock.lowest_layer().close() ;
-            tcp::endpoint endpoint = *endpointIterator;
-            m_sock.lowest_layer().async_connect(endpoint, std::bind(&BaseClient::connect_handler, shared_from_this(), std::placeholders::_1, ++endpointIterator));
+            m_sock.async_handshake(boost::asio::ssl::stream_base::client, boost::asio::bind_executor(m_strand, std::bind(&BaseClient::handle_handshake, shared_from_this(), std::placeholders::_1)));
         }
         else {
-            // final failure
-            DR_LOG(log_warning) << "Client::connect_handler tls - unable to connect to " << m_host << ":" << m_port ;
-            m_controller.outboundFailed(m_transactionId);
+            // final failure: every resolved address has been tried
+            DR_LOG(log_warning) << "Client::connect_handler tls - unable to connect to " << m_host << ":" << m_port << ": " << ec.message() ;
+            m_controller.outboundFailed( shared_from_this() );
         }
     }
 
@@ -610,8 +813,8 @@ read_again:
     void Client<ssl_socket_t, ssl_socket_t::lowest_layer_type>::handle_handshake(const boost::system::error_code& ec) {
         if (!ec) {
             DR_LOG(log_debug) << "Client::handle_handshake - TLS handshake succeeded ";
-            m_sock.async_read_some(boost::asio::buffer(m_readBuf),
-                std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ;
+            m_sock.async_read_some(prepareReadBuffer(),
+                boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
         }
         else {
             m_controller.leave( shared_from_this() ) ;
@@ -622,4 +825,126 @@ read_again:
     void Client<socket_t>::handle_handshake(const boost::system::error_code& ec) {
         assert(0);
     }
+
+    // Client (member function specializations for unix domain socket connections, which are only ever inbound)
+
+    template<>
+    Client<unix_socket_t>::Client(boost::asio::io_context& io_context, ClientController& controller) :
+        BaseClient(controller),
+        m_sock(io_context), m_resolver(io_context) {
+    }
+
+    template<>
+    void Client<unix_socket_t>::start() {
+        m_strRemoteAddress = "unix" ;
+        m_nRemotePort = 0 ;
+        m_bLocal = true ;
+
+        DR_LOG(log_debug) << "Client::start - Received connection from local client on unix socket" ;
+
+        m_controller.join( shared_from_this() ) ;
+        m_sock.async_read_some(prepareReadBuffer(),
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
+    }
+
+    template<>
+    void Client<unix_socket_t>::flush() {
+        assert( !m_bWriteInProgress ) ;
+
+        /* a frame carrying descriptors goes out on its own through sendmsg; anything queued ahead of it is written first */
+        size_t n = 0 ;
+        while( n < m_outQueue.size() && m_outQueue[n].m_fds.empty() ) n++ ;
+
+        size_t sent = 0 ;
+        if( 0 == n ) {
+            Frame& frame = m_outQueue.front() ;
+            struct iovec iov[2] ;
+            size_t niov = 0 ;
+            iov[niov].iov_base = const_cast<char*>( frame.m_header->data() ) ;
+            iov[niov++].iov_len = frame.m_header->length() ;
+            if( frame.m_body && !frame.m_body->empty() ) {
+                iov[niov].iov_base = const_cast<char*>( frame.m_body->data() ) ;
+                iov[niov++].iov_len = frame.m_body->length() ;
+            }
+            std::vector<char> control( CMSG_SPACE( sizeof(int) * frame.m_fds.size() ) ) ;
+            struct msghdr msg ;
+            memset( &msg, 0, sizeof(msg) ) ;
+            msg.msg_iov = iov ;
+            msg.msg_iovlen = niov ;
+            msg.msg_control = control.data() ;
+            msg.msg_controllen = control.size() ;
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR( &msg ) ;
+            cmsg->cmsg_level = SOL_SOCKET ;
+            cmsg->cmsg_type = SCM_RIGHTS ;
+            cmsg->cmsg_len = CMSG_LEN( sizeof(int) * frame.m_fds.size() ) ;
+            memcpy( CMSG_DATA( cmsg ), frame.m_fds.data(), sizeof(int) * frame.m_fds.size() ) ;
+
+            ssize_t rc = ::sendmsg( m_sock.native_handle(), &msg, MSG_DONTWAIT | MSG_NOSIGNAL ) ;
+            if( rc < 0 && (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) ) {
+
+                /* keep the frame, descriptors and all, at the head of the queue until the socket can take it */
+                std::shared_ptr<BaseClient> self = shared_from_this() ;
+                m_bWriteInProgress = true ;
+                m_sock.async_wait( boost::asio::socket_base::wait_write, boost::asio::bind_executor( m_strand, 
+                    [this, self]( const boost::system::error_code& ec ) {
+                        m_bWriteInProgress = false ;
+                        if( ec ) return ;
+                        flushIfIdle() ;
+                    } ) ) ;
+                return ;
+            }
+            if( rc < 0 ) {
+
+                /* the application will never get the descriptors, so the shared memory transport can not be used */
+                DR_LOG(log_error) << "Client::flush - unable to pass file descriptors to local client: " << strerror( errno ) ;
+                m_outQueue.pop_front() ;
+                std::shared_ptr<BaseClient> shm = detachSharedMemoryClient() ;
+                if( shm ) shm->close() ;
+                if( !m_outQueue.empty() ) flush() ;
+                return ;
+            }
+
+            /* the descriptors went with the first byte; the rest of the frame, and what follows it, is written as usual */
+            frame.m_fds.clear() ;
+            sent = rc ;
+            n = 1 ;
+            while( n < m_outQueue.size() && m_outQueue[n].m_fds.empty() ) n++ ;
+        }
+
+        std::vector<boost::asio::const_buffer> buffers ;
+        takeQueuedFrames( buffers, n ) ;
+        if( sent ) {
+            std::vector<boost::asio::const_buffer> remaining ;
+            for( const boost::asio::const_buffer& b : buffers ) {
+                if( sent >= b.size() ) {
+                    sent -= b.size() ;
+                    continue ;
+                }
+                remaining.push_back( b + sent ) ;
+                sent = 0 ;
+            }
+            buffers.swap( remaining ) ;
+        }
+
+        m_bWriteInProgress = true ;
+        boost::asio::async_write( m_sock, buffers, 
+            boost::asio::bind_executor( m_strand, std::bind( &BaseClient::write_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
+    }
+
+    template<>
+    void Client<unix_socket_t>::async_connect() {
+        assert(0);
+    }
+    template<>
+    void Client<unix_socket_t>::resolve_handler(const boost::system::error_code& ec, tcp::resolver::results_type results) {
+        assert(0);
+    }
+    template<>
+    void Client<unix_socket_t>::connect_handler(const boost::system::error_code& ec, const tcp::endpoint& endpoint) {
+        assert(0);
+    }
+    template<>
+    void Client<unix_socket_t>::handle_handshake(const boost::system::error_code& ec) {
+        assert(0);
+    }
 }
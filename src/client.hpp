@@ -24,12 +24,16 @@ THE SOFTWARE.
 
 #include <unordered_map>
 #include <unordered_set>
-#include <array>
+#include <deque>
+#include <vector>
+#include <string_view>
 #include <thread>
+#include <atomic>
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
-#include <boost/circular_buffer.hpp>
+
+#include "handoff-queue.hpp"
 
 #include <time.h>
 
@@ -37,76 +41,194 @@ namespace drachtio {
 
     typedef boost::asio::ip::tcp::socket socket_t;
     typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> ssl_socket_t;
+    typedef boost::asio::local::stream_protocol::socket unix_socket_t;
+    typedef boost::asio::strand<boost::asio::io_context::executor_type> strand_t;
 
 	class ClientController ;
 
 	class SipDialogController ;
 
+    /*
+     * Framing of messages we send to an application.
+     *
+     * By default every message is text, framed as "<length>#<message>".  An application may instead ask for
+     * binary framing by adding "binary" after the tags in its authenticate request; the authenticate response
+     * (still text framed) then ends with "|binary" and everything we send after it is framed as
+     *
+     *   u32 length of the remainder of the frame
+     *   u8  frame type (binary_frame_text or binary_frame_sip)
+     *
+     * A text frame carries one of the usual text messages.  A sip frame carries a fixed header followed by
+     * the transaction id, the dialog id and then the raw sip message, which runs to the end of the frame:
+     *
+     *   u64 message id (per connection sequence number)
+     *   u8  source (0 = network, 1 = application)
+     *   u8  transport (0 = unknown, 1 = udp, 2 = tcp, 3 = tls)
+     *   u8  address family (0 = none, 4 = ipv4, 6 = ipv6), then 16 bytes of address (ipv4 uses the first 4)
+     *   u16 port
+     *   u64 timestamp, microseconds since the unix epoch
+     *   u32 size of the sip message as received or sent
+     *   u8  destination address family, then 16 bytes of destination address
+     *   u16 destination port
+     *   u16 length of the transaction id
+     *   u16 length of the dialog id
+     *
+     * All integers are in network byte order.  Requests from the application are always text framed.
+     */
+    enum binary_frame_type {
+        binary_frame_text = 1,
+        binary_frame_sip = 2
+    } ;
+    #define BINARY_FRAME_PREFIX_SIZE (5)
+    #define BINARY_SIP_HEADER_SIZE (64)
+
+    // a message for an application, handed to its connection from another thread
+    struct AppMessage {
+        enum Kind {
+            sip_message,                    // sip message within a dialog
+            sip_message_with_destination,   // sip message outside a dialog, along with where it is going
+            cdr,
+            api_response
+        } ;
+
+        Kind m_kind ;
+        string m_id ;           // transaction id, or the id of the api request being answered
+        string m_text ;         // dialog id, response text, or cdr metadata
+        string m_extra ;        // additional response data
+        encoded_msg_ptr m_msg ;
+        SipMsgData_t m_meta ;
+    } ;
+
     class BaseClient : public enable_shared_from_this<BaseClient> {
     public:
         BaseClient(ClientController& controller);
         BaseClient(ClientController& controller, 
-            const string& transactionId, const string& host, const string& port);
+            const string& outboundKey, const string& host, const string& port);
         ~BaseClient();
 
         const string& endpoint_address() const { return m_strRemoteAddress;}
         const unsigned short endpoint_port() const { return m_nRemotePort;}
+
+        // all work for a connection, including messages posted from other threads, must run through its strand
+        strand_t& strand() { return m_strand; }
         
         virtual void start() = 0;
 
         virtual void async_connect() = 0;
-        virtual void connect_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator endpointIterator) = 0;
+        virtual void resolve_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results) = 0;
+        virtual void connect_handler(const boost::system::error_code& ec, const boost::asio::ip::tcp::endpoint& endpoint) = 0;
         virtual void read_handler( const boost::system::error_code& ec, std::size_t bytes_transferred ) = 0;
         virtual void write_handler( const boost::system::error_code& ec, std::size_t bytes_transferred ) = 0;
 
         virtual void handle_handshake(const boost::system::error_code& ec) = 0;
 
+        // socket connections close when the last reference goes; other transports may need to be told to stop
+        virtual void close() {}
+
+        // a shared memory transport set up over this connection, which must be closed along with it
+        std::shared_ptr<BaseClient> detachSharedMemoryClient(void) { 
+            std::shared_ptr<BaseClient> p = m_sharedMemoryClient ;
+            m_sharedMemoryClient.reset() ;
+            return p ;
+        }
 
-        bool processClientMessage( const string& msg, string& msgResponse ) ;
-        void sendSipMessageToClient( const string& transactionId, const string& dialogId, const string& rawSipMsg, const SipMsgData_t& meta ) ;
-        void sendSipMessageToClient( const string& transactionId, const string& rawSipMsg, const SipMsgData_t& meta ) ;
-        void sendCdrToClient( const string& rawSipMsg, const string& meta ) ;
+        bool processClientMessage( std::string_view msg, string& msgResponse ) ;
+        void sendSipMessageToClient( const string& transactionId, const string& dialogId, const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta ) ;
+        void sendSipMessageToClient( const string& transactionId, const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta ) ;
+        void sendCdrToClient( const encoded_msg_ptr& rawSipMsg, const string& meta ) ;
         void sendApiResponseToClient( const string& clientMsgId, const string& responseText, const string& additionalResponseText ) ;
 
+        // any thread: queue a message for the application; whatever has arrived by the time our strand picks it up goes out in one write
+        void post( AppMessage&& msg ) ;
+
         bool getAppName( string& strAppName ) { strAppName = m_strAppName; return !strAppName.empty(); }
-        bool isOutbound(void) const { return !m_transactionId.empty(); }
+        bool isOutbound(void) const { return !m_outboundKey.empty(); }
+        const string& getOutboundKey(void) const { return m_outboundKey; }
         bool hasTag(const char* tag) const { return m_tags.find(tag) != m_tags.end(); }
+        const std::unordered_set<string>& getTags(void) const { return m_tags; }
 
         int getConnectionDuration(void) const { 
             return time(NULL) - m_tConnect; 
         }
+
+        // load information used to choose among clients that want the same request type
+        void transactionStarted(void) { m_nOutstanding++; }
+        void transactionEnded(void) { m_nOutstanding--; }
+        int getOutstandingTransactions(void) const { return m_nOutstanding; }
+        void observeResponseLatency( uint64_t usecs ) ;
+        uint64_t getResponseLatency(void) const { return m_nLatencyEwma; }
     protected:
         virtual void send( const string& str ) = 0 ;  
+        virtual void flush(void) = 0 ;
 
         enum state {
             initial = 0,
             authenticated,
         } ;
     
-        bool readMessageLength( unsigned int& len ) ;
-        void createResponseMsg( const string& msgId, string& msg, bool ok = true, const char* szReason = NULL ) ;
+        bool nextFrame( std::string_view& frame ) ;
+        boost::asio::mutable_buffer prepareReadBuffer(void) ;
+        void createResponseMsg( std::string_view msgId, string& msg, bool ok = true, const char* szReason = NULL ) ;
         std::shared_ptr<SipDialogController> getDialogController(void);
 
+        // frame a message, optionally followed by a sip message, and add it to the outbound queue; returns false if nothing was queued
+        bool queueFrame( const string& str, const encoded_msg_ptr& body = encoded_msg_ptr() ) ;
+        void takeQueuedFrames( std::vector<boost::asio::const_buffer>& buffers, size_t maxFrames = SIZE_MAX ) ;
+        void queueSipFrame( const string& transactionId, const string& dialogId, const encoded_msg_ptr& rawSipMsg, const SipMsgData_t& meta, bool bIncludeDest ) ;
+        void flushIfIdle(void) ;
+        void drainInbox(void) ;
+
         ClientController& m_controller ;
+        strand_t m_strand ;
         state m_state ;
 
-        std::array<char, 8192> m_readBuf ;
-        boost::circular_buffer<char> m_buffer ;
-        unsigned int m_nMessageLength ;
+        // contiguous receive buffer; bytes in [m_nReadPos, m_nWritePos) have been read but not yet consumed
+        std::vector<char> m_buffer ;
+        size_t m_nReadPos ;
+        size_t m_nWritePos ;
         string m_strAppName ;
 
         typedef std::unordered_set<string> set_of_tags ;
         set_of_tags m_tags;
 
-        // outbound connections
-        string m_transactionId ;
+        // outbound connections, pooled by host:port;transport
+        string m_outboundKey ;
         string m_host ;
         string m_port ;
 
         string m_strRemoteAddress;
         unsigned int m_nRemotePort;
 
+        // connected over our unix domain socket, where the permissions on the socket file stand in for the secret
+        bool m_bLocal ;
+        std::shared_ptr<BaseClient> m_sharedMemoryClient ;
+
         time_t m_tConnect ;
+
+        // outbound frames: only one write is in flight at a time, and it carries everything queued when it started
+        struct Frame {
+            std::shared_ptr<const string> m_header ;    // length prefix and the text of the message
+            encoded_msg_ptr m_body ;                    // sip message that follows, if any; never copied into the frame
+            std::vector<int> m_fds ;                    // descriptors that must arrive with this frame (unix domain sockets only)
+
+            size_t length() const { return m_header->length() + (m_body ? m_body->length() : 0); }
+        } ;
+        typedef std::deque<Frame> queue_of_frames ;
+        queue_of_frames m_outQueue ;
+        std::vector<Frame> m_framesInFlight ;
+        bool m_bWriteInProgress ;
+
+        // messages posted from other threads, and whether we are in the middle of queueing a batch of them
+        HandoffQueue<AppMessage> m_inbox ;
+        bool m_bHoldWrites ;
+
+        // sip transactions in progress, and moving average of the time taken to answer a request (usecs)
+        std::atomic<int> m_nOutstanding ;
+        std::atomic<uint64_t> m_nLatencyEwma ;
+
+        // set once the application has negotiated binary framing in its authenticate request
+        bool m_bBinaryFraming ;
+        uint64_t m_nMsgSeq ;
     };
 
 	template <typename T, typename S = T> 
@@ -115,16 +237,17 @@ namespace drachtio {
 
         Client(boost::asio::io_context& io_context, ClientController& controller);
         Client(boost::asio::io_context& io_context, ClientController& controller, 
-            const string& transactionId, const string& host, const string& port);
+            const string& outboundKey, const string& host, const string& port);
 
         Client(boost::asio::io_context& io_context, boost::asio::ssl::context& context, ClientController& controller) ;
         Client(boost::asio::io_context& io_context, boost::asio::ssl::context& context,  ClientController& controller, 
-            const string& transactionId, const string& host, const string& port);
+            const string& outboundKey, const string& host, const string& port);
        
         ~Client() {}
 
         void async_connect();
-        void connect_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator endpointIterator);
+        void resolve_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results);
+        void connect_handler(const boost::system::error_code& ec, const boost::asio::ip::tcp::endpoint& endpoint);
         void read_handler( const boost::system::error_code& ec, std::size_t bytes_transferred );
         void write_handler( const boost::system::error_code& ec, std::size_t bytes_transferred );
 
@@ -136,8 +259,10 @@ namespace drachtio {
 
     protected:
         void send( const string& str );  
+        void flush(void) ;
 
         T m_sock;
+        boost::asio::ip::tcp::resolver m_resolver;
 
     private:
         Client();  // prohibited
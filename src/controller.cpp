@@ -27,7 +27,6 @@ THE SOFTWARE.
 #include <pwd.h>
 #include <algorithm>
 #include <functional>
-#include <regex>
 #include <cstdlib>
 
 #include <prometheus/exposer.h>
@@ -96,6 +95,7 @@ namespace drachtio {
 
 #include "cdr.hpp"
 #include "controller.hpp"
+#include "sip-scanners.hpp"
 
 /* clone static functions, used to post a message into the main su event loop from the worker client controller thread */
 namespace {
@@ -115,6 +115,13 @@ namespace {
     void watchdogTimerHandler(su_root_magic_t *p, su_timer_t *timer, su_timer_arg_t *arg) {
         theOneAndOnlyController->processWatchdogTimer() ;
     }
+    void cloneDrainStackWork(su_root_magic_t* p, su_msg_r msg, void* arg ) {
+        drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
+        pController->drainStackWork() ;
+    }
+    void stackWorkRetryTimerHandler(su_root_magic_t *p, su_timer_t *timer, su_timer_arg_t *arg) {
+        theOneAndOnlyController->retryStackWork() ;
+    }
             
 	/* sofia logging is redirected to this function */
 	static void __sofiasip_logger_func(void *logarg, char const *fmt, va_list ap) {
@@ -123,43 +130,48 @@ namespace {
         static bool sourceIsBlacklisted = false;
         static std::shared_ptr<drachtio::StackMsg> msg ;
 
+        /* 
+          everything the stack logs, including the dump of each message sent or received, is only ever logged at info level;
+          below that there is nothing here worth the cost of formatting it 
+        */
+        if( !theOneAndOnlyController->isCapturingStackMessages() ) {
+            loggingSipMsg = false ;
+            msg.reset() ;
+            va_end(ap) ;
+            return ;
+        }
+
         char output[MAXLOGLEN+1] ;
         vsnprintf( output, MAXLOGLEN, fmt, ap ) ;
         va_end(ap) ;
 
         if( loggingSipMsg ) {
             loggingSipMsg = NULL == ::strstr( fmt, MSG_SEPARATOR) ;
-            msg->appendLine( output, !loggingSipMsg ) ;
+            if( !sourceIsBlacklisted ) msg->appendLine( output, !loggingSipMsg ) ;
 
             if( !loggingSipMsg ) {
-                //DR_LOG(drachtio::log_debug) << "Completed logging sip message"  ;
-                if (!sourceIsBlacklisted) {
-                    DR_LOG( drachtio::log_info ) << msg->getFirstLine()  << msg->getSipMessage() <<  " " ;            
-
-                    msg->isIncoming() 
-                    ? theOneAndOnlyController->setLastRecvStackMessage( msg ) 
-                    : theOneAndOnlyController->setLastSentStackMessage( msg ) ;
-                }
+                if (!sourceIsBlacklisted) theOneAndOnlyController->captureStackMessage( msg ) ;
+                msg.reset() ;
                 sourceIsBlacklisted = false;
             }
         }
-        else if( ::strstr( output, "recv ") == output || ::strstr( output, "send ") == output ) {
+        else if( ::strncmp( output, "recv ", 5 ) == 0 || ::strncmp( output, "send ", 5 ) == 0 ) {
             drachtio::Blacklist* pBlacklist;
             loggingSipMsg = true ;
-            //DR_LOG(drachtio::log_debug) << "started logging sip message: " << output  ;
 
+            /* the remote address is the first thing in square brackets */
             if ((pBlacklist = theOneAndOnlyController->getBlacklist())) {
-                std::string header(output);
-                std::regex re("\\[(.*)\\]");
-                std::smatch mr;
-                if (std::regex_search(header, mr, re) && mr.size() > 1) {
-                    std::string host = mr[1] ;
+                char* szStart = ::strchr( output, '[' ) ;
+                char* szEnd = szStart ? ::strchr( szStart + 1, ']' ) : NULL ;
+                if( szEnd ) {
+                    std::string host( szStart + 1, szEnd - szStart - 1 ) ;
                     if (pBlacklist->isBlackListed(host.c_str())) {
                         sourceIsBlacklisted = true;
                         DR_LOG(drachtio::log_debug) << "discarding message from blacklisted host " << host  ;
                     }
                 }
             }
+            if( sourceIsBlacklisted ) return ;
 
             char* szStartSeparator = strstr( output, "   " MSG_SEPARATOR ) ;
             if( NULL != szStartSeparator ) *szStartSeparator = '\0' ;
@@ -168,7 +180,7 @@ namespace {
         }
         else {
             int len = strlen(output) ;
-            output[len-1] = '\0' ;
+            if( len > 0 ) output[len-1] = '\0' ;
             DR_LOG(drachtio::log_info) << output ;
         }
     } ;
@@ -267,30 +279,41 @@ namespace {
 
 namespace drachtio {
 
-    StackMsg::StackMsg( const char *szLine ) : m_firstLine( szLine ), m_meta( szLine ), m_os(""), m_bIncoming(::strstr( szLine, "recv ") == szLine) {
+    StackMsg::StackMsg( const char *szLine ) : m_firstLine( szLine ), m_meta( szLine ), m_bIncoming(::strncmp( szLine, "recv ", 5 ) == 0), 
+        m_bComplete(false) {
+        m_sipMessage.reserve( m_meta.getSize() + m_meta.getSize() / 16 ) ;
     }
     void StackMsg::appendLine( char *szLine, bool complete ) {
         if( complete ) {
-            m_os.flush() ;
-            m_sipMessage = m_os.str() ;
-            if (m_sipMessage.length() > 1) m_sipMessage.resize( m_sipMessage.length() - 1) ;
-            boost::replace_all(m_sipMessage, "\n", DR_CRLF);
-        }
-        else if( 0 == strcmp(szLine, "\n") ) {
-            m_os << endl ;
+
+            /* the dump ends with the line ending of the last line of the message */
+            size_t len = m_sipMessage.length() ;
+            if (len >= DR_CRLF.length() && 0 == m_sipMessage.compare( len - DR_CRLF.length(), DR_CRLF.length(), DR_CRLF )) {
+                m_sipMessage.resize( len - DR_CRLF.length() ) ;
+            }
+            m_bComplete = true ;
+            return ;
         }
-        else {
-            int i = 0 ;
-            while( ' ' == szLine[i] && '\0' != szLine[i]) i++ ;
-            m_os << ( szLine + i ) ;
+
+        const char* p = szLine ;
+        while( ' ' == *p ) p++ ;
+
+        /* the stack logs bare line feeds; the message went over the wire with crlf */
+        const char* lf ;
+        while( NULL != (lf = ::strchr( p, '\n' )) ) {
+            m_sipMessage.append( p, lf - p ) ;
+            m_sipMessage.append( DR_CRLF ) ;
+            p = lf + 1 ;
         }
+        m_sipMessage.append( p ) ;
     }
  
     DrachtioController::DrachtioController( int argc, char* argv[] ) : m_bDaemonize(false), m_bLoggingInitialized(false),
         m_configFilename(DEFAULT_CONFIG_FILENAME), m_adminTcpPort(0), m_adminTlsPort(0), m_bNoConfig(false), 
         m_current_severity_threshold(log_none), m_nSofiaLoglevel(-1), m_bIsOutbound(false), m_bConsoleLogging(false),
         m_nHomerPort(0), m_nHomerId(0), m_mtu(0), m_bAggressiveNatDetection(false), m_bMemoryDebug(false),
-        m_nPrometheusPort(0), m_strPrometheusAddress("0.0.0.0"), m_tcpKeepaliveSecs(UINT16_MAX), m_bDumpMemory(false),
+        m_nPrometheusPort(0), m_strPrometheusAddress("0.0.0.0"), m_tcpKeepaliveSecs(UINT16_MAX), m_nClientIoThreads(0), 
+        m_nSessionRefreshJitter(UINT16_MAX), m_nMaxSessionRefreshes(UINT16_MAX), m_bDumpMemory(false),
         m_minTlsVersion(0), m_bDisableNatDetection(false), m_pBlacklist(nullptr), m_bAlwaysSend180(false), 
         m_bGloballyReadableLogs(false), m_bTlsVerifyClientCert(false), m_bRejectRegisterWithNoRealm(false) {
 
@@ -357,6 +380,12 @@ namespace drachtio {
         exit(0);
     }
 
+    void DrachtioController::captureStackMessage( std::shared_ptr<StackMsg> msg ) {
+        DR_LOG( log_info ) << msg->getFirstLine()  << msg->getSipMessage() <<  " " ;            
+
+        msg->isIncoming() ? setLastRecvStackMessage( msg ) : setLastSentStackMessage( msg ) ;
+    }
+
     void DrachtioController::handleSigHup( int signal ) {
         m_bDumpMemory = true;
         DR_LOG(log_notice) << "SIGHUP handled - next storage printout will include detailed logging"  ;
@@ -461,7 +490,11 @@ namespace drachtio {
                 {"blacklist-redis-sentinels", required_argument, 0, 'V'},
                 {"blacklist-redis-master", required_argument, 0, 'W'},
                 {"blacklist-redis-password", required_argument, 0, 'X'},
+                {"io-threads", required_argument, 0, 'Y'},
+                {"unix-socket", required_argument, 0, 'Z'},
                 {"tls-cipherlist", required_argument, 0, 0},
+                {"session-refresh-jitter", required_argument, 0, 0},
+                {"max-session-refreshes", required_argument, 0, 0},
                 {"version",    no_argument, 0, 'v'},
                 {0, 0, 0, 0}
             };
@@ -482,6 +515,14 @@ namespace drachtio {
                       m_tlsCipherList = optarg;
                       break;
                     }
+                    if (strcmp(long_options[option_index].name, "session-refresh-jitter") == 0) {
+                      m_nSessionRefreshJitter = ::atoi(optarg);
+                      break;
+                    }
+                    if (strcmp(long_options[option_index].name, "max-session-refreshes") == 0) {
+                      m_nMaxSessionRefreshes = ::atoi(optarg);
+                      break;
+                    }
                     /* If this option set a flag, do nothing else now. */
                     if (long_options[option_index].flag != 0)
                         break;
@@ -697,6 +738,12 @@ namespace drachtio {
                 case 'X':
                     m_redisPassword= optarg;
                     break;
+                case 'Y':
+                    m_nClientIoThreads = ::atoi(optarg);
+                    break;
+                case 'Z':
+                    m_adminUnixSocket = optarg;
+                    break;
                 case 'v':
                     cout << DRACHTIO_VERSION << endl ;
                     exit(0) ;
@@ -767,21 +814,25 @@ namespace drachtio {
         cerr << "    --homer-id                         homer agent id to use in HEP messages to identify this server" << endl ;
         cerr << "    --http-handler                     http(s) URL to optionally send routing request to for new incoming sip request" << endl ;
         cerr << "    --http-method                      method to use with http-handler: GET (default) or POST" << endl ;
+        cerr << "    --io-threads                       number of threads handling application connections (default 1)" << endl ;
         cerr << "    --key-file                         TLS key file" << endl ;
         cerr << "-l  --loglevel                         Log level (choices: notice, error, warning, info, debug)" << endl ;
         cerr << "    --local-net                        CIDR for local subnet (e.g. \"10.132.0.0/20\")" << endl ;
+        cerr << "    --max-session-refreshes            max session refresh re-INVITEs to send per second (default 0=no limit)" << endl ;
         cerr << "    --memory-debug                     enable verbose debugging of memory allocations (do not turn on in production)" << endl ;
         cerr << "    --mtu                              max packet size for UDP (default: system-defined mtu)" << endl ;
         cerr << "-p, --port                             TCP port to listen on for application connections (default 9022)" << endl ;
         cerr << "    --prometheus-scrape-port           The port (or host:port) to listen on for Prometheus.io metrics scrapes" << endl ;
         cerr << "    --reject-register-with-no-realm    reject with a 403 any REGISTER that has an IP address in the sip uri host" << endl ;
         cerr << "    --secret                           The shared secret to use for authenticating application connections" << endl ;
+        cerr << "    --session-refresh-jitter           percent of the session interval to randomly move session refreshes by (default 10, max 25)" << endl ;
         cerr << "    --sofia-loglevel                   Log level of internal sip stack (choices: 0-9)" << endl ;
         cerr << "    --external-ip                      External IP address to use in SIP messaging" << endl ;
         cerr << "    --stdout                           Log to standard output as well as any configured log destinations" << endl ;
         cerr << "    --tcp-keepalive-interval           tcp keepalive in seconds (0=no keepalive)" << endl ;
         cerr << "    --tls-cipherlist                   list of ciphers to support for TLS connections (default: all strong ciphers supported)" << endl ;
         cerr << "    --min-tls-version                  minimum allowed TLS version for connecting clients (default: 1.0)" << endl ;
+        cerr << "    --unix-socket                      path of a unix domain socket to listen on for local application connections" << endl ;
         cerr << "    --user-agent-options-auto-respond  If we see this User-Agent header value in an OPTIONS request, automatically send 200 OK" << endl ;
         cerr << "-v  --version                          Print version and exit" << endl ;
     }
@@ -792,6 +843,8 @@ namespace drachtio {
         if (p && ::atoi(p) > 0) m_adminTcpPort = ::atoi(p);
         p = std::getenv("DRACHTIO_ADMIN_TLS_PORT");
         if (p && ::atoi(p) > 0) m_adminTlsPort = ::atoi(p);
+        p = std::getenv("DRACHTIO_ADMIN_UNIX_SOCKET");
+        if (p) m_adminUnixSocket = p;
         p = std::getenv("DRACHTIO_AGRESSIVE_NAT_DETECTION");
         if (p && ::atoi(p) == 1) m_bAggressiveNatDetection = true;
         p = std::getenv("DRACHTIO_MEMORY_DEBUG");
@@ -833,6 +886,12 @@ namespace drachtio {
         if (p && ::atoi(p) > 0) m_mtu = ::atoi(p);
         p = std::getenv("DRACHTIO_TCP_KEEPALIVE_INTERVAL");
         if (p && ::atoi(p) >= 0) m_tcpKeepaliveSecs = ::atoi(p);
+        p = std::getenv("DRACHTIO_IO_THREADS");
+        if (p && ::atoi(p) > 0) m_nClientIoThreads = ::atoi(p);
+        p = std::getenv("DRACHTIO_SESSION_REFRESH_JITTER");
+        if (p && ::atoi(p) >= 0) m_nSessionRefreshJitter = ::atoi(p);
+        p = std::getenv("DRACHTIO_MAX_SESSION_REFRESHES");
+        if (p && ::atoi(p) >= 0) m_nMaxSessionRefreshes = ::atoi(p);
         p = std::getenv("DRACHTIO_SECRET");
         if (p) m_secret = p;
         p = std::getenv("DRACHTIO_CONSOLE_LOGGING");
@@ -1172,6 +1231,10 @@ namespace drachtio {
             }
         }
 
+        if (0 == m_nClientIoThreads) m_nClientIoThreads = m_Config->getIoThreads();
+        if (0 == m_nClientIoThreads) m_nClientIoThreads = 1;
+        DR_LOG(log_notice) << "DrachtioController::run using " << m_nClientIoThreads << " thread(s) for application connections";
+
         if (adminTcpPort && !adminTlsPort) {
             DR_LOG(log_notice) << "DrachtioController::run listening for applications on tcp port " << adminTcpPort << " only";
             m_pClientController.reset(new ClientController(this, adminAddress, adminTcpPort));
@@ -1184,6 +1247,15 @@ namespace drachtio {
              DR_LOG(log_notice) << "DrachtioController::run listening for applications on tcp port " << adminTcpPort << " and tls port " << adminTlsPort ;
            m_pClientController.reset(new ClientController(this, adminAddress, adminTcpPort, adminTlsPort, tlsChainFile, tlsCertFile, tlsKeyFile, dhParam));
         }
+
+        string adminUnixSocket ;
+        unsigned int adminUnixSocketMode = 0660 ;
+        m_Config->getAdminUnixSocket( adminUnixSocket, adminUnixSocketMode ) ;
+        if (!m_adminUnixSocket.empty()) adminUnixSocket = m_adminUnixSocket ;
+        if (!adminUnixSocket.empty()) {
+            DR_LOG(log_notice) << "DrachtioController::run also listening for local applications on unix socket " << adminUnixSocket ;
+            m_pClientController->listenOnUnixSocket( adminUnixSocket, adminUnixSocketMode ) ;
+        }
         m_pClientController->start();
         
         // mtu
@@ -1279,6 +1351,13 @@ namespace drachtio {
             DR_LOG(log_notice) << "tcp keep alives will be sent to clients every " << m_tcpKeepaliveSecs << " seconds";
         }
 
+        // session timers
+        if (UINT16_MAX == m_nSessionRefreshJitter) m_nSessionRefreshJitter = m_Config->getSessionRefreshJitter();
+        if (UINT16_MAX == m_nMaxSessionRefreshes) m_nMaxSessionRefreshes = m_Config->getMaxSessionRefreshes();
+        if (m_nSessionRefreshJitter > 25) m_nSessionRefreshJitter = 25;
+        DR_LOG(log_notice) << "session refreshes will be sent within " << m_nSessionRefreshJitter << "% of the session interval either side of its midpoint, " <<
+            (m_nMaxSessionRefreshes ? "at most " + std::to_string(m_nMaxSessionRefreshes) + " per second" : "with no limit per second");
+
         int rv = su_init() ;
         if( rv < 0 ) {
             DR_LOG(log_error) << "Error calling su_init: " << rv ;
@@ -1411,6 +1490,10 @@ namespace drachtio {
         /* start a timer */
         m_timer = su_timer_create( su_root_task(m_root), 30000) ;
         su_timer_set_for_ever(m_timer, watchdogTimerHandler, this) ;
+
+        /* picks up work whose wakeup message could not be sent (see postToStack) */
+        m_stackWorkRetryTimer = su_timer_create( su_root_task(m_root), 250) ;
+        su_timer_set_for_ever(m_stackWorkRetryTimer, stackWorkRetryTimerHandler, this) ;
  
         su_root_run( m_root ) ;
         DR_LOG(log_notice) << "Sofia event loop ended"  ;
@@ -1428,9 +1511,10 @@ namespace drachtio {
     int DrachtioController::processMessageStatelessly( msg_t* msg, sip_t* sip ) {
         int rc = 0 ;
         if (m_pBlacklist) {
-            string host;
-            getSourceAddressForMsg(msg, host);
-            if (m_pBlacklist->isBlackListed(host.c_str())) {
+            su_sockaddr_t const *su = msg_addr(msg);
+            if (m_pBlacklist->isBlackListed(su->su_family, SU_ADDR(su))) {
+                STATS_COUNTER_INCREMENT(STATS_COUNTER_BLACKLIST_DROPPED_PACKETS)
+                STATS_COUNTER_INCREMENT_BY(STATS_COUNTER_BLACKLIST_DROPPED_BYTES, (double) msg_size(msg))
                 return -1;
             }
         }
@@ -1585,8 +1669,7 @@ namespace drachtio {
                 if (sip_method_register == sip->sip_request->rq_method) {
                     /* optionally reject REGISTER quickly if no sip realm provided */
                     if (m_bRejectRegisterWithNoRealm && sip_method_register == sip->sip_request->rq_method ) {
-                        std::regex ipRegex("^(?:[0-9]{1,3}\\.){3}[0-9]{1,3}$");
-                        if (std::regex_match(sip->sip_request->rq_url->url_host, ipRegex)) {
+                        if (sip->sip_request->rq_url->url_host && scan::isDottedQuad(sip->sip_request->rq_url->url_host)) {
                             DR_LOG(log_info) << "DrachtioController::processMessageStatelessly: rejecting REGISTER with no realm" ;
                             STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", "REGISTER"},{"code", "403"}})
                             nta_msg_treply( m_nta, msg, 403, NULL, TAG_END() ) ;
@@ -1676,14 +1759,12 @@ namespace drachtio {
                         if( p ) {
                             DR_LOG(log_info) << "received quick cancel for invite that is out to client for disposition: " << sip->sip_call_id->i_id  ;
 
-                            string encodedMessage ;
-                            EncodeStackMessage( sip, encodedMessage ) ;
+                            encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
                             SipMsgData_t meta( msg ) ;
 
                             client_ptr client = m_pClientController->findClientForNetTransaction(p->getTransactionId()); 
                             if(client) {
-                                void (BaseClient::*fn)(const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-                                m_pClientController->getIOService().post( std::bind(fn, client, p->getTransactionId(), encodedMessage, meta)) ;
+                                client->post( { AppMessage::sip_message_with_destination, p->getTransactionId(), "", "", encodedMessage, meta } ) ;
                             }
 
                             STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "200"}})
@@ -1805,7 +1886,7 @@ namespace drachtio {
         }
          
         std::shared_ptr<SipDialog> dlg ;
-        if( m_pDialogController->findDialogByLeg( leg, dlg ) ) {
+        if( m_pDialogController->findDialogByLeg( leg, sip->sip_call_id->i_id, dlg ) ) {
             if( sip->sip_request->rq_method == sip_method_invite && !sip->sip_to->a_tag && dlg->getSipStatus() >= 200 ) {
                DR_LOG(log_info) << "DrachtioController::processRequestInsideDialog - received INVITE out of order (still waiting ACK from prev transaction)" ;
                return 491;
@@ -1937,24 +2018,16 @@ namespace drachtio {
     string port = "9021";
     string transport = "tcp";
 
-    try {
-        std::regex re("^(.*):(\\d+)(;transport=(tcp|tls))?");
-        std::smatch mr;
-        if (std::regex_search(uri, mr, re) && mr.size() > 1) {
-            host = mr[1] ;
-            port = mr[2] ;
-            if (mr.size() > 4) {
-                transport = mr[4];
-            }
-        }
-        else {
-          DR_LOG(log_warning) << "DrachtioController::makeOutboundConnection - invalid uri: " << uri;
-          //TODO: send 480, remove pending connection
-          return ;              
-        }
-    } catch (std::regex_error& e) {
-        DR_LOG(log_warning) << "DrachtioController::makeOutboundConnection - regex error: " << e.what();
-        return;        
+    scan::OutboundUri ob ;
+    if (scan::outboundUri(uri, ob)) {
+        host.assign(ob.host) ;
+        port.assign(ob.port) ;
+        transport.assign(ob.transport) ;
+    }
+    else {
+      DR_LOG(log_warning) << "DrachtioController::makeOutboundConnection - invalid uri: " << uri;
+      //TODO: send 480, remove pending connection
+      return ;              
     }
 
     DR_LOG(log_warning) << "DrachtioController::makeOutboundConnection - attempting connection to " << 
@@ -2130,7 +2203,7 @@ namespace drachtio {
               statusLine << it->second ;
           }
       }
-      if(( !this->getDialogController()->respondToSipRequest("", transactionId, statusLine.str(), headers, body) )) {
+      if(( !this->getDialogController()->respondToSipRequest("", transactionId, statusLine.str(), HeaderIndex( headers ), body) )) {
           DR_LOG(log_error) << "DrachtioController::processRejectInstruction - error sending rejection with status " << status ;
       }
   }
@@ -2147,7 +2220,7 @@ namespace drachtio {
           headers.append(c) ;
       }
 
-      if(( !this->getDialogController()->respondToSipRequest( "", transactionId, "SIP/2.0 302 Moved", headers, body) )) {
+      if(( !this->getDialogController()->respondToSipRequest( "", transactionId, "SIP/2.0 302 Moved", HeaderIndex( headers ), body) )) {
           DR_LOG(log_error) << "DrachtioController::processRedirectInstruction - error sending redirect" ;
       }
   }
@@ -2158,7 +2231,7 @@ namespace drachtio {
     string body ;
 
     this->getProxyController()->proxyRequest( "", transactionId, recordRoute, false, followRedirects, 
-      simultaneous, provisionalTimeout, finalTimeout, vecDestination, headers ) ;
+      simultaneous, provisionalTimeout, finalTimeout, vecDestination, HeaderIndex( headers ) ) ;
   }
 
   void DrachtioController::processOutboundConnectionInstruction(const string& transactionId, const char* uri) {
@@ -2319,6 +2392,54 @@ namespace drachtio {
        STATS_GAUGE_SET(STATS_GAUGE_REGISTERED_ENDPOINTS, m_mapUri2InvalidData.size());
 
     }
+    void DrachtioController::postToStack( StackWork&& work ) {
+        if( !m_stackWork.push( std::move( work ) ) ) return ;
+
+        su_msg_r msg = SU_MSG_R_INIT ;
+        if( su_msg_create( msg, su_clone_task(m_clone), su_root_task(m_root), cloneDrainStackWork, 0 ) < 0 || su_msg_send( msg ) < 0 ) {
+            // the work stays queued; the retry timer on the stack thread drains it if no later push gets a wakeup through
+            DR_LOG(log_error) << "DrachtioController::postToStack - failed to wake the sip stack thread" ;
+            m_bStackWakeupFailed.store( true, std::memory_order_release ) ;
+            m_stackWork.wakeupFailed() ;
+        }
+    }
+
+    void DrachtioController::retryStackWork(void) {
+        if( !m_bStackWakeupFailed.exchange( false, std::memory_order_acq_rel ) ) return ;
+        DR_LOG(log_warning) << "DrachtioController::retryStackWork - draining work left behind by a failed wakeup" ;
+        drainStackWork() ;
+    }
+
+    void DrachtioController::drainStackWork(void) {
+        std::chrono::steady_clock::time_point oldest = std::chrono::steady_clock::time_point::max() ;
+        size_t count = m_stackWork.drain( [this, &oldest](StackWork&& work, std::chrono::steady_clock::time_point enqueued) {
+            oldest = std::min( oldest, enqueued ) ;
+            switch( work.m_kind ) {
+                case StackWork::request_inside_dialog:
+                    m_pDialogController->doSendRequestInsideDialog( work.m_message.get() ) ;
+                    break ;
+                case StackWork::request_outside_dialog:
+                    m_pDialogController->doSendRequestOutsideDialog( work.m_message.get() ) ;
+                    break ;
+                case StackWork::cancel_request:
+                    STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", "CANCEL"}})
+                    m_pDialogController->doSendCancelRequest( work.m_message.get() ) ;
+                    break ;
+                case StackWork::response:
+                    m_pDialogController->doRespondToSipRequest( work.m_message.get() ) ;
+                    break ;
+                case StackWork::proxy_request:
+                    m_pProxyController->doProxy( work.m_proxy.get() ) ;
+                    break ;
+            }
+        }) ;
+        if( 0 == count ) return ;
+
+        STATS_HISTOGRAM_OBSERVE(STATS_HISTOGRAM_HANDOFF_BATCH_SIZE, count, {{"direction", "to_stack"}})
+        STATS_HISTOGRAM_OBSERVE(STATS_HISTOGRAM_HANDOFF_LATENCY, 
+            std::chrono::duration<double>( std::chrono::steady_clock::now() - oldest ).count(), {{"direction", "to_stack"}})
+    }
+
     void DrachtioController::processWatchdogTimer() {
         DR_LOG(log_debug) << "DrachtioController::processWatchdogTimer"  ;
     
@@ -2360,6 +2481,10 @@ namespace drachtio {
         STATS_COUNTER_CREATE(STATS_COUNTER_SIP_RESPONSES_IN, "count of sip responses received")
         STATS_COUNTER_CREATE(STATS_COUNTER_SIP_RESPONSES_OUT, "count of sip responses sent")
         STATS_COUNTER_CREATE(STATS_COUNTER_BUILD_INFO, "drachtio version running")
+        STATS_COUNTER_CREATE(STATS_COUNTER_BLACKLIST_DROPPED_PACKETS, "count of sip messages dropped because the source is blacklisted")
+        STATS_COUNTER_CREATE(STATS_COUNTER_BLACKLIST_DROPPED_BYTES, "bytes of sip messages dropped because the source is blacklisted")
+        STATS_COUNTER_CREATE(STATS_COUNTER_SESSION_REFRESHES_DEFERRED, "count of session refreshes put off because the limit on refreshes per second was reached")
+        STATS_COUNTER_CREATE(STATS_COUNTER_DIALOG_STORE_CONTENTION, "count of times a dialog store lock was already held by another thread")
 
         STATS_GAUGE_CREATE(STATS_GAUGE_START_TIME, "drachtio start time")
         STATS_GAUGE_CREATE(STATS_GAUGE_STABLE_DIALOGS, "count of SIP dialogs in progress")
@@ -2382,6 +2507,7 @@ namespace drachtio {
         STATS_GAUGE_CREATE(STATS_GAUGE_SOFIA_BAD_REQS, "count of invalid sip requests received by sofia sip stack")
         STATS_GAUGE_CREATE(STATS_GAUGE_SOFIA_RETRANS_REQ, "count of sip requests retransmitted by sofia sip stack")
         STATS_GAUGE_CREATE(STATS_GAUGE_SOFIA_RETRANS_RES, "count of sip responses retransmitted by sofia sip stack")
+        STATS_GAUGE_CREATE(STATS_GAUGE_TIMER_QUEUE_SIZE, "count of sip timers waiting to fire, by timer")
 
         STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_INVITE_RESPONSE_TIME_IN, "call answer time in seconds for calls received", 
             {1.0, 3.0, 6.0, 10.0, 15.0, 20.0, 30.0, 60.0})
@@ -2391,6 +2517,16 @@ namespace drachtio {
             {1.0, 2.0, 3.0, 5.0, 7.0, 10.0, 15.0, 20.0})
         STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_INVITE_PDD_OUT, "call post-dial delay seconds for calls received", 
             {1.0, 2.0, 3.0, 5.0, 7.0, 10.0, 15.0, 20.0})
+        STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_APP_WRITE_QUEUE_DEPTH, "count of messages coalesced into a single write to an application", 
+            {1.0, 2.0, 4.0, 8.0, 16.0, 32.0, 64.0, 128.0})
+        STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_APP_WRITE_FLUSH_BYTES, "bytes written to an application in a single write", 
+            {512.0, 1024.0, 2048.0, 4096.0, 8192.0, 16384.0, 65536.0, 262144.0})
+        STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_HANDOFF_BATCH_SIZE, "count of messages handed between the sip stack and client threads on a single wakeup", 
+            {1.0, 2.0, 4.0, 8.0, 16.0, 32.0, 64.0, 128.0})
+        STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_HANDOFF_LATENCY, "seconds the oldest message in a batch waited to be picked up by the sip stack or client thread", 
+            {0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05})
+        STATS_HISTOGRAM_CREATE(STATS_HISTOGRAM_TIMER_LATENESS, "seconds the most overdue sip timer in a batch fired after it was due, by timer", 
+            {0.001, 0.002, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0})
 
         STATS_COUNTER_INCREMENT(STATS_COUNTER_BUILD_INFO, {{"version", DRACHTIO_VERSION}})
         STATS_GAUGE_SET_TO_CURRENT_TIME(STATS_GAUGE_START_TIME)
@@ -76,6 +76,7 @@ THE SOFTWARE.
 #include "request-router.hpp"
 #include "stats-collector.hpp"
 #include "blacklist.hpp"
+#include "handoff-queue.hpp"
 
 using namespace std ;
 
@@ -101,9 +102,8 @@ namespace drachtio {
     SipMsgData_t    m_meta ;
     bool            m_bIncoming ;
     bool            m_bComplete ;
-    string          m_sipMessage ;
+    string          m_sipMessage ;    // built up with crlf line endings as each line comes in
     string          m_firstLine ;
-    ostringstream   m_os ;
   } ;
 
 	class DrachtioController {
@@ -164,6 +164,10 @@ namespace drachtio {
     void setLastSentStackMessage(shared_ptr<StackMsg> msg) { m_lastSentMsg = msg; }
     void setLastRecvStackMessage(shared_ptr<StackMsg> msg) { m_lastRecvMsg = msg; }
 
+    // every sip message sent or received, as it went over the wire, is handed here once it is complete
+    void captureStackMessage( shared_ptr<StackMsg> msg ) ;
+    bool isCapturingStackMessages(void) const { return m_current_severity_threshold >= log_info; }
+
     bool isDaemonized(void) { return m_bDaemonize; }
     void cacheTportForSubscription( const char* user, const char* host, int expires, tport_t* tp ) ; 
     void flushTportForSubscription( const char* user, const char* host ) ; 
@@ -181,6 +185,31 @@ namespace drachtio {
     bool isNatDetectionDisabled(void) { return m_bDisableNatDetection; }
 
     unsigned int getTcpKeepaliveInterval() { return m_tcpKeepaliveSecs; }
+    unsigned int getClientIoThreads() { return m_nClientIoThreads; }
+    unsigned int getSessionRefreshJitter() { return m_nSessionRefreshJitter; }
+    unsigned int getMaxSessionRefreshesPerSec() { return m_nMaxSessionRefreshes; }
+
+    // a request from an application on its way to the stack thread
+    struct StackWork {
+        enum Kind {
+            request_inside_dialog,
+            request_outside_dialog,
+            cancel_request,
+            response,
+            proxy_request
+        } ;
+
+        Kind m_kind ;
+        std::unique_ptr<SipDialogController::SipMessageData> m_message ;
+        std::unique_ptr<SipProxyController::ProxyData> m_proxy ;
+    } ;
+
+    // any thread: queue work for the stack thread, which is woken once for however many items are waiting
+    void postToStack( StackWork&& work ) ;
+
+    // stack thread
+    void drainStackWork(void) ;
+    void retryStackWork(void) ;
 
 	private:
 
@@ -239,6 +268,7 @@ namespace drachtio {
     uint32_t m_nHomerId;
     string m_secret;
     string m_adminAddress;
+    string m_adminUnixSocket;
     string m_redisAddress;
     string m_redisSentinels;
     string m_redisMaster;
@@ -265,6 +295,9 @@ namespace drachtio {
     nta_agent_t*	m_nta ;
     nta_leg_t*      m_defaultLeg ;
   	su_clone_r 	m_clone ;
+    HandoffQueue<StackWork> m_stackWork ;
+    std::atomic<bool> m_bStackWakeupFailed{false} ;
+    su_timer_t*     m_stackWorkRetryTimer = nullptr ;
 
     std::vector< std::shared_ptr<SipTransport> >  m_vecTransports;
     
@@ -284,6 +317,9 @@ namespace drachtio {
 
     bool m_bMemoryDebug;
     unsigned int m_tcpKeepaliveSecs;
+    unsigned int m_nClientIoThreads;
+    unsigned int m_nSessionRefreshJitter;
+    unsigned int m_nMaxSessionRefreshes;
 
     bool m_bDumpMemory;
 
@@ -40,9 +40,10 @@ namespace drachtio {
 
      class DrachtioConfig::Impl {
     public:
-        Impl( const char* szFilename, bool isDaemonized) : m_bIsValid(false), m_adminTcpPort(0), m_adminTlsPort(0), m_bDaemon(isDaemonized), 
+        Impl( const char* szFilename, bool isDaemonized) : m_bIsValid(false), m_adminTcpPort(0), m_adminTlsPort(0), m_adminUnixSocketMode(0660), m_bDaemon(isDaemonized), 
         m_bConsoleLogger(false), m_captureHepVersion(3), m_mtu(0), m_bAggressiveNatDetection(false), 
-        m_prometheusPort(0), m_prometheusAddress("0.0.0.0"), m_tcpKeepalive(45), m_minTlsVersion(0) {
+        m_prometheusPort(0), m_prometheusAddress("0.0.0.0"), m_tcpKeepalive(45), m_minTlsVersion(0), m_ioThreads(1),
+        m_sessionRefreshJitter(10), m_maxSessionRefreshes(0) {
 
             // default timers
             m_nTimerT1 = 500 ;
@@ -66,10 +67,13 @@ namespace drachtio {
                     pt.get_child("drachtio.admin") ; // will throw if doesn't exist
                     m_adminTcpPort = pt.get<unsigned int>("drachtio.admin.<xmlattr>.port", 9022) ;
                     m_adminTlsPort = pt.get<unsigned int>("drachtio.admin.<xmlattr>.tls-port", 0) ;
+                    m_adminUnixSocket = pt.get<string>("drachtio.admin.<xmlattr>.unix-socket", "") ;
+                    m_adminUnixSocketMode = ::strtoul( pt.get<string>("drachtio.admin.<xmlattr>.unix-socket-mode", "0660").c_str(), NULL, 8 ) ;
                     m_secret = pt.get<string>("drachtio.admin.<xmlattr>.secret", "admin") ;
                     m_adminAddress = pt.get<string>("drachtio.admin") ;
                     string tlsValue =  pt.get<string>("drachtio.admin.<xmlattr>.tls", "false") ;
                     m_tcpKeepalive = pt.get<unsigned int>("drachtio.admin.<xmlattr>.tcp-keepalive", 45);
+                    m_ioThreads = pt.get<unsigned int>("drachtio.admin.<xmlattr>.io-threads", 1);
                 } catch( boost::property_tree::ptree_bad_path& e ) {
                     cerr << "XML tag <admin> not found; this is required to provide admin socket details" << endl ;
                     return ;
@@ -204,6 +208,21 @@ namespace drachtio {
                     // optional
                 }
 
+                /* how to choose among the applications that want a given request type */
+                try {
+                     BOOST_FOREACH(ptree::value_type &v, pt.get_child("drachtio.app-selection")) {
+                        if( 0 == v.first.compare("policy") ) {
+                            string verb = v.second.get<string>("<xmlattr>.verb","") ;
+                            boost::algorithm::to_lower(verb);
+                            string policy = v.second.data() ;
+                            boost::algorithm::trim(policy);
+                            if (!verb.empty()) m_mapAppSelectionPolicies[verb] = policy ;
+                        }
+                    }
+                } catch( boost::property_tree::ptree_bad_path& e ) {
+                    // optional
+                }
+
                 /* monitoring */
 
                 /* prometheus */
@@ -295,6 +314,9 @@ namespace drachtio {
                 m_bGenerateCdrs = ( 0 == cdrs.compare("true") || 0 == cdrs.compare("yes") ) ;
 
                 m_mtu = pt.get<unsigned int>("drachtio.sip.udp-mtu", 0);
+
+                m_sessionRefreshJitter = pt.get<unsigned int>("drachtio.sip.session-timers.<xmlattr>.refresh-jitter", 10);
+                m_maxSessionRefreshes = pt.get<unsigned int>("drachtio.sip.session-timers.<xmlattr>.max-refreshes-per-second", 0);
                 
                 fb.close() ;
                                                
@@ -379,6 +401,11 @@ namespace drachtio {
         unsigned int getAdminTlsPort() {
             return m_adminTlsPort ;
         }
+        bool getAdminUnixSocket( string& path, unsigned int& mode ) {
+            path = m_adminUnixSocket ;
+            mode = m_adminUnixSocketMode ;
+            return !path.empty() ;
+        }
         bool isSecret( const string& secret ) {
             return 0 == secret.compare( m_secret ) ;
         }
@@ -455,6 +482,22 @@ namespace drachtio {
             return m_tcpKeepalive;
         }
 
+        unsigned int getIoThreads() {
+            return m_ioThreads;
+        }
+
+        unsigned int getSessionRefreshJitter() {
+            return m_sessionRefreshJitter;
+        }
+
+        unsigned int getMaxSessionRefreshes() {
+            return m_maxSessionRefreshes;
+        }
+
+        void getAppSelectionPolicies( DrachtioConfig::mapVerb2Policy& policies ) {
+            policies = m_mapAppSelectionPolicies ;
+        }
+
         bool getMinTlsVersion(float& minTlsVersion) {
             if (m_minTlsVersion > 0) {
                 minTlsVersion = m_minTlsVersion;
@@ -503,6 +546,8 @@ namespace drachtio {
         string m_adminAddress ;
         unsigned int m_adminTcpPort ;
         unsigned int m_adminTlsPort ;
+        string m_adminUnixSocket ;
+        unsigned int m_adminUnixSocketMode ;
         string m_secret ;
         bool m_bGenerateCdrs ;
         bool m_bDaemon;
@@ -513,6 +558,7 @@ namespace drachtio {
         mapHeader2Values m_mapSpammers ;
         std::vector< std::shared_ptr<SipTransport> >  m_vecTransports;
         RequestRouter m_router ;
+        DrachtioConfig::mapVerb2Policy m_mapAppSelectionPolicies ;
         string m_captureServerAddress ;
         unsigned int m_captureServerPort;
         uint32_t m_captureServerAgentId ;
@@ -522,6 +568,9 @@ namespace drachtio {
         string m_prometheusAddress;
         unsigned int m_prometheusPort;
         unsigned int m_tcpKeepalive;
+        unsigned int m_ioThreads;
+        unsigned int m_sessionRefreshJitter;
+        unsigned int m_maxSessionRefreshes;
         float m_minTlsVersion;
         string m_redisAddress;
         string m_redisSentinels;
@@ -582,6 +631,9 @@ namespace drachtio {
     unsigned int DrachtioConfig::getAdminTlsPort() {
         return m_pimpl->getAdminTlsPort() ;
     }
+    bool DrachtioConfig::getAdminUnixSocket( string& path, unsigned int& mode ) {
+        return m_pimpl->getAdminUnixSocket( path, mode ) ;
+    }
     bool DrachtioConfig::getAdminAddress( string& address ) {
         return m_pimpl->getAdminAddress( address ) ;
     }
@@ -622,6 +674,22 @@ namespace drachtio {
     unsigned int DrachtioConfig::getTcpKeepalive() const {
         return m_pimpl->getTcpKeepalive();
     }
+
+    unsigned int DrachtioConfig::getIoThreads() const {
+        return m_pimpl->getIoThreads();
+    }
+
+    unsigned int DrachtioConfig::getSessionRefreshJitter() const {
+        return m_pimpl->getSessionRefreshJitter();
+    }
+
+    unsigned int DrachtioConfig::getMaxSessionRefreshes() const {
+        return m_pimpl->getMaxSessionRefreshes();
+    }
+
+    void DrachtioConfig::getAppSelectionPolicies( mapVerb2Policy& policies ) const {
+        m_pimpl->getAppSelectionPolicies(policies);
+    }
         
     bool DrachtioConfig::getMinTlsVersion(float& minTlsVersion) const {
         return m_pimpl->getMinTlsVersion(minTlsVersion);
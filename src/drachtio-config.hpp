@@ -46,6 +46,7 @@ namespace drachtio {
         DrachtioConfig( const DrachtioConfig& ) = delete;
         
        typedef unordered_map<string, vector<string > > mapHeader2Values ;
+       typedef unordered_map<string, string> mapVerb2Policy ;
 
         bool isValid() ;
 
@@ -68,6 +69,7 @@ namespace drachtio {
         bool getAdminAddress( string& address ) ;
         unsigned int getAdminTcpPort( void ) ;
         unsigned int getAdminTlsPort( void ) ;
+        bool getAdminUnixSocket( string& path, unsigned int& mode ) ;
 
         bool getTlsFiles( string& keyFile, string& certFile, string& chainFile, string& dhParam ) const ;
 
@@ -87,6 +89,14 @@ namespace drachtio {
 
         unsigned int getTcpKeepalive() const;
 
+        unsigned int getIoThreads() const;
+
+        unsigned int getSessionRefreshJitter() const;
+
+        unsigned int getMaxSessionRefreshes() const;
+
+        void getAppSelectionPolicies( mapVerb2Policy& policies ) const;
+
         bool getMinTlsVersion(float& minTlsVersion) const;
 
         bool getBlacklistServer(string& redisAddress, string& redisSentinels, string& redisMaster, string& redisPassword, unsigned int& redisPort, string& redisKey, unsigned int& redisRefreshSecs) const;
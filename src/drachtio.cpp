@@ -27,11 +27,12 @@ THE SOFTWARE.
 #include <ifaddrs.h>
 #include <errno.h>
 #include <stdio.h>
+#include <strings.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <mutex>
 #include <algorithm>
-#include <regex>
+#include <charconv>
 
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string.hpp>
@@ -40,6 +41,8 @@ THE SOFTWARE.
 
 #include "drachtio.h"
 #include "controller.hpp"
+#include "tag-compiler.hpp"
+#include "sip-scanners.hpp"
 
 #include <sofia-sip/url.h>
 #include <sofia-sip/nta_tport.h>
@@ -67,153 +70,15 @@ namespace {
 } ;
 
 namespace drachtio {
-    std::string capitalizeAfterDash(const std::string& input) {
-      std::unordered_set<std::string> preservedHeaders;
-      
-      preservedHeaders = theOneAndOnlyController->getPreservedHeaderNames();
-      if (!preservedHeaders.empty()) {
-        for (const auto& header : preservedHeaders) {
-            if (boost::iequals(boost::trim_copy(header), input)) {
-              DR_LOG(log_debug) << "capitalizeAfterDash - preserving header case " << header;
-              return input; // Return unmodified if header should be preserved
-            }
-        }
-      }
-
-      std::string output = input;
-      bool capitalizeNext = true;
-      if (input.substr(0, 2) != "X-" && input.substr(0, 2) != "x-") {
-        std::for_each(output.begin(), output.end(), [&](char& c) {
-          if (capitalizeNext) c = std::toupper(c, std::locale{});
-          capitalizeNext = c == '-';
-        });
-      }
-      return output;
-    }
-
-    typedef std::unordered_map<string,tag_type_t> mapHdr2Tag ;
-
-    typedef std::unordered_set<string> setHdr ;
-
-    typedef std::unordered_map<string,sip_method_t> mapMethod2Type ;
-
-	/* headers that are allowed to be set by the client in responses to sip requests */
-	mapHdr2Tag m_mapHdr2Tag({
-		{string("user_agent"), siptag_user_agent_str}, 
-        {string("subject"), siptag_subject_str}, 
-        {string("max_forwards"), siptag_max_forwards_str}, 
-        {string("proxy_require"), siptag_proxy_require_str}, 
-        {string("accept_contact"), siptag_accept_contact_str}, 
-        {string("reject_contact"), siptag_reject_contact_str}, 
-        {string("expires"), siptag_expires_str}, 
-        {string("date"), siptag_date_str}, 
-        {string("retry_after"), siptag_retry_after_str}, 
-        {string("timestamp"), siptag_timestamp_str}, 
-        {string("min_expires"), siptag_min_expires_str}, 
-        {string("priority"), siptag_priority_str}, 
-        {string("call_info"), siptag_call_info_str}, 
-        {string("organization"), siptag_organization_str}, 
-        {string("server"), siptag_server_str}, 
-        {string("in_reply_to"), siptag_in_reply_to_str}, 
-        {string("accept"), siptag_accept_str}, 
-        {string("accept_encoding"), siptag_accept_encoding_str}, 
-        {string("accept_language"), siptag_accept_language_str}, 
-        {string("allow"), siptag_allow_str}, 
-        {string("require"), siptag_require_str}, 
-        {string("supported"), siptag_supported_str}, 
-        {string("unsupported"), siptag_unsupported_str}, 
-        {string("event"), siptag_event_str}, 
-        {string("allow_events"), siptag_allow_events_str}, 
-        {string("subscription_state"), siptag_subscription_state_str}, 
-        {string("proxy_authenticate"), siptag_proxy_authenticate_str}, 
-        {string("proxy_authentication_info"), siptag_proxy_authentication_info_str}, 
-        {string("proxy_authorization"), siptag_proxy_authorization_str}, 
-        {string("authorization"), siptag_authorization_str}, 
-        {string("www_authenticate"), siptag_www_authenticate_str}, 
-        {string("authentication_info"), siptag_authentication_info_str}, 
-        {string("error_info"), siptag_error_info_str}, 
-        {string("warning"), siptag_warning_str}, 
-        {string("refer_to"), siptag_refer_to_str}, 
-        {string("referred_by"), siptag_referred_by_str}, 
-        {string("replaces"), siptag_replaces_str}, 
-        {string("session_expires"), siptag_session_expires_str}, 
-        {string("min_se"), siptag_min_se_str}, 
-        {string("path"), siptag_path_str}, 
-        {string("service_route"), siptag_service_route_str}, 
-        {string("reason"), siptag_reason_str}, 
-        {string("security_client"), siptag_security_client_str}, 
-        {string("security_server"), siptag_security_server_str}, 
-        {string("security_verify"), siptag_security_verify_str}, 
-        {string("privacy"), siptag_privacy_str}, 
-        {string("sip_etag"), siptag_etag_str}, 
-        {string("sip_if_match"), siptag_if_match_str}, 
-        {string("mime_version"), siptag_mime_version_str}, 
-        {string("content_type"), siptag_content_type_str}, 
-        {string("content_encoding"), siptag_content_encoding_str}, 
-        {string("content_language"), siptag_content_language_str}, 
-        {string("content_disposition"), siptag_content_disposition_str}, 
-        {string("request_disposition"), siptag_request_disposition_str}, 
-        {string("error"), siptag_error_str}, 
-        {string("refer_sub"), siptag_refer_sub_str}, 
-        {string("alert_info"), siptag_alert_info_str}, 
-        {string("reply_to"), siptag_reply_to_str}, 
-        {string("p_asserted_identity"), siptag_p_asserted_identity_str}, 
-        {string("p_preferred_identity"), siptag_p_preferred_identity_str}, 
-        {string("remote_party_id"), siptag_remote_party_id_str}, 
-        {string("payload"), siptag_payload_str}, 
-        {string("from"), siptag_from_str}, 
-        {string("to"), siptag_to_str}, 
-        {string("call_id"), siptag_call_id_str}, 
-        {string("cseq"), siptag_cseq_str}, 
-        {string("via"), siptag_via_str}, 
-        {string("route"), siptag_route_str}, 
-        {string("contact"), siptag_contact_str}, 
-        {string("from"), siptag_from_str}, 
-        {string("to"), siptag_to_str}, 
-        {string("rseq"), siptag_rseq_str}, 
-        {string("rack"), siptag_rack_str}, 
-        {string("record_route"), siptag_record_route_str}, 
-        {string("content_length"), siptag_content_length_str}
-	});
-
-	/* headers that are not allowed to be set by the client in responses to sip requests */
-	setHdr m_setImmutableHdrs({
-        {string("via")},
-        {string("route")},
-        {string("rseq")},
-        {string("record_route")}, 
-        {string("content_length")} 
-	});
-
-   mapMethod2Type m_mapMethod2Type({
-        {string("INVITE"), sip_method_invite},
-        {string("ACK"), sip_method_ack},
-        {string("CANCEL"), sip_method_cancel},
-        {string("BYE"), sip_method_bye},
-        {string("OPTIONS"), sip_method_options},
-        {string("REGISTER"), sip_method_register},
-        {string("INFO"), sip_method_info},
-        {string("PRACK"), sip_method_prack},
-        {string("UPDATE"), sip_method_update},
-        {string("MESSAGE"), sip_method_message},
-        {string("SUBSCRIBE"), sip_method_subscribe},
-        {string("NOTIFY"), sip_method_notify},
-        {string("REFER"), sip_method_refer},
-        {string("PUBLISH"), sip_method_publish} 
-    });
-
-
-	bool isImmutableHdr( const string& hdr ) {
-		return m_setImmutableHdrs.end() != m_setImmutableHdrs.find( hdr ) ;
+	bool isImmutableHdr( std::string_view hdr ) {
+		return isImmutableHeader( sipHeaderId( hdr ) ) ;
 	}
 
-	bool getTagTypeForHdr( const string& hdr, tag_type_t& tag ) {
-		mapHdr2Tag::const_iterator it = m_mapHdr2Tag.find( hdr ) ;
-		if( it != m_mapHdr2Tag.end() ) {
-		    tag = it->second ;
-		    return true ;
-		}		
-		return false ;
+	bool getTagTypeForHdr( std::string_view hdr, tag_type_t& tag ) {
+		sip_header_id id = sipHeaderId( hdr ) ;
+		if( sip_hdr_unknown == id ) return false ;
+		tag = tagForHeader( id ) ;
+		return true ;
 	}
 
 	void getSourceAddressForMsg(msg_t *msg, string& host) {
@@ -223,21 +88,6 @@ namespace drachtio {
         host.assign(name);
     }
 
-    void makeUniqueSipTransactionIdentifier(sip_t* sip, string& str) {
-      str = sip->sip_call_id->i_id ;
-      str.append("|") ;
-      str.append((sip->sip_request && sip_method_cancel == sip->sip_request->rq_method) ?
-        "INVITE" :
-        sip->sip_cseq->cs_method_name) ;
-      str.append("|") ;
-      str.append( boost::lexical_cast<std::string>(sip->sip_cseq->cs_seq) ) ;
-      if (sip->sip_via && sip->sip_via->v_branch) {
-        str.append("|") ;
-        str.append(sip->sip_via->v_branch) ;
-      }
-      //DR_LOG(log_debug) << "makeUniqueSipTransactionIdentifier: " << str ;
-    }
-
 	void generateUuid(string& uuid) {
 #ifdef BOOST_UUID
 	    boost::uuids::uuid id = boost::uuids::random_generator()();
@@ -269,50 +119,27 @@ namespace drachtio {
         }
     }
     bool parseTransportDescription( const string& desc, string& proto, string& host, string& port ) {
-        try {
-            std::regex re("^(.*)/(.*):(\\d+)");
-            std::smatch mr;
-            if (std::regex_search(desc, mr, re) && mr.size() > 1) {
-                proto = mr[1] ;
-                host = mr[2] ;
-                port = mr[3] ;
-                return true ;  
-            }
-        } catch (std::regex_error& e) {
-            DR_LOG(log_error) << "parseTransportDescription - regex error: " << e.what();
-        }
-        return false;
+        scan::TransportDescription td ;
+        if( !scan::transportDescription( desc, td ) ) return false ;
+        proto.assign( td.proto ) ;
+        host.assign( td.host ) ;
+        port.assign( td.port ) ;
+        return true ;
     }
     bool parseSipUri(const string& uri, string& scheme, string& userpart, string& hostpart, string& port, 
     vector< pair<string,string> >& params) {
 
-        try {
-            std::regex re("^<?(sip|sips):(?:([^;]+)@)?([^;|^>|^:]+)(?::(\\d+))?(?:;([^>]+))?>?$");
-            std::regex re2("^<?(sip|sips):(?:([^;]+)@)?(\\[[0-9a-fA-F:]+\\])(?::(\\d+))?(?:;([^>]+))?>?$");
-            std::smatch mr;
-            if (std::regex_search(uri, mr, re) || std::regex_search(uri, mr, re2)) {
-                scheme = mr[1] ;
-                userpart = mr[2] ;
-                hostpart = mr[3] ;
-                port = mr[4] ; 
-
-                string paramString = mr[5] ;
-                if (paramString.length() > 0) {
-                  vector<string> strs;
-                  boost::split(strs, paramString, boost::is_any_of(";"));
-                  for (vector<string>::iterator it = strs.begin(); it != strs.end(); ++it) {
-                    vector<string> kv ;
-                    boost::split(kv, *it, boost::is_any_of("="));
-                    std::pair<string, string> kvpair(kv[0], kv.size() == 2 ? kv[1] : "");
-                    params.push_back(kvpair);
-                  }
-                }
-                return true ;
-            }
-        } catch (std::regex_error& e) {
-            DR_LOG(log_error) << "parseSipUri - regex error: " << e.what();
-        }
-        return false;
+        scan::SipUri u ;
+        if( !scan::sipUri( uri, u ) ) return false ;
+
+        scheme.assign( u.scheme ) ;
+        userpart.assign( u.user ) ;
+        hostpart.assign( u.host ) ;
+        port.assign( u.port ) ;
+        scan::sipUriParams( u.params, [&params]( std::string_view name, std::string_view value ) {
+            params.push_back( std::pair<string, string>( string( name ), string( value ) ) ) ;
+        }) ;
+        return true ;
     }
 
 	void parseGenericHeader( msg_common_t* p, string& hvalue) {
@@ -322,18 +149,11 @@ namespace drachtio {
         if( std::distance( tok.begin(), tok.end() ) > 1 ) hvalue = *(++tok.begin() ) ;
  	}
 
-    bool FindCSeqMethod( const string& headers, string& method ) {
-        try {
-            std::regex re("^CSeq:\\s+\\d+\\s+(\\w+)$");
-            std::smatch mr;
-            if (std::regex_search(headers, mr, re) && mr.size() > 1) {
-                method = mr[1] ;
-                return true ;                
-            }
-        } catch (std::regex_error& e) {
-            DR_LOG(log_error) << "FindCSeqMethod - regex error: " << e.what();
-        }
-        return false;
+    bool FindCSeqMethod( std::string_view headers, string& method ) {
+        std::string_view m ;
+        if( !scan::cseqMethod( headers, m ) ) return false ;
+        method.assign( m ) ;
+        return true ;
     }
 
     void EncodeStackMessage( const sip_t* sip, string& encodedMessage ) {
@@ -363,6 +183,13 @@ namespace drachtio {
         }
     }
 
+    encoded_msg_ptr EncodeStackMessage( msg_t* msg ) {
+        auto encodedMessage = std::make_shared<string>() ;
+        encodedMessage->reserve( msg_size( msg ) ) ;
+        EncodeStackMessage( sip_object( msg ), *encodedMessage ) ;
+        return encodedMessage ;
+    }
+
     bool normalizeSipUri( std::string& uri, int brackets ) {
         su_home_t* home = theOneAndOnlyController->getHome() ;
         char *s ;
@@ -452,10 +279,14 @@ namespace drachtio {
         return true ;
     }
 
-    sip_method_t methodType( const string& method ) {
-        mapMethod2Type::const_iterator it = m_mapMethod2Type.find( method ) ;
-        if( m_mapMethod2Type.end() == it ) return sip_method_unknown ;
-        return it->second ;
+    sip_method_t methodType( std::string_view method ) {
+        static const sip_method_t methods[] = {
+            #define DR_SOFIA_METHOD(name, method) sip_method_##method,
+            DR_SIP_METHODS(DR_SOFIA_METHOD)
+            #undef DR_SOFIA_METHOD
+            sip_method_unknown
+        } ;
+        return methods[ sipMethodId( method ) ] ;
     }
  
     bool isLocalSipUri( const string& requestUri ) {
@@ -579,27 +410,34 @@ namespace drachtio {
         }
     }
 
-    void splitTokens( const string& s, vector<string>& vec ) {
-        split( vec, s, boost::is_any_of("|") /*, boost::token_compress_on */); 
+    void splitTokens( std::string_view s, vector<std::string_view>& vec ) {
+        vec.clear() ;
+        size_t start = 0 ;
+        size_t pos ;
+        while( std::string_view::npos != (pos = s.find('|', start)) ) {
+            vec.push_back( s.substr(start, pos - start) ) ;
+            start = pos + 1 ;
+        }
+        vec.push_back( s.substr(start) ) ;
     }
 
-    void splitMsg( const string& msg, string& meta, string& startLine, string& headers, string& body ) {
+    void splitMsg( std::string_view msg, std::string_view& meta, std::string_view& startLine, std::string_view& headers, std::string_view& body ) {
         size_t pos = msg.find( DR_CRLF ) ;
-        if( string::npos == pos ) {
+        if( std::string_view::npos == pos ) {
             meta = msg ;
             return ;
         }
         meta = msg.substr(0, pos) ;
-        string chunk = msg.substr(pos+DR_CRLF.length()) ;
+        std::string_view chunk = msg.substr(pos+DR_CRLF.length()) ;
 
         pos = chunk.find( DR_CRLF2 ) ;
-        if( string::npos != pos  ) {
+        if( std::string_view::npos != pos  ) {
             body = chunk.substr( pos + DR_CRLF2.length() ) ;
             chunk = chunk.substr( 0, pos ) ;
         }
 
         pos = chunk.find( DR_CRLF ) ;
-        if( string::npos == pos ) {
+        if( std::string_view::npos == pos ) {
             startLine = chunk ;
         }
         else {
@@ -609,166 +447,94 @@ namespace drachtio {
     }
 
     sip_method_t parseStartLine( const string& startLine, string& methodName, string& requestUri ) {
-        boost::char_separator<char> sep(" ");
-        boost::tokenizer< boost::char_separator<char> > tokens(startLine, sep);
-        int i = 0 ;
-        sip_method_t method = sip_method_invalid ;
-        BOOST_FOREACH (const string& t, tokens) {
-            switch( i++ ) {
-                case 0:
-                    methodName = t ;
-                    if( 0 == t.compare("INVITE") ) method = sip_method_invite ;
-                    else if( 0 == t.compare("ACK") ) method = sip_method_ack ;
-                    else if( 0 == t.compare("PRACK") ) method = sip_method_prack ;
-                    else if( 0 == t.compare("CANCEL") ) method = sip_method_cancel ;
-                    else if( 0 == t.compare("BYE") ) method = sip_method_bye ;
-                    else if( 0 == t.compare("OPTIONS") ) method = sip_method_options ;
-                    else if( 0 == t.compare("REGISTER") ) method = sip_method_register ;
-                    else if( 0 == t.compare("INFO") ) method = sip_method_info ;
-                    else if( 0 == t.compare("UPDATE") ) method = sip_method_update ;
-                    else if( 0 == t.compare("MESSAGE") ) method = sip_method_message ;
-                    else if( 0 == t.compare("SUBSCRIBE") ) method = sip_method_subscribe ;
-                    else if( 0 == t.compare("NOTIFY") ) method = sip_method_notify ;
-                    else if( 0 == t.compare("REFER") ) method = sip_method_refer ;
-                    else if( 0 == t.compare("PUBLISH") ) method = sip_method_publish ;
-                    else method = sip_method_unknown ;
-                    break ;
-
-                case 1:
-                    requestUri = t ;
-                    break ;
-
-                default:
-                break ;
-            }
-        }
-        return method ;
+        // method, request uri and sip version, separated by one or more spaces
+        std::string_view line( startLine ) ;
+        size_t start = line.find_first_not_of(' ') ;
+        if( std::string_view::npos == start ) return sip_method_invalid ;
+
+        size_t end = line.find(' ', start) ;
+        std::string_view method = line.substr( start, std::string_view::npos == end ? end : end - start ) ;
+        methodName.assign( method ) ;
+        if( std::string_view::npos != end && std::string_view::npos != (start = line.find_first_not_of(' ', end)) ) {
+            end = line.find(' ', start) ;
+            requestUri.assign( line.substr( start, std::string_view::npos == end ? end : end - start ) ) ;
+        }
+        return methodType( method ) ;
     }
 
-    bool GetValueForHeader( const string& headers, const char *szHeaderName, string& headerValue ) {
-        vector<string> vec ;
-        splitLines( headers, vec ) ;
-        for( std::vector<string>::const_iterator it = vec.begin(); it != vec.end(); ++it )  {
-            string hdrName ;
-            size_t pos = (*it).find_first_of(":") ;
-            if( string::npos != pos ) {
-                hdrName = (*it).substr(0,pos) ;
-                boost::trim( hdrName );
-
-                if( boost::iequals( hdrName, szHeaderName ) ) {
-                    headerValue = (*it).substr(pos+1) ;
-                    boost::trim( headerValue ) ;    
-                    return true ;                
-                }
-            }
-        }
-        return false ;
+    std::unique_ptr<char[]> packFields( std::initializer_list< std::pair<std::string_view, std::string_view*> > fields ) {
+        size_t len = 0 ;
+        for( const auto& f : fields ) len += f.first.length() + 1 ;
+        std::unique_ptr<char[]> buffer( new char[len] ) ;
+        char* p = buffer.get() ;
+        for( const auto& f : fields ) {
+            if( !f.first.empty() ) memcpy( p, f.first.data(), f.first.length() ) ;
+            p[f.first.length()] = '\0' ;
+            *f.second = std::string_view( p, f.first.length() ) ;
+            p += f.first.length() + 1 ;
+        }
+        return buffer ;
     }
     void deleteTags( tagi_t* tags ) {
-        if (!tags) return;
-        int i = 0 ;
-        while( tags[i].t_tag != tag_null ) {
-            if( tags[i].t_value ) {
-                char *p = (char *) tags[i].t_value ;
-                delete [] p ;
-            }
-             i++ ;
-        }       
-        delete [] tags ; 
+        if( tags ) deleteCompiledTags( tags ) ;
     }
 
-    tagi_t* makeSafeTags( const string&  hdrs) {
-        vector<string> vec ;
-        
-        splitLines( hdrs, vec ) ;
-        int nHdrs = vec.size() ;
-        tagi_t *tags = new tagi_t[nHdrs+1] ;
-        int i = 0; 
-        for( std::vector<string>::const_iterator it = vec.begin(); it != vec.end(); ++it )  {
-            tags[i].t_tag = tag_skip ;
-            tags[i].t_value = (tag_value_t) 0 ;                     
-            bool bValid = true ;
-            string hdrName, hdrValue ;
-
-            //parse header name and value
-            size_t pos = (*it).find_first_of(":") ;
-            if( string::npos == pos ) {
-                bValid = false ;
-            }
-            else {
-                hdrName = (*it).substr(0,pos) ;
-                boost::trim( hdrName );
-                if( string::npos != hdrName.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234567890-_") ) {
-                    bValid = false ;
-                }
-                else {
-                    hdrValue = (*it).substr(pos+1) ;
-                    boost::trim( hdrValue ) ;
+    namespace {
+        // logging and the preserved header names shared by makeTags and makeSafeTags
+        struct LoggingTagPolicy : public TagPolicy {
+            LoggingTagPolicy() : m_preserved( theOneAndOnlyController->getPreservedHeaderNames() ) {}
+
+            bool preserveCase( std::string_view name ) {
+                for( const auto& header : m_preserved ) {
+                    if( boost::iequals( header, name ) ) return true ;
                 }
+                return false ;
             }
-            if( !bValid ) {
-                DR_LOG(log_error) << "makeTags - invalid header: '" << *it << "'"  ;
-                i++ ;
-                continue ;
+            void invalidHeader( std::string_view line ) {
+                DR_LOG(log_error) << "makeTags - invalid header: '" << line << "'"  ;
             }
-            else if( string::npos != hdrValue.find(DR_CRLF) ) {
-                DR_LOG(log_error) << "SipDialogController::makeTags - client supplied invalid custom header value (contains CR or LF) for header '" << hdrName << "'" ;
-                i++ ;
-                continue ;
+            void immutableHeader( std::string_view name, sip_header_id id ) {
+                if( sip_hdr_content_length != id ) {
+                    DR_LOG(log_debug) << "makeTags - discarding header because client is not allowed to set dialog-level headers: '" << name  ;
+                }
             }
 
-            //treat well-known headers differently than custom headers 
-            tag_type_t tt ;
-            string hdr = boost::to_lower_copy( boost::replace_all_copy( hdrName, "-", "_" ) );
-            if( isImmutableHdr( hdr ) ) {
-                if( 0 != hdr.compare("content_length") ) {
-                    DR_LOG(log_debug) << "makeTags - discarding header because client is not allowed to set dialog-level headers: '" << hdrName  ;
-                }
+            const std::unordered_set<std::string>& m_preserved ;
+        } ;
+
+        // requests within a dialog may not change the addresses that identify it
+        struct SafeTagPolicy : public LoggingTagPolicy {
+            bool admitAddressHeader( std::string_view name, std::string_view value, std::string& rewritten ) {
+                DR_LOG(log_debug) << "makeSafeTags - hdr '" << name << "' can not be modified";
+                return false ;
             }
-            else if( getTagTypeForHdr( hdr, tt ) ) {
-                //well-known header
-                
-                //replace 'localhost' in certain headers with actual sip address:port
-                if( 0 == hdr.compare("from") || 
-                    0 == hdr.compare("contact") ||
-                    0 == hdr.compare("to") ||
-                    0 == hdr.compare("p_asserted_identity") ) {
+        } ;
 
-                    DR_LOG(log_debug) << "makeSafeTags - hdr '" << hdrName << "' can not be modified";
-                }
-                else {
-                    int len = hdrValue.length() ;
-                    char *p = new char[len+1] ;
-                    memset(p, '\0', len+1) ;
-                    strncpy( p, hdrValue.c_str(), len ) ;
-                    tags[i].t_tag = tt;
-                    tags[i].t_value = (tag_value_t) p ;
-                    DR_LOG(log_debug) << "makeTags - Adding well-known header '" << hdrName << "' with value '" << p << "'"  ;
+        // 'localhost' in an address header is replaced by the address of the transport we send on
+        struct LocalhostTagPolicy : public LoggingTagPolicy {
+            LocalhostTagPolicy( const string& host, const string& port ) : m_host(host), m_port(port) {}
+
+            bool admitAddressHeader( std::string_view name, std::string_view value, std::string& rewritten ) {
+                if( std::string_view::npos != value.find("@localhost") ) {
+                    DR_LOG(log_debug) << "makeTags - hdr '" << name << "' replacing host with " << m_host;
+                    rewritten.assign( value ) ;
+                    replaceHostInUri( rewritten, m_host.c_str(), m_port.c_str() ) ;
                 }
+                return true ;
             }
-            else {
-               //custom header
-                std::ostringstream oss;
-                oss << capitalizeAfterDash(hdrName) << ": " << hdrValue;
-                int len = oss.str().length() ;
-                char *p = new char[len+1] ;
-                memset(p, '\0', len+1) ;
-                strcpy( p, oss.str().c_str()) ;
-                tags[i].t_tag = siptag_unknown_str ;
-                tags[i].t_value = (tag_value_t) p ;
-                DR_LOG(log_debug) << "makeTags - custom header: '" << hdrName << "', value: " << hdrValue  ;
-            }
-            i++ ;
-        }
-        tags[nHdrs].t_tag = tag_null ;
-        tags[nHdrs].t_value = (tag_value_t) 0 ;       
 
-        return tags ;   //NB: caller responsible to delete after use to free memory      
+            const string& m_host ;
+            const string& m_port ;
+        } ;
+    }
+
+    tagi_t* makeSafeTags( const HeaderIndex& hdrs) {
+        SafeTagPolicy policy ;
+        return compileTags( hdrs, policy ) ;    //NB: caller responsible to delete after use to free memory
     }
 
-    tagi_t* makeTags( const string&  hdrs, const string& transport, const char* szExternalIP ) {
-        vector<string> vec ;
-        string proto, host, port, myHostport ;
+    tagi_t* makeTags( const HeaderIndex& hdrs, const string& transport, const char* szExternalIP ) {
+        string proto, host, port ;
         
         parseTransportDescription(transport, proto, host, port ) ;
 
@@ -777,90 +543,8 @@ namespace drachtio {
             DR_LOG(log_debug) << "makeTags - using external IP as replacement for 'localhost': " << szExternalIP  ;
         }
 
-        splitLines( hdrs, vec ) ;
-        int nHdrs = vec.size() ;
-        tagi_t *tags = new tagi_t[nHdrs+1] ;
-        int i = 0; 
-        for( std::vector<string>::const_iterator it = vec.begin(); it != vec.end(); ++it )  {
-            tags[i].t_tag = tag_skip ;
-            tags[i].t_value = (tag_value_t) 0 ;                     
-            bool bValid = true ;
-            string hdrName, hdrValue ;
-
-            //parse header name and value
-            size_t pos = (*it).find_first_of(":") ;
-            if( string::npos == pos ) {
-                bValid = false ;
-            }
-            else {
-                hdrName = (*it).substr(0,pos) ;
-                boost::trim( hdrName );
-                if( string::npos != hdrName.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234567890-_") ) {
-                    bValid = false ;
-                }
-                else {
-                    hdrValue = (*it).substr(pos+1) ;
-                    boost::trim( hdrValue ) ;
-                }
-            }
-            if( !bValid ) {
-                DR_LOG(log_error) << "makeTags - invalid header: '" << *it << "'"  ;
-                i++ ;
-                continue ;
-            }
-            else if( string::npos != hdrValue.find(DR_CRLF) ) {
-                DR_LOG(log_error) << "SipDialogController::makeTags - client supplied invalid custom header value (contains CR or LF) for header '" << hdrName << "'" ;
-                i++ ;
-                continue ;
-            }
-
-            //treat well-known headers differently than custom headers 
-            tag_type_t tt ;
-            string hdr = boost::to_lower_copy( boost::replace_all_copy( hdrName, "-", "_" ) );
-            if( isImmutableHdr( hdr ) ) {
-                if( 0 != hdr.compare("content_length") ) {
-                    DR_LOG(log_debug) << "makeTags - discarding header because client is not allowed to set dialog-level headers: '" << hdrName  ;
-                }
-            }
-            else if( getTagTypeForHdr( hdr, tt ) ) {
-                //well-known header
-                
-                //replace 'localhost' in certain headers with actual sip address:port
-                if( string::npos != hdrValue.find("@localhost") && (0 == hdr.compare("from") || 
-                    0 == hdr.compare("contact") ||
-                    0 == hdr.compare("to") ||
-                    0 == hdr.compare("p_asserted_identity") ) ) {
-
-                    DR_LOG(log_debug) << "makeTags - hdr '" << hdrName << "' replacing host with " << host;
-                    replaceHostInUri( hdrValue, host.c_str(), port.c_str() ) ;
-                }
-                int len = hdrValue.length() ;
-                char *p = new char[len+1] ;
-                memset(p, '\0', len+1) ;
-                strncpy( p, hdrValue.c_str(), len ) ;
-                tags[i].t_tag = tt;
-                tags[i].t_value = (tag_value_t) p ;
-                DR_LOG(log_debug) << "makeTags - Adding well-known header '" << hdrName << "' with value '" << p << "'"  ;
-            }
-            else {
-               //custom header
-                std::ostringstream oss;
-                oss << capitalizeAfterDash(hdrName) << ": " << hdrValue;
-                int len = oss.str().length() ;
-                char *p = new char[len+1] ;
-                memset(p, '\0', len+1) ;
-                strcpy( p, oss.str().c_str()) ;
-                tags[i].t_tag = siptag_unknown_str ;
-                tags[i].t_value = (tag_value_t) p ;
-                DR_LOG(log_debug) << "makeTags - custom header: '" << hdrName << "', value: " << hdrValue  ;
-            }
-
-            i++ ;
-        }
-        tags[nHdrs].t_tag = tag_null ;
-        tags[nHdrs].t_value = (tag_value_t) 0 ;       
-
-        return tags ;   //NB: caller responsible to delete after use to free memory      
+        LocalhostTagPolicy policy( host, port ) ;
+        return compileTags( hdrs, policy ) ;    //NB: caller responsible to delete after use to free memory
     }
  	bool isRfc1918(const char* szHost) {
         string str = szHost;
@@ -942,90 +626,68 @@ namespace drachtio {
         return e.str();
     }
 
-    SipMsgData_t::SipMsgData_t(const string& str ) {
+    SipMsgData_t::SipMsgData_t(const string& str ) : m_bytes(0), m_port(0), m_protocol(protocol_unknown), m_family(0) {
         boost::char_separator<char> sep(" []//:") ;
         tokenizer tok( str, sep) ;
         tokenizer::iterator it = tok.begin() ;
 
         m_source = 0 == (*it).compare("recv") ? "network" : "application" ;
         it++ ;
-        m_bytes = *(it) ;
+        m_bytes = ::atoi( (*it).c_str() ) ;
         it++; it++; it++ ;
-        m_protocol = *(it) ;
-        m_address = *(++it) ;
-        m_port = *(++it) ;
+        if( 0 == (*it).compare("udp") ) m_protocol = protocol_udp ;
+        else if( 0 == (*it).compare("tcp") ) m_protocol = protocol_tcp ;
+        else if( 0 == (*it).compare("tls") ) m_protocol = protocol_tls ;
+        setAddress( (*(++it)).c_str() ) ;
+        m_port = ::atoi( (*(++it)).c_str() ) ;
         it++ ;  
-        string t = *(++it) + ":" + *(++it) + ":" + *(++it) + "." + *(++it) ;
-        m_time = t.substr(0, t.size()-2);
+
+        /* the stack logs only the time of day; take it to be the most recent such time */
+        unsigned int hour = ::atoi( (*(++it)).c_str() ) ;
+        unsigned int minute = ::atoi( (*(++it)).c_str() ) ;
+        const string& seconds = *(++it) ;
+        unsigned int second = ::atoi( seconds.c_str() ) ;
+        size_t dot = seconds.find('.') ;
+
+        su_time_t now = su_now() ;
+        m_time.tv_sec = now.tv_sec - (now.tv_sec % 86400) + hour * 3600 + minute * 60 + second ;
+        if( m_time.tv_sec > now.tv_sec + 60 ) m_time.tv_sec -= 86400 ;
+        m_time.tv_usec = string::npos == dot ? 0 : ::atoi( seconds.c_str() + dot + 1 ) ;
     }
 
     SipMsgData_t::SipMsgData_t( msg_t* msg ) : m_source("network") {
-        su_time_t now = su_now() ;
-        unsigned short second, minute, hour;
-        char time[64] ;
+        m_time = su_now() ;
         tport_t *tport = nta_incoming_transport(theOneAndOnlyController->getAgent(), NULL, msg) ;        
         assert(NULL != tport) ;
 
-        second = (unsigned short)(now.tv_sec % 60);
-        minute = (unsigned short)((now.tv_sec / 60) % 60);
-        hour = (unsigned short)((now.tv_sec / 3600) % 24);
-        snprintf(time, sizeof(time), "%02u:%02u:%02u.%06lu", hour, minute, second, now.tv_usec) ;
- 
-        m_time.assign( time ) ;
-        if( tport_is_udp(tport ) ) m_protocol = "udp" ;
-        else if( tport_has_tls( tport ) ) m_protocol = "tls" ;
-        else if( tport_is_tcp( tport)  ) m_protocol = "tcp" ;
-
+        setProtocol( tport ) ;
         tport_unref( tport ) ;
 
         init( msg ) ;
     }
     SipMsgData_t::SipMsgData_t( msg_t* msg, nta_incoming_t* irq, const char* source ) : m_source(source) {
-        su_time_t now = su_now() ;
-        unsigned short second, minute, hour;
-        char time[64] ;
+        m_time = su_now() ;
         tport_t *tport = nta_incoming_transport(theOneAndOnlyController->getAgent(), irq, msg) ;  
 
-        second = (unsigned short)(now.tv_sec % 60);
-        minute = (unsigned short)((now.tv_sec / 60) % 60);
-        hour = (unsigned short)((now.tv_sec / 3600) % 24);
-        snprintf(time, sizeof(time), "%02u:%02u:%02u.%06lu", hour, minute, second, now.tv_usec) ;
- 
-        m_time.assign( time ) ;
-        if( tport_is_udp(tport ) ) m_protocol = "udp" ;
-        else if( tport_is_tcp( tport)  ) m_protocol = "tcp" ;
-        else if( tport_has_tls( tport ) ) m_protocol = "tls" ;
-
+        setProtocol( tport ) ;
         tport_unref( tport ) ;
 
         init( msg ) ;
     }
     SipMsgData_t::SipMsgData_t( msg_t* msg, nta_outgoing_t* orq, const char* source ) : m_source(source) {
-        su_time_t now = su_now() ;
-        unsigned short second, minute, hour;
-        char time[64] ;
+        m_time = su_now() ;
         tport_t *tport = nta_outgoing_transport( orq ) ;    //adds a a reference
         //assert( tport ) ; //why would this ever be null?
 
-        second = (unsigned short)(now.tv_sec % 60);
-        minute = (unsigned short)((now.tv_sec / 60) % 60);
-        hour = (unsigned short)((now.tv_sec / 3600) % 24);
-        snprintf(time, sizeof(time), "%02u:%02u:%02u.%06lu", hour, minute, second, now.tv_usec) ;
- 
-        m_time.assign( time ) ;
-
-        if( tport_is_udp(tport ) ) m_protocol = "udp" ;
-        else if( tport_is_tcp( tport)  ) m_protocol = "tcp" ;
-        else if( tport_has_tls( tport ) ) m_protocol = "tls" ;
-        else m_protocol = "unknown";
+        setProtocol( tport ) ;
 
         init( msg ) ;
 
         if( 0 == strcmp(source, "application") ) {
             if( NULL != tport ) {
                 const tp_name_t* name = tport_name(tport) ;
-                m_address = name->tpn_host ;
-                m_port = name->tpn_port ;                
+                setAddress( name->tpn_host ) ;
+                m_port = name->tpn_port ? ::atoi( name->tpn_port ) : 0 ;
             }
             //
             /*
@@ -1042,17 +704,117 @@ namespace drachtio {
     }
     void SipMsgData_t::init( msg_t* msg ) {
         su_sockaddr_t const *su = msg_addr(msg);
-        short port ;
-        char name[SU_ADDRSIZE] = "";
-        char szTmp[10] ;
 
-        su_inet_ntop(su->su_family, SU_ADDR(su), name, sizeof(name));
+        m_family = 0 ;
+        memset( m_addr, 0, sizeof(m_addr) ) ;
+        if( AF_INET == su->su_family ) {
+            m_family = 4 ;
+            memcpy( m_addr, &su->su_sin.sin_addr, 4 ) ;
+        }
+        else if( AF_INET6 == su->su_family ) {
+            m_family = 6 ;
+            memcpy( m_addr, &su->su_sin6.sin6_addr, 16 ) ;
+        }
+        m_port = ntohs(su->su_port) ;
+        m_bytes = msg_size( msg ) ;
+    }
+    void SipMsgData_t::setProtocol( tport_t* tport ) {
+        if( NULL == tport ) m_protocol = protocol_unknown ;
+        else if( tport_is_udp( tport ) ) m_protocol = protocol_udp ;
+        else if( tport_has_tls( tport ) ) m_protocol = protocol_tls ;
+        else if( tport_is_tcp( tport ) ) m_protocol = protocol_tcp ;
+        else m_protocol = protocol_unknown ;
+    }
+    void SipMsgData_t::setAddress( const char* address ) {
+        char host[INET6_ADDRSTRLEN] = "" ;
+        size_t len = address ? strlen( address ) : 0 ;
+
+        /* ipv6 transports are named in brackets */
+        if( len > 2 && '[' == address[0] && ']' == address[len - 1] && len - 2 < sizeof(host) ) {
+            memcpy( host, address + 1, len - 2 ) ;
+            host[len - 2] = '\0' ;
+        }
+        else if( len < sizeof(host) && len > 0 ) {
+            memcpy( host, address, len + 1 ) ;
+        }
 
-        m_address.assign( name ) ;
-        snprintf( szTmp, sizeof(szTmp), "%u", ntohs(su->su_port) ) ;
-        m_port.assign( szTmp );
-        snprintf( szTmp, sizeof(szTmp), "%u", msg_size( msg ) ) ;
-        m_bytes.assign( szTmp ) ;
+        m_hostName.clear() ;
+        memset( m_addr, 0, sizeof(m_addr) ) ;
+        if( 1 == inet_pton( AF_INET, host, m_addr ) ) m_family = 4 ;
+        else if( 1 == inet_pton( AF_INET6, host, m_addr ) ) m_family = 6 ;
+        else {
+            m_family = 0 ;
+            if( address ) m_hostName.assign( address ) ;
+        }
+    }
+    const char* SipMsgData_t::getProtocol() const {
+        switch( m_protocol ) {
+            case protocol_udp: return "udp" ;
+            case protocol_tcp: return "tcp" ;
+            case protocol_tls: return "tls" ;
+            default: return "unknown" ;
+        }
+    }
+    uint64_t SipMsgData_t::getTimestamp() const {
+        if( 0 == m_time.tv_sec ) return 0 ;
+        return (uint64_t) (m_time.tv_sec - SU_TIME_EPOCH) * 1000000 + m_time.tv_usec ;
+    }
+    string SipMsgData_t::getAddress() const {
+        string s ;
+        appendAddress( s ) ;
+        return s ;
+    }
+    string SipMsgData_t::getTime() const {
+        string s ;
+        appendTime( s ) ;
+        return s ;
+    }
+    void SipMsgData_t::appendAddress( string& s ) const {
+        if( !m_hostName.empty() ) {
+            s.append( m_hostName ) ;
+            return ;
+        }
+        if( 0 == m_family ) return ;
+
+        char name[INET6_ADDRSTRLEN] ;
+        if( inet_ntop( 4 == m_family ? AF_INET : AF_INET6, m_addr, name, sizeof(name) ) ) s.append( name ) ;
+    }
+    void SipMsgData_t::appendTime( string& s ) const {
+
+        /* hh:mm:ss only changes once a second, so each thread keeps the last one it formatted */
+        thread_local unsigned long cachedSecond = 0 ;
+        thread_local char prefix[16] = "" ;
+        if( cachedSecond != (unsigned long) m_time.tv_sec || '\0' == prefix[0] ) {
+            unsigned short second = (unsigned short)(m_time.tv_sec % 60);
+            unsigned short minute = (unsigned short)((m_time.tv_sec / 60) % 60);
+            unsigned short hour = (unsigned short)((m_time.tv_sec / 3600) % 24);
+            snprintf( prefix, sizeof(prefix), "%02u:%02u:%02u.", hour, minute, second ) ;
+            cachedSecond = m_time.tv_sec ;
+        }
+        s.append( prefix, 9 ) ;
+
+        char usec[6] ;
+        unsigned long v = m_time.tv_usec ;
+        for( int i = 5; i >= 0; i-- ) {
+            usec[i] = '0' + (v % 10) ;
+            v /= 10 ;
+        }
+        s.append( usec, sizeof(usec) ) ;
+    }
+    void SipMsgData_t::appendMessageFormat( string& s ) const {
+        char num[16] ;
+
+        s.append( m_source ) ;
+        s.push_back( '|' ) ;
+        s.append( num, std::to_chars( num, num + sizeof(num), m_bytes ).ptr - num ) ;
+        s.push_back( '|' ) ;
+        s.append( getProtocol() ) ;
+        s.push_back( '|' ) ;
+        appendAddress( s ) ;
+        s.push_back( '|' ) ;
+        s.append( num, std::to_chars( num, num + sizeof(num), m_port ).ptr - num ) ;
+        s.push_back( '|' ) ;
+        appendTime( s ) ;
     }
 
      int ackResponse( msg_t* msg ) {
@@ -29,9 +29,13 @@ THE SOFTWARE.
 #include <sys/stat.h>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <string.h>
 #include <iostream>
 #include <unordered_map>
 #include <chrono>
+#include <memory>
+#include <initializer_list>
 
 #if defined(__clang__)
     #pragma clang diagnostic push
@@ -63,6 +67,8 @@ THE SOFTWARE.
 #endif
 
 #include "sip-transports.hpp"
+#include "header-index.hpp"
+#include "transaction-key.hpp"
 
 using namespace std ;
 
@@ -75,6 +81,10 @@ const string STATS_COUNTER_SIP_REQUESTS_IN = "drachtio_sip_requests_in_total";
 const string STATS_COUNTER_SIP_REQUESTS_OUT = "drachtio_sip_requests_out_total";
 const string STATS_COUNTER_SIP_RESPONSES_IN = "drachtio_sip_responses_in_total";
 const string STATS_COUNTER_SIP_RESPONSES_OUT = "drachtio_sip_responses_out_total";
+const string STATS_COUNTER_BLACKLIST_DROPPED_PACKETS = "drachtio_blacklist_dropped_packets_total";
+const string STATS_COUNTER_BLACKLIST_DROPPED_BYTES = "drachtio_blacklist_dropped_bytes_total";
+const string STATS_COUNTER_SESSION_REFRESHES_DEFERRED = "drachtio_session_refreshes_deferred_total";
+const string STATS_COUNTER_DIALOG_STORE_CONTENTION = "drachtio_dialog_store_lock_contention_total";
 
 const string STATS_GAUGE_START_TIME = "drachtio_time_started";
 const string STATS_GAUGE_STABLE_DIALOGS = "drachtio_stable_dialogs";
@@ -97,11 +107,17 @@ const string STATS_GAUGE_SOFIA_BAD_MSGS = "drachtio_sofia_bad_msgs_recv";
 const string STATS_GAUGE_SOFIA_BAD_REQS = "drachtio_sofia_bad_reqs_recv";
 const string STATS_GAUGE_SOFIA_RETRANS_REQ = "drachtio_sofia_retransmitted_requests";
 const string STATS_GAUGE_SOFIA_RETRANS_RES = "drachtio_sofia_retransmitted_responses";
+const string STATS_GAUGE_TIMER_QUEUE_SIZE = "drachtio_timer_queue_size";
 
 const string STATS_HISTOGRAM_INVITE_RESPONSE_TIME_IN = "drachtio_call_answer_seconds_in";
 const string STATS_HISTOGRAM_INVITE_RESPONSE_TIME_OUT = "drachtio_call_answer_seconds_out";
 const string STATS_HISTOGRAM_INVITE_PDD_IN = "drachtio_call_pdd_seconds_in";
 const string STATS_HISTOGRAM_INVITE_PDD_OUT = "drachtio_call_pdd_seconds_out";
+const string STATS_HISTOGRAM_APP_WRITE_QUEUE_DEPTH = "drachtio_app_write_queue_depth";
+const string STATS_HISTOGRAM_APP_WRITE_FLUSH_BYTES = "drachtio_app_write_flush_bytes";
+const string STATS_HISTOGRAM_HANDOFF_BATCH_SIZE = "drachtio_handoff_batch_size";
+const string STATS_HISTOGRAM_HANDOFF_LATENCY = "drachtio_handoff_latency_seconds";
+const string STATS_HISTOGRAM_TIMER_LATENESS = "drachtio_timer_lateness_seconds";
 
 #define TIMER_C_MSECS (185000)
 #define TIMER_B_MSECS (NTA_SIP_T1 * 64)
@@ -145,8 +161,6 @@ namespace drachtio {
 
 	void getSourceAddressForMsg(msg_t *msg, string& host);
 
-  void makeUniqueSipTransactionIdentifier(sip_t* sip, string& str) ;
-
 	void getTransportDescription( const tport_t* tp, string& desc ) ;
 
 	bool parseTransportDescription( const string& desc, string& proto, string& host, string& port ) ;
@@ -155,15 +169,15 @@ namespace drachtio {
 
 	void parseGenericHeader( msg_common_t* p, std::string& hvalue) ;
 
-	bool isImmutableHdr( const std::string& hdr ) ;
+	bool isImmutableHdr( std::string_view hdr ) ;
 
-	bool getTagTypeForHdr( const std::string& hdr, tag_type_t& tag ) ;
+	bool getTagTypeForHdr( std::string_view hdr, tag_type_t& tag ) ;
 
 	bool normalizeSipUri( std::string& uri, int brackets ) ;
   
 	bool replaceHostInUri( std::string& uri, const char* szHost, const char* szPort ) ;
 
-	sip_method_t methodType( const std::string& method ) ;
+	sip_method_t methodType( std::string_view method ) ;
 
 	bool isLocalSipUri( const std::string& uri ) ;
 
@@ -173,22 +187,25 @@ namespace drachtio {
 
 	void splitLines( const std::string& s, std::vector<std::string>& vec ) ;
 
-	void splitTokens( const std::string& s, std::vector<std::string>& vec ) ;
+	void splitTokens( std::string_view s, std::vector<std::string_view>& vec ) ;
 
-	void splitMsg( const string& msg, string& meta, string& startLine, string& headers, string& body ) ;
+	void splitMsg( std::string_view msg, std::string_view& meta, std::string_view& startLine, std::string_view& headers, std::string_view& body ) ;
 
 	sip_method_t parseStartLine( const string& startLine, string& methodName, string& requestUri ) ;
 
-	bool FindValueForHeader( const string& headers, const char* hdrName, string& hdrValue) ;
-
-	bool FindCSeqMethod( const string& headers, string& method ) ;
+	bool FindCSeqMethod( std::string_view headers, string& method ) ;
 
 	void EncodeStackMessage( const sip_t* sip, string& encodedMessage ) ;
 
-	bool GetValueForHeader( const string& headers, const char *szHeaderName, string& headerValue ) ;
+	// an encoded sip message, never modified once built, shared by pending requests, cdrs and the clients it is sent to
+	typedef std::shared_ptr<const string> encoded_msg_ptr ;
+	encoded_msg_ptr EncodeStackMessage( msg_t* msg ) ;
+
+	// copy each value, nul terminated, into one new buffer and point the paired view at its copy
+	std::unique_ptr<char[]> packFields( std::initializer_list< std::pair<std::string_view, std::string_view*> > fields ) ;
 
-	tagi_t* makeTags( const string& hdrs, const string& transport, const char* szExternalIP = NULL ) ;
-	tagi_t* makeSafeTags( const string& hdrs) ;
+	tagi_t* makeTags( const HeaderIndex& hdrs, const string& transport, const char* szExternalIP = NULL ) ;
+	tagi_t* makeSafeTags( const HeaderIndex& hdrs) ;
 	void deleteTags( tagi_t* tags ) ;
 
 	int ackResponse( msg_t* msg ) ;
@@ -206,42 +223,73 @@ namespace drachtio {
 
 	static char const rfc3261prefix[] =  "z9hG4bK" ;
 
+	/* 
+		where and when a sip message was sent or received.  One of these is built for every message delivered to an
+		application, so it is kept in binary form and only formatted as text when it is written to a client
+	*/
 	class SipMsgData_t {
 	public:
-		SipMsgData_t() {} ;
+		// values match the transport byte in binary framing (see client.hpp)
+		enum Protocol {
+			protocol_unknown = 0,
+			protocol_udp,
+			protocol_tcp,
+			protocol_tls
+		} ;
+
+		SipMsgData_t() : m_bytes(0), m_port(0), m_protocol(protocol_unknown), m_family(0), m_source("network") { 
+			m_time.tv_sec = 0 ; 
+			m_time.tv_usec = 0 ;
+		}
 		SipMsgData_t(const string& str ) ;
 		SipMsgData_t(msg_t* msg) ;
 		SipMsgData_t(msg_t* msg, nta_incoming_t* irq, const char* source = "network") ;
 		SipMsgData_t(msg_t* msg, nta_outgoing_t* orq, const char* source = "application") ;
 
-		const string& getProtocol() const { return m_protocol; }
-		const string& getBytes() const { return m_bytes; }
-		const string& getAddress() const { return m_address; }
-		const string& getPort() const { return m_port; }
-		const string& getTime() const { return m_time; }
-		const string& getSource() const { return m_source; }
+		Protocol getProtocolType() const { return (Protocol) m_protocol; }
+		const char* getProtocol() const ;
+		uint32_t getSize() const { return m_bytes; }
+		string getAddress() const ;
+		unsigned short getPortNumber() const { return m_port; }
+		string getPort() const { return std::to_string( m_port ); }
+		string getTime() const ;
+		const char* getSource() const { return m_source; }
+		bool isFromApplication() const { return 0 == strcmp( m_source, "application" ); }
 		const string& getDestAddress() const { return m_destAddress;}
 		const string& getDestPort() const { return m_destPort;}
+		uint64_t getTimestamp() const ;	// microseconds since the unix epoch
+
+		// address family (0 = none, 4 = ipv4, 6 = ipv6) and network order address bytes (ipv4 uses the first 4)
+		unsigned char getAddressFamily() const { return m_family; }
+		const unsigned char* getAddressBytes() const { return m_addr; }
 
 		void setDestAddress(string& dest) { m_destAddress = dest;}
 		void setDestPort(string& dest) { m_destPort = dest;}
 
+		// source|bytes|protocol|address|port|time, appended to s
+		void appendMessageFormat(string& s) const ;
 		void toMessageFormat(string& s) const {
-			s = getSource() + "|" + getBytes() + "|" + getProtocol() + "|" + getAddress() + 
-            "|" + getPort() + "|" + getTime() ;
+			s.clear() ;
+			appendMessageFormat( s ) ;
 		}
 
 	private:
 		void init(msg_t* msg) ;
-
-		string 		m_protocol ;
-		string 		m_bytes ;
-		string 		m_address ;
-		string 		m_port ;
-		string 		m_time ;
-		string 		m_source ;
-		string		m_destAddress;
-		string		m_destPort;
+		void setProtocol(tport_t* tport) ;
+		void setAddress(const char* address) ;
+		void appendAddress(string& s) const ;
+		void appendTime(string& s) const ;
+
+		su_time_t		m_time ;
+		uint32_t		m_bytes ;
+		uint16_t		m_port ;
+		uint8_t			m_protocol ;
+		uint8_t			m_family ;
+		unsigned char	m_addr[16] ;
+		const char*		m_source ;		// always a string literal: "network" or "application"
+		string			m_hostName ;	// only when the transport was named by something other than an address
+		string			m_destAddress;
+		string			m_destPort;
 	} ;
  }
 
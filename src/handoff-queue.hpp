@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __HANDOFF_QUEUE_HPP__
+#define __HANDOFF_QUEUE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+namespace drachtio {
+
+  /*
+    Passes work from any number of threads to the one thread that owns the consumer side, without locks.
+
+    Producers push onto a singly linked list with a compare-and-swap; the consumer takes the whole list in one
+    exchange and runs through it oldest first.  Only the push that finds the queue idle is told to wake the
+    consumer, so however many items arrive before the consumer gets to run they cost a single wakeup:
+
+      if( queue.push( std::move( item ) ) ) wakeConsumer() ;    // producer
+      queue.drain( [](T&& item, time_point enqueued) {...} ) ;  // consumer, once per wakeup
+
+    A producer that then fails to deliver the wakeup must call wakeupFailed() so that the next push tries again.
+  */
+  template<typename T>
+  class HandoffQueue {
+  public:
+    typedef std::chrono::steady_clock::time_point time_point ;
+
+    HandoffQueue() : m_head(nullptr), m_bWakeupPending(false) {}
+    ~HandoffQueue() {
+      Node* p = m_head.exchange( nullptr, std::memory_order_acquire ) ;
+      while( p ) {
+        Node* next = p->m_next ;
+        delete p ;
+        p = next ;
+      }
+    }
+    HandoffQueue( const HandoffQueue& ) = delete ;
+    HandoffQueue& operator=( const HandoffQueue& ) = delete ;
+
+    // add an item; returns true if the caller must wake the consumer
+    bool push( T&& item ) {
+      Node* node = new Node( std::move( item ) ) ;
+      Node* head = m_head.load( std::memory_order_relaxed ) ;
+      do {
+        node->m_next = head ;
+      } while( !m_head.compare_exchange_weak( head, node, std::memory_order_acq_rel, std::memory_order_relaxed ) ) ;
+      return !m_bWakeupPending.exchange( true, std::memory_order_acq_rel ) ;
+    }
+
+    void wakeupFailed() {
+      m_bWakeupPending.store( false, std::memory_order_release ) ;
+    }
+
+    // consumer only: hand everything queued so far, oldest first, to f( T&&, time_point enqueued ); returns how many items there were
+    template<typename F> size_t drain( F f ) {
+      // clear the flag first: anything pushed from here on brings another wakeup rather than being missed
+      m_bWakeupPending.store( false, std::memory_order_release ) ;
+      Node* p = m_head.exchange( nullptr, std::memory_order_acq_rel ) ;
+
+      Node* oldest = nullptr ;
+      while( p ) {
+        Node* next = p->m_next ;
+        p->m_next = oldest ;
+        oldest = p ;
+        p = next ;
+      }
+
+      size_t count = 0 ;
+      while( oldest ) {
+        Node* next = oldest->m_next ;
+        f( std::move( oldest->m_item ), oldest->m_enqueued ) ;
+        delete oldest ;
+        oldest = next ;
+        count++ ;
+      }
+      return count ;
+    }
+
+  private:
+    struct Node {
+      explicit Node( T&& item ) : m_item( std::move( item ) ), m_next(nullptr), m_enqueued( std::chrono::steady_clock::now() ) {}
+
+      T m_item ;
+      Node* m_next ;
+      time_point m_enqueued ;
+    } ;
+
+    std::atomic<Node*> m_head ;
+    std::atomic<bool> m_bWakeupPending ;
+  } ;
+}
+
+#endif
@@ -0,0 +1,193 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __HEADER_INDEX_HPP__
+#define __HEADER_INDEX_HPP__
+
+#include <stdint.h>
+#include <strings.h>
+#include <string_view>
+
+#include <boost/container/small_vector.hpp>
+
+#include "sip-names.hpp"
+
+namespace drachtio {
+
+  /*
+    Where each "Name: value" line in the headers an application sent us starts and ends, built in one pass when
+    the message arrives so that later lookups neither rescan the text nor allocate.  Names are matched ignoring
+    case; well-known headers are found through their sip_header_id and custom ones through a small hash table.
+    Where a name repeats, lookups return the first one.
+
+    The index refers to the text it was built from.  An owner that copies the text elsewhere must rebase it.
+  */
+  class HeaderIndex {
+  public:
+    HeaderIndex() : m_base(""), m_length(0) {
+      clear() ;
+    }
+    explicit HeaderIndex( std::string_view headers ) {
+      build( headers ) ;
+    }
+
+    void build( std::string_view headers ) ;
+
+    // point at an identical copy of the text the index was built from
+    void rebase( const char* text ) { m_base = text; }
+
+    std::string_view text() const { return std::string_view( m_base, m_length ); }
+    size_t size() const { return m_headers.size(); }
+    std::string_view name( size_t i ) const { return std::string_view( m_base + m_headers[i].m_nameOffset, m_headers[i].m_nameLength ); }
+    std::string_view value( size_t i ) const { return std::string_view( m_base + m_headers[i].m_valueOffset, m_headers[i].m_valueLength ); }
+    sip_header_id id( size_t i ) const { return m_headers[i].m_id; }
+
+    bool find( sip_header_id id, std::string_view& value ) const {
+      if( sip_hdr_unknown == id || 0 == m_firstKnown[id] ) return false ;
+      value = this->value( m_firstKnown[id] - 1 ) ;
+      return true ;
+    }
+    bool find( std::string_view name, std::string_view& value ) const ;
+
+    // lines that are not "Name: value" with a name of letters, digits, '-' and '_'
+    template<typename F> void forEachInvalidLine( F f ) const {
+      for( const Span& s : m_invalid ) f( std::string_view( m_base + s.m_offset, s.m_length ) ) ;
+    }
+
+  private:
+    struct Header {
+      uint32_t m_nameOffset ;
+      uint32_t m_valueOffset ;
+      uint32_t m_valueLength ;
+      uint16_t m_nameLength ;
+      sip_header_id m_id ;
+    } ;
+    struct Span {
+      uint32_t m_offset ;
+      uint32_t m_length ;
+    } ;
+
+    static bool isSpace( char c ) { return ' ' == c || '\t' == c || '\v' == c || '\f' == c; }
+    static bool isNameChar( char c ) {
+      return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || '-' == c || '_' == c ;
+    }
+    static uint32_t hashName( std::string_view name ) { return sipnames::hash<true>( name, 2166136261u ); }
+
+    void clear() {
+      m_headers.clear() ;
+      m_invalid.clear() ;
+      m_customSlots.clear() ;
+      for( uint16_t& i : m_firstKnown ) i = 0 ;
+    }
+
+    const char* m_base ;
+    size_t m_length ;
+    boost::container::small_vector<Header, 24> m_headers ;
+    boost::container::small_vector<Span, 2> m_invalid ;
+
+    // 1 + position in m_headers of the first of each well-known header, or 0
+    uint16_t m_firstKnown[sip_hdr_unknown] ;
+
+    // open addressed table of 1 + position in m_headers of custom headers, or 0; the size is a power of two
+    boost::container::small_vector<uint16_t, 16> m_customSlots ;
+  } ;
+
+  inline void HeaderIndex::build( std::string_view headers ) {
+    m_base = headers.data() ;
+    m_length = headers.length() ;
+    clear() ;
+
+    size_t nCustom = 0 ;
+    const char* p = m_base ;
+    const char* end = m_base + m_length ;
+    while( p < end ) {
+      const char* eol = p ;
+      const char* colon = nullptr ;
+      while( eol < end && '\r' != *eol && '\n' != *eol ) {
+        if( !colon && ':' == *eol ) colon = eol ;
+        eol++ ;
+      }
+      const char* lineStart = p ;
+      p = eol + 1 ;
+      if( eol == lineStart ) continue ;
+
+      const char* nameStart = lineStart ;
+      const char* nameEnd = colon ;
+      if( colon ) {
+        while( nameStart < colon && isSpace( *nameStart ) ) nameStart++ ;
+        while( nameEnd > nameStart && isSpace( nameEnd[-1] ) ) nameEnd-- ;
+      }
+      bool bValid = colon && nameEnd > nameStart && nameEnd - nameStart <= UINT16_MAX && m_headers.size() < UINT16_MAX ;
+      for( const char* c = nameStart; bValid && c < nameEnd; c++ ) bValid = isNameChar( *c ) ;
+      if( !bValid ) {
+        m_invalid.push_back( Span{ static_cast<uint32_t>( lineStart - m_base ), static_cast<uint32_t>( eol - lineStart ) } ) ;
+        continue ;
+      }
+      const char* valueStart = colon + 1 ;
+      const char* valueEnd = eol ;
+      while( valueStart < valueEnd && isSpace( *valueStart ) ) valueStart++ ;
+      while( valueEnd > valueStart && isSpace( valueEnd[-1] ) ) valueEnd-- ;
+
+      sip_header_id id = sipHeaderId( std::string_view( nameStart, nameEnd - nameStart ) ) ;
+      if( sip_hdr_unknown != id ) {
+        if( 0 == m_firstKnown[id] ) m_firstKnown[id] = m_headers.size() + 1 ;
+      }
+      else nCustom++ ;
+      m_headers.push_back( Header{ static_cast<uint32_t>( nameStart - m_base ), static_cast<uint32_t>( valueStart - m_base ),
+        static_cast<uint32_t>( valueEnd - valueStart ), static_cast<uint16_t>( nameEnd - nameStart ), id } ) ;
+    }
+
+    if( 0 == nCustom ) return ;
+    size_t nSlots = 8 ;
+    while( nSlots < 2 * nCustom ) nSlots <<= 1 ;
+    m_customSlots.assign( nSlots, 0 ) ;
+    for( size_t i = 0; i < m_headers.size(); i++ ) {
+      if( sip_hdr_unknown != m_headers[i].m_id ) continue ;
+      std::string_view n = name( i ) ;
+      size_t slot = hashName( n ) & (nSlots - 1) ;
+      while( 0 != m_customSlots[slot] ) {
+        std::string_view other = name( m_customSlots[slot] - 1 ) ;
+        if( other.length() == n.length() && 0 == strncasecmp( other.data(), n.data(), n.length() ) ) break ;
+        slot = (slot + 1) & (nSlots - 1) ;
+      }
+      if( 0 == m_customSlots[slot] ) m_customSlots[slot] = i + 1 ;
+    }
+  }
+
+  inline bool HeaderIndex::find( std::string_view name, std::string_view& value ) const {
+    sip_header_id id = sipHeaderId( name ) ;
+    if( sip_hdr_unknown != id ) return find( id, value ) ;
+    if( m_customSlots.empty() ) return false ;
+
+    size_t mask = m_customSlots.size() - 1 ;
+    for( size_t slot = hashName( name ) & mask; 0 != m_customSlots[slot]; slot = (slot + 1) & mask ) {
+      size_t i = m_customSlots[slot] - 1 ;
+      std::string_view n = this->name( i ) ;
+      if( n.length() == name.length() && 0 == strncasecmp( n.data(), name.data(), name.length() ) ) {
+        value = this->value( i ) ;
+        return true ;
+      }
+    }
+    return false ;
+  }
+}
+
+#endif
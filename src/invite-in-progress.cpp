@@ -11,8 +11,6 @@ namespace {
       if( pIIP ) pIIP->doCancelTimerHandling() ;
       else assert(0) ;
     }
-
-  std::mutex	iip_mutex;
 }
 namespace drachtio {
 
@@ -78,7 +76,7 @@ namespace drachtio {
   void IIP_Insert(InvitesInProgress_t& iips, nta_leg_t* leg, nta_incoming_t* irq, const std::string& transactionId, std::shared_ptr<SipDialog>& dlg) {
     std::shared_ptr<IIP> iip = std::make_shared<IIP>(leg, irq, transactionId, dlg);
     DR_LOG(log_debug) << "IIP_Insert incoming - ref count: " << iip.use_count() << " inserting " << *iip;
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     auto& idx = iips.get<PtrTag>();
     auto res = idx.insert(iip);
     if (!res.second) {
@@ -88,7 +86,7 @@ namespace drachtio {
   void IIP_Insert(InvitesInProgress_t& iips, nta_leg_t* leg, nta_outgoing_t* orq, const std::string& transactionId, std::shared_ptr<SipDialog>& dlg) {
     std::shared_ptr<IIP> iip = std::make_shared<IIP>(leg, orq, transactionId, dlg);
     DR_LOG(log_debug) << "IIP_Insert outgoing - ref count: " << iip.use_count() << " inserting " << *iip;
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     auto& idx = iips.get<PtrTag>();
     auto res = idx.insert(iip);
     if (!res.second) {
@@ -97,7 +95,7 @@ namespace drachtio {
   }
 
   bool IIP_FindByIrq(const InvitesInProgress_t& iips, nta_incoming_t* irq, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     auto &idx = iips.get<IrqTag>();
     auto it = idx.find(irq);
     if (it == idx.end()) return false;
@@ -106,7 +104,7 @@ namespace drachtio {
   }
 
   bool IIP_FindByOrq(const InvitesInProgress_t& iips, nta_outgoing_t* orq, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     auto &idx = iips.get<OrqTag>();
     auto it = idx.find(orq);
     if (it == idx.end()) return false;
@@ -115,7 +113,7 @@ namespace drachtio {
   }
 
   bool IIP_FindByLeg(const InvitesInProgress_t& iips, nta_leg_t* leg, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     auto &idx = iips.get<LegTag>();
     auto it = idx.find(leg);
     if (it == idx.end()) return false;
@@ -124,7 +122,7 @@ namespace drachtio {
   }
 
   bool IIP_FindByReliable(const InvitesInProgress_t& iips, nta_reliable_t* rel, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex);
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     auto &idx = iips.get<TransactionIdTag>();
     for (auto it = idx.begin(); it != idx.end(); ++it) {
         const auto& reliables = (*it)->reliables();
@@ -137,7 +135,7 @@ namespace drachtio {
   }
 
   bool IIP_FindByTransactionId(const InvitesInProgress_t& iips, const std::string& transactionId, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     auto &idx = iips.get<TransactionIdTag>();
     auto it = idx.find(transactionId);
     if (it == idx.end()) return false;
@@ -153,7 +151,7 @@ namespace drachtio {
   }
 
   void IIP_Clear(InvitesInProgress_t& iips, std::shared_ptr<IIP>& iip) {
-    std::lock_guard<std::mutex> lock(iip_mutex);
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
 
     nta_incoming_t* irq = const_cast<nta_incoming_t*>(iip->irq());
     nta_outgoing_t* orq = const_cast<nta_outgoing_t*>(iip->orq());
@@ -173,13 +171,13 @@ namespace drachtio {
   }
 
   size_t IIP_Size(const InvitesInProgress_t& iips) {
-    std::lock_guard<std::mutex> lock(iip_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     auto &idx = iips.get<TransactionIdTag>();
     return idx.size();
   }
 
   void IIP_AddReliable(InvitesInProgress_t& iips, std::shared_ptr<IIP>& iip, nta_reliable_t* rel) {
-    std::lock_guard<std::mutex> lock(iip_mutex);
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     const std::string& transactionId = iip->getTransactionId();
     auto &idx = iips.get<TransactionIdTag>();
     auto it = idx.find(transactionId);
@@ -189,7 +187,7 @@ namespace drachtio {
   }
 
   void IIP_DestroyReliable(InvitesInProgress_t& iips, std::shared_ptr<IIP>& iip, nta_reliable_t* rel) {
-    std::lock_guard<std::mutex> lock(iip_mutex);
+    std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
     const std::string& transactionId = iip->getTransactionId();
     auto &idx = iips.get<TransactionIdTag>();
     auto it = idx.find(transactionId);
@@ -202,7 +200,7 @@ namespace drachtio {
     size_t count = IIP_Size(iips);
     DR_LOG(log_debug) << "IIP size:                                                        " << count;
     if (full && count) {
-      std::lock_guard<std::mutex> lock(iip_mutex) ;
+      std::unique_lock<std::mutex> lock = lockDialogStore(iips.m_mutex, "iip") ;
       auto &idx = iips.get<TimeTag>();
       for (auto it = idx.begin(); it != idx.end(); ++it) {
         std::shared_ptr<IIP> p = *it;
@@ -144,7 +144,12 @@ namespace drachtio {
         boost::multi_index::const_mem_fun<IIP, const std::string&, &IIP::getTransactionId>
       >
     >
-  > InvitesInProgress_t;
+  > InvitesInProgressIndex_t;
+
+  /* a set of invites in progress along with the lock that the IIP_* helpers take to work on it */
+  struct InvitesInProgress_t : public InvitesInProgressIndex_t {
+    mutable std::mutex m_mutex;
+  };
 
   void IIP_Insert(InvitesInProgress_t& iips, nta_leg_t* leg, nta_incoming_t* irq, const std::string& transactionId, std::shared_ptr<SipDialog>& dlg);
   void IIP_Insert(InvitesInProgress_t& iips, nta_leg_t* leg, nta_outgoing_t* irq, const std::string& transactionId, std::shared_ptr<SipDialog>& dlg);
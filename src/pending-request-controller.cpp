@@ -37,11 +37,15 @@ THE SOFTWARE.
 namespace drachtio {
   class SipDialogController ;
 
-  PendingRequest_t::PendingRequest_t(msg_t* msg, sip_t* sip, tport_t* tp ) : m_msg( msg ), m_tp(tp), m_canceled(false),
-    m_callId(sip->sip_call_id->i_id), m_seq(sip->sip_cseq->cs_seq), 
+  PendingRequest_t::PendingRequest_t(msg_t* msg, sip_t* sip, tport_t* tp, unsigned int shard ) : m_msg( msg ), m_tp(tp), m_canceled(false),
+    m_callId(sip->sip_call_id->i_id), m_branch(sip->sip_via && sip->sip_via->v_branch ? sip->sip_via->v_branch : ""),
+    m_method(sip->sip_request->rq_method), m_key( TransactionKey::requestFields( sip ) ), m_seq(sip->sip_cseq->cs_seq), 
     m_methodName(sip->sip_cseq->cs_method_name), m_timeArrive({std::chrono::steady_clock::now()}) {
     
     generateUuid( m_transactionId ) ;   
+
+    // the last hex digit of the uuid is replaced with the shard we are stored in
+    m_transactionId.back() = "0123456789abcdef"[shard & 0x0f] ;
     msg_ref_create( m_msg ) ; 
     tport_ref(m_tp);
   }
@@ -51,8 +55,9 @@ namespace drachtio {
   }
   msg_t* PendingRequest_t::getMsg() { return m_msg ; }
   sip_t* PendingRequest_t::getSipObject() { return sip_object(m_msg); }
-  const string& PendingRequest_t::getCallId() { return m_callId; }
-  const string& PendingRequest_t::getTransactionId() { return m_transactionId; }
+  const string& PendingRequest_t::getCallId() const { return m_callId; }
+  const string& PendingRequest_t::getBranch() const { return m_branch; }
+  const string& PendingRequest_t::getTransactionId() const { return m_transactionId; }
   const string& PendingRequest_t::getMethodName() { return m_methodName; }
   tport_t* PendingRequest_t::getTport() { return m_tp; }
   uint32_t PendingRequest_t::getCSeq() { return m_seq; }
@@ -67,6 +72,19 @@ namespace drachtio {
   PendingRequestController::~PendingRequestController() {
   }
 
+  unsigned int PendingRequestController::shardForCallId( const char* callId ) {
+    return std::hash<std::string_view>()( callId ) % numShards ;
+  }
+
+  PendingRequestController::Shard* PendingRequestController::shardForTransactionId( const string& transactionId ) {
+    if( transactionId.empty() ) return NULL ;
+    char c = transactionId.back() ;
+    if( c >= '0' && c <= '9' ) return &m_shards[c - '0'] ;
+    if( c >= 'a' && c <= 'f' ) return &m_shards[c - 'a' + 10] ;
+    if( c >= 'A' && c <= 'F' ) return &m_shards[c - 'A' + 10] ;
+    return NULL ;
+  }
+
   bool PendingRequestController::getMethodForRequest(const string& transactionId, string& method) {
     std::shared_ptr<PendingRequest_t> p = this->find( transactionId ) ;
     if (!p) return false;
@@ -108,8 +126,7 @@ namespace drachtio {
     const tp_name_t* tpn = tport_name( tport_parent( tp_incoming ) );
     string host = tpn->tpn_host ;
     string port = tpn->tpn_port ;
-    string encodedMessage ;
-    EncodeStackMessage( sip, encodedMessage ) ;
+    encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
     SipMsgData_t meta( msg ) ;
     meta.setDestAddress(host);
     meta.setDestPort(port);
@@ -120,8 +137,7 @@ namespace drachtio {
     if( httpUrl.empty() ) {
       m_pClientController->addNetTransaction( client, p->getTransactionId() ) ;
 
-      void (BaseClient::*fn)(const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-      m_pClientController->getIOService().post( std::bind(fn, client, p->getTransactionId(), encodedMessage, meta ) ) ;
+      client->post( { AppMessage::sip_message_with_destination, p->getTransactionId(), "", "", encodedMessage, meta } ) ;
     }
     else {
       // using outbound connection for this call
@@ -179,7 +195,7 @@ namespace drachtio {
       }
       
       std::shared_ptr<RequestHandler> pHandler = RequestHandler::getInstance();
-      pHandler->makeRequestForRoute(transactionId, httpMethod, httpUrl, encodedMessage) ;
+      pHandler->makeRequestForRoute(transactionId, httpMethod, httpUrl, *encodedMessage) ;
     }
     return 0 ;
   }
@@ -192,9 +208,7 @@ namespace drachtio {
     }
     m_pClientController->addNetTransaction( client, p->getTransactionId() ) ;
 
-    void (BaseClient::*fn)(const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-    m_pClientController->getIOService().post( std::bind(fn, client, p->getTransactionId(), 
-        p->getEncodedMsg(), p->getMeta() ) ) ;
+    client->post( { AppMessage::sip_message_with_destination, p->getTransactionId(), "", "", p->getEncodedMsg(), p->getMeta() } ) ;
     return 0 ;
   }
 
@@ -202,7 +216,8 @@ namespace drachtio {
     tport_t *tp = nta_incoming_transport(m_pController->getAgent(), NULL, msg);
     tport_unref(tp) ; //because the above increments the refcount and we don't need to
 
-    std::shared_ptr<PendingRequest_t> p = std::make_shared<PendingRequest_t>( msg, sip, tp ) ;
+    unsigned int shard = shardForCallId( sip->sip_call_id->i_id ) ;
+    std::shared_ptr<PendingRequest_t> p = std::make_shared<PendingRequest_t>( msg, sip, tp, shard ) ;
 
     DR_LOG(log_debug) << "PendingRequestController::add - tport: " << std::hex << (void*) tp << 
       ", Call-ID: " << p->getCallId() << ", transactionId " << p->getTransactionId() ;
@@ -211,28 +226,24 @@ namespace drachtio {
     TimerEventHandle handle = m_timerQueue.add( std::bind(&PendingRequestController::timeout, shared_from_this(), p->getTransactionId()), NULL, CLIENT_TIMEOUT ) ;
     p->setTimerHandle( handle ) ;
 
-    string id ;
-    p->getUniqueSipTransactionIdentifier(id) ;
-    std::lock_guard<std::mutex> lock(m_mutex) ;
-    m_mapCallId2Invite.insert( mapCallId2Invite::value_type(id, p) ) ;
-    m_mapTxnId2Invite.insert( mapTxnId2Invite::value_type(p->getTransactionId(), p) ) ;
+    Shard& sh = m_shards[shard] ;
+    std::lock_guard<std::mutex> lock(sh.m_mutex) ;
+    sh.m_requests.insert( p ) ;
 
     return p ;
   }
 
   std::shared_ptr<PendingRequest_t> PendingRequestController::findAndRemove( const string& transactionId, bool timeout ) {
     std::shared_ptr<PendingRequest_t> p ;
-    string id ;
-    std::lock_guard<std::mutex> lock(m_mutex) ;
-    mapTxnId2Invite::iterator it = m_mapTxnId2Invite.find( transactionId ) ;
-    if( it != m_mapTxnId2Invite.end() ) {
-      p = it->second ;
-      m_mapTxnId2Invite.erase( it ) ;
-
-      p->getUniqueSipTransactionIdentifier(id) ;
-      mapCallId2Invite::iterator it2 = m_mapCallId2Invite.find( id ) ;
-      assert( it2 != m_mapCallId2Invite.end()) ;
-      m_mapCallId2Invite.erase( it2 ) ;
+    Shard* sh = shardForTransactionId( transactionId ) ;
+    if( !sh ) return p ;
+
+    std::lock_guard<std::mutex> lock(sh->m_mutex) ;
+    auto& idx = sh->m_requests.get<PendingTxnIdTag>() ;
+    auto it = idx.find( transactionId ) ;
+    if( it != idx.end() ) {
+      p = *it ;
+      idx.erase( it ) ;
 
       if( !timeout ) {
         m_timerQueue.remove( p->getTimerHandle() ) ;
@@ -243,30 +254,51 @@ namespace drachtio {
 
   std::shared_ptr<PendingRequest_t> PendingRequestController::find( const string& transactionId ) {
     std::shared_ptr<PendingRequest_t> p ;
-    std::lock_guard<std::mutex> lock(m_mutex) ;
-    mapTxnId2Invite::iterator it = m_mapTxnId2Invite.find( transactionId ) ;
-    if( it != m_mapTxnId2Invite.end() ) {
-      p = it->second ;
+    Shard* sh = shardForTransactionId( transactionId ) ;
+    if( !sh ) return p ;
+
+    std::lock_guard<std::mutex> lock(sh->m_mutex) ;
+    auto& idx = sh->m_requests.get<PendingTxnIdTag>() ;
+    auto it = idx.find( transactionId ) ;
+    if( it != idx.end() ) {
+      p = *it ;
     }   
     return p ;
   }
 
+  bool PendingRequestController::isRetransmission( sip_t* sip ) {
+    TransactionKey::Fields fields = TransactionKey::requestFields( sip ) ;
+    TransactionKey key( fields ) ;
+    Shard& sh = m_shards[shardForCallId( sip->sip_call_id->i_id )] ;
+    std::lock_guard<std::mutex> lock(sh.m_mutex) ;
+    auto range = sh.m_requests.get<PendingTxnKeyTag>().equal_range( key ) ;
+    for( auto it = range.first; it != range.second; ++it ) {
+      if( TransactionKey::requestFields( (*it)->getSipObject() ) == fields ) return true ;
+    }
+    return false ;
+  }
+
+  std::shared_ptr<PendingRequest_t> PendingRequestController::findInviteByCallId( const char* call_id ) {
+    Shard& sh = m_shards[shardForCallId( call_id )] ;
+    std::lock_guard<std::mutex> lock(sh.m_mutex) ;
+    auto range = sh.m_requests.get<PendingCallIdTag>().equal_range( string( call_id ) ) ;
+    for( auto it = range.first; it != range.second; ++it ) {
+      if( sip_method_invite == (*it)->getMethod() ) return *it ;
+    }
+    return std::shared_ptr<PendingRequest_t>() ;
+  }
+
   std::shared_ptr<PendingRequest_t> PendingRequestController::findInviteByCallIdAndBranch( sip_t const *sip ) {
-    std::shared_ptr<PendingRequest_t> p ;
     string callId = sip->sip_call_id->i_id ;
-    string branch = sip->sip_via->v_branch ;
-    DR_LOG(log_info) << "PendingRequestController::findInviteByCallIdAndBranch - Call-ID: " << callId << ", branch: " << branch ;
-    std::lock_guard<std::mutex> lock(m_mutex) ;
-    for( mapCallId2Invite::iterator it = m_mapCallId2Invite.begin() ; m_mapCallId2Invite.end() != it; it++ ) {
-      std::shared_ptr<PendingRequest_t> p = it->second ;
-      sip_t* sip = p->getSipObject() ;
-      DR_LOG(log_info) << "PendingRequestController::findInviteByCallIdAndBranch - comparing Call-ID: " << sip->sip_call_id->i_id << ", branch: " << sip->sip_via->v_branch ;
-      if( 0 == callId.compare( sip->sip_call_id->i_id) && sip->sip_request->rq_method == sip_method_invite &&
-          0 == branch.compare( sip->sip_via->v_branch ) ) {
-        return p ;
-      }
+    string branch = sip->sip_via && sip->sip_via->v_branch ? sip->sip_via->v_branch : "" ;
+    DR_LOG(log_debug) << "PendingRequestController::findInviteByCallIdAndBranch - Call-ID: " << callId << ", branch: " << branch ;
+    Shard& sh = m_shards[shardForCallId( sip->sip_call_id->i_id )] ;
+    std::lock_guard<std::mutex> lock(sh.m_mutex) ;
+    auto range = sh.m_requests.get<PendingCallIdBranchTag>().equal_range( boost::make_tuple( callId, branch ) ) ;
+    for( auto it = range.first; it != range.second; ++it ) {
+      if( sip_method_invite == (*it)->getMethod() ) return *it ;
     }
-    return p ;
+    return std::shared_ptr<PendingRequest_t>() ;
   }
 
   void PendingRequestController::timeout(const string& transactionId) {
@@ -277,25 +309,24 @@ namespace drachtio {
   }
 
   void PendingRequestController::logStorageCount(bool bDetail)  {
-    std::lock_guard<std::mutex> lock(m_mutex) ;
+    size_t count = 0 ;
+    for( unsigned int i = 0; i < numShards; i++ ) {
+      std::lock_guard<std::mutex> lock(m_shards[i].m_mutex) ;
+      count += m_shards[i].m_requests.size() ;
+    }
 
     DR_LOG(bDetail ? log_info : log_debug) << "PendingRequestController storage counts"  ;
     DR_LOG(bDetail ? log_info : log_debug) << "----------------------------------"  ;
-    DR_LOG(bDetail ? log_info : log_debug) << "m_mapCallId2Invite size:                                         " << m_mapCallId2Invite.size()  ;
+    DR_LOG(bDetail ? log_info : log_debug) << "pending requests:                                                " << count  ;
     if (bDetail) {
-        for (const auto& kv : m_mapCallId2Invite) {
-          DR_LOG(bDetail ? log_info : log_debug) << "    call-id: " << std::hex << (kv.first).c_str();
-        }
-    }
-
-    DR_LOG(bDetail ? log_info : log_debug) << "m_mapTxnId2Invite size:                                          " << m_mapTxnId2Invite.size()  ;
-    if (bDetail) {
-        for (const auto& kv : m_mapTxnId2Invite) {
-          std::shared_ptr<PendingRequest_t> p = kv.second;
-          DR_LOG(bDetail ? log_info : log_debug) << "    txn id: " << std::hex << (kv.first).c_str() << ", call-id : " << p->getCallId().c_str();
+      for( unsigned int i = 0; i < numShards; i++ ) {
+        std::lock_guard<std::mutex> lock(m_shards[i].m_mutex) ;
+        DR_LOG(log_info) << "  shard " << i << ": " << m_shards[i].m_requests.size() ;
+        for( const auto& p : m_shards[i].m_requests ) {
+          DR_LOG(log_info) << "    txn id: " << p->getTransactionId() << ", call-id: " << p->getCallId() << ", key: " << p->getTransactionKey() ;
         }
+      }
     }
   }
 
-
 } ;
@@ -22,10 +22,14 @@ THE SOFTWARE.
 #ifndef __PENDING_CONTROLLER_HPP__
 #define __PENDING_CONTROLLER_HPP__
 
-#include <unordered_map>
 #include <mutex>
 #include <chrono>
 
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+
 #include <sofia-sip/su_wait.h>
 #include <sofia-sip/sip.h>
 #include <sofia-sip/sip_protos.h>
@@ -46,19 +50,23 @@ namespace drachtio {
 
   class DrachtioController ;
 
+  struct PendingTxnIdTag{};
+  struct PendingTxnKeyTag{};
+  struct PendingCallIdTag{};
+  struct PendingCallIdBranchTag{};
+
   class PendingRequest_t {
   public:
-    PendingRequest_t(msg_t* msg, sip_t* sip, tport_t* tp );
+    PendingRequest_t(msg_t* msg, sip_t* sip, tport_t* tp, unsigned int shard );
     ~PendingRequest_t() ;
 
     msg_t* getMsg() ;
     sip_t* getSipObject() ;
-    const string& getCallId() ;
-    const string& getTransactionId() ;
-    void getUniqueSipTransactionIdentifier(string& str) { 
-      sip_t* sip = sip_object(m_msg) ;
-      makeUniqueSipTransactionIdentifier(sip, str);
-    }
+    const string& getCallId() const ;
+    const string& getBranch() const ;
+    const string& getTransactionId() const ;
+    sip_method_t getMethod(void) const { return m_method; }
+    const TransactionKey& getTransactionKey(void) const { return m_key; }
     const string& getMethodName() ;
     uint32_t getCSeq() ;
     tport_t* getTport() ;
@@ -68,8 +76,8 @@ namespace drachtio {
     void cancel(void) { m_canceled = true ;}
     const SipMsgData_t& getMeta(void) { return m_meta; }
     void setMeta(SipMsgData_t& meta) { m_meta = meta ;}
-    const string& getEncodedMsg(void) { return m_encodedMsg;}
-    void setEncodedMsg(const string& msg) { m_encodedMsg = msg; }
+    const encoded_msg_ptr& getEncodedMsg(void) { return m_encodedMsg;}
+    void setEncodedMsg(const encoded_msg_ptr& msg) { m_encodedMsg = msg; }
 
     chrono::time_point<chrono::steady_clock>& getArrivalTime(void) {
       return m_timeArrive;
@@ -79,16 +87,46 @@ namespace drachtio {
     msg_t*  m_msg ;
     string  m_transactionId ;
     string  m_callId ;
+    string  m_branch ;
+    sip_method_t m_method ;
+    TransactionKey m_key ;
     uint32_t m_seq ;
     string m_methodName ;
     tport_t* m_tp ;
     TimerEventHandle m_handle ;
     bool m_canceled;
     SipMsgData_t m_meta ;
-    string m_encodedMsg ;
+    encoded_msg_ptr m_encodedMsg ;
     chrono::time_point<chrono::steady_clock> m_timeArrive;
   } ;
 
+  typedef boost::multi_index::multi_index_container<
+    std::shared_ptr<PendingRequest_t>,
+    boost::multi_index::indexed_by<
+      boost::multi_index::hashed_unique<
+        boost::multi_index::tag<PendingTxnIdTag>,
+        boost::multi_index::const_mem_fun<PendingRequest_t, const string&, &PendingRequest_t::getTransactionId>
+      >,
+      boost::multi_index::hashed_non_unique<
+        boost::multi_index::tag<PendingTxnKeyTag>,
+        boost::multi_index::const_mem_fun<PendingRequest_t, const TransactionKey&, &PendingRequest_t::getTransactionKey>,
+        TransactionKey::Hash
+      >,
+      boost::multi_index::hashed_non_unique<
+        boost::multi_index::tag<PendingCallIdTag>,
+        boost::multi_index::const_mem_fun<PendingRequest_t, const string&, &PendingRequest_t::getCallId>
+      >,
+      boost::multi_index::hashed_non_unique<
+        boost::multi_index::tag<PendingCallIdBranchTag>,
+        boost::multi_index::composite_key<
+          PendingRequest_t,
+          boost::multi_index::const_mem_fun<PendingRequest_t, const string&, &PendingRequest_t::getCallId>,
+          boost::multi_index::const_mem_fun<PendingRequest_t, const string&, &PendingRequest_t::getBranch>
+        >
+      >
+    >
+  > PendingRequests_t ;
+
 
   class PendingRequestController : public std::enable_shared_from_this<PendingRequestController> {
   public:
@@ -102,27 +140,8 @@ namespace drachtio {
 
     void logStorageCount(bool bDetail = false) ;
 
-    bool isRetransmission( sip_t* sip ) {
-      string id ;
-      makeUniqueSipTransactionIdentifier( sip, id ) ;
-      std::lock_guard<std::mutex> lock(m_mutex) ;
-      mapCallId2Invite::iterator it = m_mapCallId2Invite.find( id ) ;   
-      return it != m_mapCallId2Invite.end() ;
-    }
-
-    std::shared_ptr<PendingRequest_t> findInviteByCallId( const char* call_id ) {
-      std::shared_ptr<PendingRequest_t> p ;
-      string callId = call_id ;
-      std::lock_guard<std::mutex> lock(m_mutex) ;
-      for( mapCallId2Invite::iterator it = m_mapCallId2Invite.begin() ; m_mapCallId2Invite.end() != it; it++ ) {
-        std::shared_ptr<PendingRequest_t> p = it->second ;
-        sip_t* sip = p->getSipObject() ;
-        if( 0 == callId.compare( sip->sip_call_id->i_id) && sip->sip_request->rq_method == sip_method_invite) {
-          return p ;
-        }
-      }   
-      return p ;
-    }
+    bool isRetransmission( sip_t* sip ) ;
+    std::shared_ptr<PendingRequest_t> findInviteByCallId( const char* call_id ) ;
     std::shared_ptr<PendingRequest_t> findInviteByCallIdAndBranch( sip_t const *sip );
 
   bool getMethodForRequest(const string& transactionId, string& method);
@@ -134,17 +153,26 @@ namespace drachtio {
     std::shared_ptr<PendingRequest_t> add( msg_t* msg, sip_t* sip ) ;
 
   private:
+    /*
+      Pending requests are spread over shards by a hash of their Call-ID, each shard with its own lock, so that
+      every index of a request lives in the same shard.  The shard is also written into the last hex digit of the
+      transaction id we hand out, which lets a lookup by transaction id go straight to its shard.
+    */
+    static const unsigned int numShards = 16 ;
+
+    struct Shard {
+      std::mutex        m_mutex ;
+      PendingRequests_t m_requests ;
+    } ;
+
+    static unsigned int shardForCallId( const char* callId ) ;
+    Shard* shardForTransactionId( const string& transactionId ) ;
+
     DrachtioController* m_pController ;
     nta_agent_t*    m_agent ;
     std::shared_ptr< ClientController > m_pClientController ;
 
-    std::mutex    m_mutex ;
-
-    typedef std::unordered_map<string, std::shared_ptr<PendingRequest_t> > mapCallId2Invite ;
-    mapCallId2Invite m_mapCallId2Invite ;
-
-    typedef std::unordered_map<string, std::shared_ptr<PendingRequest_t> > mapTxnId2Invite ;
-    mapTxnId2Invite m_mapTxnId2Invite ;
+    Shard         m_shards[numShards] ;
 
     LockingTimerQueue      m_timerQueue ;
 
@@ -0,0 +1,285 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#endif
+
+#include <functional>
+#include <algorithm>
+#include <new>
+
+#include "drachtio.h"
+#include "shm-client.hpp"
+#include "client-controller.hpp"
+
+/* ring sizes an application may ask for, in bytes */
+#define SHM_RING_DEFAULT_SIZE (4 * 1024 * 1024)
+#define SHM_RING_MIN_SIZE (64 * 1024)
+#define SHM_RING_MAX_SIZE (256 * 1024 * 1024)
+
+/* most records handled before giving other connections on this thread a turn */
+#define SHM_RING_BATCH (256)
+
+namespace drachtio {
+
+  ShmClient::ShmClient( boost::asio::io_context& io_context, ClientController& controller ) : BaseClient(controller),
+    m_memFd(-1), m_serverEventFd(-1), m_appEventFd(-1), m_region(NULL), m_regionSize(0), m_ringSize(0), 
+    m_bClosed(false), m_eventDescriptor(io_context), m_eventCount(0) {
+      m_strRemoteAddress = "shm" ;
+      m_nRemotePort = 0 ;
+      m_bLocal = true ;
+  }
+
+  ShmClient::~ShmClient() {
+    DR_LOG(log_debug) << "ShmClient::~ShmClient" ;
+
+    /* the descriptor object owns the server eventfd once it has been assigned */
+    if (m_eventDescriptor.is_open()) {
+      boost::system::error_code ec ;
+      m_eventDescriptor.close( ec ) ;
+    }
+    else if (-1 != m_serverEventFd) ::close( m_serverEventFd ) ;
+    if (-1 != m_appEventFd) ::close( m_appEventFd ) ;
+    if (-1 != m_memFd) ::close( m_memFd ) ;
+#ifdef __linux__
+    if (m_region) munmap( m_region, m_regionSize ) ;
+#endif
+  }
+
+  bool ShmClient::create( uint64_t ringSize ) {
+#ifdef __linux__
+    if (0 == ringSize) ringSize = SHM_RING_DEFAULT_SIZE ;
+    ringSize = std::min( std::max( ringSize, (uint64_t) SHM_RING_MIN_SIZE ), (uint64_t) SHM_RING_MAX_SIZE ) ;
+    m_ringSize = SHM_RING_MIN_SIZE ;
+    while (m_ringSize < ringSize) m_ringSize <<= 1 ;
+    m_regionSize = ShmRing::regionSize( m_ringSize ) ;
+
+    m_memFd = memfd_create( "drachtio-shm", MFD_CLOEXEC ) ;
+    if (-1 == m_memFd) {
+      DR_LOG(log_error) << "ShmClient::create - memfd_create failed: " << strerror( errno ) ;
+      return false ;
+    }
+    if (-1 == ftruncate( m_memFd, m_regionSize )) {
+      DR_LOG(log_error) << "ShmClient::create - unable to size shared memory region to " << m_regionSize << " bytes: " << strerror( errno ) ;
+      return false ;
+    }
+    m_region = mmap( NULL, m_regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_memFd, 0 ) ;
+    if (MAP_FAILED == m_region) {
+      m_region = NULL ;
+      DR_LOG(log_error) << "ShmClient::create - unable to map shared memory region: " << strerror( errno ) ;
+      return false ;
+    }
+
+    ShmRegionHeader* hdr = static_cast<ShmRegionHeader*>( m_region ) ;
+    memset( hdr, 0, sizeof(*hdr) ) ;
+    hdr->magic = SHM_RING_MAGIC ;
+    hdr->version = SHM_RING_VERSION ;
+    hdr->ringSize = m_ringSize ;
+    for (unsigned int i = 0; i < 2; i++) new (ShmRing::ringBase( m_region, i )) ShmRingHeader() ;
+    m_in = ShmRing( ShmRing::ringBase( m_region, 0 ), m_ringSize ) ;
+    m_out = ShmRing( ShmRing::ringBase( m_region, 1 ), m_ringSize ) ;
+
+    m_serverEventFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ;
+    m_appEventFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ;
+    if (-1 == m_serverEventFd || -1 == m_appEventFd) {
+      DR_LOG(log_error) << "ShmClient::create - unable to create eventfd: " << strerror( errno ) ;
+      return false ;
+    }
+    m_eventDescriptor.assign( m_serverEventFd ) ;
+    return true ;
+#else
+    DR_LOG(log_error) << "ShmClient::create - shared memory transport is not supported on this platform" ;
+    return false ;
+#endif
+  }
+
+  void ShmClient::getFileDescriptors( std::vector<int>& fds ) const {
+    fds.push_back( m_memFd ) ;
+    fds.push_back( m_serverEventFd ) ;
+    fds.push_back( m_appEventFd ) ;
+  }
+
+  void ShmClient::start() {
+    DR_LOG(log_debug) << "ShmClient::start - shared memory transport started, ring size " << m_ringSize ;
+    m_controller.join( shared_from_this() ) ;
+    wait() ;
+  }
+
+  void ShmClient::close() {
+    client_ptr self = shared_from_this() ;
+    boost::asio::post( m_strand, [this, self]() {
+      if (m_bClosed) return ;
+      m_bClosed = true ;
+      boost::system::error_code ec ;
+      m_eventDescriptor.cancel( ec ) ;
+      m_controller.leave( self ) ;
+    }) ;
+  }
+
+  void ShmClient::wait() {
+    if (m_bClosed) return ;
+
+    /* tell the application to wake us, then check we did not miss something written just before it could see that */
+    m_in.header()->readerWaiting.store( 1 ) ;
+    std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+    if (!m_in.empty()) {
+      m_in.header()->readerWaiting.store( 0, std::memory_order_relaxed ) ;
+      boost::asio::post( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), boost::system::error_code(), 0 ) ) ;
+      return ;
+    }
+
+    m_eventDescriptor.async_read_some( boost::asio::buffer( &m_eventCount, sizeof(m_eventCount) ),
+      boost::asio::bind_executor( m_strand, std::bind( &BaseClient::read_handler, shared_from_this(), std::placeholders::_1, std::placeholders::_2 ) ) ) ;
+  }
+
+  void ShmClient::read_handler( const boost::system::error_code& ec, std::size_t bytes_transferred ) {
+    if (m_bClosed) return ;
+    if (ec) {
+      DR_LOG(log_error) << "ShmClient::read_handler - error waiting on eventfd, closing shared memory transport: " << ec.message() ;
+      m_bClosed = true ;
+      m_controller.leave( shared_from_this() ) ;
+      return ;
+    }
+    m_in.header()->readerWaiting.store( 0, std::memory_order_relaxed ) ;
+
+    bool bContinue = processRing() ;
+    if (!m_outQueue.empty()) flush() ;
+    if (!bContinue) {
+      m_bClosed = true ;
+      m_controller.leave( shared_from_this() ) ;
+      return ;
+    }
+    wait() ;
+  }
+
+  bool ShmClient::processRing() {
+    std::string_view record ;
+    bool bConsumed = false ;
+
+    for (unsigned int n = 0; n < SHM_RING_BATCH && m_in.peek( record ); n++) {
+
+      /* the record holds one "<length>#<message>" frame, exactly as it would arrive on a socket */
+      size_t len = 0 ;
+      size_t i = 0 ;
+      for ( ; i < record.length() && i < 6 && '#' != record[i]; i++) {
+        if (!isdigit( record[i] )) break ;
+        len = len * 10 + (record[i] - '0') ;
+      }
+      if (0 == i || i == record.length() || '#' != record[i] || len != record.length() - i - 1) {
+        DR_LOG(log_error) << "ShmClient::processRing - application sent invalid message -- message length not specified properly" ;
+        return false ;
+      }
+      std::string_view in = record.substr( i + 1 ) ;
+
+      string msgResponse ;
+      bool bContinue = true ;
+      try {
+        DR_LOG(log_debug) << "ShmClient::processRing read: " << in ;
+        bContinue = processClientMessage( in, msgResponse ) ;
+      } catch( std::runtime_error& err ) {
+        DR_LOG(log_error) << "ShmClient::processRing - Error processing client message: " << in << " : " << err.what() ;
+        return false ;
+      }
+
+      /* everything we need from the message has been copied by now, so the application can reuse the space */
+      m_in.consume( record ) ;
+      bConsumed = true ;
+
+      if (!msgResponse.empty()) queueFrame( msgResponse ) ;
+      if (!bContinue) {
+        DR_LOG(log_error) << "ShmClient::processRing - disconnecting client due to error processing client message" ;
+        return false ;
+      }
+    }
+
+    if (bConsumed) {
+      std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+      if (m_in.header()->writerWaiting.exchange( 0 )) signalApplication() ;
+    }
+    return true ;
+  }
+
+  void ShmClient::send( const string& str ) {
+    if (queueFrame( str )) flushIfIdle() ;
+  }
+
+  void ShmClient::flush() {
+    bool bWrote = false ;
+
+    while (!m_outQueue.empty()) {
+      while (!m_outQueue.empty()) {
+        const Frame& frame = m_outQueue.front() ;
+        if (2 * ShmRing::recordSize( frame.length() ) > m_ringSize) {
+          DR_LOG(log_error) << "ShmClient::flush - discarding message of " << frame.length() << " bytes, too large for ring of " << m_ringSize ;
+          m_outQueue.pop_front() ;
+          continue ;
+        }
+        if (!m_out.write( frame.m_header->data(), frame.m_header->length(), 
+          frame.m_body ? frame.m_body->data() : NULL, frame.m_body ? frame.m_body->length() : 0 )) break ;
+        m_outQueue.pop_front() ;
+        bWrote = true ;
+      }
+      if (m_outQueue.empty()) break ;
+
+      /* ring is full: ask the application to wake us when it makes room, unless it already has */
+      m_out.header()->writerWaiting.store( 1 ) ;
+      std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+      if (!m_out.hasRoomFor( m_outQueue.front().length() )) break ;
+      m_out.header()->writerWaiting.store( 0, std::memory_order_relaxed ) ;
+    }
+
+    if (bWrote) {
+      std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+      if (m_out.header()->readerWaiting.exchange( 0 )) signalApplication() ;
+    }
+  }
+
+  void ShmClient::signalApplication() {
+    uint64_t one = 1 ;
+    if (-1 == ::write( m_appEventFd, &one, sizeof(one) ) && EAGAIN != errno) {
+      DR_LOG(log_error) << "ShmClient::signalApplication - error signalling application: " << strerror( errno ) ;
+    }
+  }
+
+  /* a shared memory link is created already connected, and is never framed by a socket */
+  void ShmClient::async_connect() {
+    assert(0) ;
+  }
+  void ShmClient::resolve_handler( const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results ) {
+    assert(0) ;
+  }
+  void ShmClient::connect_handler( const boost::system::error_code& ec, const boost::asio::ip::tcp::endpoint& endpoint ) {
+    assert(0) ;
+  }
+  void ShmClient::write_handler( const boost::system::error_code& ec, std::size_t bytes_transferred ) {
+    assert(0) ;
+  }
+  void ShmClient::handle_handshake( const boost::system::error_code& ec ) {
+    assert(0) ;
+  }
+}
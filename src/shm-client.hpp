@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __SHM_CLIENT_H__
+#define __SHM_CLIENT_H__
+
+#include <boost/asio.hpp>
+
+#include "drachtio.h"
+#include "client.hpp"
+#include "shm-ring.hpp"
+
+namespace drachtio {
+
+  /*
+    An application connection carried over a pair of rings in shared memory rather than a socket (see shm-ring.hpp).
+
+    A local application asks for one by sending "shm|<ring size>" on its unix domain socket connection once it has 
+    authenticated.  The response carries the ring size actually used, and three file descriptors are passed with it 
+    (SCM_RIGHTS): the memfd holding the region, the eventfd the application signals to wake us, and the eventfd 
+    we signal to wake the application.  The new link takes on the tags and framing of the connection that asked 
+    for it, and lasts as long as that connection does.
+  */
+  class ShmClient : public BaseClient {
+  public:
+    ShmClient( boost::asio::io_context& io_context, ClientController& controller ) ;
+    ~ShmClient() ;
+
+    // set up the shared memory region and eventfds; ringSize is rounded up to a power of two
+    bool create( uint64_t ringSize ) ;
+    uint64_t getRingSize(void) const { return m_ringSize; }
+    void getFileDescriptors( std::vector<int>& fds ) const ;
+
+    void start() ;
+    void close() ;
+
+    void async_connect() ;
+    void resolve_handler( const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results ) ;
+    void connect_handler( const boost::system::error_code& ec, const boost::asio::ip::tcp::endpoint& endpoint ) ;
+    void read_handler( const boost::system::error_code& ec, std::size_t bytes_transferred ) ;
+    void write_handler( const boost::system::error_code& ec, std::size_t bytes_transferred ) ;
+    void handle_handshake( const boost::system::error_code& ec ) ;
+
+  protected:
+    void send( const string& str ) ;
+    void flush(void) ;
+
+  private:
+    ShmClient() ; // prohibited
+
+    void wait(void) ;
+    void signalApplication(void) ;
+    bool processRing(void) ;
+
+    int       m_memFd ;
+    int       m_serverEventFd ;   // the application signals this to wake us
+    int       m_appEventFd ;      // we signal this to wake the application
+    void*     m_region ;
+    uint64_t  m_regionSize ;
+    uint64_t  m_ringSize ;
+    ShmRing   m_in ;              // application to drachtio
+    ShmRing   m_out ;             // drachtio to application
+    bool      m_bClosed ;
+
+    boost::asio::posix::stream_descriptor m_eventDescriptor ;
+    uint64_t  m_eventCount ;
+  } ;
+}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __SHM_RING_H__
+#define __SHM_RING_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace drachtio {
+
+  /*
+    Layout of the shared memory region used by the shared memory application transport.
+
+    The region starts with a ShmRegionHeader, followed by two rings of ShmRegionHeader::ringSize bytes each:
+    the first carries messages from the application to drachtio, the second from drachtio to the application.
+    Each ring has a ShmRingHeader followed by its data area.
+
+    A ring holds records of a u32 length (host byte order) followed by that many bytes, padded to a multiple
+    of 4 bytes.  A record never wraps: if it does not fit before the end of the data area the writer puts
+    down a length of SHM_RING_WRAP and starts the record at the beginning instead.  The payload of a record
+    is exactly what would be sent on a socket connection: one framed message.
+
+    Each side has an eventfd it blocks on.  Before blocking, a side sets readerWaiting on the ring it reads
+    (and writerWaiting on the ring it writes, if it has messages that did not fit), then checks the rings
+    once more.  The other side signals the eventfd only when it finds one of those flags set, so a busy 
+    link makes no system calls at all.
+  */
+  #define SHM_RING_MAGIC (0x64727368)  // "drsh"
+  #define SHM_RING_VERSION (1)
+  #define SHM_RING_WRAP (0xffffffff)
+
+  struct ShmRegionHeader {
+    uint32_t magic ;
+    uint32_t version ;
+    uint64_t ringSize ;
+    char pad[48] ;
+  } ;
+
+  struct ShmRingHeader {
+    std::atomic<uint64_t> head ;              // total bytes ever written; only the writer changes it
+    char pad1[56] ;
+    std::atomic<uint64_t> tail ;              // total bytes ever consumed; only the reader changes it
+    char pad2[56] ;
+    std::atomic<uint32_t> readerWaiting ;     // reader is about to block and needs a signal when data arrives
+    std::atomic<uint32_t> writerWaiting ;     // writer is about to block and needs a signal when space frees up
+    char pad3[56] ;
+  } ;
+
+  // one end (reader or writer) of a single producer, single consumer ring in shared memory
+  class ShmRing {
+  public:
+    ShmRing() : m_hdr(NULL), m_data(NULL), m_size(0) {}
+    ShmRing( void* base, uint64_t size ) : m_hdr(static_cast<ShmRingHeader*>(base)), 
+      m_data(static_cast<char*>(base) + sizeof(ShmRingHeader)), m_size(size) {}
+
+    static uint64_t regionSize( uint64_t ringSize ) {
+      return sizeof(ShmRegionHeader) + 2 * (sizeof(ShmRingHeader) + ringSize) ;
+    }
+    static void* ringBase( void* region, unsigned int idx ) {
+      return static_cast<char*>(region) + sizeof(ShmRegionHeader) + idx * (sizeof(ShmRingHeader) + static_cast<ShmRegionHeader*>(region)->ringSize) ;
+    }
+
+    ShmRingHeader* header() { return m_hdr; }
+
+    // writer side: returns false, writing nothing, if there is not room for the record
+    bool write( const char* p, uint32_t len ) {
+      return write( p, len, NULL, 0 ) ;
+    }
+
+    // as above, with the record made up of two pieces
+    bool write( const char* p, uint32_t len, const char* p2, uint32_t len2 ) {
+      uint64_t head = m_hdr->head.load( std::memory_order_relaxed ) ;
+      uint64_t tail = m_hdr->tail.load( std::memory_order_acquire ) ;
+      uint64_t need = recordSize( (uint64_t) len + len2 ) ;
+      uint64_t offset = head % m_size ;
+      uint64_t toEnd = m_size - offset ;
+
+      if (need > toEnd) {
+        if (m_size - (head - tail) < toEnd + need) return false ;
+        *reinterpret_cast<uint32_t*>( m_data + offset ) = SHM_RING_WRAP ;
+        head += toEnd ;
+        offset = 0 ;
+      }
+      else if (m_size - (head - tail) < need) return false ;
+
+      *reinterpret_cast<uint32_t*>( m_data + offset ) = len + len2 ;
+      memcpy( m_data + offset + sizeof(uint32_t), p, len ) ;
+      if (len2) memcpy( m_data + offset + sizeof(uint32_t) + len, p2, len2 ) ;
+      m_hdr->head.store( head + need, std::memory_order_release ) ;
+      return true ;
+    }
+
+    // reader side: returns a view of the next record, which stays valid until consume() is called
+    bool peek( std::string_view& record ) {
+      uint64_t tail = m_hdr->tail.load( std::memory_order_relaxed ) ;
+      uint64_t head = m_hdr->head.load( std::memory_order_acquire ) ;
+      if (head == tail) return false ;
+
+      uint64_t offset = tail % m_size ;
+      uint32_t len = *reinterpret_cast<uint32_t*>( m_data + offset ) ;
+      if (SHM_RING_WRAP == len) {
+        tail += m_size - offset ;
+        m_hdr->tail.store( tail, std::memory_order_release ) ;
+        if (head == tail) return false ;
+        offset = 0 ;
+        len = *reinterpret_cast<uint32_t*>( m_data ) ;
+      }
+      if (recordSize( len ) > m_size - offset) return false ;   // corrupt; leave it for the caller to notice
+      record = std::string_view( m_data + offset + sizeof(uint32_t), len ) ;
+      return true ;
+    }
+    void consume( const std::string_view& record ) {
+      uint64_t tail = m_hdr->tail.load( std::memory_order_relaxed ) ;
+      m_hdr->tail.store( tail + recordSize( record.length() ), std::memory_order_release ) ;
+    }
+
+    bool empty() const {
+      return m_hdr->head.load( std::memory_order_acquire ) == m_hdr->tail.load( std::memory_order_relaxed ) ;
+    }
+
+    // space left for a record of len bytes, assuming the worst case of having to wrap first
+    bool hasRoomFor( uint32_t len ) const {
+      uint64_t used = m_hdr->head.load( std::memory_order_relaxed ) - m_hdr->tail.load( std::memory_order_acquire ) ;
+      return m_size - used >= 2 * recordSize( len ) ;
+    }
+
+    static uint64_t recordSize( uint64_t len ) { 
+      return (sizeof(uint32_t) + len + 3) & ~((uint64_t) 3) ; 
+    }
+
+  private:
+    ShmRingHeader*  m_hdr ;
+    char*           m_data ;
+    uint64_t        m_size ;
+  } ;
+}
+
+#endif
@@ -20,7 +20,6 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 */
 #include <algorithm>
-#include <regex>
 #include <cstdlib> // For std::getenv
 
 #include <boost/algorithm/string.hpp>
@@ -39,50 +38,32 @@ namespace drachtio {
 #include "cdr.hpp"
 #include "sip-dialog-controller.hpp"
 #include "sip-transports.hpp"
+#include "sip-scanners.hpp"
 
 namespace {
 
     const char* envSupportBestEffortTls = std::getenv("DRACHTIO_SUPPORT_BEST_EFFORT_TLS");
 
-    std::string combineCallIdAndCSeq(nta_outgoing_t* orq) {
-        string callIdAndCSeq = nta_outgoing_call_id(orq);
-        callIdAndCSeq.append(" ");
-        callIdAndCSeq.append(boost::lexical_cast<std::string>(nta_outgoing_cseq(orq)));
-        return callIdAndCSeq;
+    // an INVITE we sent and the ACK for it share a Call-ID and CSeq number, and so this key
+    drachtio::TransactionKey::Fields timerDFields(nta_outgoing_t* orq) {
+        drachtio::TransactionKey::Fields f ;
+        f.m_callId = nta_outgoing_call_id(orq) ;
+        f.m_method = sip_method_invite ;
+        f.m_cseq = nta_outgoing_cseq(orq) ;
+        return f ;
     }
 
-    bool containsCseqUpdate(const std::string& input) {
-      // Regex explanation:
-      // ^ - Beginning of line anchor
-      // (?:^|\n) - Match either start of string or newline character
-      // cseq: - Match the literal "cseq:" text (case insensitive due to std::regex_search flag)
-      // \\s* - Match zero or more whitespace characters
-      // (\\d+) - Match one or more digits
-      // \\s* - Match zero or more whitespace characters
-      // UPDATE - Match the literal "UPDATE" text (case insensitive due to std::regex_search flag)
-      std::regex pattern("(?:^|\\n)cseq:\\s*(\\d+)\\s*UPDATE", 
-                        std::regex_constants::icase);
-      
-      return std::regex_search(input, pattern);
+    bool containsCseqUpdate(const drachtio::HeaderIndex& headers) {
+      // a cseq of "<number> update", ignoring case
+      std::string_view cseq ;
+      if (!headers.find( drachtio::sip_hdr_cseq, cseq )) return false ;
+      size_t pos = cseq.find_first_not_of( "0123456789" ) ;
+      if (0 == pos || std::string_view::npos == pos) return false ;
+      pos = cseq.find_first_not_of( " \t", pos ) ;
+      return std::string_view::npos != pos && cseq.length() - pos >= 6 && 0 == strncasecmp( cseq.data() + pos, "update", 6 ) ;
     }
   
 
-    void cloneRespondToSipRequest(su_root_magic_t* p, su_msg_r msg, void* arg ) {
-        drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
-        drachtio::SipDialogController::SipMessageData* d = reinterpret_cast<drachtio::SipDialogController::SipMessageData*>( arg ) ;
-        pController->getDialogController()->doRespondToSipRequest( d ) ;
-    }
-    void cloneSendSipRequest(su_root_magic_t* p, su_msg_r msg, void* arg ) {
-        drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
-        drachtio::SipDialogController::SipMessageData* d = reinterpret_cast<drachtio::SipDialogController::SipMessageData*>( arg ) ;
-        pController->getDialogController()->doSendRequestOutsideDialog( d ) ;
-    }
-    void cloneSendSipCancelRequest(su_root_magic_t* p, su_msg_r msg, void* arg ) {
-        drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
-        drachtio::SipDialogController::SipMessageData* d = reinterpret_cast<drachtio::SipDialogController::SipMessageData*>( arg ) ;
-        STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", "CANCEL"}})
-        pController->getDialogController()->doSendCancelRequest( d ) ;
-    }
     int uacLegCallback( nta_leg_magic_t* p, nta_leg_t* leg, nta_incoming_t* irq, sip_t const *sip) {
         if( sip && sip->sip_request ) STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_IN, {{"method", sip->sip_request->rq_method_name}})
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
@@ -113,11 +94,6 @@ namespace {
         }) 
         return pController->getDialogController()->processResponseInsideDialog( request, sip ) ;
     } 
-    void cloneSendSipRequestInsideDialog(su_root_magic_t* p, su_msg_r msg, void* arg ) {
-        drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
-        drachtio::SipDialogController::SipMessageData* d = reinterpret_cast<drachtio::SipDialogController::SipMessageData*>( arg ) ;
-        pController->getDialogController()->doSendRequestInsideDialog( d ) ;
-    }
     int response_to_refreshing_reinvite( nta_outgoing_magic_t* p, nta_outgoing_t* request, sip_t const* sip ) {   
         drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
         return pController->getDialogController()->processResponseToRefreshingReinvite( request, sip ) ;
@@ -144,36 +120,24 @@ namespace drachtio {
     }
 
 	SipDialogController::SipDialogController( DrachtioController* pController, su_clone_r* pClone ) : m_pController(pController), m_pClone(pClone), 
-        m_agent(pController->getAgent()), m_pClientController(pController->getClientController())  {
+        m_agent(pController->getAgent()), m_pClientController(pController->getClientController()),
+        m_sessionTimers(pController->getRoot(), pController->getSessionRefreshJitter(), pController->getMaxSessionRefreshesPerSec())  {
 
             assert(m_agent) ;
             assert(m_pClientController) ;
-            m_pTQM = std::make_shared<SipTimerQueueManager>( pController->getRoot() ) ;
+            m_pTQM = std::make_shared<SipTimerQueueManager>( pController->getRoot(), "dialog" ) ;
             m_timerDHandler.setTimerQueueManager(m_pTQM);
 	}
 	SipDialogController::~SipDialogController() {
 	}
-    bool SipDialogController::sendRequestInsideDialog( const string& clientMsgId, const string& dialogId, const string& startLine, const string& headers, const string& body, string& transactionId ) {
+    bool SipDialogController::sendRequestInsideDialog( const string& clientMsgId, const string& dialogId, std::string_view startLine, const HeaderIndex& headers, std::string_view body, string& transactionId ) {
 
         assert( dialogId.length() > 0 ) ;
 
         if( 0 == transactionId.length() ) { generateUuid( transactionId ) ; }
 
-        su_msg_r msg = SU_MSG_R_INIT ;
-        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipRequestInsideDialog, sizeof( SipDialogController::SipMessageData ) );
-        if( rv < 0 ) {
-            m_pController->getClientController()->route_api_response( clientMsgId, "NOK", "Internal server error allocating message") ;
-            return  false;
-        }
-        void* place = su_msg_data( msg ) ;
-
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
-        SipMessageData* msgData = new(place) SipMessageData( clientMsgId, transactionId, "", dialogId, startLine, headers, body ) ;
-        rv = su_msg_send(msg);  
-        if( rv < 0 ) {
-            m_pController->getClientController()->route_api_response( clientMsgId, "NOK", "Internal server error sending message") ;
-            return  false;
-        }
+        m_pController->postToStack( { DrachtioController::StackWork::request_inside_dialog, 
+            std::make_unique<SipMessageData>( clientMsgId, transactionId, "", dialogId, startLine, headers, body ), nullptr } ) ;
         
         return true ;
     }
@@ -197,7 +161,7 @@ namespace drachtio {
         assert( pData->getDialogId() ) ;
 
         try {
-            if (!SD_FindByDialogId(m_dialogs, pData->getDialogId(), dlg ) ) {
+            if (!SD_FindByDialogId(shardForDialogId(pData->getDialogId()).m_dialogs, pData->getDialogId(), dlg ) ) {
                 if( sip_method_ack == method ) {
                     DR_LOG(log_debug) << "Can't send ACK for dialog id " << pData->getDialogId() 
                         << "; likely because stack already ACK'ed non-success final response" ;
@@ -210,7 +174,7 @@ namespace drachtio {
 
             string transport ;
             dlg->getTransportDesc(transport) ;
-            tags = makeTags( pData->getHeaders(), transport) ;
+            tags = makeTags( pData->getHeaderIndex(), transport) ;
 
             tport_t* tp = dlg->getTport() ; //DH: this does NOT take out a reference
             bool forceTport = NULL != tp ;  
@@ -226,13 +190,13 @@ namespace drachtio {
                 std::shared_ptr<IIP> iip;
                 nta_leg_t * leg = const_cast<nta_leg_t *>(dlg->getNtaLeg());
                 //DR_LOG(log_info) << "SipDialogController::doSendRequestInsideDialog - sending BYE, leg is " << std::hex << (void *) leg;
-                if (IIP_FindByLeg(m_invitesInProgress, leg, iip)) {
+                if (IIP_FindByLeg(shardFor(dlg).m_invitesInProgress, leg, iip)) {
                     const nta_outgoing_t* orq = iip->orq();
                     if (orq) {
                         DR_LOG(log_info) << "SipDialogController::doSendRequestInsideDialog - sending BYE during re-invite on leg "
                         << std::hex << (void *) leg << ", so canceling orq " << (void *) orq;
                         nta_outgoing_cancel((nta_outgoing_t*) orq);
-                        IIP_Clear(m_invitesInProgress, leg);
+                        IIP_Clear(shardFor(dlg).m_invitesInProgress, leg);
                         const string id = dlg->getDialogId();
                         clearRIPByDialogId(id);
                     }
@@ -279,7 +243,7 @@ namespace drachtio {
             //set content-type if not supplied and body contains SDP
             string body = pData->getBody() ;
             string contentType ;
-            if( body.length() && !searchForHeader( tags, siptag_content_type_str, contentType ) ) {
+            if( body.length() && !searchForHeader( pData->getHeaderIndex(), sip_hdr_content_type, contentType ) ) {
                 if( 0 == body.find("v=0") ) {
                     contentType = "application/sdp" ;
                     DR_LOG(log_debug) << "SipDialogController::doSendRequestInsideDialog - automatically detecting content-type as application/sdp"  ;
@@ -332,7 +296,7 @@ namespace drachtio {
                         tport_unref(orq_tp);  // release the reference
                     }
                     DR_LOG(log_debug) << "SipDialogController::doSendRequestInsideDialog - clearing IIP that we generated as uac" ;
-                    IIP_Clear(m_invitesInProgress, leg);  
+                    IIP_Clear(shardFor(dlg).m_invitesInProgress, leg);  
 
                     DR_LOG(log_info) << "SipDialogController::doSendRequestInsideDialog (ack) - created orq " << std::hex << (void *) orq;
 
@@ -340,7 +304,7 @@ namespace drachtio {
             }
             else if( sip_method_prack == method ) {
                 std::shared_ptr<IIP> iip;
-                if(!IIP_FindByLeg(m_invitesInProgress, leg, iip)) {
+                if(!IIP_FindByLeg(shardFor(dlg).m_invitesInProgress, leg, iip)) {
                     throw std::runtime_error("unable to find IIP when sending PRACK") ;
                 }
                 orq = nta_outgoing_prack(leg, const_cast<nta_outgoing_t *>(iip->orq()), response_to_request_inside_dialog, (nta_outgoing_magic_t*) m_pController, 
@@ -378,7 +342,7 @@ namespace drachtio {
 
             if( sip_method_ack == method && 200 != dlg->getSipStatus() ) {
                 DR_LOG(log_debug) << "SipDialogController::doSendRequestInsideDialog - clearing uac dialog that had final response " <<  dlg->getSipStatus() ;
-                SD_Clear(m_dialogs, dlg->getDialogId()) ;
+                SD_Clear(shardFor(dlg).m_dialogs, dlg->getDialogId()) ;
                 m_pController->getClientController()->route_api_response( pData->getClientMsgId(), "NOK", 
                     "ACK for non-success responses is automatically generated by the stack" ) ;
             }
@@ -433,33 +397,20 @@ namespace drachtio {
             m_pController->getClientController()->removeAppTransaction( pData->getTransactionId() ) ;
         }                       
 
-        /* we must explicitly delete an object allocated with placement new */
-        pData->~SipMessageData() ;
         if (orq && destroyOrq) nta_outgoing_destroy(orq);
         deleteTags( tags ) ;
     }
 
 //send request outside dialog
     //client thread
-    bool SipDialogController::sendRequestOutsideDialog( const string& clientMsgId, const string& startLine, const string& headers, const string& body, string& transactionId, string& dialogId, string& routeUrl ) {
+    bool SipDialogController::sendRequestOutsideDialog( const string& clientMsgId, std::string_view startLine, const HeaderIndex& headers, std::string_view body, string& transactionId, string& dialogId, string& routeUrl ) {
         if( 0 == transactionId.length() ) { generateUuid( transactionId ) ; }
         if( string::npos != startLine.find("INVITE") ) {
             generateUuid( dialogId ) ;
         }
 
-        su_msg_r msg = SU_MSG_R_INIT ;
-        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipRequest, sizeof( SipDialogController::SipMessageData ) );
-        if( rv < 0 ) {
-            return  false;
-        }
-        void* place = su_msg_data( msg ) ;
-
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
-        SipMessageData* msgData = new(place) SipMessageData( clientMsgId, transactionId, "", dialogId, startLine, headers, body, routeUrl ) ;
-        rv = su_msg_send(msg);  
-        if( rv < 0 ) {
-            return  false;
-        }
+        m_pController->postToStack( { DrachtioController::StackWork::request_outside_dialog, 
+            std::make_unique<SipMessageData>( clientMsgId, transactionId, "", dialogId, startLine, headers, body, routeUrl ), nullptr } ) ;
         return true ;
     }
     //stack thread
@@ -545,10 +496,10 @@ namespace drachtio {
             su_free( m_pController->getHome(), sip_request ) ;
 
             if (pSelectedTransport && pSelectedTransport->hasExternalIp()) {
-                tags = makeTags( pData->getHeaders(), desc, pSelectedTransport->getExternalIp().c_str()) ;
+                tags = makeTags( pData->getHeaderIndex(), desc, pSelectedTransport->getExternalIp().c_str()) ;
             }
             else {
-                tags = makeTags( pData->getHeaders(), desc, NULL) ;
+                tags = makeTags( pData->getHeaderIndex(), desc, NULL) ;
             }
            
             //if user supplied all or part of the From use it
@@ -574,14 +525,14 @@ namespace drachtio {
             DR_LOG(log_debug) << "SipDialogController::doSendRequestOutsideDialog - contact: " << contact  ;            
 
             // use call-id if supplied
-            if( searchForHeader( tags, siptag_call_id_str, callid ) ) {
+            if( searchForHeader( pData->getHeaderIndex(), sip_hdr_call_id, callid ) ) {
                 DR_LOG(log_debug) << "SipDialogController::doSendRequestOutsideDialog - using client-specified call-id: " << callid  ;            
             }
 
             //set content-type if not supplied and body contains SDP
             string body = pData->getBody() ;
             string contentType ;
-            if( body.length() && !searchForHeader( tags, siptag_content_type_str, contentType ) ) {
+            if( body.length() && !searchForHeader( pData->getHeaderIndex(), sip_hdr_content_type, contentType ) ) {
                 if( 0 == body.find("v=0") ) {
                     contentType = "application/sdp" ;
                     DR_LOG(log_debug) << "SipDialogController::doSendRequestOutsideDialog - automatically detecting content-type as application/sdp"  ;
@@ -673,43 +624,17 @@ namespace drachtio {
             m_pController->getClientController()->removeAppTransaction( pData->getTransactionId() ) ;
         }                       
 
-        //N.B.: we must explicitly call the destructor of an object allocated with placement new
-        pData->~SipMessageData() ;
-
         deleteTags(tags);
     }
 
-    bool SipDialogController::sendCancelRequest( const string& clientMsgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) {
-        su_msg_r msg = SU_MSG_R_INIT ;
-        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneSendSipCancelRequest, sizeof( SipDialogController::SipMessageData ) );
-        if( rv < 0 ) {
-            return  false;
-        }
-        void* place = su_msg_data( msg ) ;
-
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
-        SipMessageData* msgData = new(place) SipMessageData( clientMsgId, transactionId, "", "", startLine, headers, body ) ;
-        rv = su_msg_send(msg);  
-        if( rv < 0 ) {
-            return  false;
-        }
+    bool SipDialogController::sendCancelRequest( const string& clientMsgId, const string& transactionId, std::string_view startLine, const HeaderIndex& headers, std::string_view body ) {
+        m_pController->postToStack( { DrachtioController::StackWork::cancel_request, 
+            std::make_unique<SipMessageData>( clientMsgId, transactionId, "", "", startLine, headers, body ), nullptr } ) ;
         return true ;
     }
-    bool SipDialogController::respondToSipRequest( const string& clientMsgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) {
-       su_msg_r msg = SU_MSG_R_INIT ;
-        int rv = su_msg_create( msg, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneRespondToSipRequest, sizeof( SipDialogController::SipMessageData ) );
-        if( rv < 0 ) {
-            return  false ;
-        }
-        void* place = su_msg_data( msg ) ;
-
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
-        string rid ;
-        SipMessageData* msgData = new(place) SipMessageData( clientMsgId, transactionId, "", "", startLine, headers, body ) ;
-        rv = su_msg_send(msg);  
-        if( rv < 0 ) {
-            return  false ;
-        }
+    bool SipDialogController::respondToSipRequest( const string& clientMsgId, const string& transactionId, std::string_view startLine, const HeaderIndex& headers, std::string_view body ) {
+        m_pController->postToStack( { DrachtioController::StackWork::response, 
+            std::make_unique<SipMessageData>( clientMsgId, transactionId, "", "", startLine, headers, body ), nullptr } ) ;
 
         return true ;
     }
@@ -719,9 +644,9 @@ namespace drachtio {
         std::shared_ptr<IIP> iip ;
         tagi_t* tags = nullptr;
 
-        if (IIP_FindByTransactionId(m_invitesInProgress, transactionId, iip)) {
+        if (findIIPByTransactionId(transactionId, iip)) {
             iip->setCanceled();
-            tags = makeSafeTags( pData->getHeaders()) ;
+            tags = makeSafeTags( pData->getHeaderIndex()) ;
             nta_outgoing_t *cancel = nta_outgoing_tcancel(const_cast<nta_outgoing_t *>(iip->orq()), NULL, NULL, TAG_NEXT(tags));
             if( NULL != cancel ) {
                 msg_t* m = nta_outgoing_getrequest(cancel) ;    // adds a reference
@@ -756,7 +681,6 @@ namespace drachtio {
             m_pController->getClientController()->route_api_response( pData->getClientMsgId(), "NOK", 
                 string("unable to cancel unknown transaction id: ") + transactionId ) ; 
         }
-        pData->~SipMessageData() ;
         deleteTags(tags);
    }
 
@@ -765,12 +689,11 @@ namespace drachtio {
         string transactionId ;
         std::shared_ptr<SipDialog> dlg ;
 
-        string encodedMessage ;
         bool truncated ;
         msg_t* msg = nta_outgoing_getresponse(orq) ;    //adds a reference
         SipMsgData_t meta( msg, orq, "network") ;
 
-        EncodeStackMessage( sip, encodedMessage ) ;
+        encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
 
         if( sip->sip_cseq->cs_method == sip_method_invite || sip->sip_cseq->cs_method == sip_method_subscribe ) {
             std:shared_ptr<IIP> iip;
@@ -783,7 +706,7 @@ namespace drachtio {
                 return 0;
             }
 
-            if (!IIP_FindByOrq(m_invitesInProgress, orq, iip)) {
+            if (!IIP_FindByOrq(shardForCallId(sip->sip_call_id->i_id).m_invitesInProgress, orq, iip)) {
                 DR_LOG(log_error) << "SipDialogController::processResponseOutsideDialog - unable to match invite response with callid: " << sip->sip_call_id->i_id  ;
                 //TODO: do I need to destroy this transaction?
                 msg_destroy( msg ) ; 
@@ -888,7 +811,7 @@ namespace drachtio {
                     SipDialog::they_are_refresher) ;
             }
             else if (sip->sip_status->st_status > 200) {
-                IIP_Clear(m_invitesInProgress, iip);
+                IIP_Clear(shardFor(iip).m_invitesInProgress, iip);
             }
         }
         else {
@@ -930,7 +853,7 @@ namespace drachtio {
     void SipDialogController::doRespondToSipRequest( SipMessageData* pData ) {
         string transactionId( pData->getTransactionId() );
         string startLine( pData->getStartLine()) ;
-        string headers( pData->getHeaders() );
+        const HeaderIndex& headers = pData->getHeaderIndex() ;
         string body( pData->getBody()) ;
         string clientMsgId( pData->getClientMsgId()) ;
         string contentType ;
@@ -961,22 +884,16 @@ namespace drachtio {
         irq = findAndRemoveTransactionIdForIncomingRequest( transactionId ) ;
         if( !irq ) {
             DR_LOG(log_debug) << "SipDialogController::doRespondToSipRequest - unable to find transaction id " << transactionId  ;
-            if (!IIP_FindByTransactionId(m_invitesInProgress, transactionId, iip)) {
+            if (!findIIPByTransactionId(transactionId, iip)) {
                 /* could be a new incoming request that hasn't been responded to yet */
                 
                 /* we allow the app to set the local tag (ie tag on the To) */
-                string toValue;
                 string tag;
-                if (GetValueForHeader( headers, "to", toValue)) {
-                    std::regex re("tag=(.*)");
-                    std::smatch mr;
-                    if (std::regex_search(toValue, mr, re) && mr.size() > 1) {
-                        tag = mr[1] ;
-                    }
-                }
+                std::string_view toValue, t ;
+                if (headers.find( sip_hdr_to, toValue ) && scan::toTag( toValue, t )) tag.assign( t ) ;
 
                 if( m_pController->setupLegForIncomingRequest( transactionId, tag ) ) {
-                    if (!IIP_FindByTransactionId(m_invitesInProgress, transactionId, iip)) {
+                    if (!findIIPByTransactionId(transactionId, iip)) {
                         irq = findAndRemoveTransactionIdForIncomingRequest(transactionId)  ;
                     }
                 }
@@ -1104,7 +1021,7 @@ namespace drachtio {
                 nta_leg_t* leg = nta_leg_by_call_id(m_pController->getAgent(), sip->sip_call_id->i_id);
                 if (leg) {
                     std::shared_ptr<SipDialog> dlg ;
-                    if(findDialogByLeg( leg, dlg )) {
+                    if(findDialogByLeg( leg, sip->sip_call_id->i_id, dlg )) {
                         dialogId = dlg->getDialogId();
                         dlg->removeIncomingRequestTransaction(transactionId);
                         DR_LOG(log_debug) << "SipDialogController::doRespondToSipRequest retrieved dialog id for existing dialog " << dialogId  ;
@@ -1191,7 +1108,7 @@ namespace drachtio {
                     transportGone = true;
                     msg_destroy(msg);
                 }
-                else if (SD_FindByDialogId(m_dialogs, dialogId, dlg)) {
+                else if (SD_FindByDialogId(shardForDialogId(dialogId).m_dialogs, dialogId, dlg)) {
                     DR_LOG(log_error) << "SipDialogController::doRespondToSipRequest - this is a forking INVITE, rejecting this request as the call has been answered" ;
                     nta_incoming_treply( irq, SIP_480_TEMPORARILY_UNAVAILABLE, TAG_END() ) ;
                     bSentOK = false;
@@ -1254,7 +1171,7 @@ namespace drachtio {
                     if( !body.empty()  ) {
                         dlg->setLocalSdp( body.c_str() ) ;
                         string strLocalContentType ;
-                        if( searchForHeader( tags, siptag_content_type_str, strLocalContentType ) ) {
+                        if( searchForHeader( headers, sip_hdr_content_type, strLocalContentType ) ) {
                             dlg->setLocalContentType( strLocalContentType ) ;
                         }
                         else {
@@ -1270,7 +1187,7 @@ namespace drachtio {
                     sip_session_expires_t *sessionExpires = nullptr;
                     if( 200 == code && sip->sip_request->rq_method == sip_method_invite ) {
                         string strSessionExpires ;
-                        if( searchForHeader( tags, siptag_session_expires_str, strSessionExpires ) ) {
+                        if( searchForHeader( headers, sip_hdr_session_expires, strSessionExpires ) ) {
                             sip_session_expires_t* se = sip_session_expires_make(m_pController->getHome(), strSessionExpires.c_str() );
                             unsigned long interval = std::max((unsigned long) 90, se->x_delta);
                             SipDialog::SessionRefresher_t who = !se->x_refresher || 0 == strcmp( se->x_refresher, "uac") ? SipDialog::they_are_refresher : SipDialog::we_are_refresher;
@@ -1317,7 +1234,7 @@ namespace drachtio {
                             DR_LOG(log_error) << "SipDialogController::doRespondToSipRequest - failed sending reliable provisional response; most likely remote endpoint does not support 100rel"  ;
                         } 
                         else {
-                            IIP_AddReliable(m_invitesInProgress, iip, rel);
+                            IIP_AddReliable(shardFor(iip).m_invitesInProgress, iip, rel);
                         }
                         //TODO: should probably set timer here
                     }
@@ -1355,12 +1272,12 @@ namespace drachtio {
 
                                 if (tport_is_dgram(tp)) {
                                     // set timer G to retransmit 200 OK if we don't get ack
-                                    TimerEventHandle t = m_pTQM->addTimer("timerG",
+                                    TimerEventHandle t = m_pTQM->addTimer(SipTimer_t::G,
                                         std::bind(&SipDialogController::retransmitFinalResponse, this, irq, tp, dlg), NULL, NTA_SIP_T1 ) ;
                                     dlg->setTimerG(t) ;
                                 }
                                 // set timer H, which sets the time to stop these retransmissions
-                                TimerEventHandle t = m_pTQM->addTimer("timerH",
+                                TimerEventHandle t = m_pTQM->addTimer(SipTimer_t::H,
                                     std::bind(&SipDialogController::endRetransmitFinalResponse, this, irq, tp, dlg), NULL, TIMER_H_MSECS ) ;
                                 dlg->setTimerH(t) ;
                             }
@@ -1398,7 +1315,7 @@ namespace drachtio {
             bSentOK = false ;
             failMsg = "Response not sent due to unknown transaction" ;  
 
-            if( FindCSeqMethod( headers, strMethod ) ) {
+            if( FindCSeqMethod( headers.text(), strMethod ) ) {
                 DR_LOG(log_debug) << "silently discarding response to " << strMethod  ;
 
                 if( 0 == strMethod.compare("CANCEL") ) {
@@ -1456,12 +1373,11 @@ namespace drachtio {
         }
 
         if( bClearIIP && iip) {
-            IIP_Clear(m_invitesInProgress, iip);
+            IIP_Clear(shardFor(iip).m_invitesInProgress, iip);
         }
 
         if( bDestroyIrq && !transportGone) nta_incoming_destroy(irq) ;    
 
-        pData->~SipMessageData() ;
 
         deleteTags( tags );
 
@@ -1474,6 +1390,7 @@ namespace drachtio {
         int rc = 0 ;
         string transactionId ;
         generateUuid( transactionId ) ;
+        DialogShard& shard = shardForCallId( sip->sip_call_id->i_id ) ;
 
         switch (sip->sip_request->rq_method) {
             case sip_method_ack:
@@ -1481,10 +1398,10 @@ namespace drachtio {
                 /* ack to 200 OK comes here  */
                 std::shared_ptr<IIP> iip ;
                 std::shared_ptr<SipDialog> dlg ;       
-                if (!IIP_FindByLeg(m_invitesInProgress, leg, iip)) {
+                if (!IIP_FindByLeg(shard.m_invitesInProgress, leg, iip)) {
                     
                     /* not a new INVITE, so it should be found as an existing dialog; i.e. a reINVITE */
-                    if( !findDialogByLeg( leg, dlg ) ) {
+                    if( !findDialogByLeg( leg, sip->sip_call_id->i_id, dlg ) ) {
                         DR_LOG(log_error) << "SipDialogController::processRequestInsideDialog - unable to find Dialog for leg"  ;
                         assert(0) ;
                         return -1 ;
@@ -1493,13 +1410,12 @@ namespace drachtio {
                 else {
                     transactionId = iip->getTransactionId() ;
                     dlg = iip->dlg();
-                    IIP_Clear(m_invitesInProgress, iip);
+                    IIP_Clear(shard.m_invitesInProgress, iip);
                     this->clearSipTimers(dlg);
                     //addDialog( dlg ) ;  now adding when we send the 200 OK
                 }
-                string encodedMessage ;
                 msg_t* msg = nta_incoming_getrequest( irq ) ; // adds a reference
-                EncodeStackMessage( sip, encodedMessage ) ;
+                encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
                 SipMsgData_t meta( msg, irq ) ;
                 msg_destroy(msg) ;      // releases the reference
 
@@ -1519,8 +1435,7 @@ namespace drachtio {
                 std::shared_ptr<PendingRequest_t> p = theOneAndOnlyController->getPendingRequestController()->findInviteByCallIdAndBranch( sip ) ;
                 if (p) {
                   msg_t* msg = nta_incoming_getrequest( irq ) ; // adds a reference
-                  string encodedMessage ;
-                  EncodeStackMessage( sip, encodedMessage ) ;
+                  encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
                   SipMsgData_t meta( msg ) ;
                   msg_destroy(msg) ;      // releases the reference
 
@@ -1528,8 +1443,7 @@ namespace drachtio {
 
                   client_ptr client = m_pClientController->findClientForNetTransaction(p->getTransactionId());
                   if(client) {
-                      void (BaseClient::*fn)(const string&, const string&, const SipMsgData_t&) = &BaseClient::sendSipMessageToClient;
-                      m_pClientController->getIOService().post( std::bind(fn, client, p->getTransactionId(), encodedMessage, meta)) ;
+                      client->post( { AppMessage::sip_message_with_destination, p->getTransactionId(), "", "", encodedMessage, meta } ) ;
                   }
 
                   STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_RESPONSES_OUT, {{"method", sip->sip_request->rq_method_name},{"code", "200"}})
@@ -1541,7 +1455,7 @@ namespace drachtio {
                 }
 
                 std::shared_ptr<SipDialog> dlg ;
-                if( !this->findDialogByLeg( leg, dlg ) ) {
+                if( !this->findDialogByLeg( leg, sip->sip_call_id->i_id, dlg ) ) {
                     DR_LOG(log_error) << "SipDialogController::processRequestInsideDialog - unable to find Dialog for leg"  ;
                     return 481 ;
                     assert(0) ;
@@ -1568,8 +1482,7 @@ namespace drachtio {
                 DR_LOG(log_info) << "SipDialogController::processRequestInsideDialog - (cancel) created orq " << std::hex << (void *) orq  <<
                     " call-id " << sip->sip_call_id->i_id;
 
-                string encodedMessage ;
-                EncodeStackMessage( sip, encodedMessage ) ;
+                encoded_msg_ptr encodedMessage = EncodeStackMessage( m ) ;
                 SipMsgData_t meta(m, orq) ;
                 string s ;
                 meta.toMessageFormat(s) ;
@@ -1580,15 +1493,15 @@ namespace drachtio {
                 DR_LOG(log_info) << "SipDialogController::processRequestInsideDialog - destroying orq from BYE";
                 nta_outgoing_destroy(orq) ;
                 DR_LOG(log_info) << "SipDialogController::processRequestInsideDialog - clearing dialog";
-                SD_Clear(m_dialogs, leg ) ;
+                SD_Clear(shard.m_dialogs, leg ) ;
                 DR_LOG(log_info) << "SipDialogController::processRequestInsideDialog - clearing IIP";
-                IIP_Clear(m_invitesInProgress, leg);
+                IIP_Clear(shard.m_invitesInProgress, leg);
 
             }
             default:
             {
                 std::shared_ptr<SipDialog> dlg ;
-                if( !this->findDialogByLeg( leg, dlg ) ) {
+                if( !this->findDialogByLeg( leg, sip->sip_call_id->i_id, dlg ) ) {
                     DR_LOG(log_error) << "SipDialogController::processRequestInsideDialog - unable to find Dialog for leg"  ;
                     return 481 ;
                     assert(0) ;
@@ -1636,9 +1549,8 @@ namespace drachtio {
 
                 }
 
-                string encodedMessage ;
                 msg_t* msg = nta_incoming_getrequest( irq ) ;   //adds a reference
-                EncodeStackMessage( sip, encodedMessage ) ;
+                encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
                 SipMsgData_t meta( msg, irq ) ;
                 msg_destroy( msg ); // release the reference
 
@@ -1686,7 +1598,7 @@ namespace drachtio {
                     this->clearSipTimers(dlg);
 
                     //clear dialog when we send a 200 OK response to BYE
-                    SD_Clear(m_dialogs, leg ) ;
+                    SD_Clear(shard.m_dialogs, leg ) ;
                     if( !routed ) {
                         nta_incoming_treply( irq, SIP_481_NO_TRANSACTION, TAG_END() ) ;                
                     }
@@ -1694,8 +1606,8 @@ namespace drachtio {
                     // check for race condition where we received a BYE with a re-INVITE we sent still outstanding
                     auto txnId = dlg->getTransactionId();
                     std::shared_ptr<IIP> iip ;
-                    if (IIP_FindByTransactionId(m_invitesInProgress, txnId, iip)) {
-                        IIP_Clear(m_invitesInProgress, iip);
+                    if (IIP_FindByTransactionId(shard.m_invitesInProgress, txnId, iip)) {
+                        IIP_Clear(shard.m_invitesInProgress, iip);
                         nta_outgoing_t* orq = const_cast<nta_outgoing_t *>(iip->orq());
                         DR_LOG(log_info) << "SipDialogController::processRequestInsideDialog: cleared IIP for reinvite due to recv BYE";
                         if (orq) {
@@ -1726,11 +1638,10 @@ namespace drachtio {
         if( findRIPByOrq( orq, rip ) ) {
             DR_LOG(log_debug) << "SipDialogController::processResponseInsideDialog: found request for "  << sip->sip_cseq->cs_method_name << " sip status " << statusCode ;
 
-            string encodedMessage ;
             bool truncated ;
             msg_t* msg = nta_outgoing_getresponse(orq) ;  // adds a reference
             SipMsgData_t meta( msg, orq, "network") ;
-            EncodeStackMessage( sip, encodedMessage ) ;
+            encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
             
             m_pController->getClientController()->route_response_inside_transaction( encodedMessage, meta, orq, sip, rip->getTransactionId(), rip->getDialogId() ) ;            
 
@@ -1748,7 +1659,7 @@ namespace drachtio {
                     std::shared_ptr<SipDialog> dlg ;
                     nta_leg_t* leg = nta_leg_by_call_id(m_pController->getAgent(), sip->sip_call_id->i_id);
                     DR_LOG(log_debug) << "SipDialogController::processResponseInsideDialog: searching for dialog by leg " << std::hex << (void *) leg;
-                    if(leg && findDialogByLeg( leg, dlg )) {
+                    if(leg && findDialogByLeg( leg, sip->sip_call_id->i_id, dlg )) {
                         DR_LOG(log_debug) << "SipDialogController::processResponseInsideDialog: (re)setting session expires timer to " <<  se->x_delta;
                         //TODO: if session-expires value is less than min-se ACK and then BYE with Reason header    
                         dlg->setSessionTimer( se->x_delta, 
@@ -1771,7 +1682,7 @@ namespace drachtio {
                 }
                 else if( dialogId.length() > 0 ) {
                     DR_LOG(log_debug) << "SipDialogController::processResponseInsideDialog: clearing dialog after receiving response to BYE or notify w/ subscription-state terminated"  ;
-                    SD_Clear(m_dialogs, dialogId ) ;
+                    SD_Clear(shardForDialogId(dialogId).m_dialogs, dialogId ) ;
                 }
                 else {
                     DR_LOG(log_debug) << "SipDialogController::processResponseInsideDialog: got 200 OK to BYE but don't have dialog id"  ;
@@ -1800,7 +1711,7 @@ namespace drachtio {
             return 0;
         }
         std::shared_ptr<SipDialog> dlg ;
-        if( !findDialogByLeg( leg, dlg ) ) {
+        if( !findDialogByLeg( leg, sip->sip_call_id->i_id, dlg ) ) {
             assert(0) ;
         }
         if( findRIPByOrq( orq, rip ) ) {
@@ -1847,21 +1758,22 @@ namespace drachtio {
                 hex << (void*) irq << ", most probably timerH indicating end of final response retransmissions" ;
             //nta_incoming_destroy(irq);
             std::shared_ptr<IIP> iip ;
-            if (!IIP_FindByIrq(m_invitesInProgress, irq, iip)) {
+            if (!findIIPByIrq(irq, iip)) {
                 DR_LOG(log_error) << "Unable to find invite-in-progress for irq " << hex << (void*) irq;
             }
             else {
                 DR_LOG(log_debug) << "SipDialogController::processCancelOrAck - clearing IIP for leg " << hex << (void*) iip->leg();   ;
-                IIP_Clear(m_invitesInProgress, iip);
+                IIP_Clear(shardFor(iip).m_invitesInProgress, iip);
             }
             return -1 ;
         }
         DR_LOG(log_debug) << "SipDialogController::processCancelOrAck: " << sip->sip_request->rq_method_name  ;
         string transactionId ;
         generateUuid( transactionId ) ;
+        DialogShard& shard = shardForCallId( sip->sip_call_id->i_id ) ;
 
         if( sip->sip_request->rq_method == sip_method_cancel ) {
-            if (!IIP_FindByIrq(m_invitesInProgress, irq, iip)) {
+            if (!IIP_FindByIrq(shard.m_invitesInProgress, irq, iip)) {
                 DR_LOG(log_error) << "Unable to find invite-in-progress for CANCEL with call-id " << sip->sip_call_id->i_id  ;
                 return 0 ;
             }
@@ -1874,9 +1786,8 @@ namespace drachtio {
 
             DR_LOG(log_debug) << "SipDialogController::processCancelOrAck - Received CANCEL for call-id " << sip->sip_call_id->i_id << ", sending to client"  ;
 
-            string encodedMessage ;
             msg_t* msg = nta_incoming_getrequest( irq ) ;   // adds a reference
-            EncodeStackMessage( sip, encodedMessage ) ;
+            encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
             SipMsgData_t meta( msg, irq ) ;
             Cdr::postCdr( std::make_shared<CdrStop>( msg, "network", Cdr::call_canceled ) );
             msg_destroy(msg);                               // releases reference
@@ -1887,25 +1798,24 @@ namespace drachtio {
             //addIncomingRequestTransaction( irq, transactionId) ;
 
             DR_LOG(log_debug) << "SipDialogController::processCancelOrAck - clearing IIP "   ;
-            IIP_Clear(m_invitesInProgress, iip);
+            IIP_Clear(shard.m_invitesInProgress, iip);
             DR_LOG(log_debug) << "SipDialogController::processCancelOrAck - done clearing IIP "   ;
 
         }
         else if( sip->sip_request->rq_method == sip_method_ack ) {
-            if (!IIP_FindByIrq(m_invitesInProgress, irq, iip)) {
+            if (!IIP_FindByIrq(shard.m_invitesInProgress, irq, iip)) {
                 DR_LOG(log_error) << "Unable to find invite-in-progress for ACK with call-id " << sip->sip_call_id->i_id  ;
                 return 0 ;
             }
             std::shared_ptr<SipDialog> dlg = iip->dlg(); 
-            IIP_Clear(m_invitesInProgress, iip);
+            IIP_Clear(shard.m_invitesInProgress, iip);
             this->clearSipTimers(dlg);
 
             string transactionId ;
             generateUuid( transactionId ) ;
 
-            string encodedMessage ;
             msg_t* msg = nta_incoming_getrequest( irq ) ;  // adds a reference
-            EncodeStackMessage( sip, encodedMessage ) ;
+            encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
             SipMsgData_t meta( msg, irq ) ;
             msg_destroy( msg ) ;    //release the reference
 
@@ -1925,7 +1835,7 @@ namespace drachtio {
     int SipDialogController::processPrack( nta_reliable_t* rel, nta_incoming_t* prack, sip_t const *sip) {
         DR_LOG(log_debug) << "SipDialogController::processPrack: rel "  << std::hex << (void*) rel ;
         std::shared_ptr<IIP> iip ;
-        if( IIP_FindByReliable( m_invitesInProgress, rel, iip) ) {
+        if( IIP_FindByReliable( shardForCallId(sip->sip_call_id->i_id).m_invitesInProgress, rel, iip) ) {
             string transactionId ;
             generateUuid( transactionId ) ;
 
@@ -1934,9 +1844,8 @@ namespace drachtio {
 
             m_pClientController->addDialogForTransaction( dlg->getTransactionId(), dlg->getDialogId() ) ;  
 
-            string encodedMessage ;
             msg_t* msg = nta_incoming_getrequest( prack ) ; // adds a reference
-            EncodeStackMessage( sip, encodedMessage ) ;
+            encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
             SipMsgData_t meta( msg, prack ) ;
             msg_destroy(msg);                               // releases the reference
 
@@ -2003,12 +1912,11 @@ namespace drachtio {
 
             string byeTransactionId  = "unsolicited";
 
-            string encodedMessage ;
-            EncodeStackMessage( sip, encodedMessage ) ;
+            encoded_msg_ptr encodedMessage = EncodeStackMessage( m ) ;
             SipMsgData_t meta(m, orq) ;
             string s ;
             meta.toMessageFormat(s) ;
-            string data = s + "|" + byeTransactionId + "|Msg sent:|" + DR_CRLF + encodedMessage ;
+            string data = s + "|" + byeTransactionId + "|Msg sent:|" + DR_CRLF + *encodedMessage ;
             msg_destroy(m) ;    // releases reference::process
 
             // this is slightly inaccurate: we are telling the app we received a BYE when we are in fact generating it
@@ -2020,12 +1928,12 @@ namespace drachtio {
 
             STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", "BYE"}})
         }
-        SD_Clear(m_dialogs, dlg) ;
+        SD_Clear(shardFor(dlg).m_dialogs, dlg) ;
     }
     void SipDialogController::notifyCancelTimeoutReachedIIP( std::shared_ptr<IIP> iip ) {
         DR_LOG(log_info) << "SipDialogController::notifyCancelTimeoutReachedIIP - tearing down transaction id " << iip->getTransactionId() ;
         m_pController->getClientController()->removeAppTransaction( iip->getTransactionId() ) ;
-        IIP_Clear(m_invitesInProgress, iip) ;
+        IIP_Clear(shardFor(iip).m_invitesInProgress, iip) ;
     }
 
     void SipDialogController::bindIrq( nta_incoming_t* irq ) {
@@ -2042,50 +1950,73 @@ namespace drachtio {
         }
         return false ;
     }
+    bool SipDialogController::searchForHeader( const HeaderIndex& headers, sip_header_id header, string& value ) {
+        std::string_view v ;
+        if( !headers.find( header, v ) ) return false ;
+        value.assign( v ) ;
+        return true ;
+    }
     void SipDialogController::addIncomingInviteTransaction( nta_leg_t* leg, nta_incoming_t* irq, sip_t const *sip, const string& transactionId, std::shared_ptr<SipDialog> dlg, const string& tag ) {
         const char* a_tag = nta_incoming_tag( irq, tag.length() == 0 ? NULL : tag.c_str()) ;
         nta_leg_tag( leg, a_tag ) ;
         dlg->setLocalTag( a_tag ) ;
 
-        IIP_Insert(m_invitesInProgress, leg, irq, transactionId, dlg);
+        IIP_Insert(shardFor(dlg).m_invitesInProgress, leg, irq, transactionId, dlg);
 
         this->bindIrq( irq ) ;
     }
     void SipDialogController::addOutgoingInviteTransaction( nta_leg_t* leg, nta_outgoing_t* orq, sip_t const *sip, std::shared_ptr<SipDialog> dlg ) {
         DR_LOG(log_debug) << "SipDialogController::addOutgoingInviteTransaction:  adding leg " << std::hex << leg  ;
-        IIP_Insert(m_invitesInProgress, leg, orq, dlg->getTransactionId(), dlg);
+        IIP_Insert(shardFor(dlg).m_invitesInProgress, leg, orq, dlg->getTransactionId(), dlg);
+    }
+    bool SipDialogController::findIIPByTransactionId( const string& transactionId, std::shared_ptr<IIP>& iip ) {
+        for (auto& shard : m_shards) {
+            if (IIP_FindByTransactionId(shard.m_invitesInProgress, transactionId, iip)) return true;
+        }
+        return false;
+    }
+    bool SipDialogController::findIIPByIrq( nta_incoming_t* irq, std::shared_ptr<IIP>& iip ) {
+        for (auto& shard : m_shards) {
+            if (IIP_FindByIrq(shard.m_invitesInProgress, irq, iip)) return true;
+        }
+        return false;
     }
 
     void SipDialogController::addRIP( nta_outgoing_t* orq, std::shared_ptr<RIP> rip) {
         DR_LOG(log_debug) << "SipDialogController::addRIP adding orq " << std::hex << (void*) orq  ;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        m_mapOrq2RIP.insert( mapOrq2RIP::value_type(orq,rip)) ;
+        DialogShard& shard = shardFor( orq ) ;
+        std::unique_lock<std::mutex> lock = lockDialogStore( shard.m_mutex, "rip" ) ;
+        shard.m_mapOrq2RIP.insert( mapOrq2RIP::value_type(orq,rip)) ;
     }
     bool SipDialogController::findRIPByOrq( nta_outgoing_t* orq, std::shared_ptr<RIP>& rip ) {
         DR_LOG(log_debug) << "SipDialogController::findRIPByOrq orq " << std::hex << (void*) orq  ;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        mapOrq2RIP::iterator it = m_mapOrq2RIP.find( orq ) ;
-        if( m_mapOrq2RIP.end() == it ) return false ;
+        DialogShard& shard = shardFor( orq ) ;
+        std::unique_lock<std::mutex> lock = lockDialogStore( shard.m_mutex, "rip" ) ;
+        mapOrq2RIP::iterator it = shard.m_mapOrq2RIP.find( orq ) ;
+        if( shard.m_mapOrq2RIP.end() == it ) return false ;
         rip = it->second ;
         return true ;                       
     }
     void SipDialogController::clearRIP( nta_outgoing_t* orq ) {
         DR_LOG(log_debug) << "SipDialogController::clearRIP clearing orq " << std::hex << (void*) orq  ;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        mapOrq2RIP::iterator it = m_mapOrq2RIP.find( orq ) ;
+        DialogShard& shard = shardFor( orq ) ;
+        std::unique_lock<std::mutex> lock = lockDialogStore( shard.m_mutex, "rip" ) ;
+        mapOrq2RIP::iterator it = shard.m_mapOrq2RIP.find( orq ) ;
         nta_outgoing_destroy( orq ) ;
-        if( m_mapOrq2RIP.end() == it ) return  ;
-        m_mapOrq2RIP.erase( it ) ;                      
+        if( shard.m_mapOrq2RIP.end() == it ) return  ;
+        shard.m_mapOrq2RIP.erase( it ) ;                      
     }
     void SipDialogController::clearRIPByDialogId( const std::string dialogId) {
         DR_LOG(log_debug) << "SipDialogController::clearRIPByDialogId - searching for RIP for dialog id " <<  dialogId  ;
-        for (const auto& pair : m_mapOrq2RIP) {
+        DialogShard& shard = shardForDialogId( dialogId ) ;
+        std::unique_lock<std::mutex> lock = lockDialogStore( shard.m_mutex, "rip" ) ;
+        for (const auto& pair : shard.m_mapOrq2RIP) {
             nta_outgoing_t* orq = pair.first;
             std::shared_ptr<RIP> p = pair.second;
             if (0 == dialogId.compare(p->getDialogId())) {
                 DR_LOG(log_debug) << "SipDialogController::clearRIPByDialogId - found for RIP for dialog id, orq to destroy is " <<
                 std::hex << (void *) orq;
-                m_mapOrq2RIP.erase(orq);
+                shard.m_mapOrq2RIP.erase(orq);
                 nta_outgoing_destroy( orq ) ;
                 return;
             }
@@ -2099,7 +2030,7 @@ namespace drachtio {
 
         // set next timer
         uint32_t ms = dlg->bumpTimerG() ;
-        TimerEventHandle t = m_pTQM->addTimer("timerG", 
+        TimerEventHandle t = m_pTQM->addTimer(SipTimer_t::G, 
             std::bind(&SipDialogController::retransmitFinalResponse, this, irq, tp, dlg), NULL, ms ) ;
         dlg->setTimerG(t) ;
     }
@@ -2114,7 +2045,7 @@ namespace drachtio {
         nta_leg_t* leg = const_cast<nta_leg_t *>(dlg->getNtaLeg());
         TimerEventHandle h = dlg->getTimerG() ;
         if( h ) {
-            m_pTQM->removeTimer( h, "timerG");
+            m_pTQM->removeTimer( h, SipTimer_t::G);
             dlg->clearTimerG();
         }
         h = dlg->getTimerH() ;
@@ -2122,7 +2053,7 @@ namespace drachtio {
             dlg->clearTimerH();
         }
 
-        IIP_Clear(m_invitesInProgress, leg);
+        IIP_Clear(shardFor(dlg).m_invitesInProgress, leg);
 
 
         // we never got the ACK, so now we should tear down the call by sending a BYE
@@ -2142,8 +2073,7 @@ namespace drachtio {
 
         STATS_COUNTER_INCREMENT(STATS_COUNTER_SIP_REQUESTS_OUT, {{"method", "BYE"}})
 
-        string encodedMessage ;
-        EncodeStackMessage( sip, encodedMessage ) ;
+        encoded_msg_ptr encodedMessage = EncodeStackMessage( m ) ;
         SipMsgData_t meta(m, orq) ;
         string s ;
         meta.toMessageFormat(s) ;
@@ -2153,28 +2083,31 @@ namespace drachtio {
         msg_destroy( m ); // release the reference
 
         nta_outgoing_destroy(orq) ;
-        SD_Clear(m_dialogs, leg);
+        SD_Clear(shardFor(dlg).m_dialogs, leg);
     }
     void SipDialogController::addIncomingRequestTransaction( nta_incoming_t* irq, const string& transactionId) {
         DR_LOG(log_debug) << "SipDialogController::addIncomingRequestTransaction - adding transactionId " << transactionId << " for irq:" << std::hex << (void*) irq;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        m_mapTransactionId2Irq.insert( mapTransactionId2Irq::value_type(transactionId, irq)) ;
+        DialogShard& shard = shardForTransactionId( transactionId ) ;
+        std::unique_lock<std::mutex> lock = lockDialogStore( shard.m_mutex, "irq" ) ;
+        shard.m_mapTransactionId2Irq.insert( mapTransactionId2Irq::value_type(transactionId, irq)) ;
     }
     bool SipDialogController::findIrqByTransactionId( const string& transactionId, nta_incoming_t*& irq ) {
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        mapTransactionId2Irq::iterator it = m_mapTransactionId2Irq.find( transactionId ) ;
-        if( m_mapTransactionId2Irq.end() == it ) return false ;
+        DialogShard& shard = shardForTransactionId( transactionId ) ;
+        std::unique_lock<std::mutex> lock = lockDialogStore( shard.m_mutex, "irq" ) ;
+        mapTransactionId2Irq::iterator it = shard.m_mapTransactionId2Irq.find( transactionId ) ;
+        if( shard.m_mapTransactionId2Irq.end() == it ) return false ;
         irq = it->second ;
         return true ;                       
     }
     nta_incoming_t* SipDialogController::findAndRemoveTransactionIdForIncomingRequest( const string& transactionId ) {
         DR_LOG(log_debug) << "SipDialogController::findAndRemoveTransactionIdForIncomingRequest - searching transactionId " << transactionId ;
-        std::lock_guard<std::mutex> lock(m_mutex) ;
+        DialogShard& shard = shardForTransactionId( transactionId ) ;
+        std::unique_lock<std::mutex> lock = lockDialogStore( shard.m_mutex, "irq" ) ;
         nta_incoming_t* irq = nullptr ;
-        mapTransactionId2Irq::iterator it = m_mapTransactionId2Irq.find( transactionId ) ;
-        if( m_mapTransactionId2Irq.end() != it ) {
+        mapTransactionId2Irq::iterator it = shard.m_mapTransactionId2Irq.find( transactionId ) ;
+        if( shard.m_mapTransactionId2Irq.end() != it ) {
             irq = it->second ;
-            m_mapTransactionId2Irq.erase( it ) ;
+            shard.m_mapTransactionId2Irq.erase( it ) ;
         }
         else {
             DR_LOG(log_debug) << "SipDialogController::findAndRemoveTransactionIdForIncomingRequest - failed to find transactionId " << transactionId << 
@@ -2197,12 +2130,12 @@ namespace drachtio {
         DR_LOG(log_debug) << "SipDialogController::clearSipTimers for " << dlg->getCallId()  ;
         TimerEventHandle h = dlg->getTimerG() ;
         if( h ) {
-            m_pTQM->removeTimer( h, "timerG");  
+            m_pTQM->removeTimer( h, SipTimer_t::G);  
             dlg->clearTimerG();
         }
         h = dlg->getTimerH() ;
         if( h ) {
-            m_pTQM->removeTimer( h, "timerH"); 
+            m_pTQM->removeTimer( h, SipTimer_t::H); 
             dlg->clearTimerH();
         }
     }
@@ -2215,30 +2148,36 @@ namespace drachtio {
 
     // when we get a 200 OK to an INVITE we sent, call this to prepare handling timerD
     void TimerDHandler::addInvite(nta_outgoing_t* invite) {
-        string callIdAndCSeq = combineCallIdAndCSeq(invite);
+        TransactionKey key(timerDFields(invite));
         
         // should never see this twice
-        assert(m_mapCallIdAndCSeq2Invite.end() == m_mapCallIdAndCSeq2Invite.find(callIdAndCSeq));
+        assert(m_mapCallIdAndCSeq2Invite.end() == m_mapCallIdAndCSeq2Invite.find(key));
 
         // we are waiting for the ACK from the app
-        m_mapCallIdAndCSeq2Invite.insert(mapCallIdAndCSeq2Invite::value_type(callIdAndCSeq, invite));
+        m_mapCallIdAndCSeq2Invite.insert(mapCallIdAndCSeq2Invite::value_type(key, invite));
 
         // start timerD
-        TimerEventHandle t = m_pTQM->addTimer("timerD", std::bind(&TimerDHandler::timerD, this, invite, callIdAndCSeq), NULL, TIMER_D_MSECS ) ;
+        TimerEventHandle t = m_pTQM->addTimer(SipTimer_t::D, std::bind(&TimerDHandler::timerD, this, invite, key), NULL, TIMER_D_MSECS ) ;
 
-        DR_LOG(log_info) << "TimerDHandler::addInvite orq " << hex << (void *)invite << ", " << callIdAndCSeq;
+        DR_LOG(log_info) << "TimerDHandler::addInvite orq " << hex << (void *)invite << ", " << nta_outgoing_call_id(invite) << " " << dec << nta_outgoing_cseq(invite);
+
+    }
 
+    TimerDHandler::mapCallIdAndCSeq2Invite::iterator TimerDHandler::findInvite(const TransactionKey& key, const TransactionKey::Fields& fields) {
+        mapCallIdAndCSeq2Invite::iterator it = m_mapCallIdAndCSeq2Invite.find(key);
+        if (it != m_mapCallIdAndCSeq2Invite.end() && timerDFields(it->second) != fields) return m_mapCallIdAndCSeq2Invite.end();
+        return it;
     }
 
     // ..then, when the app gives us the ACK to send out, call this to save for possible retransmits
     void TimerDHandler::addAck(nta_outgoing_t* ack) {
-        string callIdAndCSeq = combineCallIdAndCSeq(ack);
+        TransactionKey::Fields fields = timerDFields(ack);
 
-        mapCallIdAndCSeq2Invite::const_iterator it = m_mapCallIdAndCSeq2Invite.find(callIdAndCSeq);
+        mapCallIdAndCSeq2Invite::iterator it = findInvite(TransactionKey(fields), fields);
         if (m_mapCallIdAndCSeq2Invite.end() != it) {
             m_mapInvite2Ack.insert(mapInvite2Ack::value_type(it->second, ack));
             m_mapCallIdAndCSeq2Invite.erase(it);
-            DR_LOG(log_info) << "TimerDHandler::addAck " << hex << (void *)ack << ", " << callIdAndCSeq;
+            DR_LOG(log_info) << "TimerDHandler::addAck " << hex << (void *)ack << ", " << fields.m_callId << " " << dec << fields.m_cseq;
         }
         else {
             DR_LOG(log_error) << "TimerDHandler::addAck - failed to find outbound invite we sent for callid " << nta_outgoing_call_id(ack);
@@ -2254,8 +2193,8 @@ namespace drachtio {
             return true;
         }
         else if (m_mapCallIdAndCSeq2Invite.size() > 0) {
-            string callIdAndCSeq = combineCallIdAndCSeq(invite);
-            if (m_mapCallIdAndCSeq2Invite.find(callIdAndCSeq) != m_mapCallIdAndCSeq2Invite.end()) {
+            TransactionKey::Fields fields = timerDFields(invite);
+            if (findInvite(TransactionKey(fields), fields) != m_mapCallIdAndCSeq2Invite.end()) {
                 DR_LOG(log_error) << "TimerDHandler::resendIfNeeded - cannot retransmit ACK because app has not yet provided it " << nta_outgoing_call_id(invite);
                 return true;
             }
@@ -2264,9 +2203,9 @@ namespace drachtio {
     }
 
     // this will automatically remove the transactions at the proper time, after timer D has expired
-    void TimerDHandler::timerD(nta_outgoing_t* invite, const string& callIdAndCSeq) {
-        mapCallIdAndCSeq2Invite::const_iterator it = m_mapCallIdAndCSeq2Invite.find(callIdAndCSeq);
-        if (it != m_mapCallIdAndCSeq2Invite.end()) {
+    void TimerDHandler::timerD(nta_outgoing_t* invite, const TransactionKey& key) {
+        mapCallIdAndCSeq2Invite::const_iterator it = m_mapCallIdAndCSeq2Invite.find(key);
+        if (it != m_mapCallIdAndCSeq2Invite.end() && it->second == invite) {
             DR_LOG(log_error) << "TimerDHandler::timerD - app never sent ACK for successful uac INVITE"  ;
             m_mapCallIdAndCSeq2Invite.erase(it);
         }
@@ -2274,7 +2213,7 @@ namespace drachtio {
             mapInvite2Ack::const_iterator it = m_mapInvite2Ack.find(invite);
             if (it != m_mapInvite2Ack.end()) {
                 DR_LOG(log_info) << "TimerDHandler::timerD - freeing ACK orq " << hex << (void *) it->second <<
-                    " associated with invite orq " << invite << " for call-id/cseq " << callIdAndCSeq;
+                    " associated with invite orq " << invite << " for call-id " << nta_outgoing_call_id(invite);
                 nta_outgoing_destroy(it->second);
                 m_mapInvite2Ack.erase(it);
             }
@@ -2283,8 +2222,8 @@ namespace drachtio {
 
     bool TimerDHandler::clearTimerD(nta_outgoing_t* invite) {
         bool success = false;
-        string callIdAndCSeq = combineCallIdAndCSeq(invite);
-        mapCallIdAndCSeq2Invite::const_iterator it = m_mapCallIdAndCSeq2Invite.find(callIdAndCSeq);
+        TransactionKey::Fields fields = timerDFields(invite);
+        mapCallIdAndCSeq2Invite::iterator it = findInvite(TransactionKey(fields), fields);
         if (it != m_mapCallIdAndCSeq2Invite.end()) {
             DR_LOG(log_error) << "TimerDHandler::clearTimerD - app never sent ACK for successful uac INVITE"  ;
             m_mapCallIdAndCSeq2Invite.erase(it);
@@ -2293,7 +2232,7 @@ namespace drachtio {
             mapInvite2Ack::const_iterator it = m_mapInvite2Ack.find(invite);
             if (it != m_mapInvite2Ack.end()) {
                 DR_LOG(log_info) << "TimerDHandler::clearTimerD - freeing ACK orq " << hex << (void *) it->second <<
-                    " associated with invite orq " << invite << " for call-id/cseq " << callIdAndCSeq;
+                    " associated with invite orq " << invite << " for call-id " << fields.m_callId;
                 nta_outgoing_destroy(it->second);
                 m_mapInvite2Ack.erase(it);
                 success = true;
@@ -2303,29 +2242,96 @@ namespace drachtio {
     }
 
     void SipDialogController::logRIP(bool bDetail) {
-        DR_LOG(bDetail ? log_info : log_debug) << "RIP size:                                                        " <<
-            m_mapOrq2RIP.size();
+        size_t count = 0;
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.m_mutex) ;
+            count += shard.m_mapOrq2RIP.size();
+        }
+        DR_LOG(bDetail ? log_info : log_debug) << "RIP size:                                                        " << count;
         if (bDetail) {
-            for (const auto& pair : m_mapOrq2RIP) {
-                nta_outgoing_t* orq = pair.first;
-                std::shared_ptr<RIP> p = pair.second;
-                DR_LOG(log_debug) << "    orq: " << std::hex << (void *) orq << " dialog id " << p->getDialogId() << " txn id " << p->getTransactionId();
+            for (auto& shard : m_shards) {
+                std::lock_guard<std::mutex> lock(shard.m_mutex) ;
+                for (const auto& pair : shard.m_mapOrq2RIP) {
+                    nta_outgoing_t* orq = pair.first;
+                    std::shared_ptr<RIP> p = pair.second;
+                    DR_LOG(log_debug) << "    orq: " << std::hex << (void *) orq << " dialog id " << p->getDialogId() << " txn id " << p->getTransactionId();
+                }
             }
         }
     }
 
+    SessionTimerScheduler::SessionTimerScheduler(su_root_t* root, unsigned int refreshJitter, unsigned int maxRefreshesPerSec) : 
+        m_queue(root, "session-timer"), m_refreshJitter(std::min(refreshJitter, 25U)), m_maxRefreshesPerSec(maxRefreshesPerSec),
+        m_currentSecond(0), m_refreshesThisSecond(0) {
+        m_queue.setMetricLabels({{"timer", "session"}, {"owner", "dialog"}});
+    }
+
+    TimerEventHandle SessionTimerScheduler::add(SipDialog* dlg, unsigned long nSecs, bool bWeAreRefresher, su_time_t& deadline) {
+        su_time_t now = su_now();
+        su_duration_t interval = nSecs * 1000;
+
+        // RFC 4028 section 10: refresh no later than a third of the interval, or 32 seconds if less, before it expires
+        su_duration_t latest = interval - std::min<su_duration_t>(32000, interval / 3);
+        deadline = su_time_add(now, latest);
+        if (!bWeAreRefresher) return m_queue.add(fire, dlg, interval, now);
+
+        su_duration_t when = interval / 2;
+        su_duration_t spread = interval / 100 * m_refreshJitter;
+        if (spread > 0) when += (rand() % (2 * spread + 1)) - spread;
+        when = std::min(std::max(when, interval / 4), latest);
+        return m_queue.add(fire, dlg, when, now);
+    }
+
+    TimerEventHandle SessionTimerScheduler::throttleRefresh(SipDialog* dlg, su_time_t deadline) {
+        su_time_t now = su_now();
+        if (now.tv_sec != m_currentSecond) {
+            m_currentSecond = now.tv_sec;
+            m_refreshesThisSecond = 0;
+        }
+        if (0 == m_maxRefreshesPerSec || m_refreshesThisSecond < m_maxRefreshesPerSec || su_time_cmp(now, deadline) >= 0) {
+            m_refreshesThisSecond++;
+            return NULL;
+        }
+
+        // try again at some point in the next second, but no later than the deadline
+        su_duration_t delay = (1000000 - now.tv_usec) / 1000 + rand() % 1000 + 1;
+        delay = std::max<su_duration_t>(std::min(delay, su_duration(deadline, now)), 1);
+        DR_LOG(log_debug) << "SessionTimerScheduler::throttleRefresh - " << m_maxRefreshesPerSec << 
+            " refreshes already sent this second, putting off refresh of call-id " << dlg->getCallId() << " for " << std::dec << delay << "ms";
+        STATS_COUNTER_INCREMENT(STATS_COUNTER_SESSION_REFRESHES_DEFERRED)
+        return m_queue.add(fire, dlg, delay, now);
+    }
+
+    void SessionTimerScheduler::fire(void* arg) {
+        static_cast<SipDialog*>(arg)->doSessionTimerHandling();
+    }
+
     // logging / metrics
     void SipDialogController::logStorageCount(bool bDetail)  {
 
         DR_LOG(bDetail ? log_info : log_debug) << "SipDiaSD_LoglogController storage counts"  ;
         DR_LOG(bDetail ? log_info : log_debug) << "----------------------------------"  ;
-        IIP_Log(m_invitesInProgress, bDetail);
-        SD_Log(m_dialogs, bDetail);
+        size_t nIIP = 0, nDialogs = 0, nIrq = 0 ;
+        for (auto& shard : m_shards) {
+            nIIP += IIP_Size(shard.m_invitesInProgress);
+            nDialogs += SD_Size(shard.m_dialogs);
 
-        std::lock_guard<std::mutex> lock(m_mutex) ;
-        DR_LOG(bDetail ? log_info : log_debug) << "m_mapTransactionId2Irq size:                                     " << m_mapTransactionId2Irq.size()  ;
+            std::lock_guard<std::mutex> lock(shard.m_mutex) ;
+            nIrq += shard.m_mapTransactionId2Irq.size() ;
+        }
+        DR_LOG(bDetail ? log_info : log_debug) << "IIP size:                                                        " << nIIP  ;
+        DR_LOG(bDetail ? log_info : log_debug) << "StableDialogs total size:                                        " << nDialogs  ;
+        if (bDetail) {
+            for (unsigned int i = 0; i < numDialogShards; i++) {
+                DR_LOG(log_info) << "dialog shard " << i << ":" ;
+                IIP_Log(m_shards[i].m_invitesInProgress, true);
+                SD_Log(m_shards[i].m_dialogs, true);
+            }
+        }
+        DR_LOG(bDetail ? log_info : log_debug) << "m_mapTransactionId2Irq size:                                     " << nIrq  ;
         DR_LOG(bDetail ? log_info : log_debug) << "number of outgoing transactions held for timerD:                 " << m_timerDHandler.countTimerD()  ;
         DR_LOG(bDetail ? log_info : log_debug) << "number of outgoing transactions waiting for ACK from app:        " << m_timerDHandler.countPending()  ;
+        DR_LOG(bDetail ? log_info : log_debug) << "number of dialogs with a session timer running:                  " << m_sessionTimers.size()  ;
         logRIP(bDetail);
         m_pTQM->logQueueSizes() ;
 
@@ -2333,7 +2339,12 @@ namespace drachtio {
         if (theOneAndOnlyController->getStatsCollector().enabled()) {
 
             size_t nUas = 0, nUac = 0;
-            size_t total = SD_Size(m_dialogs, nUac, nUas);
+            for (auto& shard : m_shards) {
+                size_t uac, uas;
+                SD_Size(shard.m_dialogs, uac, uas);
+                nUac += uac;
+                nUas += uas;
+            }
             STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_STABLE_DIALOGS, nUas, {{"type", "inbound"}})
             STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_STABLE_DIALOGS, nUac, {{"type", "outbound"}})
         }
@@ -42,10 +42,6 @@ THE SOFTWARE.
 #include "timer-queue-manager.hpp"
 #include "invite-in-progress.hpp"
 
-#define START_LEN (512)
-#define HDR_LEN (8400)
-#define BODY_LEN (12288)
-
 namespace drachtio {
 
 	class DrachtioController ;
@@ -90,92 +86,101 @@ namespace drachtio {
 		size_t countPending() { return m_mapCallIdAndCSeq2Invite.size();}
 
 	private:
-		void timerD(nta_outgoing_t*	invite, const string& callIdAndCSeq);
+		typedef std::unordered_map<TransactionKey, nta_outgoing_t*, TransactionKey::Hash> mapCallIdAndCSeq2Invite;
+
+		void timerD(nta_outgoing_t*	invite, const TransactionKey& key);
+		mapCallIdAndCSeq2Invite::iterator findInvite(const TransactionKey& key, const TransactionKey::Fields& fields);
 
 		std::shared_ptr<TimerQueueManager> m_pTQM;
-		typedef std::unordered_map<string, nta_outgoing_t*> mapCallIdAndCSeq2Invite;
 		typedef std::unordered_map<nta_outgoing_t*, nta_outgoing_t*> mapInvite2Ack;
 		
 		mapCallIdAndCSeq2Invite	m_mapCallIdAndCSeq2Invite;
 		mapInvite2Ack 					m_mapInvite2Ack;
 	} ;
 
+	/**
+	 * runs the session timers (RFC 4028) of all dialogs off a single timer queue.  When we are the refresher the
+	 * refresh goes out at a random point within refreshJitter percent of the session interval either side of its
+	 * midpoint, so that calls set up together do not all refresh together, and never later than the latest point
+	 * the RFC allows.  If maxRefreshesPerSec is set, refreshes beyond that in any one second are pushed into
+	 * the following seconds, again no further than the latest allowed point.  When the other side is the refresher
+	 * the timer runs to the end of the session interval.
+	 */
+	class SessionTimerScheduler {
+	public:
+		SessionTimerScheduler(su_root_t* root, unsigned int refreshJitter, unsigned int maxRefreshesPerSec) ;
+		~SessionTimerScheduler() {}
+
+		/* start the session timer for a dialog; deadline is set to the latest time a refresh could be sent */
+		TimerEventHandle add(SipDialog* dlg, unsigned long nSecs, bool bWeAreRefresher, su_time_t& deadline) ;
+		void remove(TimerEventHandle handle) { m_queue.remove(handle); }
+
+		/* a refresh is due: returns NULL if it can be sent now, otherwise the handle of the timer that will try again */
+		TimerEventHandle throttleRefresh(SipDialog* dlg, su_time_t deadline) ;
+
+		int size(void) { return m_queue.size(); }
+
+	private:
+		static void fire(void* arg) ;
+
+		TimerQueue 		m_queue ;
+		unsigned int 	m_refreshJitter ;
+		unsigned int 	m_maxRefreshesPerSec ;
+		unsigned long m_currentSecond ;
+		unsigned int 	m_refreshesThisSecond ;
+	} ;
+
 	class SipDialogController : public std::enable_shared_from_this<SipDialogController> {
 	public:
 		SipDialogController(DrachtioController* pController, su_clone_r* pClone );
 		~SipDialogController() ;
 
+		/*
+			What the client thread hands the stack thread for each message an app sends.  Every field is copied,
+			nul terminated, into one buffer owned by the payload; DrachtioController::postToStack queues it.
+		*/
 		class SipMessageData {
 		public:
-			SipMessageData() {
-				memset(m_szClientMsgId, 0, sizeof(m_szClientMsgId) ) ;
-				memset(m_szTransactionId, 0, sizeof(m_szTransactionId) ) ;
-				memset(m_szRequestId, 0, sizeof(m_szRequestId) ) ;
-				memset(m_szDialogId, 0, sizeof(m_szDialogId) ) ;
-				memset(m_szStartLine, 0, sizeof(m_szStartLine) ) ;
-				memset(m_szHeaders, 0, sizeof(m_szHeaders) ) ;
-				memset(m_szBody, 0, sizeof(m_szBody) ) ;
-				memset(m_szRouteUrl, 0, sizeof(m_szRouteUrl) ) ;
-			}
-			SipMessageData(const string& clientMsgId, const string& transactionId, const string& requestId, const string& dialogId,
-				const string& startLine, const string& headers, const string& body ) : SipMessageData() {
-				memcpy( m_szClientMsgId, clientMsgId.c_str(), std::min(MSG_ID_LEN, (int) clientMsgId.length()) ) ;
-				if( !transactionId.empty() ) memcpy( m_szTransactionId, transactionId.c_str(), std::min(MSG_ID_LEN, (int) transactionId.length())) ;
-				if( !requestId.empty() ) memcpy( m_szRequestId, requestId.c_str(), std::min(MSG_ID_LEN, (int) requestId.length()));
-				if( !dialogId.empty() )  memcpy( m_szDialogId, dialogId.c_str(), std::min(MAX_DIALOG_ID_LEN, (int) dialogId.length()));
-				memcpy( m_szStartLine, startLine.c_str(), std::min(START_LEN, (int) startLine.length()));
-				memcpy( m_szHeaders, headers.c_str(), std::min(HDR_LEN, (int) headers.length())) ;
-				memcpy( m_szBody, body.c_str(), std::min(BODY_LEN, (int) body.length()));
-			}
 			SipMessageData(const string& clientMsgId, const string& transactionId, const string& requestId, const string& dialogId,
-				const string& startLine, const string& headers, const string& body, const string& routeUrl )  : SipMessageData() {
-				memcpy( m_szClientMsgId, clientMsgId.c_str(), std::min(MSG_ID_LEN, (int) clientMsgId.length())) ;
-				if( !transactionId.empty() ) memcpy( m_szTransactionId, transactionId.c_str(), std::min(MSG_ID_LEN, (int) transactionId.length())) ;
-				if( !requestId.empty() ) memcpy( m_szRequestId, requestId.c_str(), std::min(MSG_ID_LEN, (int) requestId.length())) ;
-				if( !dialogId.empty() ) memcpy( m_szDialogId, dialogId.c_str(), std::min(MSG_ID_LEN, (int) dialogId.length()) ) ;
-				memcpy( m_szStartLine, startLine.c_str(), std::min(START_LEN, (int) startLine.length()) ) ;
-				memcpy( m_szHeaders, headers.c_str(), std::min(HDR_LEN, (int) headers.length()) ) ;
-				memcpy( m_szBody, body.c_str(), std::min(BODY_LEN, (int) body.length()) ) ;
-				memcpy( m_szRouteUrl, routeUrl.c_str(), std::min(START_LEN, (int) routeUrl.length()) ) ;
-			}
-			~SipMessageData() {}
-			SipMessageData& operator=(const SipMessageData& md) {
-				strncpy( m_szClientMsgId, md.m_szClientMsgId, MSG_ID_LEN) ;
-				strncpy( m_szTransactionId, md.m_szTransactionId, MSG_ID_LEN) ;
-				strncpy( m_szDialogId, md.m_szDialogId, MSG_ID_LEN) ;
-				strncpy( m_szRequestId, md.m_szRequestId, MSG_ID_LEN) ;
-				strncpy( m_szStartLine, md.m_szStartLine, START_LEN ) ;
-				strncpy( m_szHeaders, md.m_szHeaders, HDR_LEN ) ;
-				strncpy( m_szBody, md.m_szBody, BODY_LEN ) ;
-				strncpy( m_szRouteUrl, md.m_szRouteUrl, START_LEN ) ;
-				return *this ;
+				std::string_view startLine, const HeaderIndex& headers, std::string_view body, std::string_view routeUrl = std::string_view() ) {
+				m_buffer = packFields({ {clientMsgId, &m_clientMsgId}, {transactionId, &m_transactionId}, {requestId, &m_requestId},
+					{dialogId, &m_dialogId}, {startLine, &m_startLine}, {headers.text(), &m_headers}, {body, &m_body}, {routeUrl, &m_routeUrl} }) ;
+				m_headerIndex = headers ;
+				m_headerIndex.rebase( m_headers.data() ) ;
 			}
-
-			const char* getClientMsgId() { return m_szClientMsgId; } 
-			const char* getTransactionId() { return m_szTransactionId; } 
-			const char* getDialogId() { return m_szDialogId; } 
-			const char* getRequestId() { return m_szRequestId; } 
-			const char* getHeaders() { return m_szHeaders; } 
-			const char* getStartLine() { return m_szStartLine; } 
-			const char* getBody() { return m_szBody; } 
-			const char* getRouteUrl() { return m_szRouteUrl; } 
+			SipMessageData(const SipMessageData&) = delete ;
+			SipMessageData& operator=(const SipMessageData&) = delete ;
+			SipMessageData(SipMessageData&&) = default ;
+			SipMessageData& operator=(SipMessageData&&) = default ;
+
+			const char* getClientMsgId() const { return m_clientMsgId.data(); } 
+			const char* getTransactionId() const { return m_transactionId.data(); } 
+			const char* getDialogId() const { return m_dialogId.data(); } 
+			const char* getRequestId() const { return m_requestId.data(); } 
+			const char* getHeaders() const { return m_headers.data(); } 
+			const HeaderIndex& getHeaderIndex() const { return m_headerIndex; } 
+			const char* getStartLine() const { return m_startLine.data(); } 
+			const char* getBody() const { return m_body.data(); } 
+			const char* getRouteUrl() const { return m_routeUrl.data(); } 
 
 		private:
-			char	m_szClientMsgId[MSG_ID_LEN+1];
-			char	m_szTransactionId[MSG_ID_LEN+1];
-			char	m_szRequestId[MSG_ID_LEN+1];
-			char	m_szDialogId[MAX_DIALOG_ID_LEN+1];
-			char	m_szStartLine[START_LEN+1];
-			char	m_szHeaders[HDR_LEN+1];
-			char	m_szBody[BODY_LEN+1];
-			char	m_szRouteUrl[START_LEN+1];
+			std::unique_ptr<char[]> m_buffer ;
+			std::string_view m_clientMsgId ;
+			std::string_view m_transactionId ;
+			std::string_view m_requestId ;
+			std::string_view m_dialogId ;
+			std::string_view m_startLine ;
+			std::string_view m_headers ;
+			std::string_view m_body ;
+			std::string_view m_routeUrl ;
+			HeaderIndex m_headerIndex ;
 		} ;
 
 		//NB: sendXXXX are called when client is sending a message
-		bool sendRequestInsideDialog( const string& clientMsgId, const string& dialogId, const string& startLine, const string& headers, const string& body, string& transactionId ) ;
-		bool sendRequestOutsideDialog( const string& clientMsgId, const string& startLine, const string& headers, const string& body, string& transactionId, string& dialogId, string& routeUrl ) ;
-    bool respondToSipRequest( const string& msgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) ;		
-		bool sendCancelRequest( const string& msgId, const string& transactionId, const string& startLine, const string& headers, const string& body ) ;
+		bool sendRequestInsideDialog( const string& clientMsgId, const string& dialogId, std::string_view startLine, const HeaderIndex& headers, std::string_view body, string& transactionId ) ;
+		bool sendRequestOutsideDialog( const string& clientMsgId, std::string_view startLine, const HeaderIndex& headers, std::string_view body, string& transactionId, string& dialogId, string& routeUrl ) ;
+    bool respondToSipRequest( const string& msgId, const string& transactionId, std::string_view startLine, const HeaderIndex& headers, std::string_view body ) ;		
+		bool sendCancelRequest( const string& msgId, const string& transactionId, std::string_view startLine, const HeaderIndex& headers, std::string_view body ) ;
 
 		//NB: doSendXXX correspond to the above, and are run in the stack thread
 		void doSendRequestInsideDialog( SipMessageData* pData ) ;
@@ -209,25 +214,28 @@ namespace drachtio {
 			nta_leg_t *leg = nta_leg_by_call_id( m_agent, dlg->getCallId().c_str() );
 			assert( leg ) ;
 
-			SD_Insert(m_dialogs, dlg);
+			SD_Insert(shardFor(dlg).m_dialogs, dlg);
       m_pClientController->addDialogForTransaction( dlg->getTransactionId(), strDialogId ) ;		
 		}
-		bool findDialogByLeg( nta_leg_t* leg, std::shared_ptr<SipDialog>& dlg ) {
+		bool findDialogByLeg( nta_leg_t* leg, const char* callId, std::shared_ptr<SipDialog>& dlg ) {
+			DialogShard& shard = shardForCallId(callId) ;
+
 			/* look in invites-in-progress first */
 			std::shared_ptr<IIP> iip;
-			if (!IIP_FindByLeg(m_invitesInProgress, leg, iip)) {
+			if (!IIP_FindByLeg(shard.m_invitesInProgress, leg, iip)) {
 
 				/* if not found, look in stable dialogs */
-				return SD_FindByLeg(m_dialogs, leg, dlg);
+				return SD_FindByLeg(shard.m_dialogs, leg, dlg);
 			}
 			dlg = iip->dlg() ;
 			return true ;
 		}
 		bool findDialogByCallId( const string& strCallId, std::shared_ptr<SipDialog>& dlg ) {
+			DialogShard& shard = shardForCallId(strCallId) ;
 			string strDialogId = strCallId + ";uas";
-			if (!SD_FindByDialogId(m_dialogs, strDialogId, dlg)) {
+			if (!SD_FindByDialogId(shard.m_dialogs, strDialogId, dlg)) {
 				strDialogId = strCallId + ";uac";
-				return SD_FindByDialogId(m_dialogs, strDialogId, dlg);
+				return SD_FindByDialogId(shard.m_dialogs, strDialogId, dlg);
 			}
 			return true;
 		}
@@ -238,6 +246,10 @@ namespace drachtio {
         void clearRIP( nta_outgoing_t* orq ) ;
         void clearRIPByDialogId( const std::string dialogId) ;
 
+		/// IIP helpers that have no Call-ID to go on, and so look in each shard in turn
+		bool findIIPByTransactionId( const string& transactionId, std::shared_ptr<IIP>& iip ) ;
+		bool findIIPByIrq( nta_incoming_t* irq, std::shared_ptr<IIP>& iip ) ;
+
 		/// IRQ helpers
 		void addIncomingRequestTransaction( nta_incoming_t* irq, const string& transactionId) ;
 		bool findIrqByTransactionId( const string& transactionId, nta_incoming_t*& irq ) ;
@@ -249,12 +261,14 @@ namespace drachtio {
 
 		// timers
 		void clearSipTimers(std::shared_ptr<SipDialog>& dlg);
+		SessionTimerScheduler& getSessionTimers(void) { return m_sessionTimers; }
 		bool stopTimerD(nta_outgoing_t* invite);
         
     void clearDanglingIncomingRequests(std::vector<std::string> txnIds);
 
 	protected:
  		bool searchForHeader( tagi_t* tags, tag_type_t header, string& value ) ;
+ 		bool searchForHeader( const HeaderIndex& headers, sip_header_id header, string& value ) ;
 		void bindIrq( nta_incoming_t* irq ) ;
 
 
@@ -262,34 +276,65 @@ namespace drachtio {
 		DrachtioController* m_pController ;
 		su_clone_r*			m_pClone ;
 
-		/* since access to the various maps below can be triggered either by arriva or network message, or client message - 
-			each in a different thread - we use this mutex to protect them.  To keep things straight, the mutex lock operations
-			are utilized in the low-level addXX, findXX, and clearXX methods that appear in this header file.  There should be
-			NO direct access to the maps nor use of the mutex in the .cpp (the exception being the method to log storage counts)
-		*/
-   	std::mutex 		m_mutex ;
-
 		nta_agent_t*		m_agent ;
 		std::shared_ptr< ClientController > m_pClientController ;
 
 		TimerDHandler 	m_timerDHandler;
+		SessionTimerScheduler m_sessionTimers;
  
-		InvitesInProgress_t  	m_invitesInProgress;
-		StableDialogs_t				m_dialogs;
-
 		// Requests sent by client
 
 		/* we need to lookup responses to requests sent by the client inside a dialog */
 		typedef std::unordered_map<nta_outgoing_t*, std::shared_ptr<RIP> > mapOrq2RIP ;
-		mapOrq2RIP m_mapOrq2RIP ;
         void logRIP(bool detail);
         
 		// Requests received from the network
 
 		/* we need to lookup incoming transactions by transaction id when we get a response from the client */
 		typedef std::unordered_map<string, nta_incoming_t*> mapTransactionId2Irq ;
-		mapTransactionId2Irq m_mapTransactionId2Irq ;
 
+		/* 
+			Access to the stores below can be triggered either by arrival of a network message or a client message - each in a
+			different thread - so they are split into shards, each with its own locks, and two threads only contend when working
+			on calls that land in the same shard.  Invites in progress, stable dialogs and requests in progress are sharded by a
+			hash of the Call-ID, so everything for one call lives in one shard; the SD_* and IIP_* helpers take the lock of the
+			store they are handed, and m_mutex guards the two maps.  Incoming request transactions are only ever looked up by
+			transaction id, so those are sharded by a hash of that instead.  There should be NO direct access to the maps nor use
+			of the mutex in the .cpp other than in the low-level addXX, findXX, and clearXX methods (and the method to log storage counts)
+		*/
+		static const unsigned int numDialogShards = 16 ;
+
+		struct DialogShard {
+			InvitesInProgress_t  	m_invitesInProgress;
+			StableDialogs_t				m_dialogs;
+
+			std::mutex 						m_mutex ;
+			mapOrq2RIP 						m_mapOrq2RIP ;
+			mapTransactionId2Irq 	m_mapTransactionId2Irq ;
+		} ;
+
+		DialogShard m_shards[numDialogShards] ;
+
+		DialogShard& shardForCallId( std::string_view callId ) {
+			return m_shards[std::hash<std::string_view>()(callId) % numDialogShards] ;
+		}
+		DialogShard& shardFor( const std::shared_ptr<SipDialog>& dlg ) {
+			return shardForCallId( dlg->getCallId() ) ;
+		}
+		DialogShard& shardFor( const std::shared_ptr<IIP>& iip ) {
+			return shardFor( iip->dlg() ) ;
+		}
+		DialogShard& shardFor( nta_outgoing_t* orq ) {
+			const char* callId = nta_outgoing_call_id( orq ) ;
+			return shardForCallId( callId ? callId : "" ) ;
+		}
+		/* a dialog id starts with the Call-ID */
+		DialogShard& shardForDialogId( std::string_view dialogId ) {
+			return shardForCallId( dialogId.substr( 0, dialogId.find( ';' ) ) ) ;
+		}
+		DialogShard& shardForTransactionId( const string& transactionId ) {
+			return m_shards[std::hash<string>()(transactionId) % numDialogShards] ;
+		}
 
 		// timers for dialogs and leg that we can remove after suitable timeout period waiting for retransmissions
     std::shared_ptr<TimerQueueManager> m_pTQM ;
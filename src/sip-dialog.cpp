@@ -42,25 +42,16 @@ namespace {
         boost::hash_combine(seed, d.getRemoteEndpoint().m_strTag.c_str());
         return seed;
     }
-
-    void session_timer_handler( su_root_magic_t* magic, su_timer_t* timer, su_timer_arg_t* args) {
-    	std::weak_ptr<drachtio::SipDialog> *p = reinterpret_cast< std::weak_ptr<drachtio::SipDialog> *>( args ) ;
-    	std::shared_ptr<drachtio::SipDialog> pDialog = p->lock() ;
-    	if( pDialog ) pDialog->doSessionTimerHandling() ;
-    	else assert(0) ;
-    }
-
-  	std::mutex sd_mutex;
 }
 
 namespace drachtio {
 	
 	/* dialog generated by an incoming INVITE */
 	SipDialog::SipDialog( nta_leg_t* leg, nta_incoming_t* irq, sip_t const *sip, msg_t* msg ) : m_type(we_are_uas), m_recentSipStatus(100), 
-		m_startTime(time(NULL)), m_connectTime(0), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),m_ppSelf(NULL),
+		m_startTime(time(NULL)), m_connectTime(0), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),
 		m_nSessionExpiresSecs(0), m_nMinSE(90), m_tp(nta_incoming_transport(theOneAndOnlyController->getAgent(), irq, msg) ), 
     m_leg( leg ), m_timerG(NULL), m_durationTimerG(0), m_timerH(NULL), m_orqAck(nullptr), m_orq(nullptr), m_seq(0),
-		m_bInviteDialog(sip->sip_request->rq_method == sip_method_invite), m_bAlerting(false), m_nSessionTimerDuration(0),
+		m_bInviteDialog(sip->sip_request->rq_method == sip_method_invite), m_bAlerting(false),
 		m_timeArrive(std::chrono::steady_clock::now()), m_bAckBye(false), m_tmArrival(sip_now()), m_bDestroyAckOnClose(false), m_irqUpdate(NULL)
 	{
     const tp_name_t* tpn = tport_name( m_tp );
@@ -122,9 +113,9 @@ namespace drachtio {
 	/* dialog generated by an outgoing INVITE */
 	SipDialog::SipDialog( const string& transactionId, nta_leg_t* leg, 
 		nta_outgoing_t* orq, sip_t const *sip, msg_t *msg, const string& transport) : m_type(we_are_uac), m_recentSipStatus(0), 
-		m_startTime(0), m_connectTime(0), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),m_ppSelf(NULL),
+		m_startTime(0), m_connectTime(0), m_endTime(0), m_releaseCause(no_release), m_refresher(no_refresher), m_timerSessionRefresh(NULL),
 		m_nSessionExpiresSecs(0), m_nMinSE(90), m_tp(NULL), m_leg(leg), m_orqAck(nullptr), m_orq(orq), m_seq(0),
-    m_timerG(NULL), m_durationTimerG(0), m_timerH(NULL), m_nSessionTimerDuration(0),
+    m_timerG(NULL), m_durationTimerG(0), m_timerH(NULL),
 		m_bInviteDialog(sip->sip_request->rq_method == sip_method_invite), m_bAlerting(false), m_transactionId(transactionId),
 		m_timeArrive(std::chrono::steady_clock::now()), m_bAckBye(false), m_tmArrival(sip_now()), m_bDestroyAckOnClose(false), m_irqUpdate(NULL)
 	{
@@ -191,10 +182,6 @@ namespace drachtio {
             " leg " << std::hex << (void *) m_leg;
 		if( NULL != m_timerSessionRefresh ) {
 			cancelSessionTimer() ;
-			assert( m_ppSelf ) ;
-		}
-		if( m_ppSelf ) {
-			delete m_ppSelf ;
 		}
 
 		nta_leg_t *leg = nta_leg_by_call_id( theOneAndOnlyController->getAgent(), getCallId().c_str() );
@@ -284,49 +271,58 @@ namespace drachtio {
 	void SipDialog::setSessionTimer( unsigned long nSecs, SessionRefresher_t whoIsResponsible ) {
 		if (m_timerSessionRefresh) cancelSessionTimer();
 		m_refresher = whoIsResponsible ;
-		m_nSessionTimerDuration = nSecs * 1000  ;
 		m_nSessionExpiresSecs = nSecs ;
 
 		DR_LOG(log_info) << "SipDialog::setSessionTimer: " << getCallId() << " Session expires has been set to " << nSecs << " seconds and refresher is " << (areWeRefresher() ? "us" : "them")  ;
 
-		/* if we are the refresher, then we want the timer to go off halfway through the interval */
-		if( areWeRefresher() ) {
-			m_nSessionTimerDuration /= 2 ;
-			m_nSessionTimerDuration += (rand() % 10000) - 5000 ;
-		}
-		m_timerSessionRefresh = su_timer_create( su_root_task(theOneAndOnlyController->getRoot()), m_nSessionTimerDuration ) ;
-
-		m_ppSelf = new std::weak_ptr<SipDialog>( shared_from_this() ) ;
-		su_timer_set(m_timerSessionRefresh, session_timer_handler, (su_timer_arg_t *) m_ppSelf );
+		/* if we are the refresher the timer goes off around halfway through the interval, otherwise at the end of it */
+		m_timerSessionRefresh = theOneAndOnlyController->getDialogController()->getSessionTimers().add( this, nSecs, areWeRefresher(), 
+			m_tmSessionRefreshDeadline ) ;
 	}
 	void SipDialog::cancelSessionTimer() {
 		assert( NULL != m_timerSessionRefresh ) ;
-		if (m_timerSessionRefresh) su_timer_destroy( m_timerSessionRefresh ) ;
+		if (m_timerSessionRefresh) theOneAndOnlyController->getDialogController()->getSessionTimers().remove( m_timerSessionRefresh ) ;
 		m_timerSessionRefresh = NULL ;
 		m_refresher = no_refresher ;
 		m_nSessionExpiresSecs = 0 ;
 	}
 	void SipDialog::doSessionTimerHandling() {
+		/* the scheduler calls us through a raw pointer; hold a reference so tearing down the dialog can't free us mid-call */
+		std::shared_ptr<SipDialog> self = shared_from_this() ;
 		bool bWeAreRefresher = areWeRefresher()  ;
+		m_timerSessionRefresh = NULL ;
 		
 		if( bWeAreRefresher ) {
+			/* too many refreshes going out right now: the scheduler will call us again a little later */
+			m_timerSessionRefresh = theOneAndOnlyController->getDialogController()->getSessionTimers().throttleRefresh( this, 
+				m_tmSessionRefreshDeadline ) ;
+			if( m_timerSessionRefresh ) return ;
+
 			//send a refreshing reINVITE, and notify the client
 			DR_LOG(log_info) << "SipDialog::doSessionTimerHandling - sending refreshing re-INVITE with call-id " << getCallId()  ; 
-			theOneAndOnlyController->getDialogController()->notifyRefreshDialog( shared_from_this() ) ;
+			theOneAndOnlyController->getDialogController()->notifyRefreshDialog( self ) ;
 		}
 		else {
 			//tear down the leg, and notify the client
 			DR_LOG(log_info) << "SipDialog::doSessionTimerHandling - tearing down sip dialog with call-id " << getCallId() 
 				<< " because remote peer did not refresh the session within the specified interval"  ; 
-			theOneAndOnlyController->getDialogController()->notifyTerminateStaleDialog( shared_from_this() ) ;
+			theOneAndOnlyController->getDialogController()->notifyTerminateStaleDialog( self ) ;
 		}
 
-		assert( m_ppSelf ) ;
-		delete m_ppSelf ; m_ppSelf = NULL ; m_timerSessionRefresh = NULL ; m_refresher = no_refresher ; m_nSessionExpiresSecs = 0 ;
+		m_refresher = no_refresher ; m_nSessionExpiresSecs = 0 ;
+	}
+
+	std::unique_lock<std::mutex> lockDialogStore(std::mutex& m, const char* store) {
+		std::unique_lock<std::mutex> lock(m, std::try_to_lock) ;
+		if (!lock.owns_lock()) {
+			STATS_COUNTER_INCREMENT(STATS_COUNTER_DIALOG_STORE_CONTENTION, {{"store", store}})
+			lock.lock() ;
+		}
+		return lock ;
 	}
 
 	void SD_Insert(StableDialogs_t& dialogs, std::shared_ptr<SipDialog>& dlg) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
 		auto& idx = dialogs.get<DlgPtrTag>();
     auto res = idx.insert(dlg);
 		if (!res.second) {
@@ -335,7 +331,7 @@ namespace drachtio {
 	}
 
 	bool SD_FindByLeg(const StableDialogs_t& dialogs, nta_leg_t* leg, std::shared_ptr<SipDialog>& dlg) {
-		std::lock_guard<std::mutex> lock(sd_mutex) ;
+		std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
     auto &idx = dialogs.get<DlgLegTag>();
     auto it = idx.find(leg);
     if (it == idx.end()) return false;
@@ -343,7 +339,7 @@ namespace drachtio {
     return true;
 	}
 	bool SD_FindByDialogId(const StableDialogs_t& dialogs, const std::string& dialogId, std::shared_ptr<SipDialog>& dlg) {
-		std::lock_guard<std::mutex> lock(sd_mutex) ;
+		std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
     auto &idx = dialogs.get<DialogIdTag>();
     auto it = idx.find(dialogId);
     if (it == idx.end()) return false;
@@ -351,34 +347,34 @@ namespace drachtio {
     return true;
 	}
   void SD_Clear(StableDialogs_t& dialogs, std::shared_ptr<SipDialog>& dlg) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
 
     auto &idx = dialogs.get<DlgPtrTag>();
     idx.erase(dlg);
 	}
 
   void SD_Clear(StableDialogs_t& dialogs, const std::string& dialogId) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
 
     auto &idx = dialogs.get<DialogIdTag>();
     idx.erase(dialogId);
 	}
 
   void SD_Clear(StableDialogs_t& dialogs, nta_leg_t* leg) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
 
     auto &idx = dialogs.get<DlgLegTag>();
     idx.erase(leg);
 	}
 
   size_t SD_Size(const StableDialogs_t& dialogs) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
     auto &idx = dialogs.get<DlgPtrTag>();
     return idx.size();
 	}
 
   size_t SD_Size(const StableDialogs_t& dialogs, size_t& nUac, size_t& nUas) {
-    std::lock_guard<std::mutex> lock(sd_mutex) ;
+    std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
     auto &idx = dialogs.get<DlgPtrTag>();
     size_t total = idx.size();
 		auto &idxRole = dialogs.get<DlgRoleTag>();
@@ -394,7 +390,7 @@ namespace drachtio {
     DR_LOG(log_debug) << "StableDialogs uac:                                               " << nUac;
     DR_LOG(log_debug) << "StableDialogs uas:                                               " << nUas;
     if (full && count) {
-      std::lock_guard<std::mutex> lock(sd_mutex) ;
+      std::unique_lock<std::mutex> lock = lockDialogStore(dialogs.m_mutex, "dialogs") ;
       auto &idx = dialogs.get<DlgTimeTag>();
       for (auto it = idx.begin(); it != idx.end(); ++it) {
 				std::shared_ptr<SipDialog> p = *it;
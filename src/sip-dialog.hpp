@@ -26,6 +26,7 @@ THE SOFTWARE.
 #include <chrono>
 #include <iostream>
 #include <set>
+#include <mutex>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -267,9 +268,9 @@ namespace drachtio {
     /* session timer */
     unsigned long 	m_nSessionExpiresSecs ;
     unsigned long 	m_nMinSE ;
-    su_timer_t*     m_timerSessionRefresh ;
+    TimerEventHandle  m_timerSessionRefresh ;
+    su_time_t       m_tmSessionRefreshDeadline ;
     SessionRefresher_t	m_refresher ;
-    std::weak_ptr<SipDialog>* m_ppSelf ;
 
 		std::string 			m_sourceAddress ;
 		unsigned int 	m_sourcePort ;
@@ -296,8 +297,6 @@ namespace drachtio {
 		std::chrono::time_point<std::chrono::steady_clock> m_timeArrive;
 		bool m_bAlerting;
 
-		su_duration_t 		m_nSessionTimerDuration;
-
 		// for race condition of sending CANCEL but getting 200 OK to INVITE
 		bool 							m_bAckBye;
 
@@ -331,7 +330,15 @@ namespace drachtio {
         boost::multi_index::const_mem_fun<SipDialog, SipDialog::DialogType_t, &SipDialog::getRole>
       >
     >
-  > StableDialogs_t;
+  > StableDialogIndex_t;
+
+  /* a set of stable dialogs along with the lock that the SD_* helpers take to work on it */
+  struct StableDialogs_t : public StableDialogIndex_t {
+    mutable std::mutex m_mutex;
+  };
+
+  /* lock a dialog store, counting the times another thread already held it */
+  std::unique_lock<std::mutex> lockDialogStore(std::mutex& m, const char* store);
 
 	void SD_Insert(StableDialogs_t& dialogs, std::shared_ptr<SipDialog>& dlg);
 
@@ -0,0 +1,253 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __SIP_NAMES_HPP__
+#define __SIP_NAMES_HPP__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string_view>
+
+namespace drachtio {
+
+  /*
+    Well-known sip headers an application may supply, as (name, sofia tag suffix).  Names are matched ignoring
+    case, with '-' and '_' treated alike, so "Max-Forwards" and "max_forwards" are the same header.
+  */
+  #define DR_SIP_HEADERS(X) \
+    X(user_agent, user_agent) \
+    X(subject, subject) \
+    X(max_forwards, max_forwards) \
+    X(proxy_require, proxy_require) \
+    X(accept_contact, accept_contact) \
+    X(reject_contact, reject_contact) \
+    X(expires, expires) \
+    X(date, date) \
+    X(retry_after, retry_after) \
+    X(timestamp, timestamp) \
+    X(min_expires, min_expires) \
+    X(priority, priority) \
+    X(call_info, call_info) \
+    X(organization, organization) \
+    X(server, server) \
+    X(in_reply_to, in_reply_to) \
+    X(accept, accept) \
+    X(accept_encoding, accept_encoding) \
+    X(accept_language, accept_language) \
+    X(allow, allow) \
+    X(require, require) \
+    X(supported, supported) \
+    X(unsupported, unsupported) \
+    X(event, event) \
+    X(allow_events, allow_events) \
+    X(subscription_state, subscription_state) \
+    X(proxy_authenticate, proxy_authenticate) \
+    X(proxy_authentication_info, proxy_authentication_info) \
+    X(proxy_authorization, proxy_authorization) \
+    X(authorization, authorization) \
+    X(www_authenticate, www_authenticate) \
+    X(authentication_info, authentication_info) \
+    X(error_info, error_info) \
+    X(warning, warning) \
+    X(refer_to, refer_to) \
+    X(referred_by, referred_by) \
+    X(replaces, replaces) \
+    X(session_expires, session_expires) \
+    X(min_se, min_se) \
+    X(path, path) \
+    X(service_route, service_route) \
+    X(reason, reason) \
+    X(security_client, security_client) \
+    X(security_server, security_server) \
+    X(security_verify, security_verify) \
+    X(privacy, privacy) \
+    X(sip_etag, etag) \
+    X(sip_if_match, if_match) \
+    X(mime_version, mime_version) \
+    X(content_type, content_type) \
+    X(content_encoding, content_encoding) \
+    X(content_language, content_language) \
+    X(content_disposition, content_disposition) \
+    X(request_disposition, request_disposition) \
+    X(error, error) \
+    X(refer_sub, refer_sub) \
+    X(alert_info, alert_info) \
+    X(reply_to, reply_to) \
+    X(p_asserted_identity, p_asserted_identity) \
+    X(p_preferred_identity, p_preferred_identity) \
+    X(remote_party_id, remote_party_id) \
+    X(payload, payload) \
+    X(from, from) \
+    X(to, to) \
+    X(call_id, call_id) \
+    X(cseq, cseq) \
+    X(via, via) \
+    X(route, route) \
+    X(contact, contact) \
+    X(rseq, rseq) \
+    X(rack, rack) \
+    X(record_route, record_route) \
+    X(content_length, content_length)
+
+  // sip methods we know by name, as (method, sofia method suffix); unlike header names they are case sensitive
+  #define DR_SIP_METHODS(X) \
+    X(INVITE, invite) \
+    X(ACK, ack) \
+    X(CANCEL, cancel) \
+    X(BYE, bye) \
+    X(OPTIONS, options) \
+    X(REGISTER, register) \
+    X(INFO, info) \
+    X(PRACK, prack) \
+    X(UPDATE, update) \
+    X(MESSAGE, message) \
+    X(SUBSCRIBE, subscribe) \
+    X(NOTIFY, notify) \
+    X(REFER, refer) \
+    X(PUBLISH, publish)
+
+  enum sip_header_id : uint8_t {
+    #define DR_SIP_HEADER_ID(name, tag) sip_hdr_##name,
+    DR_SIP_HEADERS(DR_SIP_HEADER_ID)
+    #undef DR_SIP_HEADER_ID
+    sip_hdr_unknown
+  } ;
+
+  enum sip_method_id : uint8_t {
+    #define DR_SIP_METHOD_ID(name, method) sip_mth_##method,
+    DR_SIP_METHODS(DR_SIP_METHOD_ID)
+    #undef DR_SIP_METHOD_ID
+    sip_mth_unknown
+  } ;
+
+  namespace sipnames {
+
+    constexpr std::string_view headerNames[] = {
+      #define DR_SIP_HEADER_NAME(name, tag) #name,
+      DR_SIP_HEADERS(DR_SIP_HEADER_NAME)
+      #undef DR_SIP_HEADER_NAME
+    } ;
+
+    constexpr std::string_view methodNames[] = {
+      #define DR_SIP_METHOD_NAME(name, method) #name,
+      DR_SIP_METHODS(DR_SIP_METHOD_NAME)
+      #undef DR_SIP_METHOD_NAME
+    } ;
+
+    // header names ignore case and treat '-' and '_' alike
+    constexpr char fold( char c ) {
+      return '-' == c ? '_' : (c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c) ;
+    }
+
+    template<bool Fold>
+    constexpr uint32_t hash( std::string_view s, uint32_t seed ) {
+      uint32_t h = seed ^ static_cast<uint32_t>( s.length() ) ;
+      for( char c : s ) h = (h ^ static_cast<unsigned char>( Fold ? fold( c ) : c )) * 16777619u ;
+      return h ^ (h >> 15) ;
+    }
+
+    template<bool Fold>
+    constexpr bool equal( std::string_view a, std::string_view b ) {
+      if( a.length() != b.length() ) return false ;
+      for( size_t i = 0; i < a.length(); i++ ) {
+        if( (Fold ? fold( a[i] ) : a[i]) != (Fold ? fold( b[i] ) : b[i]) ) return false ;
+      }
+      return true ;
+    }
+
+    /*
+      A perfect hash table over a fixed list of names, built at compile time: each name hashes to its own slot,
+      so a lookup is one hash and one compare.  The seed is searched for when the table is built.
+    */
+    template<size_t N, size_t Slots, bool Fold>
+    struct NameTable {
+      const std::string_view* m_names ;
+      uint32_t m_seed ;
+      uint8_t m_slots[Slots] ;
+
+      // index of the name in the list, or N if it is not one of them
+      constexpr size_t find( std::string_view name ) const {
+        uint8_t i = m_slots[ hash<Fold>( name, m_seed ) % Slots ] ;
+        return i < N && equal<Fold>( name, m_names[i] ) ? i : N ;
+      }
+    } ;
+
+    template<size_t Slots, bool Fold, size_t N>
+    constexpr NameTable<N, Slots, Fold> makeNameTable( const std::string_view (&names)[N] ) {
+      static_assert( N < 255, "name tables index with a byte" ) ;
+      NameTable<N, Slots, Fold> t = {} ;
+      t.m_names = names ;
+      for( uint32_t seed = 2166136261u; seed < 2166136261u + 4096; seed++ ) {
+        for( size_t i = 0; i < Slots; i++ ) t.m_slots[i] = 0xff ;
+        bool perfect = true ;
+        for( size_t i = 0; i < N && perfect; i++ ) {
+          uint8_t& slot = t.m_slots[ hash<Fold>( names[i], seed ) % Slots ] ;
+          perfect = 0xff == slot ;
+          slot = static_cast<uint8_t>( i ) ;
+        }
+        if( perfect ) {
+          t.m_seed = seed ;
+          return t ;
+        }
+      }
+      t.m_seed = 0 ;
+      return t ;
+    }
+
+    constexpr auto headerTable = makeNameTable<1024, true>( headerNames ) ;
+    constexpr auto methodTable = makeNameTable<64, false>( methodNames ) ;
+    static_assert( 0 != headerTable.m_seed, "no collision free seed for the sip header table; add slots" ) ;
+    static_assert( 0 != methodTable.m_seed, "no collision free seed for the sip method table; add slots" ) ;
+  }
+
+  // classify a header name, e.g. "Content-Type"; returns sip_hdr_unknown for custom headers
+  constexpr sip_header_id sipHeaderId( std::string_view name ) {
+    return static_cast<sip_header_id>( sipnames::headerTable.find( name ) ) ;
+  }
+
+  // classify a request method, e.g. "INVITE"; returns sip_mth_unknown for extension methods
+  constexpr sip_method_id sipMethodId( std::string_view method ) {
+    return static_cast<sip_method_id>( sipnames::methodTable.find( method ) ) ;
+  }
+
+  constexpr std::string_view sipMethodName( sip_method_id id ) {
+    return sip_mth_unknown == id ? std::string_view() : sipnames::methodNames[id] ;
+  }
+
+  // headers an application is not allowed to set; the stack generates them
+  constexpr bool isImmutableHeader( sip_header_id id ) {
+    return sip_hdr_via == id || sip_hdr_route == id || sip_hdr_rseq == id ||
+      sip_hdr_record_route == id || sip_hdr_content_length == id ;
+  }
+
+  // headers carrying an address of ours that an application may write as 'localhost'
+  constexpr bool isAddressHeader( sip_header_id id ) {
+    return sip_hdr_from == id || sip_hdr_to == id || sip_hdr_contact == id || sip_hdr_p_asserted_identity == id ;
+  }
+
+  static_assert( sip_hdr_content_type == sipHeaderId( "Content-Type" ), "header classification" ) ;
+  static_assert( sip_hdr_sip_etag == sipHeaderId( "SIP-ETag" ), "header classification" ) ;
+  static_assert( sip_hdr_unknown == sipHeaderId( "X-Custom" ), "header classification" ) ;
+  static_assert( sip_mth_subscribe == sipMethodId( "SUBSCRIBE" ), "method classification" ) ;
+  static_assert( sip_mth_unknown == sipMethodId( "invite" ), "method classification" ) ;
+}
+
+#endif
@@ -26,7 +26,6 @@ namespace drachtio {
 
 #include <algorithm> // for remove_if
 #include <functional> // for unary_function
-#include <regex>
 
 #include <sofia-sip/sip_util.h>
 #include <sofia-sip/msg_header.h>
@@ -38,20 +37,12 @@ namespace drachtio {
 #include "pending-request-controller.hpp"
 #include "cdr.hpp"
 #include "sip-transports.hpp"
+#include "sip-scanners.hpp"
 
 static drachtio::SipProxyController* theProxyController = NULL ;
 
 #define NTA (theOneAndOnlyController->getAgent())
 
-namespace {
-    void cloneProxy(su_root_magic_t* p, su_msg_r msg, void* arg ) {
-        drachtio::DrachtioController* pController = reinterpret_cast<drachtio::DrachtioController*>( p ) ;
-        drachtio::SipProxyController::ProxyData* d = reinterpret_cast<drachtio::SipProxyController::ProxyData*>( arg ) ;
-        pController->getProxyController()->doProxy(d) ;
-    }
-} ;
-
-
 namespace drachtio {
     struct without_nonce
     {
@@ -335,14 +326,14 @@ namespace drachtio {
     }
     ProxyCore::ClientTransaction::~ClientTransaction() {
         DR_LOG(log_debug) << "ClientTransaction::~ClientTransaction" ;
-        removeTimer( m_timerA, "timerA" ) ;
-        removeTimer( m_timerB, "timerB" ) ;
-        removeTimer( m_timerC, "timerC" ) ;
-        removeTimer( m_timerD, "timerD" ) ;
-        removeTimer( m_timerE, "timerE" ) ;
-        removeTimer( m_timerF, "timerF" ) ;
-        removeTimer( m_timerK, "timerK" ) ;
-        removeTimer( m_timerProvisional, "timerProvisional" ) ;
+        removeTimer( m_timerA, SipTimer_t::A ) ;
+        removeTimer( m_timerB, SipTimer_t::B ) ;
+        removeTimer( m_timerC, SipTimer_t::C ) ;
+        removeTimer( m_timerD, SipTimer_t::D ) ;
+        removeTimer( m_timerE, SipTimer_t::E ) ;
+        removeTimer( m_timerF, SipTimer_t::F ) ;
+        removeTimer( m_timerK, SipTimer_t::K ) ;
+        removeTimer( m_timerProvisional, SipTimer_t::provisional ) ;
 
         if( m_msgFinal ) { 
             msg_destroy( m_msgFinal ) ;
@@ -360,9 +351,9 @@ namespace drachtio {
         } ;
         return szNames[ static_cast<int>( state ) ] ;
     }
-    void ProxyCore::ClientTransaction::removeTimer( TimerEventHandle& handle, const char* szTimer ) {
+    void ProxyCore::ClientTransaction::removeTimer( TimerEventHandle& handle, SipTimer_t timer ) {
         if( NULL == handle ) return ;
-        m_pTQM->removeTimer( handle, szTimer ) ;
+        m_pTQM->removeTimer( handle, timer ) ;
         handle = NULL ;
     }
     void ProxyCore::ClientTransaction::setState( State_t newState ) {
@@ -384,19 +375,19 @@ namespace drachtio {
                     assert( !m_timerC ) ;
 
                     //timer A = retransmission timer 
-                    m_timerA = m_pTQM->addTimer("timerA", 
+                    m_timerA = m_pTQM->addTimer(SipTimer_t::A, 
                         std::bind(&ProxyCore::timerA, pCore, shared_from_this()), NULL, m_durationTimerA = NTA_SIP_T1 ) ;
 
                     //timer B = timeout when all invite retransmissions have been exhausted
-                    m_timerB = m_pTQM->addTimer("timerB", 
+                    m_timerB = m_pTQM->addTimer(SipTimer_t::B, 
                         std::bind(&ProxyCore::timerB, pCore, shared_from_this()), NULL, TIMER_B_MSECS ) ;
                     
                     //timer C - timeout to wait for final response before returning 408 Request Timeout. 
-                    m_timerC = m_pTQM->addTimer("timerC", 
+                    m_timerC = m_pTQM->addTimer(SipTimer_t::C, 
                         std::bind(&ProxyCore::timerC, pCore, shared_from_this()), NULL, TIMER_C_MSECS ) ;
 
                     if( pCore->getProvisionalTimeout() > 0 ) {
-                        m_timerProvisional = m_pTQM->addTimer("timerProvisional", 
+                        m_timerProvisional = m_pTQM->addTimer(SipTimer_t::provisional, 
                             std::bind(&ProxyCore::timerProvisional, pCore, shared_from_this()), NULL, pCore->getProvisionalTimeout() ) ;
                     }
                     m_timeArrive = std::chrono::steady_clock::now();
@@ -404,31 +395,31 @@ namespace drachtio {
                 break ;
 
                 case proceeding:
-                    removeTimer( m_timerA, "timerA" ) ;
-                    removeTimer( m_timerB, "timerB" ) ;
-                    removeTimer( m_timerProvisional, "timerProvisional" ) ;
+                    removeTimer( m_timerA, SipTimer_t::A ) ;
+                    removeTimer( m_timerB, SipTimer_t::B ) ;
+                    removeTimer( m_timerProvisional, SipTimer_t::provisional ) ;
                 break; 
 
                 case completed:
-                    removeTimer( m_timerA, "timerA" ) ;
-                    removeTimer( m_timerB, "timerB" ) ;
-                    removeTimer( m_timerC, "timerC" ) ;
-                    removeTimer( m_timerProvisional, "timerProvisional" ) ;
+                    removeTimer( m_timerA, SipTimer_t::A ) ;
+                    removeTimer( m_timerB, SipTimer_t::B ) ;
+                    removeTimer( m_timerC, SipTimer_t::C ) ;
+                    removeTimer( m_timerProvisional, SipTimer_t::provisional ) ;
 
                     //timer D - timeout when transaction can move from completed state to terminated
                     //note: in the case of a late-arriving provisional response after we've decided to cancel an invite, 
                     //we can have a timer D set when we get here as state will go 
                     //CALLING --> COMPLETED (when decide to cancel) --> PROCEEDING (when late response arrives) --> COMPLETED (as we send the CANCEL)
-                    removeTimer( m_timerD, "timerD" ) ;
-                    m_timerD = m_pTQM->addTimer("timerD", std::bind(&ProxyCore::timerD, pCore, shared_from_this()), 
+                    removeTimer( m_timerD, SipTimer_t::D ) ;
+                    m_timerD = m_pTQM->addTimer(SipTimer_t::D, std::bind(&ProxyCore::timerD, pCore, shared_from_this()), 
                         NULL, TIMER_D_MSECS ) ;
                 break ;
 
                 case terminated:
-                    removeTimer( m_timerA, "timerA" ) ;
-                    removeTimer( m_timerB, "timerB" ) ;
-                    removeTimer( m_timerC, "timerC" ) ;
-                    removeTimer( m_timerProvisional, "timerProvisional" ) ;
+                    removeTimer( m_timerA, SipTimer_t::A ) ;
+                    removeTimer( m_timerB, SipTimer_t::B ) ;
+                    removeTimer( m_timerC, SipTimer_t::C ) ;
+                    removeTimer( m_timerProvisional, SipTimer_t::provisional ) ;
                 break ;
 
                 default:
@@ -444,29 +435,29 @@ namespace drachtio {
 
                     assert( !m_timerE ) ; //TODO: should only be doing this on unreliable transports
                     assert( !m_timerF ) ;
-                    m_timerE = m_pTQM->addTimer("timerE", 
+                    m_timerE = m_pTQM->addTimer(SipTimer_t::E, 
                         std::bind(&ProxyCore::timerE, pCore, shared_from_this()), NULL, m_durationTimerA = NTA_SIP_T1 ) ;
-                    m_timerF = m_pTQM->addTimer("timerF", 
+                    m_timerF = m_pTQM->addTimer(SipTimer_t::F, 
                         std::bind(&ProxyCore::timerF, pCore, shared_from_this()), NULL, 64 * NTA_SIP_T1 ) ;
                 break ;
 
                 case proceeding: 
                     //we've received a provisional response to a non-INVITE (rare, but possible)
-                    removeTimer( m_timerE, "timerE" ) ;
+                    removeTimer( m_timerE, SipTimer_t::E ) ;
                 break ;
 
                 case completed: 
                     //we've received a final response to a non-INVITE request
-                    removeTimer( m_timerE, "timerE" ) ;
-                    removeTimer( m_timerF, "timerF" ) ;
-                    m_timerK = m_pTQM->addTimer("timerK", std::bind(&ProxyCore::timerK, pCore, shared_from_this()), 
+                    removeTimer( m_timerE, SipTimer_t::E ) ;
+                    removeTimer( m_timerF, SipTimer_t::F ) ;
+                    m_timerK = m_pTQM->addTimer(SipTimer_t::K, std::bind(&ProxyCore::timerK, pCore, shared_from_this()), 
                         NULL, NTA_SIP_T4 ) ;
                 break ;
 
                 case terminated:
-                    removeTimer( m_timerE, "timerE" ) ;
-                    removeTimer( m_timerF, "timerF" ) ;
-                    removeTimer( m_timerK, "timerK" ) ;
+                    removeTimer( m_timerE, SipTimer_t::E ) ;
+                    removeTimer( m_timerF, SipTimer_t::F ) ;
+                    removeTimer( m_timerK, SipTimer_t::K ) ;
                 break ;
 
                 default:
@@ -524,7 +515,7 @@ namespace drachtio {
 
         return true ;
     }
-    bool ProxyCore::ClientTransaction::forwardRequest(msg_t* msg, const string& headers) {
+    bool ProxyCore::ClientTransaction::forwardRequest(msg_t* msg, const HeaderIndex& headers) {
         std::shared_ptr<ProxyCore> pCore = m_pCore.lock() ;
         assert( pCore ) ;
 
@@ -630,18 +621,18 @@ namespace drachtio {
         
         return true ;
     }
-    bool ProxyCore::ClientTransaction::retransmitRequest(msg_t* msg, const string& headers) {
+    bool ProxyCore::ClientTransaction::retransmitRequest(msg_t* msg, const HeaderIndex& headers) {
         m_durationTimerA <<= 1 ;
         if( forwardRequest(msg, headers) ) {
             DR_LOG(log_debug) << "ClientTransaction - retransmitting request, timer A/E will be set to " << dec << m_durationTimerA << "ms" ;
             std::shared_ptr<ProxyCore> pCore = m_pCore.lock() ;
             assert( pCore ) ;
             if( this->isInviteTransaction() ) {
-                m_timerA = m_pTQM->addTimer("timerA", 
+                m_timerA = m_pTQM->addTimer(SipTimer_t::A, 
                     std::bind(&ProxyCore::timerA, pCore, shared_from_this()), NULL, m_durationTimerA) ;
             }
             else {
-                m_timerE = m_pTQM->addTimer("timerE", 
+                m_timerE = m_pTQM->addTimer(SipTimer_t::E, 
                     std::bind(&ProxyCore::timerE, pCore, shared_from_this()), NULL, m_durationTimerA) ;                
             }
             return true ;
@@ -698,8 +689,8 @@ namespace drachtio {
 
                 if( 100 != m_sipStatus && this->isInviteTransaction() ) {
                     assert( m_timerC ) ;
-                    removeTimer( m_timerC, "timerC" ) ;
-                    m_timerC = m_pTQM->addTimer("timerC", std::bind(&ProxyCore::timerC, pCore, shared_from_this()), 
+                    removeTimer( m_timerC, SipTimer_t::C ) ;
+                    m_timerC = m_pTQM->addTimer(SipTimer_t::C, std::bind(&ProxyCore::timerC, pCore, shared_from_this()), 
                         NULL, TIMER_C_MSECS ) ;
 
                     if (theOneAndOnlyController->getStatsCollector().enabled() && !this->hasAlerted()) {
@@ -732,7 +723,7 @@ namespace drachtio {
             }
 
             if( m_sipStatus >= 200 && this->isInviteTransaction() ) {
-                removeTimer(m_timerC, "timerC") ;
+                removeTimer(m_timerC, SipTimer_t::C) ;
             }
 
             //determine whether to forward this response upstream
@@ -820,12 +811,12 @@ namespace drachtio {
     int ProxyCore::ClientTransaction::cancelRequest(msg_t* msg) {
 
         //cancel retransmission timers 
-        removeTimer( m_timerA, "timerA" ) ;
-        removeTimer( m_timerB, "timerB" ) ;
-        removeTimer( m_timerC, "timerC" ) ;
-        removeTimer( m_timerC, "timerE" ) ;
-        removeTimer( m_timerC, "timerF" ) ;
-        removeTimer( m_timerC, "timerK" ) ;
+        removeTimer( m_timerA, SipTimer_t::A ) ;
+        removeTimer( m_timerB, SipTimer_t::B ) ;
+        removeTimer( m_timerC, SipTimer_t::C ) ;
+        removeTimer( m_timerE, SipTimer_t::E ) ;
+        removeTimer( m_timerF, SipTimer_t::F ) ;
+        removeTimer( m_timerK, SipTimer_t::K ) ;
 
         if( calling == m_state ) {
             DR_LOG(log_debug) << "ClientTransaction::cancelRequest - client request in CALLING state has not received a response so not sending CANCEL" ;
@@ -889,8 +880,7 @@ namespace drachtio {
             return -1;
     }
     void ProxyCore::ClientTransaction::writeCdr( msg_t* msg, sip_t* sip ) {
-        string encodedMessage ;
-        EncodeStackMessage( sip, encodedMessage ) ;
+        encoded_msg_ptr encodedMessage = EncodeStackMessage( msg ) ;
         if( 200 == m_sipStatus ) {
             Cdr::postCdr( std::make_shared<CdrStart>( msg, "network", Cdr::proxy_uac ), encodedMessage );                
         }               
@@ -902,10 +892,11 @@ namespace drachtio {
 
     ///ProxyCore
     ProxyCore::ProxyCore(const string& clientMsgId, const string& transactionId, tport_t* tp,bool recordRoute, 
-        bool fullResponse, bool simultaneous, const string& headers ) : 
-        m_clientMsgId(clientMsgId), m_transactionId(transactionId), m_tp(tp), m_canceled(false), m_headers(headers),
-        m_fullResponse(fullResponse), m_bRecordRoute(recordRoute), m_launchType(simultaneous ? ProxyCore::simultaneous : ProxyCore::serial), 
-        m_searching(true), m_nProvisionalTimeout(0) {
+        bool fullResponse, bool simultaneous, const HeaderIndex& headers ) : 
+        m_clientMsgId(clientMsgId), m_transactionId(transactionId), m_tp(tp), m_canceled(false), m_headers(headers.text()),
+        m_headerIndex(headers), m_fullResponse(fullResponse), m_bRecordRoute(recordRoute), 
+        m_launchType(simultaneous ? ProxyCore::simultaneous : ProxyCore::serial), m_searching(true), m_nProvisionalTimeout(0) {
+        m_headerIndex.rebase( m_headers.data() ) ;
     }
     ProxyCore::~ProxyCore() {
         DR_LOG(log_debug) << "ProxyCore::~ProxyCore" ;
@@ -954,23 +945,18 @@ namespace drachtio {
         DR_LOG(log_debug) << "ProxyCore::addClientTransactions: there are now " << dec << vecClientTransactions.size() << " client transactions";
     }
     void ProxyCore::setProvisionalTimeout(const string& t ) {
-        try {
-            std::regex re("^(\\d+)(ms|s)$");
-            std:smatch mr;
-            if (std::regex_search(t, mr, re) && mr.size() > 1) {
-                string s = mr[1] ;
-                m_nProvisionalTimeout = ::atoi( s.c_str() ) ;
-                if( 0 == mr[2].compare("s") ) {
-                    m_nProvisionalTimeout *= 1000 ;
-                }
-                DR_LOG(log_debug) << "provisional timeout is " << m_nProvisionalTimeout << "ms" ;
+        std::string_view digits ;
+        bool bSeconds ;
+        if( scan::timeout( t, digits, bSeconds ) ) {
+            m_nProvisionalTimeout = ::atoi( string( digits ).c_str() ) ;
+            if( bSeconds ) {
+                m_nProvisionalTimeout *= 1000 ;
             }
-            else if( t.length() > 0 ) {
-                DR_LOG(log_error) << "Invalid timeout syntax: " << t ;
-            }        
-        } catch( std::regex_error& e) {
-            DR_LOG(log_error) << "ProxyCore::setProvisionalTimeout - regex error " << e.what();
+            DR_LOG(log_debug) << "provisional timeout is " << m_nProvisionalTimeout << "ms" ;
         }
+        else if( t.length() > 0 ) {
+            DR_LOG(log_error) << "Invalid timeout syntax: " << t ;
+        }        
     }
 
     //timer functions
@@ -982,7 +968,7 @@ namespace drachtio {
         assert( pClient->getTransactionState() == ClientTransaction::calling ) ;
         pClient->clearTimerA() ;
         msg_t* msg = m_pServerTransaction->msgDup() ;
-        pClient->retransmitRequest(msg, m_headers) ;
+        pClient->retransmitRequest(msg, m_headerIndex) ;
         //msg_destroy(msg) ;
     }
     //max retransmission timer
@@ -1024,7 +1010,7 @@ namespace drachtio {
         assert( pClient->getTransactionState() == ClientTransaction::trying ) ;
         pClient->clearTimerE() ;
         msg_t* msg = m_pServerTransaction->msgDup() ;
-        pClient->retransmitRequest(msg, m_headers) ;
+        pClient->retransmitRequest(msg, m_headerIndex) ;
         //msg_destroy(msg) ;
     }
     //non-INVITE transaction timeout timer
@@ -1069,7 +1055,7 @@ namespace drachtio {
             if( ClientTransaction::not_started == pClient->getTransactionState() ) {
                 DR_LOG(log_debug) << "launching client " << idx ;
                 msg_t* msg = m_pServerTransaction->msgDup();
-                bool sent = pClient->forwardRequest(msg, m_headers) ;
+                bool sent = pClient->forwardRequest(msg, m_headerIndex) ;
                 //msg_destroy( msg ) ;
                 if( sent ) count++ ;
                 if( sent && ProxyCore::serial == getLaunchType() ) {
@@ -1148,7 +1134,7 @@ namespace drachtio {
     }
     bool ProxyCore::forwardRequest( msg_t* msg, sip_t* sip ) {
         std::shared_ptr< ClientTransaction > pClient ;
-        string headers ;
+        HeaderIndex headers ;
         vector< std::shared_ptr< ClientTransaction > >::const_iterator it = std::find_if( m_vecClientTransactions.begin(), 
             m_vecClientTransactions.end(), ClientTransactionIsCallingOrProceeding ) ;
         if( m_vecClientTransactions.end() != it ) {
@@ -1187,10 +1173,6 @@ namespace drachtio {
             theOneAndOnlyController->getClientController()->route_api_response( getClientMsgId(), "OK", "done" ) ;
          }             
     }
-    void ProxyCore::getUniqueSipTransactionIdentifier(string& str) { 
-      sip_t* sip = sip_object(m_pServerTransaction->msg()) ;
-      theProxyController->makeUniqueSipTransactionIdentifier(sip, str);
-    }
 
     ///SipProxyController
     SipProxyController::SipProxyController( DrachtioController* pController, su_clone_r* pClone ) : m_pController(pController), m_pClone(pClone), 
@@ -1198,33 +1180,20 @@ namespace drachtio {
 
             assert(m_agent) ;
             theProxyController = this ;
-            m_pTQM = std::make_shared<SipTimerQueueManager>( pController->getRoot() ) ;
+            m_pTQM = std::make_shared<SipTimerQueueManager>( pController->getRoot(), "proxy" ) ;
     }
     SipProxyController::~SipProxyController() {
     }
 
     void SipProxyController::proxyRequest( const string& clientMsgId, const string& transactionId, bool recordRoute, 
         bool fullResponse, bool followRedirects, bool simultaneous, const string& provisionalTimeout, const string& finalTimeout, 
-        const vector<string>& vecDestinations, const string& headers )  {
+        const vector<string>& vecDestinations, const HeaderIndex& headers )  {
 
         DR_LOG(log_debug) << "SipProxyController::proxyRequest - transactionId: " << transactionId ;
        
-        su_msg_r m = SU_MSG_R_INIT ;
-        int rv = su_msg_create( m, su_clone_task(*m_pClone), su_root_task(m_pController->getRoot()),  cloneProxy, sizeof( SipProxyController::ProxyData ) );
-        if( rv < 0 ) {
-            m_pController->getClientController()->route_api_response( clientMsgId, "NOK", "Internal server error allocating message") ;
-            return  ;
-        }
-        void* place = su_msg_data( m ) ;
-
-        /* we need to use placement new to allocate the object in a specific address, hence we are responsible for deleting it (below) */
-        ProxyData* msgData = new(place) ProxyData( clientMsgId, transactionId, recordRoute, fullResponse, followRedirects, 
-            simultaneous, provisionalTimeout, finalTimeout, vecDestinations, headers ) ;
-        rv = su_msg_send(m);  
-        if( rv < 0 ) {
-            m_pController->getClientController()->route_api_response( clientMsgId, "NOK", "Internal server error sending message") ;
-            return  ;
-        }
+        m_pController->postToStack( { DrachtioController::StackWork::proxy_request, nullptr, 
+            std::make_unique<ProxyData>( clientMsgId, transactionId, recordRoute, fullResponse, followRedirects, 
+                simultaneous, provisionalTimeout, finalTimeout, vecDestinations, headers ) } ) ;
         
         return  ;
     } 
@@ -1255,7 +1224,7 @@ namespace drachtio {
             }
             std::shared_ptr<ProxyCore> pCore = addProxy( clientMsgId, transactionId, p->getMsg(), p->getSipObject(), p->getTport(), pData->getRecordRoute(), 
                 pData->getFullResponse(), pData->getFollowRedirects(), pData->getSimultaneous(), pData->getProvisionalTimeout(), 
-                pData->getFinalTimeout(), vecDestination, pData->getHeaders() ) ;
+                pData->getFinalTimeout(), vecDestination, pData->getHeaderIndex() ) ;
 
 
             if( sip->sip_max_forwards && sip->sip_max_forwards->mf_count <= 0 ) {
@@ -1274,7 +1243,6 @@ namespace drachtio {
                 msg_destroy(reply) ;
 
                 removeProxy( pCore )  ;
-                pData->~ProxyData() ; 
                 return ;
             }
  
@@ -1305,9 +1273,6 @@ namespace drachtio {
             }
 //          }
         }
-        //N.B.: we must explicitly call the destructor of an object allocated with placement new
-        pData->~ProxyData() ; 
-
     }
     bool SipProxyController::processResponse( msg_t* msg, sip_t* sip ) {
         string callId = sip->sip_call_id->i_id ;
@@ -1349,12 +1314,11 @@ namespace drachtio {
         return true ;
     }
     std::shared_ptr<ProxyCore> SipProxyController::getProxy( sip_t* sip ) {
-      string id ;
-      theProxyController->makeUniqueSipTransactionIdentifier(sip, id) ;
-      //DR_LOG(log_debug) << "SipProxyController::getProxy searching proxy for id " << id ;
+      TransactionKey::Fields fields = TransactionKey::proxyFields( sip ) ;
+      TransactionKey key( fields ) ;
       std::shared_ptr<ProxyCore> p ;
       std::lock_guard<std::mutex> lock(m_mutex) ;
-      mapCallId2Proxy::iterator it = m_mapCallId2Proxy.find( id ) ;
+      mapCallId2Proxy::iterator it = findProxy( key, fields ) ;
       if( it != m_mapCallId2Proxy.end() ) {
         p = it->second ;
       }
@@ -1497,19 +1461,18 @@ namespace drachtio {
         return true ;
     }
     bool SipProxyController::isProxyingRequest( msg_t* msg, sip_t* sip )  {
-      string id ;
-      theProxyController->makeUniqueSipTransactionIdentifier(sip, id) ;
+      TransactionKey::Fields fields = TransactionKey::proxyFields( sip ) ;
+      TransactionKey key( fields ) ;
       std::lock_guard<std::mutex> lock(m_mutex) ;
-      mapCallId2Proxy::iterator it = m_mapCallId2Proxy.find( id ) ;
-      return it != m_mapCallId2Proxy.end() ;
+      return m_mapCallId2Proxy.end() != findProxy( key, fields ) ;
     }
 
     std::shared_ptr<ProxyCore> SipProxyController::removeProxy( sip_t* sip ) {
-      string id ;
-      theProxyController->makeUniqueSipTransactionIdentifier(sip, id); 
+      TransactionKey::Fields fields = TransactionKey::proxyFields( sip ) ;
+      TransactionKey key( fields ) ;
       std::shared_ptr<ProxyCore> p ;
       std::lock_guard<std::mutex> lock(m_mutex) ;
-      mapCallId2Proxy::iterator it = m_mapCallId2Proxy.find( id ) ;
+      mapCallId2Proxy::iterator it = findProxy( key, fields ) ;
       if( it != m_mapCallId2Proxy.end() ) {
         p = it->second ;
         m_mapCallId2Proxy.erase(it) ;
@@ -1532,39 +1495,15 @@ namespace drachtio {
         }
     }
 
-    void SipProxyController::makeUniqueSipTransactionIdentifier(sip_t* sip, string& str) {
-      str = sip->sip_call_id->i_id ;
-      str.append("|") ;
-      str.append((sip->sip_request && sip_method_cancel == sip->sip_request->rq_method) ?
-        "INVITE" :
-        sip->sip_cseq->cs_method_name) ;
-      str.append("|") ;
-      str.append( boost::lexical_cast<std::string>(sip->sip_cseq->cs_seq) ) ;
-
-      // note: the branch we used in sending was the branch on the incoming invite which is now the second via
-      // if we are processing a response
-      if (sip->sip_status && sip->sip_via && sip->sip_via->v_next &&  sip->sip_via->v_next->v_branch) {
-        str.append("|") ;
-        str.append(sip->sip_via->v_next->v_branch) ;
-      }
-      else if (sip->sip_request && sip->sip_via && sip->sip_via->v_branch) {
-        str.append("|") ;
-        str.append(sip->sip_via->v_branch) ;
-      }
-      //DR_LOG(log_debug) << "SipProxyController::makeUniqueSipTransactionIdentifier: " << str ;
-    }
-
-
     std::shared_ptr<ProxyCore>  SipProxyController::addProxy( const string& clientMsgId, const string& transactionId, 
         msg_t* msg, sip_t* sip, tport_t* tp, bool recordRoute, bool fullResponse, bool followRedirects,
         bool simultaneous, const string& provisionalTimeout, const string& finalTimeout, vector<string> vecDestination, 
-        const string& headers ) {
+        const HeaderIndex& headers ) {
 
-      string id ;
-      theProxyController->makeUniqueSipTransactionIdentifier(sip, id) ;
+      TransactionKey key( TransactionKey::proxyFields( sip ) ) ;
 
-      DR_LOG(log_debug) << "SipProxyController::addProxy - adding transaction id " << transactionId << ", id " << 
-        id << " before insert there are "<< m_mapCallId2Proxy.size() << " proxy instances";
+      DR_LOG(log_debug) << "SipProxyController::addProxy - adding transaction id " << transactionId << ", key " << 
+        key << " before insert there are "<< m_mapCallId2Proxy.size() << " proxy instances";
 
       std::shared_ptr<ProxyCore> p = std::make_shared<ProxyCore>( clientMsgId, transactionId, tp, recordRoute, 
         fullResponse, simultaneous, headers ) ;
@@ -1573,7 +1512,7 @@ namespace drachtio {
       if( !provisionalTimeout.empty() ) p->setProvisionalTimeout( provisionalTimeout ) ;
       
       std::lock_guard<std::mutex> lock(m_mutex) ;
-      m_mapCallId2Proxy.insert( mapCallId2Proxy::value_type(id, p) ) ;
+      m_mapCallId2Proxy.insert( mapCallId2Proxy::value_type(key, p) ) ;
       return p ;         
     }
 
@@ -1658,7 +1597,7 @@ namespace drachtio {
         if (bDetail) {
             for (const auto& kv : m_mapCallId2Proxy) {
                 std::shared_ptr<ProxyCore> p = kv.second;
-                DR_LOG(bDetail ? log_info : log_debug) << "    sip proxy txn id: " << std::hex << (kv.first).c_str() << ", call-id: " << p->getCallId();
+                DR_LOG(bDetail ? log_info : log_debug) << "    sip proxy txn key: " << kv.first << ", call-id: " << p->getCallId();
             }
         }
 
@@ -41,8 +41,6 @@ THE SOFTWARE.
 #include "timer-queue.hpp"
 #include "timer-queue-manager.hpp"
 
-#define MAX_DESTINATIONS (10)
-#define HDR_STR_LEN (1024)
 
 namespace drachtio {
 
@@ -135,20 +133,20 @@ namespace drachtio {
           m_msgFinal = NULL ;
         }
         //cancel  timers 
-        removeTimer( m_timerA, "timerA" ) ;
-        removeTimer( m_timerB, "timerB" ) ;
-        removeTimer( m_timerC, "timerC" ) ;
-        removeTimer( m_timerD, "timerD" ) ;
-        removeTimer( m_timerE, "timerE" ) ;
-        removeTimer( m_timerF, "timerF" ) ;
-        removeTimer( m_timerK, "timerK" ) ;
+        removeTimer( m_timerA, SipTimer_t::A ) ;
+        removeTimer( m_timerB, SipTimer_t::B ) ;
+        removeTimer( m_timerC, SipTimer_t::C ) ;
+        removeTimer( m_timerD, SipTimer_t::D ) ;
+        removeTimer( m_timerE, SipTimer_t::E ) ;
+        removeTimer( m_timerF, SipTimer_t::F ) ;
+        removeTimer( m_timerK, SipTimer_t::K ) ;
       }
 
 
       bool processResponse( msg_t* msg, sip_t* sip ) ;
       
-      bool forwardRequest(msg_t* msg, const string& headers) ;
-      bool retransmitRequest(msg_t* msg, const string& headers) ;
+      bool forwardRequest(msg_t* msg, const HeaderIndex& headers) ;
+      bool retransmitRequest(msg_t* msg, const HeaderIndex& headers) ;
       bool forwardPrack(msg_t* msg, sip_t* sip) ;
       int cancelRequest(msg_t* msg) ;
 
@@ -174,7 +172,7 @@ namespace drachtio {
       }
       void writeCdr( msg_t* msg, sip_t* sip ) ;
       const char* getStateName( State_t state) ;
-      void removeTimer( TimerEventHandle& handle, const char *szTimer = NULL ) ;
+      void removeTimer( TimerEventHandle& handle, SipTimer_t timer ) ;
 
       std::weak_ptr<ProxyCore>  m_pCore ;
       msg_t*  m_msgFinal ;
@@ -215,7 +213,7 @@ namespace drachtio {
 
 
     ProxyCore(const string& clientMsgId, const string& transactionId, tport_t* tp, bool recordRoute, 
-      bool fullResponse, bool simultaneous, const string& headers );
+      bool fullResponse, bool simultaneous, const HeaderIndex& headers );
 
     ~ProxyCore() ;
 
@@ -244,7 +242,7 @@ namespace drachtio {
     void timerProvisional( std::shared_ptr<ClientTransaction> pClient ) ;
 
     const char* getCallId(void) { return sip_object( m_pServerTransaction->msg() )->sip_call_id->i_id; }
-    void getUniqueSipTransactionIdentifier(string& str);
+    TransactionKey::Fields getTransactionFields(void) { return TransactionKey::proxyFields( sip_object( m_pServerTransaction->msg() ) ); }
     const char* getMethodName(void) { return sip_object( m_pServerTransaction->msg() )->sip_request->rq_method_name; }
     sip_method_t getMethod(void) { return sip_object( m_pServerTransaction->msg() )->sip_request->rq_method; }
     sip_cseq_t* getCseq(void) { return sip_object( m_pServerTransaction->msg() )->sip_cseq; }
@@ -258,7 +256,7 @@ namespace drachtio {
     const string& getTransactionId() ;
     tport_t* getTport() ;
     bool wantsFullResponse(void) { return m_fullResponse; }
-    const string& getHeaders(void) { return m_headers; }
+    const HeaderIndex& getHeaders(void) { return m_headerIndex; }
 
     bool isCanceled(void) { return m_canceled; }
 
@@ -282,6 +280,7 @@ namespace drachtio {
     bool m_bFollowRedirects ;
     bool m_bRecordRoute ;    
     string m_headers ;
+    HeaderIndex m_headerIndex ;
 
     bool m_canceled ;
     bool m_searching ;
@@ -322,86 +321,55 @@ namespace drachtio {
       TimerEventHandle m_handle ;
     } ;
 
+    // what the client thread hands the stack thread for a proxy request; queued by DrachtioController::postToStack
     class ProxyData {
     public:
-      ProxyData() {
-        memset(m_szClientMsgId, 0, sizeof(m_szClientMsgId) ) ;
-        memset(m_szTransactionId, 0, sizeof(m_szTransactionId) ) ;
-        memset(m_szProvisionalTimeout, 0, sizeof(m_szProvisionalTimeout)) ;
-        memset(m_szFinalTimeout, 0, sizeof(m_szFinalTimeout)) ;
-        memset(m_szDestination, 0, MAX_DESTINATIONS * URI_LEN) ;
-        memset(m_szHeaders, 0, sizeof(m_szHeaders)) ;
-        m_bRecordRoute = m_bFullResponse = m_bSimultaneous = m_bFollowRedirects = false ;
-      }
       ProxyData(const string& clientMsgId, const string& transactionId, bool recordRoute, 
         bool fullResponse, bool followRedirects, bool simultaneous, const string& provisionalTimeout, const string& finalTimeout, 
-        const vector<string>& vecDestinations, const string& headers ) {
-
-        strncpy( m_szClientMsgId, clientMsgId.c_str(), MSG_ID_LEN - 1) ;
-        strncpy( m_szTransactionId, transactionId.c_str(), MSG_ID_LEN -1 ) ;
-        m_bRecordRoute = recordRoute ;
-        m_bFullResponse = fullResponse ;
-        m_bFollowRedirects = followRedirects ;
-        m_bSimultaneous = simultaneous ;
-        strncpy( m_szProvisionalTimeout, provisionalTimeout.c_str(), 15) ;
-        strncpy( m_szFinalTimeout, finalTimeout.c_str(), 15) ;
-        strncpy( m_szHeaders, headers.c_str(), HDR_STR_LEN - 1) ;
-        int i = 0 ;
-        BOOST_FOREACH( const string& dest, vecDestinations ) {
-          strncpy( m_szDestination[i++], dest.c_str(), URI_LEN - 1) ;
-        }
-       }
-      ~ProxyData() {}
-      ProxyData& operator=(const ProxyData& md) {
-        strncpy( m_szClientMsgId, md.m_szClientMsgId, MSG_ID_LEN) ;
-        strncpy( m_szTransactionId, md.m_szTransactionId, MSG_ID_LEN) ;
-        m_bRecordRoute = md.m_bRecordRoute ;
-        m_bFullResponse = md.m_bFullResponse ;
-        m_bFollowRedirects = md.m_bFollowRedirects ;
-        m_bSimultaneous = md.m_bSimultaneous ;
-        strncpy( m_szProvisionalTimeout, md.m_szProvisionalTimeout, 15) ;
-        strncpy( m_szFinalTimeout, md.m_szFinalTimeout, 15) ;
-        strncpy( m_szHeaders, md.m_szHeaders, HDR_STR_LEN - 1) ;
-        memset(m_szDestination, 0, MAX_DESTINATIONS * URI_LEN) ;
-        for( int i = 0; i < MAX_DESTINATIONS && *md.m_szDestination[i]; i++ ) {
-          strcpy( m_szDestination[i], md.m_szDestination[i] ) ;
-        }
-        return *this ;
-      }
+        const vector<string>& vecDestinations, const HeaderIndex& headers ) : m_bRecordRoute(recordRoute), m_bFullResponse(fullResponse), 
+        m_bFollowRedirects(followRedirects), m_bSimultaneous(simultaneous), m_vecDestination(vecDestinations) {
 
-      const char* getClientMsgId() { return m_szClientMsgId; } 
-      bool hasClientMsgId() { return m_szClientMsgId[0] != '\0'; }
-      const char* getTransactionId() { return m_szTransactionId; } 
-      bool getRecordRoute() { return m_bRecordRoute;}
-      bool getFullResponse() { return m_bFullResponse;}
-      bool getFollowRedirects() { return m_bFollowRedirects;}
-      bool getSimultaneous() { return m_bSimultaneous;}
-      const char* getProvisionalTimeout() { return m_szProvisionalTimeout;}
-      const char* getFinalTimeout() { return m_szFinalTimeout;}
-      void getDestinations( vector<string>& vecDestination ) {
-        vecDestination.clear() ;
-        for( int i = 0; i < MAX_DESTINATIONS && *m_szDestination[i]; i++ ) {
-          vecDestination.push_back( m_szDestination[i] ) ;
-        }
+        m_buffer = packFields({ {clientMsgId, &m_clientMsgId}, {transactionId, &m_transactionId}, 
+          {provisionalTimeout, &m_provisionalTimeout}, {finalTimeout, &m_finalTimeout}, {headers.text(), &m_headers} }) ;
+        m_headerIndex = headers ;
+        m_headerIndex.rebase( m_headers.data() ) ;
       }
-      const char* getHeaders() { return m_szHeaders;}
+      ProxyData(const ProxyData&) = delete ;
+      ProxyData& operator=(const ProxyData&) = delete ;
+      ProxyData(ProxyData&&) = default ;
+      ProxyData& operator=(ProxyData&&) = default ;
+
+      const char* getClientMsgId() const { return m_clientMsgId.data(); } 
+      bool hasClientMsgId() const { return !m_clientMsgId.empty(); }
+      const char* getTransactionId() const { return m_transactionId.data(); } 
+      bool getRecordRoute() const { return m_bRecordRoute;}
+      bool getFullResponse() const { return m_bFullResponse;}
+      bool getFollowRedirects() const { return m_bFollowRedirects;}
+      bool getSimultaneous() const { return m_bSimultaneous;}
+      const char* getProvisionalTimeout() const { return m_provisionalTimeout.data();}
+      const char* getFinalTimeout() const { return m_finalTimeout.data();}
+      void getDestinations( vector<string>& vecDestination ) const { vecDestination = m_vecDestination; }
+      const char* getHeaders() const { return m_headers.data();}
+      const HeaderIndex& getHeaderIndex() const { return m_headerIndex;}
 
     private:
-      char  m_szClientMsgId[MSG_ID_LEN];
-      char  m_szTransactionId[MSG_ID_LEN];
+      std::unique_ptr<char[]> m_buffer ;
+      std::string_view m_clientMsgId ;
+      std::string_view m_transactionId ;
+      std::string_view m_provisionalTimeout ;
+      std::string_view m_finalTimeout ;
+      std::string_view m_headers ;
       bool  m_bRecordRoute ;
       bool  m_bFullResponse ;
       bool  m_bFollowRedirects ;
       bool  m_bSimultaneous ;
-      char  m_szProvisionalTimeout[16] ;
-      char  m_szFinalTimeout[16] ;
-      char  m_szDestination[MAX_DESTINATIONS][URI_LEN] ;
-      char  m_szHeaders[HDR_STR_LEN] ;
+      vector<string> m_vecDestination ;
+      HeaderIndex m_headerIndex ;
     } ;
 
     void proxyRequest( const string& clientMsgId, const string& transactionId, bool recordRoute, bool fullResponse,
       bool followRedirects, bool simultaneous, const string& provisionalTimeout, const string& finalTimeout, 
-      const vector<string>& vecDestination, const string& headers )  ;
+      const vector<string>& vecDestination, const HeaderIndex& headers )  ;
     void doProxy( ProxyData* pData ) ;
     bool processResponse( msg_t* msg, sip_t* sip ) ;
     bool processRequestWithRouteHeader( msg_t* msg, sip_t* sip ) ;
@@ -414,11 +382,10 @@ namespace drachtio {
     void logStorageCount(bool bDetail = false) ;
 
     bool isRetransmission( sip_t* sip ) {
+      TransactionKey::Fields fields = TransactionKey::proxyFields( sip ) ;
+      TransactionKey key( fields ) ;
       std::lock_guard<std::mutex> lock(m_mutex) ;
-      string id ;
-      this->makeUniqueSipTransactionIdentifier(sip, id) ;
-      mapCallId2Proxy::iterator it = m_mapCallId2Proxy.find( id ) ;   
-      return it != m_mapCallId2Proxy.end() ;
+      return m_mapCallId2Proxy.end() != findProxy( key, fields ) ;
     }
 
     std::shared_ptr<TimerQueueManager> getTimerQueueManager(void) { return m_pTQM; }
@@ -429,8 +396,6 @@ namespace drachtio {
     bool addChallenge( sip_t* sip, const string& target ) ;
     void timeoutChallenge(const char* nonce) ;
 
-    void makeUniqueSipTransactionIdentifier(sip_t* sip, string& str);
-
   protected:
 
     void clearTimerProvisional( std::shared_ptr<ProxyCore> p );
@@ -438,14 +403,14 @@ namespace drachtio {
 
     std::shared_ptr<ProxyCore> addProxy( const string& clientMsgId, const string& transactionId, msg_t* msg, sip_t* sip, tport_t* tp, 
       bool recordRoute, bool fullResponse, bool followRedirects, bool simultaneous, const string& provisionalTimeout, 
-      const string& finalTimeout, vector<string> vecDestination, const string& headers ) ;
+      const string& finalTimeout, vector<string> vecDestination, const HeaderIndex& headers ) ;
 
     std::shared_ptr<ProxyCore> getProxy( sip_t* sip );
     std::shared_ptr<ProxyCore> getProxyByCallId( sip_t* sip ) {
       std::shared_ptr<ProxyCore> p ;
       std::lock_guard<std::mutex> lock(m_mutex) ;
       for( mapCallId2Proxy::iterator it = m_mapCallId2Proxy.begin(); it != m_mapCallId2Proxy.end(); ++it ) {
-        if( string::npos != it->first.find( sip->sip_call_id->i_id ) ) {
+        if( 0 == strcmp( it->second->getCallId(), sip->sip_call_id->i_id ) ) {
           return it->second ;
         }
       }
@@ -467,9 +432,16 @@ namespace drachtio {
 
     std::shared_ptr<TimerQueueManager> m_pTQM ;
 
-    typedef std::unordered_map<string, std::shared_ptr<ProxyCore> > mapCallId2Proxy ;
+    typedef std::unordered_map<TransactionKey, std::shared_ptr<ProxyCore>, TransactionKey::Hash > mapCallId2Proxy ;
     mapCallId2Proxy m_mapCallId2Proxy ;
 
+    // the proxy for a transaction, checked against the request it holds; the caller must hold m_mutex
+    mapCallId2Proxy::iterator findProxy( const TransactionKey& key, const TransactionKey::Fields& fields ) {
+      mapCallId2Proxy::iterator it = m_mapCallId2Proxy.find( key ) ;
+      if( it != m_mapCallId2Proxy.end() && it->second->getTransactionFields() != fields ) return m_mapCallId2Proxy.end() ;
+      return it ;
+    }
+
     typedef std::unordered_map<string, std::shared_ptr<ChallengedRequest> > mapNonce2Challenge ;
     mapNonce2Challenge m_mapNonce2Challenge ;
 
@@ -0,0 +1,296 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __SIP_SCANNERS_HPP__
+#define __SIP_SCANNERS_HPP__
+
+#include <string.h>
+#include <string_view>
+
+/*
+  Hand written scanners for the small grammars we used to match with std::regex.  Each one accepts exactly what
+  the regular expression noted above it did and returns views into its input, so none of them allocate.
+  test_sip_scanners.cpp checks them against the original expressions.
+*/
+namespace drachtio {
+  namespace scan {
+
+    inline bool isDigit( char c ) { return c >= '0' && c <= '9'; }
+    inline bool isWordChar( char c ) { return isDigit( c ) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || '_' == c; }
+    inline bool isSpace( char c ) { return ' ' == c || '\t' == c || '\n' == c || '\v' == c || '\f' == c || '\r' == c; }
+    inline bool isHexOrColon( char c ) { return isDigit( c ) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') || ':' == c; }
+
+    // '.' in a regular expression does not match a line terminator, so '^(.*)...' patterns only see the first line
+    inline std::string_view firstLine( std::string_view s ) {
+      for( size_t i = 0; i < s.length(); i++ ) if( '\n' == s[i] || '\r' == s[i] ) return s.substr( 0, i ) ;
+      return s ;
+    }
+
+    inline size_t digitsAt( std::string_view s, size_t pos ) {
+      size_t end = pos ;
+      while( end < s.length() && isDigit( s[end] ) ) end++ ;
+      return end - pos ;
+    }
+
+    inline bool startsWithNoCase( std::string_view s, std::string_view prefix ) {
+      if( s.length() < prefix.length() ) return false ;
+      for( size_t i = 0; i < prefix.length(); i++ ) {
+        char c = s[i] ;
+        if( c >= 'A' && c <= 'Z' ) c += 'a' - 'A' ;
+        if( c != prefix[i] ) return false ;
+      }
+      return true ;
+    }
+
+    struct TransportDescription {
+      std::string_view proto ;
+      std::string_view host ;
+      std::string_view port ;
+    } ;
+
+    // "udp/10.0.0.1:5060": ^(.*)/(.*):(\d+)
+    inline bool transportDescription( std::string_view s, TransportDescription& out ) {
+      s = firstLine( s ) ;
+      for( size_t slash = s.rfind( '/' ); std::string_view::npos != slash; slash = 0 == slash ? std::string_view::npos : s.rfind( '/', slash - 1 ) ) {
+        for( size_t colon = s.rfind( ':' ); std::string_view::npos != colon && colon > slash; colon = s.rfind( ':', colon - 1 ) ) {
+          size_t n = digitsAt( s, colon + 1 ) ;
+          if( n ) {
+            out.proto = s.substr( 0, slash ) ;
+            out.host = s.substr( slash + 1, colon - slash - 1 ) ;
+            out.port = s.substr( colon + 1, n ) ;
+            return true ;
+          }
+        }
+      }
+      return false ;
+    }
+
+    struct SipUri {
+      std::string_view scheme ;
+      std::string_view user ;
+      std::string_view host ;
+      std::string_view port ;
+      std::string_view params ;     // everything after the first ';', not yet split
+    } ;
+
+    // what follows the host in a sip uri: (?::(\d+))?(?:;([^>]+))?>?$
+    inline bool sipUriTail( std::string_view s, size_t pos, SipUri& out ) {
+      out.port = std::string_view() ;
+      out.params = std::string_view() ;
+      if( pos < s.length() && ':' == s[pos] ) {
+        size_t n = digitsAt( s, pos + 1 ) ;
+        if( 0 == n ) return false ;
+        out.port = s.substr( pos + 1, n ) ;
+        pos += n + 1 ;
+      }
+      if( pos < s.length() && ';' == s[pos] ) {
+        size_t end = s.find( '>', pos + 1 ) ;
+        if( std::string_view::npos == end ) end = s.length() ;
+        if( end == pos + 1 ) return false ;
+        out.params = s.substr( pos + 1, end - pos - 1 ) ;
+        pos = end ;
+      }
+      if( pos < s.length() && '>' == s[pos] ) pos++ ;
+      return pos == s.length() ;
+    }
+
+    // ([^;|^>|^:]+) or, when bBracketed, (\[[0-9a-fA-F:]+\]), followed by the tail
+    inline bool sipUriHost( std::string_view s, size_t pos, bool bBracketed, SipUri& out ) {
+      size_t end = pos ;
+      if( bBracketed ) {
+        if( end >= s.length() || '[' != s[end] ) return false ;
+        end++ ;
+        while( end < s.length() && isHexOrColon( s[end] ) ) end++ ;
+        if( end == pos + 1 || end >= s.length() || ']' != s[end] ) return false ;
+        end++ ;
+      }
+      else {
+        while( end < s.length() && nullptr == memchr( ";|^>:", s[end], 5 ) ) end++ ;
+        if( end == pos ) return false ;
+      }
+      if( !sipUriTail( s, end, out ) ) return false ;
+      out.host = s.substr( pos, end - pos ) ;
+      return true ;
+    }
+
+    // ^<?(sip|sips):(?:([^;]+)@)?HOST... where the user part, if any, runs to the last '@' that lets the rest match
+    inline bool sipUriAfterScheme( std::string_view s, size_t pos, bool bBracketed, SipUri& out ) {
+      size_t semi = s.find( ';', pos ) ;
+      size_t limit = std::string_view::npos == semi ? s.length() : semi ;
+      for( size_t at = s.rfind( '@', limit - 1 ); std::string_view::npos != at && at > pos && at < limit; at = s.rfind( '@', at - 1 ) ) {
+        if( sipUriHost( s, at + 1, bBracketed, out ) ) {
+          out.user = s.substr( pos, at - pos ) ;
+          return true ;
+        }
+      }
+      if( sipUriHost( s, pos, bBracketed, out ) ) {
+        out.user = std::string_view() ;
+        return true ;
+      }
+      return false ;
+    }
+
+    /*
+      ^<?(sip|sips):(?:([^;]+)@)?([^;|^>|^:]+)(?::(\d+))?(?:;([^>]+))?>?$, and failing that the same with
+      an ipv6 reference, (\[[0-9a-fA-F:]+\]), as the host
+    */
+    inline bool sipUri( std::string_view s, SipUri& out ) {
+      size_t pos = 0 ;
+      if( pos < s.length() && '<' == s[pos] ) pos++ ;
+      std::string_view rest = s.substr( pos ) ;
+      if( 0 == rest.compare( 0, 4, "sip:" ) ) out.scheme = rest.substr( 0, 3 ) ;
+      else if( 0 == rest.compare( 0, 5, "sips:" ) ) out.scheme = rest.substr( 0, 4 ) ;
+      else return false ;
+      pos += out.scheme.length() + 1 ;
+      return sipUriAfterScheme( s, pos, false, out ) || sipUriAfterScheme( s, pos, true, out ) ;
+    }
+
+    // call f( name, value ) for each ';' separated parameter; a parameter with more than one '=' has an empty value
+    template<typename F>
+    void sipUriParams( std::string_view params, F f ) {
+      if( params.empty() ) return ;
+      size_t start = 0 ;
+      while( true ) {
+        size_t end = params.find( ';', start ) ;
+        std::string_view param = params.substr( start, std::string_view::npos == end ? end : end - start ) ;
+        size_t eq = param.find( '=' ) ;
+        if( std::string_view::npos == eq ) f( param, std::string_view() ) ;
+        else if( std::string_view::npos != param.find( '=', eq + 1 ) ) f( param.substr( 0, eq ), std::string_view() ) ;
+        else f( param.substr( 0, eq ), param.substr( eq + 1 ) ) ;
+        if( std::string_view::npos == end ) break ;
+        start = end + 1 ;
+      }
+    }
+
+    // ^CSeq:\s+\d+\s+(\w+)$ -- anchored at both ends, so it only matches when the headers are a single CSeq header
+    inline bool cseqMethod( std::string_view s, std::string_view& method ) {
+      if( 0 != s.compare( 0, 5, "CSeq:" ) ) return false ;
+      size_t pos = 5 ;
+      size_t start = pos ;
+      while( pos < s.length() && isSpace( s[pos] ) ) pos++ ;
+      if( pos == start ) return false ;
+      size_t n = digitsAt( s, pos ) ;
+      if( 0 == n ) return false ;
+      pos += n ;
+      start = pos ;
+      while( pos < s.length() && isSpace( s[pos] ) ) pos++ ;
+      if( pos == start || pos == s.length() ) return false ;
+      for( size_t i = pos; i < s.length(); i++ ) if( !isWordChar( s[i] ) ) return false ;
+      method = s.substr( pos ) ;
+      return true ;
+    }
+
+    // (?:^|\n)cseq:\s*(\d+)\s*UPDATE, ignoring case
+    inline bool hasCSeqUpdate( std::string_view s ) {
+      size_t pos = 0 ;
+      while( true ) {
+        if( startsWithNoCase( s.substr( pos ), "cseq:" ) ) {
+          size_t p = pos + 5 ;
+          while( p < s.length() && isSpace( s[p] ) ) p++ ;
+          size_t n = digitsAt( s, p ) ;
+          if( n ) {
+            p += n ;
+            while( p < s.length() && isSpace( s[p] ) ) p++ ;
+            if( startsWithNoCase( s.substr( p ), "update" ) ) return true ;
+          }
+        }
+        pos = s.find( '\n', pos ) ;
+        if( std::string_view::npos == pos ) return false ;
+        pos++ ;
+      }
+    }
+
+    // tag=(.*)
+    inline bool toTag( std::string_view s, std::string_view& tag ) {
+      size_t pos = s.find( "tag=" ) ;
+      if( std::string_view::npos == pos ) return false ;
+      tag = firstLine( s.substr( pos + 4 ) ) ;
+      return true ;
+    }
+
+    // ^(\d+)(ms|s)$; the value is converted with atoi by the caller, as before
+    inline bool timeout( std::string_view s, std::string_view& digits, bool& bSeconds ) {
+      size_t n = digitsAt( s, 0 ) ;
+      if( 0 == n ) return false ;
+      std::string_view unit = s.substr( n ) ;
+      if( unit == "ms" ) bSeconds = false ;
+      else if( unit == "s" ) bSeconds = true ;
+      else return false ;
+      digits = s.substr( 0, n ) ;
+      return true ;
+    }
+
+    struct OutboundUri {
+      std::string_view host ;
+      std::string_view port ;
+      std::string_view transport ;  // empty unless ;transport=tcp or ;transport=tls follows the port
+    } ;
+
+    // ^(.*):(\d+)(;transport=(tcp|tls))?
+    inline bool outboundUri( std::string_view s, OutboundUri& out ) {
+      s = firstLine( s ) ;
+      for( size_t colon = s.rfind( ':' ); std::string_view::npos != colon; colon = 0 == colon ? std::string_view::npos : s.rfind( ':', colon - 1 ) ) {
+        size_t n = digitsAt( s, colon + 1 ) ;
+        if( 0 == n ) continue ;
+        out.host = s.substr( 0, colon ) ;
+        out.port = s.substr( colon + 1, n ) ;
+        std::string_view rest = s.substr( colon + 1 + n ) ;
+        if( 0 == rest.compare( 0, 14, ";transport=tcp" ) || 0 == rest.compare( 0, 14, ";transport=tls" ) ) out.transport = rest.substr( 11, 3 ) ;
+        else out.transport = std::string_view() ;
+        return true ;
+      }
+      return false ;
+    }
+
+    // ^(?:[0-9]{1,3}\.){3}[0-9]{1,3}$
+    inline bool isDottedQuad( std::string_view s ) {
+      size_t pos = 0 ;
+      for( int i = 0; i < 4; i++ ) {
+        size_t n = digitsAt( s, pos ) ;
+        if( n < 1 || n > 3 ) return false ;
+        pos += n ;
+        if( i < 3 ) {
+          if( pos >= s.length() || '.' != s[pos] ) return false ;
+          pos++ ;
+        }
+      }
+      return pos == s.length() ;
+    }
+
+    // ^(\d+)\.(\d+)\.(\d+)\.(\d+)
+    inline bool dottedQuadPrefix( std::string_view s, std::string_view (&octets)[4] ) {
+      size_t pos = 0 ;
+      for( int i = 0; i < 4; i++ ) {
+        size_t n = digitsAt( s, pos ) ;
+        if( 0 == n ) return false ;
+        octets[i] = s.substr( pos, n ) ;
+        pos += n ;
+        if( i < 3 ) {
+          if( pos >= s.length() || '.' != s[pos] ) return false ;
+          pos++ ;
+        }
+      }
+      return true ;
+    }
+  }
+}
+
+#endif
@@ -30,6 +30,7 @@ THE SOFTWARE.
 #include "sip-transports.hpp"
 #include "controller.hpp"
 #include "drachtio.h"
+#include "sip-scanners.hpp"
 
 namespace {
     /* needed to be able to live in a boost unordered container */
@@ -306,31 +307,12 @@ namespace drachtio {
 
   uint32_t SipTransport::getOctetMatchCount(const string& address) {
     uint32_t count = 0 ;
-    string them[4], mine[4];
-    try {
-      std::regex re("^(\\d+)\\.(\\d+)\\.(\\d+)\\.(\\d+)");
-      std::smatch mr;
-      if (std::regex_search(address, mr, re) && mr.size() > 1) {
-        them[0] = mr[1] ;
-        them[1] = mr[2] ;
-        them[2] = mr[3] ;
-        them[3] = mr[4] ;
-
-        string host = this->getHost();
-        if (std::regex_search(host, mr, re) && mr.size() > 1) {
-          mine[0] = mr[1] ;
-          mine[1] = mr[2] ;
-          mine[2] = mr[3] ;
-          mine[3] = mr[4] ;
-  
-          for(int i = 0; i < 4; i++) {
-            if(0 != them[i].compare(mine[i])) return count;
-            count++;
-          }          
-        }        
-      }
-    } catch (std::regex_error& e) {
-      DR_LOG(log_error) << "SipTransport::getOctetMatchCount - regex error " << e.what();
+    std::string_view them[4], mine[4];
+    if (scan::dottedQuadPrefix(address, them) && scan::dottedQuadPrefix(this->getHost(), mine)) {
+      for(int i = 0; i < 4; i++) {
+        if(them[i] != mine[i]) return count;
+        count++;
+      }          
     }
 
     return count;
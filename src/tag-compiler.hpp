@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __TAG_COMPILER_HPP__
+#define __TAG_COMPILER_HPP__
+
+#include <string.h>
+#include <string>
+#include <string_view>
+
+#include <boost/container/small_vector.hpp>
+
+#include <sofia-sip/su_tag.h>
+#include <sofia-sip/sip_tag.h>
+
+#include "sip-names.hpp"
+#include "header-index.hpp"
+
+namespace drachtio {
+
+  inline tag_type_t tagForHeader( sip_header_id id ) {
+    static tag_type_t const tags[] = {
+      #define DR_SIP_HEADER_TAG(name, tag) siptag_##tag##_str,
+      DR_SIP_HEADERS(DR_SIP_HEADER_TAG)
+      #undef DR_SIP_HEADER_TAG
+    } ;
+    return tags[id] ;
+  }
+
+  /*
+    What compileTags does with the headers that need a decision.  A policy derives from this and hides the
+    members it wants to change; compileTags is a template on the policy, so the calls are resolved statically.
+  */
+  struct TagPolicy {
+    // return false to drop a from, to, contact or p-asserted-identity header; set rewritten to replace its value
+    bool admitAddressHeader( std::string_view name, std::string_view value, std::string& rewritten ) { return true; }
+
+    // custom header names are sent as Title-Case unless the name is listed here
+    bool preserveCase( std::string_view name ) { return false; }
+
+    void invalidHeader( std::string_view line ) {}
+    void immutableHeader( std::string_view name, sip_header_id id ) {}
+  } ;
+
+  /*
+    Turn the headers an application sent ("Name: value" lines) into a sofia tag list.
+    The tag list and all of the values are one allocation, which the caller frees with deleteCompiledTags.
+  */
+  template<typename Policy>
+  tagi_t* compileTags( const HeaderIndex& index, Policy& policy ) {
+    struct Entry {
+      tag_type_t m_tag ;
+      std::string_view m_name ;     // set only for custom headers
+      std::string_view m_value ;
+      int m_rewrite ;               // index of a replacement value in rewrites, or -1
+    } ;
+    boost::container::small_vector<Entry, 24> entries ;
+    boost::container::small_vector<std::string, 2> rewrites ;
+    size_t bytes = 0 ;
+
+    index.forEachInvalidLine( [&policy]( std::string_view line ) { policy.invalidHeader( line ); } ) ;
+
+    for( size_t h = 0; h < index.size(); h++ ) {
+      std::string_view name = index.name( h ) ;
+      std::string_view value = index.value( h ) ;
+      sip_header_id id = index.id( h ) ;
+      if( isImmutableHeader( id ) ) {
+        policy.immutableHeader( name, id ) ;
+        continue ;
+      }
+      if( sip_hdr_unknown == id ) {
+        entries.push_back( Entry{siptag_unknown_str, name, value, -1} ) ;
+        bytes += name.length() + 2 + value.length() + 1 ;
+        continue ;
+      }
+      int rewrite = -1 ;
+      if( isAddressHeader( id ) ) {
+        std::string rewritten ;
+        if( !policy.admitAddressHeader( name, value, rewritten ) ) continue ;
+        if( !rewritten.empty() ) {
+          rewrite = rewrites.size() ;
+          rewrites.push_back( std::move( rewritten ) ) ;
+        }
+      }
+      entries.push_back( Entry{tagForHeader( id ), std::string_view(), value, rewrite} ) ;
+      bytes += (rewrite < 0 ? value.length() : rewrites[rewrite].length()) + 1 ;
+    }
+
+    size_t tagBytes = (entries.size() + 1) * sizeof(tagi_t) ;
+    char* block = new char[tagBytes + bytes] ;
+    tagi_t* tags = reinterpret_cast<tagi_t*>( block ) ;
+    char* out = block + tagBytes ;
+    size_t i = 0 ;
+    for( const Entry& e : entries ) {
+      tags[i].t_tag = e.m_tag ;
+      tags[i].t_value = (tag_value_t) out ;
+      if( !e.m_name.empty() ) {
+        bool capitalize = !policy.preserveCase( e.m_name ) &&
+          !(e.m_name.length() >= 2 && ('X' == e.m_name[0] || 'x' == e.m_name[0]) && '-' == e.m_name[1]) ;
+        bool capitalizeNext = true ;
+        for( char c : e.m_name ) {
+          *out++ = capitalize && capitalizeNext && c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c ;
+          capitalizeNext = '-' == c ;
+        }
+        *out++ = ':' ;
+        *out++ = ' ' ;
+      }
+      std::string_view value = e.m_rewrite < 0 ? e.m_value : std::string_view( rewrites[e.m_rewrite] ) ;
+      memcpy( out, value.data(), value.length() ) ;
+      out += value.length() ;
+      *out++ = '\0' ;
+      i++ ;
+    }
+    tags[i].t_tag = tag_null ;
+    tags[i].t_value = (tag_value_t) 0 ;
+
+    return tags ;
+  }
+
+  template<typename Policy>
+  tagi_t* compileTags( std::string_view hdrs, Policy& policy ) {
+    HeaderIndex index( hdrs ) ;
+    return compileTags( index, policy ) ;
+  }
+
+  inline void deleteCompiledTags( tagi_t* tags ) {
+    delete [] reinterpret_cast<char*>( tags ) ;
+  }
+}
+
+#endif
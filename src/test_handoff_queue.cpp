@@ -0,0 +1,152 @@
+/*
+  Compares handing messages from several producer threads to one consumer thread through a HandoffQueue, which
+  signals the consumer once per batch, against a mutex protected queue of std::function that signals it per message.
+  Also checks that every message arrives, in the order each producer sent them.
+
+  g++ -std=c++17 -O2 -I. -o test_handoff_queue test_handoff_queue.cpp -lpthread
+  ./test_handoff_queue [producers] [messages per producer]
+*/
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+#include "handoff-queue.hpp"
+
+using std::cout ;
+using std::endl ;
+using namespace drachtio ;
+
+struct Message {
+  unsigned int m_producer ;
+  unsigned int m_seq ;
+  std::string m_text ;
+} ;
+
+static double elapsed( std::chrono::steady_clock::time_point start ) {
+  return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+}
+
+static void signal( int fd ) {
+  uint64_t one = 1 ;
+  if (write( fd, &one, sizeof(one) ) < 0) exit( 1 ) ;
+}
+
+static void block( int fd ) {
+  uint64_t count ;
+  if (read( fd, &count, sizeof(count) ) < 0) exit( 1 ) ;
+}
+
+class Checker {
+public:
+  explicit Checker( unsigned int producers ) : m_next( producers, 0 ), m_count(0), m_bOk(true) {}
+
+  void receive( const Message& msg ) {
+    if (msg.m_seq != m_next[msg.m_producer]++) m_bOk = false ;
+    m_count++ ;
+  }
+  unsigned long count() const { return m_count; }
+  bool ok() const { return m_bOk; }
+
+private:
+  std::vector<unsigned int> m_next ;
+  unsigned long m_count ;
+  bool m_bOk ;
+} ;
+
+static void runHandoffQueue( unsigned int producers, unsigned int count ) {
+  HandoffQueue<Message> queue ;
+  Checker checker( producers ) ;
+  int fd = eventfd( 0, 0 ) ;
+  unsigned long wakeups = 0, batches = 0 ;
+
+  auto start = std::chrono::steady_clock::now() ;
+  std::thread consumer([&]() {
+    while (checker.count() < (unsigned long) producers * count) {
+      block( fd ) ;
+      if (queue.drain( [&](Message&& msg, HandoffQueue<Message>::time_point) { checker.receive( msg ); } ) > 0) batches++ ;
+    }
+  }) ;
+  std::vector<std::thread> threads ;
+  std::vector<unsigned long> signalled( producers, 0 ) ;
+  for (unsigned int p = 0; p < producers; p++) {
+    threads.emplace_back([&, p]() {
+      for (unsigned int i = 0; i < count; i++) {
+        if (queue.push( Message{ p, i, "sip message" } )) {
+          signal( fd ) ;
+          signalled[p]++ ;
+        }
+      }
+    }) ;
+  }
+  for (auto& t : threads) t.join() ;
+  consumer.join() ;
+  double secs = elapsed( start ) ;
+  close( fd ) ;
+
+  for (unsigned long n : signalled) wakeups += n ;
+  cout << "HandoffQueue:              " << (unsigned long) (checker.count() / secs) << " msgs/sec, " << wakeups << " wakeups, " <<
+    (batches ? checker.count() / batches : 0) << " msgs per batch" << (checker.ok() ? "" : " OUT OF ORDER") << endl ;
+}
+
+static void runLockedQueue( unsigned int producers, unsigned int count ) {
+  std::mutex mutex ;
+  std::deque< std::function<void()> > queue ;
+  Checker checker( producers ) ;
+  int fd = eventfd( 0, 0 ) ;
+
+  auto start = std::chrono::steady_clock::now() ;
+  std::thread consumer([&]() {
+    while (checker.count() < (unsigned long) producers * count) {
+      block( fd ) ;
+      while (true) {
+        std::function<void()> f ;
+        {
+          std::lock_guard<std::mutex> lock( mutex ) ;
+          if (queue.empty()) break ;
+          f = std::move( queue.front() ) ;
+          queue.pop_front() ;
+        }
+        f() ;
+      }
+    }
+  }) ;
+  std::vector<std::thread> threads ;
+  for (unsigned int p = 0; p < producers; p++) {
+    threads.emplace_back([&, p]() {
+      for (unsigned int i = 0; i < count; i++) {
+        Message msg{ p, i, "sip message" } ;
+        {
+          std::lock_guard<std::mutex> lock( mutex ) ;
+          queue.push_back( std::bind( &Checker::receive, &checker, msg ) ) ;
+        }
+        signal( fd ) ;
+      }
+    }) ;
+  }
+  for (auto& t : threads) t.join() ;
+  consumer.join() ;
+  double secs = elapsed( start ) ;
+  close( fd ) ;
+
+  cout << "locked queue, per message: " << (unsigned long) (checker.count() / secs) << " msgs/sec, " <<
+    (unsigned long) producers * count << " wakeups" << (checker.ok() ? "" : " OUT OF ORDER") << endl ;
+}
+
+int main( int argc, char* argv[] ) {
+  unsigned int producers = argc > 1 ? atoi( argv[1] ) : 4 ;
+  unsigned int count = argc > 2 ? atoi( argv[2] ) : 250000 ;
+
+  cout << producers << " producers, " << count << " messages each" << endl ;
+  runLockedQueue( producers, count ) ;
+  runHandoffQueue( producers, count ) ;
+  return 0 ;
+}
@@ -0,0 +1,175 @@
+/*
+  Compares moving framed messages between two threads over a ShmRing signalled with eventfd against a tcp loopback connection.
+
+  g++ -std=c++17 -O2 -I. -o test_shm_ring test_shm_ring.cpp -lpthread
+  ./test_shm_ring [message count] [message size]
+*/
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <cassert>
+#include <new>
+
+#include "shm-ring.hpp"
+
+using std::cout ;
+using std::endl ;
+using namespace drachtio ;
+
+static std::string makeFrame( size_t size ) {
+  std::string msg( size, 'x' ) ;
+  return std::to_string( msg.length() ) + "#" + msg ;
+}
+
+static double elapsed( std::chrono::steady_clock::time_point start ) {
+  return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+}
+
+static void block( int fd ) {
+  uint64_t count ;
+  if (read( fd, &count, sizeof(count) ) < 0) {}
+}
+static void signal( int fd ) {
+  uint64_t one = 1 ;
+  if (write( fd, &one, sizeof(one) ) < 0) {}
+}
+
+double benchShm( unsigned int count, const std::string& frame, uint64_t& wakeups ) {
+  const uint64_t ringSize = 4 * 1024 * 1024 ;
+  std::vector<char> region( ShmRing::regionSize( ringSize ) + 64 ) ;
+  void* base = region.data() + (64 - reinterpret_cast<uintptr_t>( region.data() ) % 64) ;
+  static_cast<ShmRegionHeader*>( base )->ringSize = ringSize ;
+  new (ShmRing::ringBase( base, 0 )) ShmRingHeader() ;
+  ShmRing writer( ShmRing::ringBase( base, 0 ), ringSize ) ;
+  ShmRing reader( ShmRing::ringBase( base, 0 ), ringSize ) ;
+  int readerFd = eventfd( 0, 0 ) ;
+  int writerFd = eventfd( 0, 0 ) ;
+  wakeups = 0 ;
+
+  auto start = std::chrono::steady_clock::now() ;
+  std::thread consumer([&]() {
+    unsigned int received = 0 ;
+    std::string_view record ;
+    while (received < count) {
+      if (!reader.peek( record )) {
+        reader.header()->readerWaiting.store( 1 ) ;
+        std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+        if (reader.empty()) {
+          block( readerFd ) ;
+          wakeups++ ;
+        }
+        reader.header()->readerWaiting.store( 0 ) ;
+        continue ;
+      }
+      assert( record.length() == frame.length() ) ;
+      reader.consume( record ) ;
+      received++ ;
+      std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+      if (reader.header()->writerWaiting.exchange( 0 )) signal( writerFd ) ;
+    }
+  }) ;
+
+  for (unsigned int i = 0; i < count; ) {
+    if (writer.write( frame.data(), frame.length() )) {
+      i++ ;
+      std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+      if (writer.header()->readerWaiting.exchange( 0 )) signal( readerFd ) ;
+      continue ;
+    }
+    writer.header()->writerWaiting.store( 1 ) ;
+    std::atomic_thread_fence( std::memory_order_seq_cst ) ;
+    if (!writer.hasRoomFor( frame.length() )) block( writerFd ) ;
+    writer.header()->writerWaiting.store( 0 ) ;
+  }
+  consumer.join() ;
+  double secs = elapsed( start ) ;
+
+  close( readerFd ) ;
+  close( writerFd ) ;
+  return secs ;
+}
+
+double benchTcp( unsigned int count, const std::string& frame ) {
+  int listener = socket( AF_INET, SOCK_STREAM, 0 ) ;
+  struct sockaddr_in addr ;
+  memset( &addr, 0, sizeof(addr) ) ;
+  addr.sin_family = AF_INET ;
+  addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK ) ;
+  socklen_t len = sizeof(addr) ;
+  int rc = bind( listener, (struct sockaddr*) &addr, sizeof(addr) ) ;
+  assert( 0 == rc ) ;
+  listen( listener, 1 ) ;
+  getsockname( listener, (struct sockaddr*) &addr, &len ) ;
+
+  int client = socket( AF_INET, SOCK_STREAM, 0 ) ;
+  rc = connect( client, (struct sockaddr*) &addr, sizeof(addr) ) ;
+  assert( 0 == rc ) ;
+  int server = accept( listener, NULL, NULL ) ;
+  int one = 1 ;
+  setsockopt( client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) ) ;
+
+  auto start = std::chrono::steady_clock::now() ;
+  std::thread consumer([&]() {
+    /* parse "<length>#<message>" frames out of a contiguous buffer, the way the app connection does */
+    std::vector<char> buf( 65536 ) ;
+    size_t readPos = 0, writePos = 0 ;
+    unsigned int received = 0 ;
+    while (received < count) {
+      if (readPos == writePos) readPos = writePos = 0 ;
+      else if (buf.size() - writePos < 4096) {
+        memmove( buf.data(), buf.data() + readPos, writePos - readPos ) ;
+        writePos -= readPos ;
+        readPos = 0 ;
+        if (buf.size() - writePos < 4096) buf.resize( buf.size() * 2 ) ;
+      }
+      ssize_t n = read( server, buf.data() + writePos, buf.size() - writePos ) ;
+      if (n <= 0) break ;
+      writePos += n ;
+      while (true) {
+        size_t i = readPos, msgLen = 0 ;
+        while (i < writePos && '#' != buf[i]) msgLen = msgLen * 10 + (buf[i++] - '0') ;
+        if (i == writePos || writePos - i - 1 < msgLen) break ;
+        readPos = i + 1 + msgLen ;
+        received++ ;
+      }
+    }
+  }) ;
+
+  /* one write per message, as an application connection does when messages arrive one at a time */
+  for (unsigned int i = 0; i < count; i++) {
+    if (write( client, frame.data(), frame.length() ) < 0) break ;
+  }
+  consumer.join() ;
+  double secs = elapsed( start ) ;
+
+  close( client ) ;
+  close( server ) ;
+  close( listener ) ;
+  return secs ;
+}
+
+int main( int argc, char* argv[] ) {
+  unsigned int count = argc > 1 ? atoi( argv[1] ) : 1000000 ;
+  size_t size = argc > 2 ? atoi( argv[2] ) : 600 ;
+  std::string frame = makeFrame( size ) ;
+
+  uint64_t wakeups ;
+  double shm = benchShm( count, frame, wakeups ) ;
+  double tcp = benchTcp( count, frame ) ;
+
+  cout << count << " messages of " << frame.length() << " bytes" << endl ;
+  cout << "shared memory ring: " << (uint64_t) (count / shm) << " msgs/sec (" << wakeups << " reader wakeups)" << endl ;
+  cout << "tcp loopback:       " << (uint64_t) (count / tcp) << " msgs/sec" << endl ;
+  return 0 ;
+}
@@ -0,0 +1,299 @@
+/*
+  Differential fuzz test of the scanners in sip-scanners.hpp against the regular expressions they replaced,
+  followed by a benchmark of each against its expression.
+
+  g++ -std=c++17 -O2 -I. -o test_sip_scanners test_sip_scanners.cpp
+  ./test_sip_scanners [fuzz iterations] [benchmark iterations]
+*/
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <regex>
+#include <random>
+#include <chrono>
+#include <iostream>
+
+#include <boost/algorithm/string.hpp>
+
+#include "sip-scanners.hpp"
+
+using std::cout ;
+using std::endl ;
+using std::string ;
+using std::string_view ;
+using namespace drachtio ;
+
+namespace regexes {
+  bool transportDescription( const string& desc, string& proto, string& host, string& port ) {
+    std::regex re("^(.*)/(.*):(\\d+)");
+    std::smatch mr;
+    if (std::regex_search(desc, mr, re) && mr.size() > 1) {
+      proto = mr[1] ;
+      host = mr[2] ;
+      port = mr[3] ;
+      return true ;
+    }
+    return false ;
+  }
+
+  bool sipUri( const string& uri, string& scheme, string& userpart, string& hostpart, string& port, std::vector< std::pair<string,string> >& params ) {
+    std::regex re("^<?(sip|sips):(?:([^;]+)@)?([^;|^>|^:]+)(?::(\\d+))?(?:;([^>]+))?>?$");
+    std::regex re2("^<?(sip|sips):(?:([^;]+)@)?(\\[[0-9a-fA-F:]+\\])(?::(\\d+))?(?:;([^>]+))?>?$");
+    std::smatch mr;
+    if (std::regex_search(uri, mr, re) || std::regex_search(uri, mr, re2)) {
+      scheme = mr[1] ;
+      userpart = mr[2] ;
+      hostpart = mr[3] ;
+      port = mr[4] ;
+      string paramString = mr[5] ;
+      if (paramString.length() > 0) {
+        std::vector<string> strs;
+        boost::split(strs, paramString, boost::is_any_of(";"));
+        for (const string& s : strs) {
+          std::vector<string> kv ;
+          boost::split(kv, s, boost::is_any_of("="));
+          params.push_back( std::pair<string, string>(kv[0], kv.size() == 2 ? kv[1] : "") ) ;
+        }
+      }
+      return true ;
+    }
+    return false ;
+  }
+
+  bool cseqMethod( const string& headers, string& method ) {
+    std::regex re("^CSeq:\\s+\\d+\\s+(\\w+)$");
+    std::smatch mr;
+    if (std::regex_search(headers, mr, re) && mr.size() > 1) {
+      method = mr[1] ;
+      return true ;
+    }
+    return false ;
+  }
+
+  bool hasCSeqUpdate( const string& input ) {
+    std::regex pattern("(?:^|\\n)cseq:\\s*(\\d+)\\s*UPDATE", std::regex_constants::icase);
+    return std::regex_search(input, pattern);
+  }
+
+  bool toTag( const string& toValue, string& tag ) {
+    std::regex re("tag=(.*)");
+    std::smatch mr;
+    if (std::regex_search(toValue, mr, re) && mr.size() > 1) {
+      tag = mr[1] ;
+      return true ;
+    }
+    return false ;
+  }
+
+  bool timeout( const string& t, string& digits, bool& bSeconds ) {
+    std::regex re("^(\\d+)(ms|s)$");
+    std::smatch mr;
+    if (std::regex_search(t, mr, re) && mr.size() > 1) {
+      digits = mr[1] ;
+      bSeconds = 0 == mr[2].compare("s") ;
+      return true ;
+    }
+    return false ;
+  }
+
+  bool outboundUri( const string& uri, string& host, string& port, string& transport ) {
+    std::regex re("^(.*):(\\d+)(;transport=(tcp|tls))?");
+    std::smatch mr;
+    if (std::regex_search(uri, mr, re) && mr.size() > 1) {
+      host = mr[1] ;
+      port = mr[2] ;
+      transport = mr[4] ;
+      return true ;
+    }
+    return false ;
+  }
+
+  bool isDottedQuad( const string& host ) {
+    std::regex ipRegex("^(?:[0-9]{1,3}\\.){3}[0-9]{1,3}$");
+    return std::regex_match(host, ipRegex) ;
+  }
+
+  bool dottedQuadPrefix( const string& address, string (&octets)[4] ) {
+    std::regex re("^(\\d+)\\.(\\d+)\\.(\\d+)\\.(\\d+)");
+    std::smatch mr;
+    if (std::regex_search(address, mr, re) && mr.size() > 1) {
+      for( int i = 0; i < 4; i++ ) octets[i] = mr[i + 1] ;
+      return true ;
+    }
+    return false ;
+  }
+}
+
+static std::mt19937 rng( 42 ) ;
+
+// random strings built from fragments that matter to the grammars, so that near misses are common
+static string randomInput( const std::vector<string>& fragments, size_t maxPieces ) {
+  static const char* chars = "abcXYZ019:;/@<>[]|^.=\r\n \tsSmM" ;
+  string s ;
+  size_t pieces = rng() % (maxPieces + 1) ;
+  for( size_t i = 0; i < pieces; i++ ) {
+    if( rng() % 3 ) s.append( fragments[ rng() % fragments.size() ] ) ;
+    else s.push_back( chars[ rng() % strlen( chars ) ] ) ;
+  }
+  return s ;
+}
+
+static int failures = 0 ;
+
+// how many inputs each expression accepted, to show that the fuzzing reaches the matching paths
+static std::map<string,int> accepted ;
+
+static void mismatch( const char* what, const string& input ) {
+  if( ++failures <= 20 ) cout << what << " differs for input '" << input << "'" << endl ;
+}
+
+static void check( const string& input ) {
+  {
+    string proto, host, port ;
+    scan::TransportDescription td ;
+    bool a = regexes::transportDescription( input, proto, host, port ) ;
+    if( a ) accepted["transportDescription"]++ ;
+    bool b = scan::transportDescription( input, td ) ;
+    if( a != b || (a && (proto != td.proto || host != td.host || port != td.port)) ) mismatch( "transportDescription", input ) ;
+  }
+  {
+    string scheme, user, host, port ;
+    std::vector< std::pair<string,string> > params, params2 ;
+    scan::SipUri uri ;
+    bool a = regexes::sipUri( input, scheme, user, host, port, params ) ;
+    if( a ) accepted["sipUri"]++ ;
+    bool b = scan::sipUri( input, uri ) ;
+    if( b ) scan::sipUriParams( uri.params, [&params2]( string_view name, string_view value ) {
+      params2.push_back( std::pair<string,string>( string( name ), string( value ) ) ) ;
+    }) ;
+    if( a != b || (a && (scheme != uri.scheme || user != uri.user || host != uri.host || port != uri.port || params != params2)) ) {
+      mismatch( "sipUri", input ) ;
+    }
+  }
+  {
+    string method ;
+    string_view method2 ;
+    bool a = regexes::cseqMethod( input, method ) ;
+    if( a ) accepted["cseqMethod"]++ ;
+    bool b = scan::cseqMethod( input, method2 ) ;
+    if( a != b || (a && method != method2) ) mismatch( "cseqMethod", input ) ;
+  }
+  if( regexes::hasCSeqUpdate( input ) ) accepted["hasCSeqUpdate"]++ ;
+  if( regexes::hasCSeqUpdate( input ) != scan::hasCSeqUpdate( input ) ) mismatch( "hasCSeqUpdate", input ) ;
+  {
+    string tag ;
+    string_view tag2 ;
+    bool a = regexes::toTag( input, tag ) ;
+    if( a ) accepted["toTag"]++ ;
+    bool b = scan::toTag( input, tag2 ) ;
+    if( a != b || (a && tag != tag2) ) mismatch( "toTag", input ) ;
+  }
+  {
+    string digits ;
+    string_view digits2 ;
+    bool s1 = false, s2 = false ;
+    bool a = regexes::timeout( input, digits, s1 ) ;
+    if( a ) accepted["timeout"]++ ;
+    bool b = scan::timeout( input, digits2, s2 ) ;
+    if( a != b || (a && (digits != digits2 || s1 != s2)) ) mismatch( "timeout", input ) ;
+  }
+  {
+    string host, port, transport ;
+    scan::OutboundUri ob ;
+    bool a = regexes::outboundUri( input, host, port, transport ) ;
+    if( a ) accepted["outboundUri"]++ ;
+    bool b = scan::outboundUri( input, ob ) ;
+    if( a != b || (a && (host != ob.host || port != ob.port || transport != ob.transport)) ) mismatch( "outboundUri", input ) ;
+  }
+  if( regexes::isDottedQuad( input ) ) accepted["isDottedQuad"]++ ;
+  if( regexes::isDottedQuad( input ) != scan::isDottedQuad( input ) ) mismatch( "isDottedQuad", input ) ;
+  {
+    string octets[4] ;
+    string_view octets2[4] ;
+    bool a = regexes::dottedQuadPrefix( input, octets ) ;
+    if( a ) accepted["dottedQuadPrefix"]++ ;
+    bool b = scan::dottedQuadPrefix( input, octets2 ) ;
+    bool same = a == b ;
+    for( int j = 0; a && same && j < 4; j++ ) same = octets[j] == octets2[j] ;
+    if( !same ) mismatch( "dottedQuadPrefix", input ) ;
+  }
+}
+
+static void fuzz( int iterations ) {
+  // general inputs, then inputs aimed at the grammars that random text rarely satisfies
+  const std::vector< std::vector<string> > fragmentSets = {
+    {"sip:", "sips:", "<", ">", "@", ":", ";", "=", "user", "10.0.0.1", "example.com", "[", "]", "::1", "fe80::1", "5060",
+      ";transport=tcp", ";lr", "a=b=c", "|", "^", "/", "udp", "tls", ";transport=tls", "CSeq:", " ", "\r\n", "tag=", "256", "."},
+    {"CSeq:", "cseq:", "CSEQ:", " ", "\t", "\r\n", "\n", "12", "7", " 1 ", "UPDATE", "update", "INVITE", "x_1", "-"},
+    {"1", "250", "0", "ms", "s", "m", " ", ".", "10", "256", "999", "1234"}
+  } ;
+  for( int i = 0; i < iterations; i++ ) {
+    const std::vector<string>& fragments = fragmentSets[ i % fragmentSets.size() ] ;
+    check( randomInput( fragments, 2 + rng() % 8 ) ) ;
+
+    // a CSeq header on its own is the only thing the CSeq method expression accepts
+    if( 1 == i % fragmentSets.size() ) check( "CSeq:" + randomInput( fragments, 2 + rng() % 4 ) ) ;
+  }
+}
+
+template<typename F>
+static double nsPerCall( int iterations, F f ) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() ;
+  for( int i = 0; i < iterations; i++ ) f() ;
+  return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() * 1e9 / iterations ;
+}
+
+static void report( const char* what, double regexNs, double scanNs ) {
+  cout << what << ": regex " << regexNs << " ns, scanner " << scanNs << " ns" << endl ;
+}
+
+static void benchmark( int iterations ) {
+  volatile bool sink ;
+  const string uri = "<sip:alice@10.1.2.3:5060;transport=tcp;lr>" ;
+  const string desc = "tcp/10.1.2.3:5060" ;
+  const string headers = "From: <sip:alice@example.com>;tag=1234\r\nCSeq: 2 UPDATE\r\nContent-Type: application/sdp" ;
+
+  report( "parseSipUri", nsPerCall( iterations, [&]() {
+    string scheme, user, host, port ;
+    std::vector< std::pair<string,string> > params ;
+    sink = regexes::sipUri( uri, scheme, user, host, port, params ) ;
+  }), nsPerCall( iterations, [&]() {
+    scan::SipUri u ;
+    sink = scan::sipUri( uri, u ) ;
+  })) ;
+  report( "parseTransportDescription", nsPerCall( iterations, [&]() {
+    string proto, host, port ;
+    sink = regexes::transportDescription( desc, proto, host, port ) ;
+  }), nsPerCall( iterations, [&]() {
+    scan::TransportDescription td ;
+    sink = scan::transportDescription( desc, td ) ;
+  })) ;
+  report( "containsCseqUpdate", nsPerCall( iterations, [&]() {
+    sink = regexes::hasCSeqUpdate( headers ) ;
+  }), nsPerCall( iterations, [&]() {
+    sink = scan::hasCSeqUpdate( headers ) ;
+  })) ;
+  report( "isDottedQuad", nsPerCall( iterations, [&]() {
+    sink = regexes::isDottedQuad( "10.1.2.3" ) ;
+  }), nsPerCall( iterations, [&]() {
+    sink = scan::isDottedQuad( "10.1.2.3" ) ;
+  })) ;
+  (void) sink ;
+}
+
+int main( int argc, char* argv[] ) {
+  int fuzzIterations = argc > 1 ? atoi( argv[1] ) : 100000 ;
+  int benchIterations = argc > 2 ? atoi( argv[2] ) : 100000 ;
+
+  fuzz( fuzzIterations ) ;
+  if( failures ) {
+    cout << failures << " mismatches in " << fuzzIterations << " inputs" << endl ;
+    return 1 ;
+  }
+  cout << "no mismatches in " << fuzzIterations << " inputs" << endl ;
+  for( const auto& kv : accepted ) cout << "  " << kv.first << " matched " << kv.second << endl ;
+
+  benchmark( benchIterations ) ;
+  return 0 ;
+}
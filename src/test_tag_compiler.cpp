@@ -0,0 +1,405 @@
+/*
+  Checks compileTags against a copy of makeTags and makeSafeTags as they were before it replaced them, then compares
+  their speed: boost::split into strings, a lowercased copy of each name looked up in hash tables, and a separate
+  allocation for every value.
+
+  The policies below make the same decisions as the ones makeTags and makeSafeTags use in drachtio.cpp, without the
+  logging and the controller.  replaceHostInUri needs the controller too, so both sides rewrite '@localhost' with the
+  same stand-in; what is checked is which headers get rewritten.
+
+  g++ -std=c++17 -O2 -I. -I../deps/sofia-sip/libsofia-sip-ua/su -I../deps/sofia-sip/libsofia-sip-ua/sip \
+    -I../deps/sofia-sip/libsofia-sip-ua/msg -I../deps/sofia-sip/libsofia-sip-ua/url -I../deps/sofia-sip/libsofia-sip-ua/bnf \
+    -o test_tag_compiler test_tag_compiler.cpp ../deps/sofia-sip/libsofia-sip-ua/.libs/libsofia-sip-ua.a -lpthread
+  ./test_tag_compiler [iterations]
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <locale>
+#include <iterator>
+#include <chrono>
+#include <iostream>
+
+#include <boost/algorithm/string.hpp>
+
+#include "tag-compiler.hpp"
+
+using std::cout ;
+using std::endl ;
+using std::string ;
+using namespace drachtio ;
+
+// stands in for replaceHostInUri, which needs the controller's su_home
+static void rewriteLocalhost( string& uri, const string& host, const string& port ) {
+  size_t pos = uri.find( "@localhost" ) ;
+  if( string::npos != pos ) uri.replace( pos + 1, strlen("localhost"), host + ":" + port ) ;
+}
+
+namespace legacy {
+  /* copied from drachtio.cpp before compileTags replaced makeTags and makeSafeTags; logging dropped, and the
+     preserved header names and the '@localhost' rewrite passed in rather than taken from the controller */
+  typedef std::unordered_map<string,tag_type_t> mapHdr2Tag ;
+  mapHdr2Tag m_mapHdr2Tag({
+    {string("user_agent"), siptag_user_agent_str}, 
+    {string("subject"), siptag_subject_str}, 
+    {string("max_forwards"), siptag_max_forwards_str}, 
+    {string("proxy_require"), siptag_proxy_require_str}, 
+    {string("accept_contact"), siptag_accept_contact_str}, 
+    {string("reject_contact"), siptag_reject_contact_str}, 
+    {string("expires"), siptag_expires_str}, 
+    {string("date"), siptag_date_str}, 
+    {string("retry_after"), siptag_retry_after_str}, 
+    {string("timestamp"), siptag_timestamp_str}, 
+    {string("min_expires"), siptag_min_expires_str}, 
+    {string("priority"), siptag_priority_str}, 
+    {string("call_info"), siptag_call_info_str}, 
+    {string("organization"), siptag_organization_str}, 
+    {string("server"), siptag_server_str}, 
+    {string("in_reply_to"), siptag_in_reply_to_str}, 
+    {string("accept"), siptag_accept_str}, 
+    {string("accept_encoding"), siptag_accept_encoding_str}, 
+    {string("accept_language"), siptag_accept_language_str}, 
+    {string("allow"), siptag_allow_str}, 
+    {string("require"), siptag_require_str}, 
+    {string("supported"), siptag_supported_str}, 
+    {string("unsupported"), siptag_unsupported_str}, 
+    {string("event"), siptag_event_str}, 
+    {string("allow_events"), siptag_allow_events_str}, 
+    {string("subscription_state"), siptag_subscription_state_str}, 
+    {string("proxy_authenticate"), siptag_proxy_authenticate_str}, 
+    {string("proxy_authentication_info"), siptag_proxy_authentication_info_str}, 
+    {string("proxy_authorization"), siptag_proxy_authorization_str}, 
+    {string("authorization"), siptag_authorization_str}, 
+    {string("www_authenticate"), siptag_www_authenticate_str}, 
+    {string("authentication_info"), siptag_authentication_info_str}, 
+    {string("error_info"), siptag_error_info_str}, 
+    {string("warning"), siptag_warning_str}, 
+    {string("refer_to"), siptag_refer_to_str}, 
+    {string("referred_by"), siptag_referred_by_str}, 
+    {string("replaces"), siptag_replaces_str}, 
+    {string("session_expires"), siptag_session_expires_str}, 
+    {string("min_se"), siptag_min_se_str}, 
+    {string("path"), siptag_path_str}, 
+    {string("service_route"), siptag_service_route_str}, 
+    {string("reason"), siptag_reason_str}, 
+    {string("security_client"), siptag_security_client_str}, 
+    {string("security_server"), siptag_security_server_str}, 
+    {string("security_verify"), siptag_security_verify_str}, 
+    {string("privacy"), siptag_privacy_str}, 
+    {string("sip_etag"), siptag_etag_str}, 
+    {string("sip_if_match"), siptag_if_match_str}, 
+    {string("mime_version"), siptag_mime_version_str}, 
+    {string("content_type"), siptag_content_type_str}, 
+    {string("content_encoding"), siptag_content_encoding_str}, 
+    {string("content_language"), siptag_content_language_str}, 
+    {string("content_disposition"), siptag_content_disposition_str}, 
+    {string("request_disposition"), siptag_request_disposition_str}, 
+    {string("error"), siptag_error_str}, 
+    {string("refer_sub"), siptag_refer_sub_str}, 
+    {string("alert_info"), siptag_alert_info_str}, 
+    {string("reply_to"), siptag_reply_to_str}, 
+    {string("p_asserted_identity"), siptag_p_asserted_identity_str}, 
+    {string("p_preferred_identity"), siptag_p_preferred_identity_str}, 
+    {string("remote_party_id"), siptag_remote_party_id_str}, 
+    {string("payload"), siptag_payload_str}, 
+    {string("from"), siptag_from_str}, 
+    {string("to"), siptag_to_str}, 
+    {string("call_id"), siptag_call_id_str}, 
+    {string("cseq"), siptag_cseq_str}, 
+    {string("via"), siptag_via_str}, 
+    {string("route"), siptag_route_str}, 
+    {string("contact"), siptag_contact_str}, 
+    {string("from"), siptag_from_str}, 
+    {string("to"), siptag_to_str}, 
+    {string("rseq"), siptag_rseq_str}, 
+    {string("rack"), siptag_rack_str}, 
+    {string("record_route"), siptag_record_route_str}, 
+    {string("content_length"), siptag_content_length_str}
+  }) ;
+
+  std::unordered_set<string> m_setImmutableHdrs({
+    {string("via")},
+    {string("route")},
+    {string("rseq")},
+    {string("record_route")}, 
+    {string("content_length")} 
+  }) ;
+
+  bool isImmutableHdr( const string& hdr ) {
+    return m_setImmutableHdrs.end() != m_setImmutableHdrs.find( hdr ) ;
+  }
+
+  bool getTagTypeForHdr( const string& hdr, tag_type_t& tag ) {
+    mapHdr2Tag::const_iterator it = m_mapHdr2Tag.find( hdr ) ;
+    if( it != m_mapHdr2Tag.end() ) {
+      tag = it->second ;
+      return true ;
+    }
+    return false ;
+  }
+
+  string capitalizeAfterDash( const string& input, const std::unordered_set<string>& preservedHeaders ) {
+    for( const auto& header : preservedHeaders ) {
+      if( boost::iequals( boost::trim_copy( header ), input ) ) return input ;
+    }
+
+    string output = input ;
+    bool capitalizeNext = true ;
+    if( input.substr(0, 2) != "X-" && input.substr(0, 2) != "x-" ) {
+      std::for_each( output.begin(), output.end(), [&](char& c) {
+        if( capitalizeNext ) c = std::toupper( c, std::locale{} ) ;
+        capitalizeNext = c == '-' ;
+      }) ;
+    }
+    return output ;
+  }
+
+  void splitLines( const string& s, std::vector<string>& vec ) {
+    if( s.length() ) {
+      boost::split( vec, s, boost::is_any_of("\r\n"), boost::token_compress_on ) ;
+    }
+  }
+
+  // makeSafeTags when bSafe is set, otherwise makeTags with '@localhost' replaced by host:port
+  tagi_t* makeTags( const string& hdrs, bool bSafe, const string& host, const string& port, const std::unordered_set<string>& preserved ) {
+    std::vector<string> vec ;
+    splitLines( hdrs, vec ) ;
+    int nHdrs = vec.size() ;
+    tagi_t *tags = new tagi_t[nHdrs+1] ;
+    int i = 0 ;
+    for( std::vector<string>::const_iterator it = vec.begin(); it != vec.end(); ++it ) {
+      tags[i].t_tag = tag_skip ;
+      tags[i].t_value = (tag_value_t) 0 ;
+      bool bValid = true ;
+      string hdrName, hdrValue ;
+
+      size_t pos = (*it).find_first_of(":") ;
+      if( string::npos == pos ) {
+        bValid = false ;
+      }
+      else {
+        hdrName = (*it).substr(0,pos) ;
+        boost::trim( hdrName ) ;
+        if( string::npos != hdrName.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ01234567890-_") ) {
+          bValid = false ;
+        }
+        else {
+          hdrValue = (*it).substr(pos+1) ;
+          boost::trim( hdrValue ) ;
+        }
+      }
+      if( !bValid ) {
+        i++ ;
+        continue ;
+      }
+      else if( string::npos != hdrValue.find("\r\n") ) {
+        i++ ;
+        continue ;
+      }
+
+      tag_type_t tt ;
+      string hdr = boost::to_lower_copy( boost::replace_all_copy( hdrName, "-", "_" ) ) ;
+      bool bAddress = 0 == hdr.compare("from") || 0 == hdr.compare("contact") || 0 == hdr.compare("to") || 
+        0 == hdr.compare("p_asserted_identity") ;
+      if( isImmutableHdr( hdr ) ) {
+      }
+      else if( getTagTypeForHdr( hdr, tt ) ) {
+        if( bAddress && bSafe ) {
+          i++ ;
+          continue ;
+        }
+        if( bAddress && string::npos != hdrValue.find("@localhost") ) rewriteLocalhost( hdrValue, host, port ) ;
+        int len = hdrValue.length() ;
+        char *p = new char[len+1] ;
+        memset(p, '\0', len+1) ;
+        strncpy( p, hdrValue.c_str(), len ) ;
+        tags[i].t_tag = tt ;
+        tags[i].t_value = (tag_value_t) p ;
+      }
+      else {
+        std::ostringstream oss ;
+        oss << capitalizeAfterDash( hdrName, preserved ) << ": " << hdrValue ;
+        int len = oss.str().length() ;
+        char *p = new char[len+1] ;
+        memset(p, '\0', len+1) ;
+        strcpy( p, oss.str().c_str() ) ;
+        tags[i].t_tag = siptag_unknown_str ;
+        tags[i].t_value = (tag_value_t) p ;
+      }
+      i++ ;
+    }
+    tags[nHdrs].t_tag = tag_null ;
+    tags[nHdrs].t_value = (tag_value_t) 0 ;
+    return tags ;
+  }
+
+  void deleteTags( tagi_t* tags ) {
+    for( int i = 0; tags[i].t_tag != tag_null; i++ ) delete [] (char *) tags[i].t_value ;
+    delete [] tags ;
+  }
+}
+
+// the decisions of the policies in drachtio.cpp
+struct PreservingTagPolicy : public TagPolicy {
+  explicit PreservingTagPolicy( const std::unordered_set<string>& preserved ) : m_preserved( preserved ) {}
+
+  bool preserveCase( std::string_view name ) {
+    for( const auto& header : m_preserved ) {
+      if( boost::iequals( boost::trim_copy( header ), name ) ) return true ;
+    }
+    return false ;
+  }
+
+  const std::unordered_set<string>& m_preserved ;
+} ;
+
+struct SafeTagPolicy : public PreservingTagPolicy {
+  using PreservingTagPolicy::PreservingTagPolicy ;
+
+  bool admitAddressHeader( std::string_view name, std::string_view value, std::string& rewritten ) { return false; }
+} ;
+
+struct LocalhostTagPolicy : public PreservingTagPolicy {
+  LocalhostTagPolicy( const std::unordered_set<string>& preserved, const string& host, const string& port ) : 
+    PreservingTagPolicy( preserved ), m_host( host ), m_port( port ) {}
+
+  bool admitAddressHeader( std::string_view name, std::string_view value, std::string& rewritten ) {
+    if( std::string_view::npos != value.find("@localhost") ) {
+      rewritten.assign( value ) ;
+      rewriteLocalhost( rewritten, m_host, m_port ) ;
+    }
+    return true ;
+  }
+
+  const string& m_host ;
+  const string& m_port ;
+} ;
+
+// the tags that carry a value, as "tag-name=value" lines, so the two lists can be compared
+static string describe( const tagi_t* tags ) {
+  string s ;
+  for( int i = 0; tags[i].t_tag != tag_null; i++ ) {
+    if( tag_skip == tags[i].t_tag ) continue ;
+    s.append( tags[i].t_tag->tt_name ).append( "=" ).append( (const char *) tags[i].t_value ).append( "\n" ) ;
+  }
+  return s ;
+}
+
+// compile a header block both ways, with makeSafeTags' policy if bSafe and makeTags' otherwise; true if they agree
+static bool sameTags( const char* what, const string& hdrs, bool bSafe, const std::unordered_set<string>& preserved ) {
+  const string host( "10.10.10.1" ), port( "5060" ) ;
+  tagi_t* oldTags = legacy::makeTags( hdrs, bSafe, host, port, preserved ) ;
+  tagi_t* newTags ;
+  if( bSafe ) {
+    SafeTagPolicy policy( preserved ) ;
+    newTags = compileTags( hdrs, policy ) ;
+  }
+  else {
+    LocalhostTagPolicy policy( preserved, host, port ) ;
+    newTags = compileTags( hdrs, policy ) ;
+  }
+  bool bSame = describe( oldTags ) == describe( newTags ) ;
+  if( !bSame ) {
+    cout << what << (bSafe ? " (makeSafeTags)" : " (makeTags)") << ": tag lists differ" << endl << describe( oldTags ) << "--" << endl << describe( newTags ) ;
+  }
+  legacy::deleteTags( oldTags ) ;
+  deleteCompiledTags( newTags ) ;
+  return bSame ;
+}
+
+int main( int argc, char* argv[] ) {
+  int iterations = argc > 1 ? atoi( argv[1] ) : 1000000 ;
+
+  const string hdrs =
+    "Content-Type: application/sdp\r\n"
+    "User-Agent: drachtio test\r\n"
+    "Max-Forwards: 70\r\n"
+    "Supported: timer, replaces\r\n"
+    "Allow: INVITE, ACK, BYE, CANCEL, OPTIONS, UPDATE\r\n"
+    "Session-Expires: 1800;refresher=uac\r\n"
+    "Via: SIP/2.0/UDP 10.0.0.1;branch=z9hG4bK776asdhds\r\n"
+    "X-Account-Id: 1234567\r\n"
+    "p-call-reference:  abcdef-0123  \r\n" ;
+
+  struct {
+    const char* m_what ;
+    string m_hdrs ;
+  } cases[] = {
+    { "mixed headers", hdrs },
+    { "invalid lines", 
+      "no colon here\r\n"
+      "Bad Name: space inside the name\r\n"
+      "Bad@Name: at sign in the name\r\n"
+      "Subject: kept\r\n"
+      "X-Good_Name-1: kept too\r\n" },
+    { "immutable headers", 
+      "Via: SIP/2.0/UDP 10.0.0.1;branch=z9hG4bK1\r\n"
+      "route: <sip:10.0.0.2;lr>\r\n"
+      "RSeq: 1\r\n"
+      "Record-Route: <sip:10.0.0.3;lr>\r\n"
+      "record_route: <sip:10.0.0.4;lr>\r\n"
+      "CONTENT-LENGTH: 0\r\n"
+      "Content-Type: text/plain\r\n" },
+    { "address headers", 
+      "From: <sip:alice@example.com>;tag=1234\r\n"
+      "To: <sip:bob@localhost>\r\n"
+      "Contact: <sip:drachtio@localhost;transport=tcp>\r\n"
+      "P-Asserted-Identity: \"Alice\" <sip:alice@localhost>\r\n"
+      "p_asserted_identity: <sip:carol@example.com>\r\n"
+      "P-Preferred-Identity: <sip:alice@localhost>\r\n"
+      "Refer-To: <sip:carol@localhost>\r\n"
+      "X-Origin: sip:someone@localhost\r\n" },
+    { "header case", 
+      "my-custom-header: preserved\r\n"
+      "my-other-header: preserved, listed with whitespace\r\n"
+      "another-custom-header: capitalized\r\n"
+      "x-lower-case: left alone\r\n"
+      "X-UPPER: left alone\r\n"
+      "max_forwards: 10\r\n"
+      "SESSION-expires: 90\r\n"
+      "Sip-ETag: abc\r\n" },
+    { "line endings and whitespace", 
+      "\r\n\r\nSubject:   padded   \n"
+      "\tUser-Agent\t:\tx\t\r"
+      "X-Empty:\r\n"
+      "X-Colons: a:b:c\r\n"
+      "Warning: 399 example.com \"text\"\r\n\r\n" },
+  } ;
+  const std::unordered_set<string> preserved({ "My-Custom-Header", "  my-other-header " }) ;
+
+  bool bOK = true ;
+  for( const auto& c : cases ) {
+    bOK = sameTags( c.m_what, c.m_hdrs, false, preserved ) && bOK ;
+    bOK = sameTags( c.m_what, c.m_hdrs, true, preserved ) && bOK ;
+  }
+  if( !bOK ) return 1 ;
+  cout << "compileTags matches makeTags and makeSafeTags on " << std::size( cases ) << " header blocks" << endl ;
+
+  const std::unordered_set<string> none ;
+  const string host( "10.10.10.1" ), port( "5060" ) ;
+  LocalhostTagPolicy policy( none, host, port ) ;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now() ;
+  for( int i = 0; i < iterations; i++ ) legacy::deleteTags( legacy::makeTags( hdrs, false, host, port, none ) ) ;
+  double legacySecs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+
+  start = std::chrono::steady_clock::now() ;
+  for( int i = 0; i < iterations; i++ ) deleteCompiledTags( compileTags( hdrs, policy ) ) ;
+  double compiledSecs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+
+  HeaderIndex index( hdrs ) ;
+  start = std::chrono::steady_clock::now() ;
+  for( int i = 0; i < iterations; i++ ) deleteCompiledTags( compileTags( index, policy ) ) ;
+  double indexedSecs = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+
+  cout << "makeTags (split and lookup): " << (legacySecs * 1e9 / iterations) << " ns per header block" << endl ;
+  cout << "compileTags:                 " << (compiledSecs * 1e9 / iterations) << " ns per header block" << endl ;
+  cout << "compileTags (indexed):       " << (indexedSecs * 1e9 / iterations) << " ns per header block" << endl ;
+
+  return 0 ;
+}
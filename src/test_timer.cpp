@@ -1,3 +1,15 @@
+/*
+  Runs a TimerQueue through a short sequence of timers on a live su_root, checks the timing wheel against a
+  reference model with many random timers on a simulated clock, then compares it with the sorted list TimerQueue
+  used to be with 1M timers outstanding: a fixed delay, where the list could always append at its tail, and
+  random delays, where every add had to walk the list.
+
+  g++ -std=c++17 -O2 -DTEST -I. -I../deps/sofia-sip/libsofia-sip-ua/su -I../deps/sofia-sip/libsofia-sip-ua/nta \
+    -I../deps/sofia-sip/libsofia-sip-ua/sip -I../deps/sofia-sip/libsofia-sip-ua/msg -I../deps/sofia-sip/libsofia-sip-ua/url \
+    -I../deps/sofia-sip/libsofia-sip-ua/bnf -I../deps/sofia-sip/libsofia-sip-ua/tport \
+    -o test_timer test_timer.cpp timer-queue.cpp ../deps/sofia-sip/libsofia-sip-ua/.libs/libsofia-sip-ua.a -lpthread
+  ./test_timer [outstanding timers]
+*/
 #include <signal.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -5,6 +17,9 @@
 #include <string>
 #include <iostream>
 #include <cassert>
+#include <vector>
+#include <random>
+#include <chrono>
 
 #include "sofia-sip/su.h"
 #include "sofia-sip/su_wait.h"
@@ -101,7 +116,252 @@ start_test(su_root_magic_t * p, su_timer_t *t, su_timer_arg_t *a)
 
 }
 
+namespace legacy {
+
+  // TimerQueue as it was: a list kept sorted by expiry, searched from the head unless a timer goes on the end
+  struct Entry {
+    Entry( TimerFunc f, void* args, su_time_t when ) : m_next(NULL), m_prev(NULL), m_function(f), m_functionArgs(args), m_when(when) {}
+
+    Entry* m_next ;
+    Entry* m_prev ;
+    TimerFunc m_function ;
+    void* m_functionArgs ;
+    su_time_t m_when ;
+  } ;
+
+  class ListQueue {
+  public:
+    ListQueue() : m_head(NULL), m_tail(NULL), m_length(0) {}
+    ~ListQueue() {
+      while( m_head ) {
+        Entry* p = m_head ;
+        m_head = m_head->m_next ;
+        delete p ;
+      }
+    }
+
+    Entry* add( TimerFunc f, void* args, uint32_t milliseconds, su_time_t now ) {
+      Entry* entry = new Entry( f, args, su_time_add( now, milliseconds ) ) ;
+      if( NULL == m_head ) m_head = m_tail = entry ;
+      else if( su_time_cmp( entry->m_when, m_tail->m_when ) > 0 ) {
+        entry->m_prev = m_tail ;
+        m_tail->m_next = entry ;
+        m_tail = entry ;
+      }
+      else {
+        Entry* ptr = m_head ;
+        while( su_time_cmp( entry->m_when, ptr->m_when ) >= 0 ) ptr = ptr->m_next ;
+        entry->m_next = ptr ;
+        entry->m_prev = ptr->m_prev ;
+        if( ptr->m_prev ) ptr->m_prev->m_next = entry ;
+        else m_head = entry ;
+        ptr->m_prev = entry ;
+      }
+      m_length++ ;
+      return entry ;
+    }
+
+    void remove( Entry* entry ) {
+      if( entry->m_prev ) entry->m_prev->m_next = entry->m_next ;
+      else m_head = entry->m_next ;
+      if( entry->m_next ) entry->m_next->m_prev = entry->m_prev ;
+      else m_tail = entry->m_prev ;
+      m_length-- ;
+      delete entry ;
+    }
+
+    void runExpired( su_time_t now ) {
+      while( m_head && su_time_cmp( m_head->m_when, now ) <= 0 ) {
+        Entry* p = m_head ;
+        m_head = p->m_next ;
+        if( m_head ) m_head->m_prev = NULL ;
+        else m_tail = NULL ;
+        m_length-- ;
+        p->m_function( p->m_functionArgs ) ;
+        delete p ;
+      }
+    }
+
+    int size() const { return m_length; }
+
+  private:
+    Entry* m_head ;
+    Entry* m_tail ;
+    int m_length ;
+  } ;
+}
+
+static su_time_t at( su_time_t origin, uint64_t usecs ) {
+  su_time_t t ;
+  uint64_t total = origin.tv_usec + usecs ;
+  t.tv_sec = origin.tv_sec + total / 1000000 ;
+  t.tv_usec = total % 1000000 ;
+  return t ;
+}
+
+static double elapsed( std::chrono::steady_clock::time_point start ) {
+  return std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count() ;
+}
+
+/*
+  Random timers, some removed again, on a clock that moves forward in uneven steps; every timer must fire no sooner
+  than it is due and no later than the first step a tick (1ms) after that, and a removed one never.  Some of the
+  timers add or remove others as they fire.
+*/
+struct Model {
+  TimerEventHandle m_handle ;
+  uint64_t m_due ;        // usecs from the start
+  bool m_bRemoved ;
+  bool m_bFired ;
+} ;
+
+static std::vector<Model> models ;
+static uint64_t clockNow ;
+static su_time_t clockOrigin ;
+static std::mt19937 rng( 5060 ) ;
+static bool ok = true ;
+
+static uint32_t randomDelay() {
+  switch( rng() % 4 ) {
+    case 0: return rng() % 50 ;
+    case 1: return rng() % 4000 ;
+    case 2: return rng() % 300000 ;
+    default: return rng() % 20000000 ;
+  }
+}
+
+static void addModelTimer( TimerQueue* q ) ;
+
+static void modelFired( void* arg ) {
+  Model& m = models[(size_t) arg] ;
+  if( m.m_bRemoved || m.m_bFired || m.m_due > clockNow ) ok = false ;
+  m.m_bFired = true ;
+  m.m_handle = NULL ;
+
+  // keep the queue busy from inside the callbacks
+  if( 0 == rng() % 3 ) addModelTimer( queue ) ;
+  if( 0 == rng() % 5 ) {
+    size_t i = rng() % models.size() ;
+    if( models[i].m_handle ) {
+      queue->remove( models[i].m_handle ) ;
+      models[i].m_handle = NULL ;
+      models[i].m_bRemoved = true ;
+    }
+  }
+}
+
+static void addModelTimer( TimerQueue* q ) {
+  uint32_t ms = randomDelay() ;
+  models.push_back( Model{ NULL, clockNow + (uint64_t) ms * 1000, false, false } ) ;
+  models.back().m_handle = q->add( modelFired, (void *) (models.size() - 1), ms, at( clockOrigin, clockNow ) ) ;
+}
+
+static bool checkAgainstModel( unsigned int count ) {
+  models.clear() ;
+  models.reserve( count * 4 ) ;
+  clockNow = 0 ;
+  clockOrigin = su_now() ;
+  ok = true ;
+  queue = new TimerQueue( root ) ;
+
+  for( unsigned int i = 0; i < count; i++ ) {
+    if( 0 == rng() % 8 ) clockNow += rng() % 3000 ;
+    addModelTimer( queue ) ;
+    if( 0 == rng() % 4 ) {
+      size_t j = rng() % models.size() ;
+      if( models[j].m_handle ) {
+        queue->remove( models[j].m_handle ) ;
+        models[j].m_handle = NULL ;
+        models[j].m_bRemoved = true ;
+      }
+    }
+    if( 0 == rng() % 16 ) {
+      queue->runExpired( at( clockOrigin, clockNow ) ) ;
+      for( const Model& m : models ) {
+        if( m.m_handle && m.m_due + 1000 <= clockNow ) ok = false ;
+      }
+    }
+  }
+  while( !queue->isEmpty() && ok ) {
+    clockNow += rng() % 2 ? 1 + rng() % 1500 : 1 + rng() % 3000000 ;
+    queue->runExpired( at( clockOrigin, clockNow ) ) ;
+  }
+  for( const Model& m : models ) {
+    if( !m.m_bRemoved && !m.m_bFired ) ok = false ;
+  }
+  delete queue ;
+  queue = NULL ;
+  return ok ;
+}
+
+static unsigned long fired ;
+static void countFired( void* ) {
+  fired++ ;
+}
+
+/*
+  Adds count timers, removes every other one and runs the clock forward until the rest have fired.  With
+  randomDelays the delays spread over five minutes, otherwise they are all the same, as with a sip timer class.
+*/
+template<typename Q, typename H>
+static void bench( const char* name, Q& q, unsigned int count, bool randomDelays ) {
+  std::vector<H> handles( count ) ;
+  std::mt19937 gen( 1 ) ;
+  su_time_t origin = su_now() ;
+  fired = 0 ;
+
+  auto start = std::chrono::steady_clock::now() ;
+  for( unsigned int i = 0; i < count; i++ ) {
+    uint32_t ms = randomDelays ? gen() % 300000 : 32000 ;
+    handles[i] = q.add( countFired, NULL, ms, at( origin, (uint64_t) i * 1000000 / count ) ) ;
+  }
+  double addSecs = elapsed( start ) ;
+
+  start = std::chrono::steady_clock::now() ;
+  for( unsigned int i = 0; i < count; i += 2 ) q.remove( handles[i] ) ;
+  double removeSecs = elapsed( start ) ;
+
+  start = std::chrono::steady_clock::now() ;
+  for( uint64_t ms = 0; q.size() > 0; ms += 20 ) q.runExpired( at( origin, ms * 1000 ) ) ;
+  double expireSecs = elapsed( start ) ;
+
+  cout << "  " << name << ": add " << (unsigned long) (count / addSecs) << "/sec, remove " <<
+    (unsigned long) (count / 2 / removeSecs) << "/sec, expire " << (unsigned long) (fired / expireSecs) << "/sec" <<
+    (fired == count - (count + 1) / 2 ? "" : " WRONG NUMBER FIRED") << endl ;
+}
+
+static void runBenchmarks( unsigned int count ) {
+  // the list is quadratic when it has to search, so it only gets a fraction of the timers in that case
+  unsigned int listCount = std::min( count, 20000U ) ;
+
+  cout << count << " timers, same delay" << endl ;
+  {
+    TimerQueue q( root ) ;
+    bench<TimerQueue, TimerEventHandle>( "timing wheel", q, count, false ) ;
+  }
+  {
+    legacy::ListQueue q ;
+    bench<legacy::ListQueue, legacy::Entry*>( "sorted list ", q, count, false ) ;
+  }
+
+  cout << count << " timers, random delays" << endl ;
+  {
+    TimerQueue q( root ) ;
+    bench<TimerQueue, TimerEventHandle>( "timing wheel", q, count, true ) ;
+  }
+  cout << listCount << " timers, random delays" << endl ;
+  {
+    TimerQueue q( root ) ;
+    bench<TimerQueue, TimerEventHandle>( "timing wheel", q, listCount, true ) ;
+  }
+  {
+    legacy::ListQueue q ;
+    bench<legacy::ListQueue, legacy::Entry*>( "sorted list ", q, listCount, true ) ;
+  }
+}
+
 int main( int argc, char **argv) {
+  unsigned int count = argc > 1 ? atoi( argv[1] ) : 1000000 ;
 
 	su_init() ;
   root = su_root_create( NULL ) ;
@@ -111,7 +371,16 @@ int main( int argc, char **argv) {
   su_timer_set_interval(timer, start_test, root, 25 ) ;
 
 	su_root_run( root ) ;
+  delete queue ;
+  queue = NULL ;
 
-}
+  cout << "timers should fire when due, and only if not removed..." ;
+  if( !checkAgainstModel( 200000 ) ) {
+    cout << "FAILED" << endl ;
+    return 1 ;
+  }
+  cout << "OK" << endl ;
 
- 
\ No newline at end of file
+  runBenchmarks( count ) ;
+  return 0 ;
+}
@@ -3,15 +3,33 @@
 #include "controller.hpp"
 
 namespace drachtio {
+  SipTimerQueueManager::SipTimerQueueManager(su_root_t* root, const char* szOwner) : m_owner(szOwner) {
+    for( unsigned int i = 0; i < numSipTimers; i++ ) {
+      const char* szName = getTimerName( static_cast<SipTimer_t>(i) ) ;
+      m_queues[i] = std::make_unique<TimerQueue>( root, szName ) ;
+      m_queues[i]->setMetricLabels( {{"timer", szName}, {"owner", m_owner}} ) ;
+    }
+  }
+
+  const char* SipTimerQueueManager::getTimerName( SipTimer_t timer ) {
+    static const char* szNames[numSipTimers] = {
+      "general-sip",
+      "timerA", "timerB", "timerC", "timerD", "timerE", "timerF", "timerG", "timerH", "timerK",
+      "timerProvisional"
+    } ;
+    return szNames[static_cast<unsigned int>(timer)] ;
+  }
+
   void SipTimerQueueManager::logQueueSizes(void) {
-    DR_LOG(log_debug) << "general queue size:                                              " << m_queue.size() ;
-    DR_LOG(log_debug) << "timer A queue size:                                              " << m_queueA.size() ;
-    DR_LOG(log_debug) << "timer B queue size:                                              " << m_queueB.size() ;
-    DR_LOG(log_debug) << "timer C queue size:                                              " << m_queueC.size() ;
-    DR_LOG(log_debug) << "timer D queue size:                                              " << m_queueD.size() ;
-    DR_LOG(log_debug) << "timer E queue size:                                              " << m_queueE.size() ;
-    DR_LOG(log_debug) << "timer F queue size:                                              " << m_queueF.size() ;
-    DR_LOG(log_debug) << "timer G queue size:                                              " << m_queueF.size() ;
-    DR_LOG(log_debug) << "timer K queue size:                                              " << m_queueK.size() ;
+    bool bStats = theOneAndOnlyController->getStatsCollector().enabled() ;
+    for( unsigned int i = 0; i < numSipTimers; i++ ) {
+      const char* szName = getTimerName( static_cast<SipTimer_t>(i) ) ;
+      DR_LOG(log_debug) << m_owner << " " << szName << " queue size: " << std::dec << m_queues[i]->size() ;
+
+      // queues also report their size as timers fire, this catches the ones that have not fired lately
+      if( bStats ) {
+        STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_TIMER_QUEUE_SIZE, m_queues[i]->size(), {{"timer", szName}, {"owner", m_owner}})
+      }
+    }
   }
-}
\ No newline at end of file
+}
@@ -22,66 +22,50 @@ THE SOFTWARE.
 #ifndef __TIMER_QUEUE_MANAGER_H__
 #define __TIMER_QUEUE_MANAGER_H__
 
-#include <cstring> 
+#include <string>
+#include <memory>
 
 #include "timer-queue.hpp"
 
 namespace drachtio {
 
+  // the sip timers a TimerQueueManager keeps a queue for; anything else goes on the general queue
+  enum class SipTimer_t : unsigned int {
+    general = 0,
+    A, B, C, D, E, F, G, H, K,
+    provisional
+  } ;
+  const unsigned int numSipTimers = static_cast<unsigned int>(SipTimer_t::provisional) + 1 ;
+
   class TimerQueueManager {
   public:
-    virtual TimerEventHandle addTimer( const char* szTimerClass, TimerFunc f, void* functionArgs, uint32_t milliseconds ) = 0 ;
-    virtual void removeTimer( TimerEventHandle handle, const char* szTimer ) = 0 ;
+    virtual TimerEventHandle addTimer( SipTimer_t timer, TimerFunc f, void* functionArgs, uint32_t milliseconds ) = 0 ;
+    virtual void removeTimer( TimerEventHandle handle, SipTimer_t timer ) = 0 ;
     virtual void logQueueSizes(void) {}
   } ;
 
+  /*
+    One TimerQueue per sip timer, so that a queue holds timers of much the same duration.  Each queue reports its
+    size and how late its timers fire to the stats collector, labelled with the timer and the owner given here.
+  */
   class SipTimerQueueManager : public TimerQueueManager {
   public:
-    SipTimerQueueManager(su_root_t* root) : 
-        m_queue(root, "general-sip"), m_queueA(root,"timerA"), m_queueB(root,"timerB"),
-        m_queueC(root, "timerC"), m_queueD(root, "timerD"), m_queueE(root, "timerE"), 
-        m_queueF(root, "timerF"), m_queueG(root, "timerG"), m_queueH(root, "timerH"), m_queueK(root, "timerK") {}
+    SipTimerQueueManager(su_root_t* root, const char* szOwner) ;
     ~SipTimerQueueManager() {}
 
-    TimerEventHandle addTimer( const char* szTimerClass, TimerFunc f, void* functionArgs, uint32_t milliseconds ) {
-        TimerEventHandle handle ;
-        if( 0 == strcmp("timerA", szTimerClass) ) handle = m_queueA.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerB", szTimerClass) ) handle = m_queueB.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerC", szTimerClass) ) handle = m_queueC.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerD", szTimerClass) ) handle = m_queueD.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerE", szTimerClass) ) handle = m_queueE.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerF", szTimerClass) ) handle = m_queueF.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerG", szTimerClass) ) handle = m_queueG.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerH", szTimerClass) ) handle = m_queueH.add( f, functionArgs, milliseconds );
-        else if( 0 == strcmp("timerK", szTimerClass) ) handle = m_queueK.add( f, functionArgs, milliseconds );
-        else handle = m_queue.add( f, functionArgs, milliseconds );
-        return handle ;
+    TimerEventHandle addTimer( SipTimer_t timer, TimerFunc f, void* functionArgs, uint32_t milliseconds ) {
+      return m_queues[static_cast<unsigned int>(timer)]->add( f, functionArgs, milliseconds ) ;
     }
-    void removeTimer( TimerEventHandle handle, const char* szTimerClass ) {
-        if( 0 == strcmp("timerA", szTimerClass) ) m_queueA.remove( handle ) ;
-        else if( 0 == strcmp("timerB", szTimerClass) ) m_queueB.remove( handle ) ;
-        else if( 0 == strcmp("timerC", szTimerClass) ) m_queueC.remove( handle ) ;
-        else if( 0 == strcmp("timerD", szTimerClass) ) m_queueD.remove( handle ) ;
-        else if( 0 == strcmp("timerE", szTimerClass) ) m_queueE.remove( handle ) ;
-        else if( 0 == strcmp("timerF", szTimerClass) ) m_queueF.remove( handle ) ;
-        else if( 0 == strcmp("timerG", szTimerClass) ) m_queueG.remove( handle ) ;
-        else if( 0 == strcmp("timerH", szTimerClass) ) m_queueH.remove( handle ) ;
-        else if( 0 == strcmp("timerK", szTimerClass) ) m_queueK.remove( handle ) ;
-        else m_queue.remove( handle ) ;
+    void removeTimer( TimerEventHandle handle, SipTimer_t timer ) {
+      m_queues[static_cast<unsigned int>(timer)]->remove( handle ) ;
     }
     void logQueueSizes(void) ;
 
+    static const char* getTimerName( SipTimer_t timer ) ;
+
   protected:
-    TimerQueue      m_queue ;
-    TimerQueue      m_queueA ;
-    TimerQueue      m_queueB ;
-    TimerQueue      m_queueC ;
-    TimerQueue      m_queueD ;    
-    TimerQueue      m_queueE ;    
-    TimerQueue      m_queueF ;    
-    TimerQueue      m_queueG ;    
-    TimerQueue      m_queueH ;    
-    TimerQueue      m_queueK ;    
+    std::string                   m_owner ;
+    std::unique_ptr<TimerQueue>   m_queues[numSipTimers] ;
   } ;
 
 }
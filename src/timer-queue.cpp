@@ -1,4 +1,6 @@
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 
 #include <sofia-sip/nta.h>
 
@@ -17,24 +19,16 @@ namespace {
 }
 
 namespace drachtio {
- queueEntry_t::queueEntry_t(TimerQueue* queue, TimerFunc f, void * functionArgs, su_time_t when) : m_queue(queue), 
-  m_functionArgs(functionArgs), m_when(when), m_next(NULL), m_prev(NULL), m_function(f) {
-  }
 
-  TimerQueue::TimerQueue(su_root_t* root, const char* szName) : m_root(root), m_head(NULL), m_tail(NULL), 
-    m_length(0), m_in_timer(0) {
+  TimerQueue::TimerQueue(su_root_t* root, const char* szName) : m_root(root), m_current(0), m_scheduled(UINT64_MAX), 
+    m_length(0), m_in_timer(0), m_free(NULL) {
     m_name.assign( szName ? szName : "timer") ;
     m_timer = su_timer_create(su_root_task(m_root), NTA_SIP_T1 / 8 ) ;
+    m_origin = su_now() ;
+    memset( m_wheel, 0, sizeof(m_wheel) ) ;
+    memset( m_occupied, 0, sizeof(m_occupied) ) ;
   }
   TimerQueue::~TimerQueue() {
-    queueEntry_t* ptr = m_head ;
-    while( ptr ) {
-      queueEntry_t* p = ptr ;
-      ptr = ptr->m_next ;
-      delete p ;
-      m_length-- ;
-      m_head = ptr ;
-    }
   }
 
   TimerEventHandle TimerQueue::add( TimerFunc f, void* functionArgs, uint32_t milliseconds ) {
@@ -42,229 +36,249 @@ namespace drachtio {
   }
 
   TimerEventHandle TimerQueue::add( TimerFunc f, void* functionArgs, uint32_t milliseconds, su_time_t now ) {
-    //self check
-    /*
-    assert( m_length == numberOfElements()) ;
-    assert( 0 != m_length || (NULL == m_head && NULL == m_tail) ) ;
-    assert( 1 != m_length || (m_head == m_tail)) ;
-    assert( m_length < 2 || (m_head != m_tail)) ;
-    assert( !(NULL == m_head && NULL != m_tail)) ;
-    assert( !(NULL == m_tail && NULL != m_head)) ;
-    */
-  
-    su_time_t when = su_time_add(now, milliseconds) ;
-    queueEntry_t* entry = new queueEntry_t(this, f, functionArgs, when) ;
-    TimerEventHandle handle = entry ;
-    assert(handle) ;
-
-    if( entry ) {
-#ifndef TEST
-      DR_LOG(log_debug) << m_name << ": Adding entry to go off in " << std::dec << milliseconds << "ms" ;
-#endif
-      //std::cout << "Adding entry to go off in " << milliseconds << "ms" << std::endl;
-
-      if( NULL == m_head ) {
-        assert( NULL == m_tail ) ;
-        m_head = m_tail = entry; 
-#ifndef TEST
-        DR_LOG(log_debug) << m_name << ": Adding entry to the head (queue was empty), length: " << dec << m_length+1 ;
-#endif
-        //std::cout << "Adding entry to the head of the queue (it was empty)" << std::endl ;
-      }
-      else if( NULL != m_tail && su_time_cmp( when, m_tail->m_when ) > 0) {
-        //one class of timer queues will always be appending entries, so check the tail
-        //before starting to iterate through
-#ifndef TEST
-          DR_LOG(log_debug) << m_name << ": Adding entry to the tail of the queue: length " << dec << m_length+1;
-#endif
-          //std::cout << "Adding entry to the tail of the queue" << std::endl ;
-          entry->m_prev = m_tail ;
-          m_tail->m_next = entry ;
-          m_tail = entry ;
-      }
-      else { 
-        //iterate
-        queueEntry_t* ptr = m_head ;
-        int idx = 0 ;
-        do {
-          if( su_time_cmp( when, ptr->m_when ) < 0) {
-#ifndef TEST
-            DR_LOG(log_debug) << m_name << ": Adding entry at position " << std::dec << idx << " of the queue, length: " << dec << m_length+1 ;
-#endif
-            //std::cout << "Adding entry at position " << idx << " of the queue" << std::endl ;
-            entry->m_next = ptr ;
-            if( 0 == idx ) {
-              m_head = entry ;
-            }   
-            else {
-              entry->m_prev = ptr->m_prev ; 
-              ptr->m_prev->m_next = entry ;
-
-            }         
-            ptr->m_prev = entry ;
-            break ;
-          }
-          idx++ ;
-        } while( NULL != (ptr = ptr->m_next) ) ;
-        assert( NULL != ptr ) ;
-      }
-      ++m_length ;
-    }
-    else {
-      //DR_LOG(log_error) << "Error allocating queue entry" ;
-      //std::cerr << "Error allocating queue entry" << std::endl ;
-      return NULL ;
+    // an idle wheel may have fallen behind the clock; with nothing on it, it can simply jump ahead
+    if( 0 == m_length ) m_current = std::max( m_current, tickOf( now, false ) ) ;
+
+    queueEntry_t* entry = allocate() ;
+    entry->m_function = f ;
+    entry->m_functionArgs = functionArgs ;
+    entry->m_when = su_time_add(now, milliseconds) ;
+    entry->m_expires = std::max( m_current, tickOf( entry->m_when, true ) ) ;
+    place( entry ) ;
+    ++m_length ;
+
+    // the sofia timer needs to go off sooner if this is the first timer due, or it will be moved down from a level sooner
+    unsigned shift = wheel_bits * entry->m_level ;
+    uint64_t wakeup = (entry->m_expires >> shift) << shift ;
+    if( wakeup < m_scheduled ) {
+      m_scheduled = wakeup ;
+      su_timer_set_at(m_timer, timer_function, this, su_time_add( m_origin, wakeup ) ) ;
     }
 
-    //only need to set the timer if we added to the front
-    if( m_head == entry ) {
-      int rc = su_timer_set_at(m_timer, timer_function, this, when);
-      assert( 0 == rc ) ;
-    }
-
-
-     //self check
-     /*
-    assert( m_length == numberOfElements()) ;
-    assert( 0 != m_length || (NULL == m_head && NULL == m_tail) ) ;
-    assert( 1 != m_length || (m_head == m_tail)) ;
-    assert( m_length < 2 || (m_head != m_tail)) ;
-    assert( !(NULL == m_head && NULL != m_tail)) ;
-    assert( !(NULL == m_tail && NULL != m_head)) ;
-    */
-
-    return handle ;
-
+    return entry ;
   }
-  void TimerQueue::remove( TimerEventHandle entry) {
-
-#ifndef TEST
-        DR_LOG(log_debug) << m_name << ": removing entry, prior to removal length: " << dec << m_length;
-#endif
-
-    {
-      if( m_head == entry ) {
-        m_head = entry->m_next ;
-        if( m_head ) m_head->m_prev = NULL ;
-        else {
-          assert( 1 == m_length ) ;
-          m_tail = NULL ;
-        }
-      }
-      else if( m_tail == entry ) {
-        assert( m_head && entry->m_prev ) ;
-        m_tail = entry->m_prev ;
-        m_tail->m_next = NULL ;
-      }
-      else {
-        assert( entry->m_prev ) ;
-        assert( entry->m_next ) ;
-        entry->m_prev->m_next = entry->m_next ;
-        entry->m_next->m_prev = entry->m_prev ;
-      }
-      m_length-- ;
-      assert( m_length >= 0 ) ;
 
-      if( NULL == m_head ) {
-#ifndef TEST
-        DR_LOG(log_debug) << m_name << ": removed entry, timer not set (queue is empty after removal), length: " << dec << m_length;
-#endif
-        //std::cout << "timer not set (queue is empty after removal)"  << std::endl;
-        su_timer_reset( m_timer ) ;
-      }
-      else if( m_head == entry->m_next ) {
-#ifndef TEST
-        DR_LOG(log_debug) << m_name << ": removed entry, setting timer for " << std::dec << su_duration( m_head->m_when, su_now() )  << 
-          "ms after removal, length: " << dec << m_length;
-#endif
-        //std::cout << "Setting timer for " << su_duration( m_head->m_when, su_now() )  << "ms after removal of head entry"  << std::endl;
-        su_timer_set_at(m_timer, timer_function, this, m_head->m_when);
-      }      
+  void TimerQueue::remove( TimerEventHandle entry) {
+    if( entry->m_level < 0 ) {
+      // already taken off the wheel to be fired along with the timer now running: just make sure it does not
+      entry->m_function = nullptr ;
+      return ;
+    }
+    unlink( entry ) ;
+    m_length-- ;
+    assert( m_length >= 0 ) ;
+    release( entry ) ;
+
+    // otherwise leave the sofia timer be; if it goes off with nothing due, it just gets set again
+    if( 0 == m_length && UINT64_MAX != m_scheduled ) {
+      su_timer_reset( m_timer ) ;
+      m_scheduled = UINT64_MAX ;
     }
-
-    delete entry ;
   }
 
   void TimerQueue::doTimer(su_timer_t* timer) {
+    // the sofia timer is no longer set once it has gone off
+    m_scheduled = UINT64_MAX ;
+    runExpired( su_now() ) ;
+  }
 
-#ifndef TEST
-    DR_LOG(log_debug) << m_name << ": running timer function" ;
-#endif
-    //std::cout << "doTimer: running timer function with " << m_length << " timers queued " << std::endl;
-
+  void TimerQueue::runExpired( su_time_t now ) {
     if( m_in_timer ) return ;
     m_in_timer = 1 ;
 
     queueEntry_t* expired = NULL ;
     queueEntry_t* tailExpired = NULL ;
-
-    su_time_t now = su_now() ;
-    assert( NULL != m_head ) ;
-
-    queueEntry_t* ptr = m_head ;
-    while( ptr && su_time_cmp( ptr->m_when, now ) < 0 ) {
-      //std::cout << "expiring a timer" << std::endl ;
-      m_length-- ;
-      m_head = ptr->m_next ;
-      if( m_head ) m_head->m_prev = NULL ;
-      else m_tail = NULL ;
-
-      //detach and assemble them into a new queue temporarily
-      if( !expired ) {
-        expired = tailExpired = ptr ;
-        ptr->m_prev = ptr->m_next = NULL ;
-      }
-      else {
-        tailExpired->m_next = ptr ;
-        ptr->m_prev = tailExpired ;
-        tailExpired = ptr ;
+    int count = 0 ;
+    su_time_t oldest = now ;
+
+    uint64_t nowTick = tickOf( now, false ) ;
+    while( m_length > 0 && m_current <= nowTick ) {
+      unsigned idx = m_current & (wheel_slots - 1) ;
+      if( 0 == idx ) cascade( 1 ) ;
+
+      // detach everything due this tick and assemble it into a list of its own
+      Slot& slot = m_wheel[0][idx] ;
+      if( slot.m_head ) {
+        for( queueEntry_t* p = slot.m_head; p; p = p->m_next ) {
+          p->m_level = -1 ;
+          m_length-- ;
+          if( 0 == count++ || su_time_cmp( p->m_when, oldest ) < 0 ) oldest = p->m_when ;
+        }
+        if( tailExpired ) {
+          tailExpired->m_next = slot.m_head ;
+          slot.m_head->m_prev = tailExpired ;
+        }
+        else expired = slot.m_head ;
+        tailExpired = slot.m_tail ;
+        slot.m_head = slot.m_tail = NULL ;
+        m_occupied[0][idx >> 6] &= ~(1ULL << (idx & 63)) ;
       }
-      ptr = ptr->m_next ;
+
+      // skip straight to the next tick with something in it, or to where the wheel turns over, but never past
+      // now: a timer added from here on must not land behind m_current and fire late
+      int next = idx + 1 < wheel_slots ? findOccupied( 0, idx + 1, wheel_slots - 1 - idx ) : -1 ;
+      m_current = std::min( m_current + (next < 0 ? wheel_slots - idx : next + 1), nowTick + 1 ) ;
     }
+    if( 0 == m_length ) m_current = std::max( m_current, nowTick + 1 ) ;
 
-    if( NULL == m_head ) {
 #ifndef TEST
-      DR_LOG(log_debug) << m_name << ": timer not set (queue is empty after processing expired timers), length: " << dec << m_length ;
-#endif
-      assert( 0 == m_length ) ;
+    if( count ) {
+      DR_LOG(log_debug) << m_name << ": firing " << std::dec << count << " timers, " << m_length << " remain" ;
+      if( !m_metricLabels.empty() && theOneAndOnlyController->getStatsCollector().enabled() ) {
+        STATS_HISTOGRAM_OBSERVE_NOCHECK(STATS_HISTOGRAM_TIMER_LATENESS, std::max( su_time_diff( now, oldest ), 0.0 ), m_metricLabels)
+        STATS_GAUGE_SET_NOCHECK(STATS_GAUGE_TIMER_QUEUE_SIZE, m_length, m_metricLabels)
+      }
     }
-    else {
-#ifndef TEST
-      DR_LOG(log_debug) << m_name << ": Setting timer for " << su_duration( m_head->m_when, su_now() )  << 
-        "ms after processing expired timers, length: "  << dec << m_length ;
 #endif
-      int rc = su_timer_set_at(m_timer, timer_function, this, m_head->m_when);      
-    }
+
+    reschedule() ;
     m_in_timer = 0 ;
 
     while( NULL != expired ) {
-      expired->m_function( expired->m_functionArgs ) ;
       queueEntry_t* p = expired ;
       expired = expired->m_next ;
-      delete p ;
+
+      // a timer fired earlier in this batch may have removed this one
+      if( p->m_function ) {
+        TimerFunc f = std::move( p->m_function ) ;
+        p->m_function = nullptr ;
+        f( p->m_functionArgs ) ;
+      }
+      release( p ) ;
     }    
   }
 
   int TimerQueue::positionOf(TimerEventHandle handle) {
+    if( handle->m_level < 0 ) return -1 ;
+
     int pos = 0 ;
-    queueEntry_t* ptr = m_head ;
-    while( ptr ) {
-      if( ptr == handle ) {
-        return pos ;
+    for( unsigned level = 0; level < wheel_levels; level++ ) {
+      for( unsigned i = 0; i < wheel_slots; i++ ) {
+        for( queueEntry_t* p = m_wheel[level][i].m_head; p; p = p->m_next ) {
+          if( p != handle && su_time_cmp( p->m_when, handle->m_when ) < 0 ) pos++ ;
+        }
+      }
+    }
+    return pos ;
+  }
+
+  uint64_t TimerQueue::tickOf( su_time_t t, bool roundUp ) const {
+    int64_t usecs = ((int64_t) t.tv_sec - (int64_t) m_origin.tv_sec) * 1000000 + ((int64_t) t.tv_usec - (int64_t) m_origin.tv_usec) ;
+    if( usecs <= 0 ) return 0 ;
+    return roundUp ? (usecs + 999) / 1000 : usecs / 1000 ;
+  }
+
+  void TimerQueue::place( queueEntry_t* entry ) {
+    uint64_t delta = entry->m_expires - m_current ;
+    unsigned level = 0 ;
+    while( level < wheel_levels - 1 && delta >= (1ULL << (wheel_bits * (level + 1))) ) level++ ;
+    if( delta >> (wheel_bits * wheel_levels) ) entry->m_expires = m_current + (1ULL << (wheel_bits * wheel_levels)) - 1 ;
+
+    unsigned idx = (entry->m_expires >> (wheel_bits * level)) & (wheel_slots - 1) ;
+    Slot& slot = m_wheel[level][idx] ;
+    entry->m_level = level ;
+    entry->m_slot = idx ;
+    entry->m_next = NULL ;
+    entry->m_prev = slot.m_tail ;
+    if( slot.m_tail ) slot.m_tail->m_next = entry ;
+    else slot.m_head = entry ;
+    slot.m_tail = entry ;
+    m_occupied[level][idx >> 6] |= 1ULL << (idx & 63) ;
+  }
+
+  void TimerQueue::unlink( queueEntry_t* entry ) {
+    Slot& slot = m_wheel[entry->m_level][entry->m_slot] ;
+    if( entry->m_prev ) entry->m_prev->m_next = entry->m_next ;
+    else slot.m_head = entry->m_next ;
+    if( entry->m_next ) entry->m_next->m_prev = entry->m_prev ;
+    else slot.m_tail = entry->m_prev ;
+    if( NULL == slot.m_head ) m_occupied[entry->m_level][entry->m_slot >> 6] &= ~(1ULL << (entry->m_slot & 63)) ;
+    entry->m_next = entry->m_prev = NULL ;
+    entry->m_level = -1 ;
+  }
+
+  // the wheel has turned over at the level below: move the timers in this level's current slot down
+  void TimerQueue::cascade( unsigned level ) {
+    unsigned idx = (m_current >> (wheel_bits * level)) & (wheel_slots - 1) ;
+    if( 0 == idx && level + 1 < wheel_levels ) cascade( level + 1 ) ;
+
+    Slot& slot = m_wheel[level][idx] ;
+    queueEntry_t* p = slot.m_head ;
+    slot.m_head = slot.m_tail = NULL ;
+    m_occupied[level][idx >> 6] &= ~(1ULL << (idx & 63)) ;
+    while( p ) {
+      queueEntry_t* next = p->m_next ;
+      place( p ) ;
+      p = next ;
+    }
+  }
+
+  // distance from slot 'from' to the first occupied one among the next 'count' slots (wrapping around), or -1
+  int TimerQueue::findOccupied( unsigned level, unsigned from, unsigned count ) const {
+    for( unsigned d = 0; d < count; ) {
+      unsigned i = (from + d) & (wheel_slots - 1) ;
+      uint64_t word = m_occupied[level][i >> 6] >> (i & 63) ;
+      if( word ) {
+        unsigned skip = __builtin_ctzll( word ) ;
+        return d + skip < count ? d + skip : -1 ;
       }
-      pos++ ;
-      ptr = ptr->m_next ;
+      d += 64 - (i & 63) ;
     }
     return -1 ;
   }
-  int TimerQueue::numberOfElements() {
-    int len = 0 ;
-    queueEntry_t* ptr = m_head ;
-    while( ptr ) {
-      len++ ;
-      ptr = ptr->m_next ;
+
+  // the next tick at which a timer is due or one needs moving down a level, or UINT64_MAX if the wheel is empty
+  uint64_t TimerQueue::nextWakeup(void) const {
+    if( 0 == m_length ) return UINT64_MAX ;
+
+    uint64_t wakeup = UINT64_MAX ;
+    int d = findOccupied( 0, m_current & (wheel_slots - 1), wheel_slots ) ;
+    if( d >= 0 ) wakeup = m_current + d ;
+
+    for( unsigned level = 1; level < wheel_levels; level++ ) {
+      unsigned shift = wheel_bits * level ;
+      uint64_t turn = m_current >> shift ;
+
+      // the current slot moves down when the wheel next turns over, unless that is now and it already has
+      unsigned first = (m_current & ((1ULL << shift) - 1)) ? 1 : 0 ;
+      d = findOccupied( level, (turn + first) & (wheel_slots - 1), wheel_slots ) ;
+      if( d >= 0 ) wakeup = std::min( wakeup, (turn + first + d) << shift ) ;
+    }
+    return wakeup ;
+  }
+
+  void TimerQueue::reschedule(void) {
+    uint64_t wakeup = nextWakeup() ;
+    if( wakeup == m_scheduled ) return ;
+    if( UINT64_MAX == wakeup ) su_timer_reset( m_timer ) ;
+    else su_timer_set_at(m_timer, timer_function, this, su_time_add( m_origin, wakeup ) ) ;
+    m_scheduled = wakeup ;
+  }
+
+  queueEntry_t* TimerQueue::allocate(void) {
+    if( NULL == m_free ) {
+      const size_t blockSize = 256 ;
+      m_blocks.emplace_back( new queueEntry_t[blockSize] ) ;
+      queueEntry_t* block = m_blocks.back().get() ;
+      for( size_t i = 0; i < blockSize; i++ ) {
+        block[i].m_next = m_free ;
+        m_free = block + i ;
+      }
     }
-    return len ;
+    queueEntry_t* entry = m_free ;
+    m_free = entry->m_next ;
+    entry->m_next = NULL ;
+    return entry ;
+  }
+
+  void TimerQueue::release( queueEntry_t* entry ) {
+    // let go of anything the function holds on to now rather than when the entry is reused
+    entry->m_function = nullptr ;
+    entry->m_functionArgs = NULL ;
+    entry->m_level = -1 ;
+    entry->m_prev = NULL ;
+    entry->m_next = m_free ;
+    m_free = entry ;
   }
 
   // LockingTimerQueue
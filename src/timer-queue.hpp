@@ -22,10 +22,14 @@ THE SOFTWARE.
 #ifndef __QUEUE_H__
 #define __QUEUE_H__
 
+#include <stdint.h>
 #include <functional>
 #include <thread>
 #include <string>
 #include <mutex>
+#include <memory>
+#include <vector>
+#include <map>
 #include <sofia-sip/su_wait.h>
 
 namespace drachtio {
@@ -34,19 +38,32 @@ namespace drachtio {
 
   typedef std::function<void (void*)> TimerFunc ;
 
+  // entries are pooled by their queue: a handle must not be used once its timer has fired or been removed
   struct queueEntry_t {
-    queueEntry_t(TimerQueue* queue, TimerFunc f, void* functionArgs, su_time_t when) ;
+    queueEntry_t() : m_next(NULL), m_prev(NULL), m_functionArgs(NULL), m_expires(0), m_level(-1), m_slot(0) {}
 
-    TimerQueue*       m_queue ;
     queueEntry_t*     m_next ;
     queueEntry_t*     m_prev ;
     TimerFunc         m_function ;
     void*             m_functionArgs ;
     su_time_t         m_when ;
+    uint64_t          m_expires ;   // tick at which the timer is due
+    int8_t            m_level ;     // wheel level holding the entry, or -1 if it is not queued
+    uint8_t           m_slot ;
   } ;
 
   typedef queueEntry_t * TimerEventHandle ;
  
+  /*
+    Timers on a hierarchical timing wheel with a resolution of one millisecond (a tick).  Each of the four levels
+    has 256 slots, a slot at level n covering 256^n ticks, so the wheel reaches 2^32 ms (about 49 days) ahead;
+    longer timers are clamped to that.  A timer goes into the slot at the lowest level that reaches its tick,
+    moves down a level each time the wheel turns over to the slot holding it, and fires from level 0.  Adding,
+    removing and firing a timer are all constant time, and a single sofia timer is kept set for the next tick at
+    which there is anything to do.
+
+    A timer never fires before it is due, but timers due in the same millisecond may fire in any order.
+  */
   class TimerQueue {
   public:
     
@@ -65,16 +82,50 @@ namespace drachtio {
 
     virtual void doTimer(su_timer_t* timer) ;      
 
+    // fire everything due as of now; doTimer calls this with the current time
+    void runExpired( su_time_t now ) ;
+
+    // once labelled, each batch of timers fired reports the queue size and how late the most overdue of them was
+    void setMetricLabels( const std::map<std::string, std::string>& labels ) { m_metricLabels = labels; }
+
   protected:
-    int          numberOfElements(void) ;
+    enum {
+      wheel_bits = 8,
+      wheel_slots = 1 << wheel_bits,
+      wheel_levels = 4
+    } ;
+
+    struct Slot {
+      queueEntry_t* m_head ;
+      queueEntry_t* m_tail ;
+    } ;
+
+    uint64_t tickOf( su_time_t t, bool roundUp ) const ;
+    void place( queueEntry_t* entry ) ;
+    void unlink( queueEntry_t* entry ) ;
+    void cascade( unsigned level ) ;
+    int findOccupied( unsigned level, unsigned from, unsigned count ) const ;
+    uint64_t nextWakeup(void) const ;
+    void reschedule(void) ;
+    queueEntry_t* allocate(void) ;
+    void release( queueEntry_t* entry ) ;
 
     su_root_t*    m_root ;
     std::string   m_name ;
     su_timer_t*   m_timer ;
-    queueEntry_t* m_head ;
-    queueEntry_t* m_tail ;
+    su_time_t     m_origin ;      // tick 0
+    uint64_t      m_current ;     // the next tick to process; every earlier one has been
+    uint64_t      m_scheduled ;   // tick the sofia timer is set for, or UINT64_MAX if it is not set
+    Slot          m_wheel[wheel_levels][wheel_slots] ;
+    uint64_t      m_occupied[wheel_levels][wheel_slots / 64] ;
     int           m_length ;
     unsigned      m_in_timer:1; /**< Set when executing timers */
+
+    // entries are allocated in blocks and recycled through a free list
+    std::vector< std::unique_ptr<queueEntry_t[]> > m_blocks ;
+    queueEntry_t* m_free ;
+
+    std::map<std::string, std::string> m_metricLabels ;
    } ;
 
    class LockingTimerQueue: public TimerQueue {
@@ -0,0 +1,144 @@
+/*
+Copyright (c) 2024, FirstFive8, Inc
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+#ifndef __TRANSACTION_KEY_HPP__
+#define __TRANSACTION_KEY_HPP__
+
+#include <stdint.h>
+#include <string.h>
+#include <string_view>
+#include <ostream>
+
+#include <sofia-sip/sip.h>
+
+namespace drachtio {
+
+  /*
+    Identifies a sip transaction by Call-ID, method, CSeq and Via branch without building a string: the Call-ID
+    and branch are folded into a 128-bit hash and kept alongside the method and CSeq number, so a key is a small
+    fixed-size value that is cheap to compute, hash and compare.
+
+    Two different transactions share a key only if their hashes collide; a store that must be certain checks the
+    Fields of the message it holds against those of the one it was asked about.
+  */
+  class TransactionKey {
+  public:
+    // what a key is made from; the strings refer into the message they were taken from
+    struct Fields {
+      std::string_view m_callId ;
+      sip_method_t m_method ;
+      std::string_view m_methodName ;   // only set for methods sofia does not know
+      uint32_t m_cseq ;
+      std::string_view m_branch ;
+
+      bool operator==( const Fields& o ) const {
+        return m_method == o.m_method && m_cseq == o.m_cseq && m_callId == o.m_callId && m_branch == o.m_branch &&
+          m_methodName == o.m_methodName ;
+      }
+      bool operator!=( const Fields& o ) const { return !(*this == o); }
+    } ;
+
+    /*
+      A request, or a response, received from the network.  A CANCEL is keyed as the INVITE it cancels; the branch
+      is that of the top Via.
+    */
+    static Fields requestFields( const sip_t* sip ) {
+      return fields( sip, sip->sip_via ) ;
+    }
+
+    /*
+      As requestFields, except that for a response the branch comes from the second Via: a proxied request goes
+      out under the branch it arrived with, which is second in the response that comes back.
+    */
+    static Fields proxyFields( const sip_t* sip ) {
+      if( sip->sip_status ) return fields( sip, sip->sip_via ? sip->sip_via->v_next : NULL ) ;
+      return fields( sip, sip->sip_via ) ;
+    }
+
+    TransactionKey() : m_method(sip_method_invalid), m_cseq(0) {
+      m_hash[0] = m_hash[1] = 0 ;
+    }
+    explicit TransactionKey( const Fields& f ) : m_method(f.m_method), m_cseq(f.m_cseq) {
+      m_hash[0] = 0x9e3779b97f4a7c15ULL ;
+      m_hash[1] = 0xc2b2ae3d27d4eb4fULL ;
+      add( f.m_callId ) ;
+      add( f.m_methodName ) ;
+      add( f.m_branch ) ;
+    }
+
+    bool operator==( const TransactionKey& o ) const {
+      return m_hash[0] == o.m_hash[0] && m_hash[1] == o.m_hash[1] && m_cseq == o.m_cseq && m_method == o.m_method ;
+    }
+    bool operator!=( const TransactionKey& o ) const { return !(*this == o); }
+
+    struct Hash {
+      size_t operator()( const TransactionKey& k ) const { return k.m_hash[0] ^ k.m_cseq; }
+    } ;
+
+    friend std::ostream& operator<<( std::ostream& os, const TransactionKey& k ) {
+      std::ios_base::fmtflags flags = os.flags() ;
+      os << std::hex << k.m_hash[0] << k.m_hash[1] << std::dec << "/" << (int) k.m_method << "/" << k.m_cseq ;
+      os.flags( flags ) ;
+      return os ;
+    }
+
+  private:
+    static Fields fields( const sip_t* sip, const sip_via_t* via ) {
+      Fields f ;
+      f.m_callId = sip->sip_call_id->i_id ;
+      f.m_cseq = sip->sip_cseq->cs_seq ;
+      if( sip->sip_request && sip_method_cancel == sip->sip_request->rq_method ) f.m_method = sip_method_invite ;
+      else {
+        f.m_method = sip->sip_cseq->cs_method ;
+        if( sip_method_unknown == f.m_method && sip->sip_cseq->cs_method_name ) f.m_methodName = sip->sip_cseq->cs_method_name ;
+      }
+      if( via && via->v_branch ) f.m_branch = via->v_branch ;
+      return f ;
+    }
+
+    // each string is followed by its length, so that ("ab", "c") and ("a", "bc") differ
+    void add( std::string_view s ) {
+      const char* p = s.data() ;
+      size_t n = s.length() ;
+      for( ; n >= 8; p += 8, n -= 8 ) {
+        uint64_t w ;
+        memcpy( &w, p, 8 ) ;
+        mix( w ) ;
+      }
+      uint64_t w = 0 ;
+      if( n ) memcpy( &w, p, n ) ;
+      mix( w ) ;
+      mix( s.length() ) ;
+    }
+    void mix( uint64_t w ) {
+      m_hash[0] = (m_hash[0] ^ w) * 0xff51afd7ed558ccdULL ;
+      m_hash[0] ^= m_hash[0] >> 32 ;
+      m_hash[1] = (m_hash[1] + w) * 0xc4ceb9fe1a85ec53ULL ;
+      m_hash[1] ^= m_hash[1] >> 29 ;
+    }
+
+    uint64_t m_hash[2] ;
+    sip_method_t m_method ;
+    uint32_t m_cseq ;
+  } ;
+}
+
+#endif